@@ -2,6 +2,30 @@
 
 #define _USE_MATH_DEFINES 
 #include <math.h>
+
+// SIMD backend: SSE2 is used whenever the target supports it (always the
+// case on x64), AVX and FMA are used on top when the compiler is allowed
+// to emit them (/arch:AVX2 on MSVC, -mavx2 -mfma -mf16c on GCC/Clang).
+// Define MATHS_NO_SIMD before including this file to force the plain
+// scalar code, e.g. to compare results or timings against it.
+#if !defined(MATHS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define MATHS_SIMD_SSE2
+    #include <emmintrin.h>
+    #if defined(__AVX__)
+        #define MATHS_SIMD_AVX
+        #include <immintrin.h>
+    #endif
+    // MSVC never defines __FMA__, but every AVX2 CPU has FMA3
+    #if defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__))
+        #define MATHS_SIMD_FMA
+        #include <immintrin.h>
+    #endif
+    // F16C (half <-> float conversion) also ships with every AVX2 CPU
+    #if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+        #define MATHS_SIMD_F16C
+        #include <immintrin.h>
+    #endif
+#endif
 #pragma warning(push)
 #pragma warning(disable:4201) // anonymous struct warning
 
@@ -32,15 +56,76 @@ union float4x4
     float m[4][4];
     float4 cols[4];
 
-    inline float4 row(int i) { // Returns i-th row of matrix
+    constexpr float4 row(int i) { // Returns i-th row of matrix
         return { m[0][i], m[1][i], m[2][i], m[3][i] };
     }
 };
 
-inline float degreesToRadians(float degs) {
+// Affine transform (rotation/scale/shear + translation) stored as the
+// first three columns of a float4x4; the implicit last column is
+// (0, 0, 0, 1). Same memory layout as float3x3 except that the fourth
+// element of each column holds the translation instead of padding.
+union affine3x4
+{
+    float m[3][4];
+    float4 cols[3];
+};
+
+// Rotation quaternion: xyz = axis * sin(angle/2), w = cos(angle/2)
+struct quat
+{
+    float x, y, z, w;
+};
+
+constexpr float degreesToRadians(float degs) {
     return degs * ((float)M_PI / 180.0f);
 }
 
+// Constants for sinCos() and its batch versions in SimdMaths.h.
+// pi/2 split into three parts so that quadrant * SINCOS_PIO2_A (and _B)
+// is exact, which keeps the range reduction accurate (Cody-Waite).
+constexpr float SINCOS_TWO_OVER_PI = 0.636619772367581f;
+constexpr float SINCOS_PIO2_A = 1.5703125f;
+constexpr float SINCOS_PIO2_B = 4.837512969970703125e-4f;
+constexpr float SINCOS_PIO2_C = 7.54978995489188216e-8f;
+// Minimax polynomial coefficients on [-pi/4, pi/4] (from Cephes sinf/cosf)
+constexpr float SINCOS_SIN_1 = -1.6666654611e-1f;
+constexpr float SINCOS_SIN_2 = 8.3321608736e-3f;
+constexpr float SINCOS_SIN_3 = -1.9515295891e-4f;
+constexpr float SINCOS_COS_1 = 4.166664568298827e-2f;
+constexpr float SINCOS_COS_2 = -1.388731625493765e-3f;
+constexpr float SINCOS_COS_3 = 2.443315711809948e-5f;
+
+// Computes sinf(rad) and cosf(rad) together, without calling into the C
+// runtime. 'rad' is reduced to [-pi/4, pi/4] plus a quadrant and both
+// polynomials are evaluated on the reduced angle.
+// Max absolute error vs. double precision is 1e-7 for |rad| <= 8192;
+// the reduction loses precision beyond that.
+constexpr void sinCos(float rad, float* outSin, float* outCos)
+{
+    // quadrant = floor(q + 0.5). Offset so the sum is positive and
+    // truncation rounds down; in double the sum is exact for |q| < 2^30.
+    float q = rad * SINCOS_TWO_OVER_PI;
+    int quadrant = (int)((double)q + 1073741824.5) - 1073741824;
+    float j = (float)quadrant;
+    float r = ((rad - j*SINCOS_PIO2_A) - j*SINCOS_PIO2_B) - j*SINCOS_PIO2_C;
+    float r2 = r*r;
+
+    float s = r + r*r2*(SINCOS_SIN_1 + r2*(SINCOS_SIN_2 + r2*SINCOS_SIN_3));
+    float c = 1.f - 0.5f*r2 + r2*r2*(SINCOS_COS_1 + r2*(SINCOS_COS_2 + r2*SINCOS_COS_3));
+
+    // Rotate the result by quadrant * 90 degrees: odd quadrants swap sin
+    // and cos, and the signs follow the quadrant. Selected by multiplying
+    // with 0/1 and +-1 (exact) instead of branching, as the quadrants of
+    // unrelated angles are unpredictable, and so loops over arrays of
+    // angles can be vectorised by the compiler.
+    float odd = (float)(quadrant & 1);
+    float sinSign = (float)(1 - (quadrant & 2));
+    float cosSign = (float)(1 - ((quadrant + 1) & 2));
+    *outSin = s * ((1.f - odd) * sinSign) + c * (odd * sinSign);
+    *outCos = c * ((1.f - odd) * cosSign) + s * (odd * cosSign);
+}
+
 inline float length(float3 v) {
     return sqrtf(v.x*v.x + v.y*v.y + v.z*v.z);
 }
@@ -49,15 +134,39 @@ inline float length(float4 v) {
     return sqrtf(v.x*v.x + v.y*v.y + v.z*v.z +v.w*v.w);
 }
 
-inline float dot(float4 a, float4 b) {
+constexpr float dot(float4 a, float4 b) {
     return a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
 }
 
-inline float3 operator* (float3 v, float f) {
+#if defined(MATHS_SIMD_SSE2)
+inline __m128 simdLoad(float4 v) {
+    return _mm_loadu_ps(&v.x);
+}
+
+inline float4 simdStore(__m128 v) {
+    float4 result;
+    _mm_storeu_ps(&result.x, v);
+    return result;
+}
+
+// Returns a*b + c
+inline __m128 simdMulAdd(__m128 a, __m128 b, __m128 c) {
+#if defined(MATHS_SIMD_FMA)
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+// Returns 'v' with component i copied into all four lanes
+#define simdSplat(v, i) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(i, i, i, i))
+#endif
+
+constexpr float3 operator* (float3 v, float f) {
     return {v.x*f, v.y*f, v.z*f};
 }
 
-inline float4 operator* (float4 v, float f) {
+constexpr float4 operator* (float4 v, float f) {
     return {v.x*f, v.y*f, v.z*f, v.w*f};
 }
 
@@ -66,10 +175,27 @@ inline float3 normalise(float3 v) {
 }
 
 inline float4 normalise(float4 v) {
+#if defined(MATHS_SIMD_SSE2)
+    __m128 vec = simdLoad(v);
+    __m128 sq = _mm_mul_ps(vec, vec);
+    // Horizontal add: every lane ends up with x*x + y*y + z*z + w*w
+    sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+    sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 0, 3, 2)));
+    return simdStore(_mm_div_ps(vec, _mm_sqrt_ps(sq)));
+#else
     return v * (1.f / length(v));
+#endif
+}
+
+constexpr float dot(float3 a, float3 b) {
+    return a.x*b.x + a.y*b.y + a.z*b.z;
 }
 
-inline float3 cross(float3 a, float3 b) {
+constexpr float3 operator+ (float3 a, float3 b) {
+    return {a.x+b.x, a.y+b.y, a.z+b.z};
+}
+
+constexpr float3 cross(float3 a, float3 b) {
     return {
         a.y*b.z - a.z*b.y,
         a.z*b.x - a.x*b.z,
@@ -77,25 +203,25 @@ inline float3 cross(float3 a, float3 b) {
     };
 }
 
-inline float3 operator+= (float3 &lhs, float3 rhs) {
+constexpr float3 operator+= (float3 &lhs, float3 rhs) {
     lhs.x += rhs.x;
     lhs.y += rhs.y;
     lhs.z += rhs.z;
     return lhs;
 }
 
-inline float3 operator-= (float3 &lhs, float3 rhs) {
+constexpr float3 operator-= (float3 &lhs, float3 rhs) {
     lhs.x -= rhs.x;
     lhs.y -= rhs.y;
     lhs.z -= rhs.z;
     return lhs;
 }
 
-inline float3 operator- (float3 v) {
+constexpr float3 operator- (float3 v) {
     return {-v.x, -v.y, -v.z};
 }
 
-inline float4x4 scaleMat(float s) {
+constexpr float4x4 scaleMat(float s) {
     return {
         s, 0, 0, 0,
         0, s, 0, 0,
@@ -104,9 +230,9 @@ inline float4x4 scaleMat(float s) {
     };
 }
 
-inline float4x4 rotateXMat(float rad) {
-    float sinTheta = sinf(rad);
-    float cosTheta = cosf(rad);
+constexpr float4x4 rotateXMat(float rad) {
+    float sinTheta = 0, cosTheta = 0;
+    sinCos(rad, &sinTheta, &cosTheta);
     return {
         1, 0, 0, 0,
         0, cosTheta, -sinTheta, 0,
@@ -115,9 +241,9 @@ inline float4x4 rotateXMat(float rad) {
     };
 }
 
-inline float4x4 rotateYMat(float rad) {
-    float sinTheta = sinf(rad);
-    float cosTheta = cosf(rad);
+constexpr float4x4 rotateYMat(float rad) {
+    float sinTheta = 0, cosTheta = 0;
+    sinCos(rad, &sinTheta, &cosTheta);
     return {
         cosTheta, 0, sinTheta, 0,
         0, 1, 0, 0,
@@ -126,7 +252,7 @@ inline float4x4 rotateYMat(float rad) {
     };
 }
 
-inline float4x4 translationMat(float3 trans) {
+constexpr float4x4 translationMat(float3 trans) {
     return {
         1, 0, 0, trans.x,
         0, 1, 0, trans.y,
@@ -135,12 +261,14 @@ inline float4x4 translationMat(float3 trans) {
     };
 }
 
-inline float4x4 makePerspectiveMat(float aspectRatio, float fovYRadians, float zNear, float zFar)
+constexpr float4x4 makePerspectiveMat(float aspectRatio, float fovYRadians, float zNear, float zFar)
 {
     // float yScale = 1 / tanf(0.5f * fovYRadians); 
-    // NOTE: 1/tan(X) = tan(90degs - X), so we can avoid a divide
-    // float yScale = tanf((0.5f * M_PI) - (0.5f * fovYRadians));
-    float yScale = tanf(0.5f * ((float)M_PI - fovYRadians));
+    // NOTE: 1/tan(X) = cos(X)/sin(X), and sinCos() gives both without
+    // calling the C runtime, so this can run at compile time
+    float sinHalfFov = 0, cosHalfFov = 0;
+    sinCos(0.5f * fovYRadians, &sinHalfFov, &cosHalfFov);
+    float yScale = cosHalfFov / sinHalfFov;
     float xScale = yScale / aspectRatio;
     float zRangeInverse = 1.f / (zNear - zFar);
     float zScale = zFar * zRangeInverse;
@@ -155,46 +283,270 @@ inline float4x4 makePerspectiveMat(float aspectRatio, float fovYRadians, float z
     return result;
 }
 
+// Same as makePerspectiveMat() but maps zNear to depth 1 and zFar to 0.
+// The perspective divide leaves little depth precision in the distance
+// and floats have the most precision near 0, so reversing the range
+// (with a D32_FLOAT depth buffer) spreads precision far more evenly.
+// Needs D3D11_COMPARISON_GREATER and a depth clear value of 0.
+constexpr float4x4 makeReverseZPerspectiveMat(float aspectRatio, float fovYRadians, float zNear, float zFar)
+{
+    float4x4 result = makePerspectiveMat(aspectRatio, fovYRadians, zNear, zFar);
+    float zRangeInverse = 1.f / (zFar - zNear);
+    result.m[2][2] = zNear * zRangeInverse;
+    result.m[2][3] = zFar * zNear * zRangeInverse;
+    return result;
+}
+
+// Reverse-Z with the far plane at infinity: depth = zNear / distance,
+// so nothing is ever clipped for being too far away. Same depth test
+// and clear value as makeReverseZPerspectiveMat().
+constexpr float4x4 makeInfiniteReverseZPerspectiveMat(float aspectRatio, float fovYRadians, float zNear)
+{
+    float4x4 result = makePerspectiveMat(aspectRatio, fovYRadians, zNear, 2*zNear);
+    result.m[2][2] = 0;
+    result.m[2][3] = zNear;
+    return result;
+}
+
+enum DepthMode
+{
+    DepthModeStandard,        // makePerspectiveMat()
+    DepthModeReverseZ,        // makeReverseZPerspectiveMat()
+    DepthModeInfiniteReverseZ // makeInfiniteReverseZPerspectiveMat(), zFar is ignored
+};
+
+constexpr float4x4 makePerspectiveMat(DepthMode depthMode, float aspectRatio, float fovYRadians, float zNear, float zFar)
+{
+    return (depthMode == DepthModeStandard) ? makePerspectiveMat(aspectRatio, fovYRadians, zNear, zFar) :
+           (depthMode == DepthModeReverseZ) ? makeReverseZPerspectiveMat(aspectRatio, fovYRadians, zNear, zFar) :
+                                              makeInfiniteReverseZPerspectiveMat(aspectRatio, fovYRadians, zNear);
+}
+
+// Plain scalar a * b. Unlike operator* (which uses SIMD intrinsics) this
+// can be evaluated at compile time, e.g. to fold constant transforms.
+constexpr float4x4 scalarMul(float4x4 a, float4x4 b) {
+    float4x4 result = {};
+    for(int c=0; c<4; ++c)
+        for(int r=0; r<4; ++r)
+            result.m[c][r] = a.m[0][r]*b.m[c][0] + a.m[1][r]*b.m[c][1] + a.m[2][r]*b.m[c][2] + a.m[3][r]*b.m[c][3];
+    return result;
+}
+
 inline float4x4 operator* (float4x4 a, float4x4 b) {
-    return {
-        dot(a.row(0), b.cols[0]),
-        dot(a.row(1), b.cols[0]),
-        dot(a.row(2), b.cols[0]),
-        dot(a.row(3), b.cols[0]),
-        dot(a.row(0), b.cols[1]),
-        dot(a.row(1), b.cols[1]),
-        dot(a.row(2), b.cols[1]),
-        dot(a.row(3), b.cols[1]),
-        dot(a.row(0), b.cols[2]),
-        dot(a.row(1), b.cols[2]),
-        dot(a.row(2), b.cols[2]),
-        dot(a.row(3), b.cols[2]),
-        dot(a.row(0), b.cols[3]),
-        dot(a.row(1), b.cols[3]),
-        dot(a.row(2), b.cols[3]),
-        dot(a.row(3), b.cols[3])
-    };
+#if defined(MATHS_SIMD_AVX)
+    // Two result columns per 256-bit register:
+    // result.cols[c] = sum over k of a.cols[k] * b.m[c][k]
+    __m256 aCol0 = _mm256_broadcast_ps((const __m128*)&a.cols[0]);
+    __m256 aCol1 = _mm256_broadcast_ps((const __m128*)&a.cols[1]);
+    __m256 aCol2 = _mm256_broadcast_ps((const __m128*)&a.cols[2]);
+    __m256 aCol3 = _mm256_broadcast_ps((const __m128*)&a.cols[3]);
+    float4x4 result;
+    for(int c=0; c<4; c+=2)
+    {
+        __m256 bCols = _mm256_loadu_ps(&b.m[c][0]);
+        __m256 r = _mm256_mul_ps(aCol0, _mm256_shuffle_ps(bCols, bCols, 0x00));
+    #if defined(MATHS_SIMD_FMA)
+        r = _mm256_fmadd_ps(aCol1, _mm256_shuffle_ps(bCols, bCols, 0x55), r);
+        r = _mm256_fmadd_ps(aCol2, _mm256_shuffle_ps(bCols, bCols, 0xaa), r);
+        r = _mm256_fmadd_ps(aCol3, _mm256_shuffle_ps(bCols, bCols, 0xff), r);
+    #else
+        r = _mm256_add_ps(r, _mm256_mul_ps(aCol1, _mm256_shuffle_ps(bCols, bCols, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(aCol2, _mm256_shuffle_ps(bCols, bCols, 0xaa)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(aCol3, _mm256_shuffle_ps(bCols, bCols, 0xff)));
+    #endif
+        _mm256_storeu_ps(&result.m[c][0], r);
+    }
+    return result;
+#elif defined(MATHS_SIMD_SSE2)
+    // result.cols[c] = sum over k of a.cols[k] * b.m[c][k]
+    // Accumulating in k order keeps the same rounding as the scalar
+    // dot() version (unless FMA is enabled).
+    __m128 aCol0 = simdLoad(a.cols[0]);
+    __m128 aCol1 = simdLoad(a.cols[1]);
+    __m128 aCol2 = simdLoad(a.cols[2]);
+    __m128 aCol3 = simdLoad(a.cols[3]);
+    float4x4 result;
+    for(int c=0; c<4; ++c)
+    {
+        __m128 bCol = simdLoad(b.cols[c]);
+        __m128 r = _mm_mul_ps(aCol0, simdSplat(bCol, 0));
+        r = simdMulAdd(aCol1, simdSplat(bCol, 1), r);
+        r = simdMulAdd(aCol2, simdSplat(bCol, 2), r);
+        r = simdMulAdd(aCol3, simdSplat(bCol, 3), r);
+        _mm_storeu_ps(&result.m[c][0], r);
+    }
+    return result;
+#else
+    return scalarMul(a, b);
+#endif
 }
 
 inline float4 operator* (float4 v, float4x4 m) {
+#if defined(MATHS_SIMD_SSE2)
+    // Four dot products at once: multiply v into every column, then
+    // transpose the products so the sums happen lane-wise
+    __m128 vec = simdLoad(v);
+    __m128 p0 = _mm_mul_ps(vec, simdLoad(m.cols[0]));
+    __m128 p1 = _mm_mul_ps(vec, simdLoad(m.cols[1]));
+    __m128 p2 = _mm_mul_ps(vec, simdLoad(m.cols[2]));
+    __m128 p3 = _mm_mul_ps(vec, simdLoad(m.cols[3]));
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    return simdStore(_mm_add_ps(_mm_add_ps(_mm_add_ps(p0, p1), p2), p3));
+#else
     return {
         dot(v, m.cols[0]),
         dot(v, m.cols[1]),
         dot(v, m.cols[2]),
         dot(v, m.cols[3])
     };
+#endif
 }
 
 inline float4x4 transpose(float4x4 m) {
+#if defined(MATHS_SIMD_SSE2)
+    __m128 c0 = simdLoad(m.cols[0]);
+    __m128 c1 = simdLoad(m.cols[1]);
+    __m128 c2 = simdLoad(m.cols[2]);
+    __m128 c3 = simdLoad(m.cols[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    float4x4 result;
+    _mm_storeu_ps(&result.m[0][0], c0);
+    _mm_storeu_ps(&result.m[1][0], c1);
+    _mm_storeu_ps(&result.m[2][0], c2);
+    _mm_storeu_ps(&result.m[3][0], c3);
+    return result;
+#else
     return float4x4 {
         m.m[0][0], m.m[1][0], m.m[2][0], m.m[3][0], 
         m.m[0][1], m.m[1][1], m.m[2][1], m.m[3][1], 
         m.m[0][2], m.m[1][2], m.m[2][2], m.m[3][2], 
         m.m[0][3], m.m[1][3], m.m[2][3], m.m[3][3]
     };
+#endif
+}
+
+// General 4x4 inverse, works for any invertible matrix (including
+// projections). Prefer inverse(affine3x4) or inverseRigid() when the
+// matrix is known to be affine/rigid, they are much cheaper.
+inline float4x4 inverse(float4x4 m) {
+#if defined(MATHS_SIMD_SSE2)
+    // Block-wise inversion, treating m as four 2x2 sub-matrices
+    //     | A B |
+    //     | C D |
+    // each held in one register as (m00, m01, m10, m11).
+    // Based on "Fast 4x4 Matrix Inverse with SSE SIMD, Explained" by Eric Zhang.
+    // The inverse of a transpose is the transpose of the inverse, so this
+    // works for our column-major storage as-is.
+    // X# is the adjugate of 2x2 matrix X, |X| is its determinant.
+    #define MATHS_SWIZZLE(v, x, y, z, w) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(w, z, y, x))
+    #define MATHS_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps((a), (b), _MM_SHUFFLE(w, z, y, x))
+    struct Mat2 {
+        // A*B
+        static __m128 mul(__m128 a, __m128 b) {
+            return _mm_add_ps(_mm_mul_ps(a, MATHS_SWIZZLE(b, 0,3,0,3)),
+                              _mm_mul_ps(MATHS_SWIZZLE(a, 1,0,3,2), MATHS_SWIZZLE(b, 2,1,2,1)));
+        }
+        // A# * B
+        static __m128 adjMul(__m128 a, __m128 b) {
+            return _mm_sub_ps(_mm_mul_ps(MATHS_SWIZZLE(a, 3,3,0,0), b),
+                              _mm_mul_ps(MATHS_SWIZZLE(a, 1,1,2,2), MATHS_SWIZZLE(b, 2,3,0,1)));
+        }
+        // A * B#
+        static __m128 mulAdj(__m128 a, __m128 b) {
+            return _mm_sub_ps(_mm_mul_ps(a, MATHS_SWIZZLE(b, 3,0,3,0)),
+                              _mm_mul_ps(MATHS_SWIZZLE(a, 1,0,3,2), MATHS_SWIZZLE(b, 2,1,2,1)));
+        }
+    };
+
+    __m128 v0 = simdLoad(m.cols[0]);
+    __m128 v1 = simdLoad(m.cols[1]);
+    __m128 v2 = simdLoad(m.cols[2]);
+    __m128 v3 = simdLoad(m.cols[3]);
+    __m128 A = _mm_movelh_ps(v0, v1);
+    __m128 B = _mm_movehl_ps(v1, v0);
+    __m128 C = _mm_movelh_ps(v2, v3);
+    __m128 D = _mm_movehl_ps(v3, v2);
+
+    // (|A|, |B|, |C|, |D|)
+    __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(MATHS_SHUFFLE(v0, v2, 0,2,0,2), MATHS_SHUFFLE(v1, v3, 1,3,1,3)),
+        _mm_mul_ps(MATHS_SHUFFLE(v0, v2, 1,3,1,3), MATHS_SHUFFLE(v1, v3, 0,2,0,2)));
+    __m128 detA = simdSplat(detSub, 0);
+    __m128 detB = simdSplat(detSub, 1);
+    __m128 detC = simdSplat(detSub, 2);
+    __m128 detD = simdSplat(detSub, 3);
+
+    __m128 D_C = Mat2::adjMul(D, C);
+    __m128 A_B = Mat2::adjMul(A, B);
+    // X# = |D|A - B(D#C)
+    __m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2::mul(B, D_C));
+    // W# = |A|D - C(A#B)
+    __m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2::mul(C, A_B));
+    // Y# = |B|C - D(A#B)#
+    __m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2::mulAdj(D, A_B));
+    // Z# = |C|B - A(D#C)#
+    __m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2::mulAdj(A, D_C));
+
+    // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+    __m128 tr = _mm_mul_ps(A_B, MATHS_SWIZZLE(D_C, 0,2,1,3));
+    tr = _mm_add_ps(tr, MATHS_SWIZZLE(tr, 1,0,3,2));
+    tr = _mm_add_ps(tr, MATHS_SWIZZLE(tr, 2,3,0,1));
+    __m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+    __m128 rcpDetM = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+    X_ = _mm_mul_ps(X_, rcpDetM);
+    Y_ = _mm_mul_ps(Y_, rcpDetM);
+    Z_ = _mm_mul_ps(Z_, rcpDetM);
+    W_ = _mm_mul_ps(W_, rcpDetM);
+
+    // Undo the adjugates while storing
+    float4x4 result;
+    _mm_storeu_ps(&result.m[0][0], MATHS_SHUFFLE(X_, Y_, 3,1,3,1));
+    _mm_storeu_ps(&result.m[1][0], MATHS_SHUFFLE(X_, Y_, 2,0,2,0));
+    _mm_storeu_ps(&result.m[2][0], MATHS_SHUFFLE(Z_, W_, 3,1,3,1));
+    _mm_storeu_ps(&result.m[3][0], MATHS_SHUFFLE(Z_, W_, 2,0,2,0));
+    #undef MATHS_SWIZZLE
+    #undef MATHS_SHUFFLE
+    return result;
+#else
+    // Cofactor expansion using shared 2x2 sub-determinants.
+    // Also layout-agnostic, for the same reason as above.
+    const float* a = &m.m[0][0];
+    float s0 = a[0]*a[5] - a[4]*a[1];
+    float s1 = a[0]*a[6] - a[4]*a[2];
+    float s2 = a[0]*a[7] - a[4]*a[3];
+    float s3 = a[1]*a[6] - a[5]*a[2];
+    float s4 = a[1]*a[7] - a[5]*a[3];
+    float s5 = a[2]*a[7] - a[6]*a[3];
+    float c5 = a[10]*a[15] - a[14]*a[11];
+    float c4 = a[9]*a[15] - a[13]*a[11];
+    float c3 = a[9]*a[14] - a[13]*a[10];
+    float c2 = a[8]*a[15] - a[12]*a[11];
+    float c1 = a[8]*a[14] - a[12]*a[10];
+    float c0 = a[8]*a[13] - a[12]*a[9];
+    float invDet = 1.f / (s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0);
+    return {
+        ( a[5]*c5 - a[6]*c4 + a[7]*c3) * invDet,
+        (-a[1]*c5 + a[2]*c4 - a[3]*c3) * invDet,
+        ( a[13]*s5 - a[14]*s4 + a[15]*s3) * invDet,
+        (-a[9]*s5 + a[10]*s4 - a[11]*s3) * invDet,
+        (-a[4]*c5 + a[6]*c2 - a[7]*c1) * invDet,
+        ( a[0]*c5 - a[2]*c2 + a[3]*c1) * invDet,
+        (-a[12]*s5 + a[14]*s2 - a[15]*s1) * invDet,
+        ( a[8]*s5 - a[10]*s2 + a[11]*s1) * invDet,
+        ( a[4]*c4 - a[5]*c2 + a[7]*c0) * invDet,
+        (-a[0]*c4 + a[1]*c2 - a[3]*c0) * invDet,
+        ( a[12]*s4 - a[13]*s2 + a[15]*s0) * invDet,
+        (-a[8]*s4 + a[9]*s2 - a[11]*s0) * invDet,
+        (-a[4]*c3 + a[5]*c1 - a[6]*c0) * invDet,
+        ( a[0]*c3 - a[1]*c1 + a[2]*c0) * invDet,
+        (-a[12]*s3 + a[13]*s1 - a[14]*s0) * invDet,
+        ( a[8]*s3 - a[9]*s1 + a[10]*s0) * invDet
+    };
+#endif
 }
 
-inline float3x3 float4x4ToFloat3x3(float4x4 m) {
+constexpr float3x3 float4x4ToFloat3x3(float4x4 m) {
     float3x3 result = {
         m.m[0][0], m.m[0][1], m.m[0][2], 0.0, 
         m.m[1][0], m.m[1][1], m.m[1][2], 0.0,
@@ -202,3 +554,312 @@ inline float3x3 float4x4ToFloat3x3(float4x4 m) {
     };
     return result;
 }
+
+constexpr quat quatIdentity() {
+    return {0, 0, 0, 1};
+}
+
+// 'axis' must be normalised
+constexpr quat quatFromAxisAngle(float3 axis, float rad) {
+    float sinHalfAngle = 0, cosHalfAngle = 0;
+    sinCos(0.5f * rad, &sinHalfAngle, &cosHalfAngle);
+    return {axis.x*sinHalfAngle, axis.y*sinHalfAngle, axis.z*sinHalfAngle, cosHalfAngle};
+}
+
+// Composes rotations in the same order as the matrix functions:
+// rotationMat(a * b) == rotationMat(a) * rotationMat(b), i.e. 'a' is
+// applied first. (This is the Hamilton product b*a.)
+constexpr quat operator* (quat a, quat b) {
+    return {
+        b.w*a.x + a.w*b.x + (b.y*a.z - b.z*a.y),
+        b.w*a.y + a.w*b.y + (b.z*a.x - b.x*a.z),
+        b.w*a.z + a.w*b.z + (b.x*a.y - b.y*a.x),
+        b.w*a.w - (b.x*a.x + b.y*a.y + b.z*a.z)
+    };
+}
+
+// Inverse rotation, for unit quaternions
+constexpr quat conjugate(quat q) {
+    return {-q.x, -q.y, -q.z, q.w};
+}
+
+constexpr float dot(quat a, quat b) {
+    return a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+}
+
+inline quat normalise(quat q) {
+    float invLength = 1.f / sqrtf(dot(q, q));
+    return {q.x*invLength, q.y*invLength, q.z*invLength, q.w*invLength};
+}
+
+// Normalised linear interpolation. Cheap, and accurate enough when
+// 'a' and 'b' are close (e.g. consecutive animation keys), but the
+// angular speed isn't constant across t.
+inline quat nlerp(quat a, quat b, float t) {
+    // q and -q are the same rotation, flip b to take the shortest path
+    float sign = (dot(a, b) < 0.f) ? -1.f : 1.f;
+    float s = 1.f - t;
+    float tb = t * sign;
+    return normalise(quat{s*a.x + tb*b.x, s*a.y + tb*b.y, s*a.z + tb*b.z, s*a.w + tb*b.w});
+}
+
+// Spherical linear interpolation: constant angular speed across t
+inline quat slerp(quat a, quat b, float t) {
+    float cosTheta = dot(a, b);
+    float sign = 1.f;
+    if(cosTheta < 0.f){
+        cosTheta = -cosTheta;
+        sign = -1.f;
+    }
+    // sin(theta) -> 0 as the rotations converge, nlerp is exact enough there
+    if(cosTheta > 0.9995f)
+        return nlerp(a, b, t);
+
+    float theta = acosf(cosTheta);
+    float invSinTheta = 1.f / sinf(theta);
+    float wa = sinf((1.f - t) * theta) * invSinTheta;
+    float wb = sinf(t * theta) * invSinTheta * sign;
+    return {wa*a.x + wb*b.x, wa*a.y + wb*b.y, wa*a.z + wb*b.z, wa*a.w + wb*b.w};
+}
+
+constexpr float4x4 rotationMat(quat q) {
+    float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    return {
+        1 - 2*(yy+zz), 2*(xy-wz), 2*(xz+wy), 0,
+        2*(xy+wz), 1 - 2*(xx+zz), 2*(yz-wx), 0,
+        2*(xz-wy), 2*(yz+wx), 1 - 2*(xx+yy), 0,
+        0, 0, 0, 1
+    };
+}
+
+constexpr float4x4 affine3x4ToFloat4x4(affine3x4 a) {
+    return {
+        a.m[0][0], a.m[0][1], a.m[0][2], a.m[0][3],
+        a.m[1][0], a.m[1][1], a.m[1][2], a.m[1][3],
+        a.m[2][0], a.m[2][1], a.m[2][2], a.m[2][3],
+        0, 0, 0, 1
+    };
+}
+
+// Drops the last column, so 'm' must be affine
+constexpr affine3x4 float4x4ToAffine3x4(float4x4 m) {
+    return {
+        m.m[0][0], m.m[0][1], m.m[0][2], m.m[0][3],
+        m.m[1][0], m.m[1][1], m.m[1][2], m.m[1][3],
+        m.m[2][0], m.m[2][1], m.m[2][2], m.m[2][3]
+    };
+}
+
+// Upper-left 3x3 of 'a' in the HLSL-friendly float3x3 layout
+// (only the translation slots are zeroed, no arithmetic involved)
+constexpr float3x3 affine3x4ToFloat3x3(affine3x4 a) {
+    float3x3 result = {
+        a.m[0][0], a.m[0][1], a.m[0][2], 0.0,
+        a.m[1][0], a.m[1][1], a.m[1][2], 0.0,
+        a.m[2][0], a.m[2][1], a.m[2][2], 0.0
+    };
+    return result;
+}
+
+// Plain scalar a * b for affine transforms, usable at compile time
+constexpr affine3x4 scalarMul(affine3x4 a, affine3x4 b) {
+    affine3x4 result = {};
+    for(int c=0; c<3; ++c){
+        for(int r=0; r<3; ++r)
+            result.m[c][r] = a.m[0][r]*b.m[c][0] + a.m[1][r]*b.m[c][1] + a.m[2][r]*b.m[c][2];
+        result.m[c][3] = a.m[0][3]*b.m[c][0] + a.m[1][3]*b.m[c][1] + a.m[2][3]*b.m[c][2] + b.m[c][3];
+    }
+    return result;
+}
+
+// Same as affine3x4ToFloat4x4(a) * affine3x4ToFloat4x4(b) but skips the
+// constant last column: 12 dot products instead of 16
+inline affine3x4 operator* (affine3x4 a, affine3x4 b) {
+    // result.cols[c] = sum over k of a.cols[k] * b.m[c][k], plus b's
+    // translation which only reaches the w lane (a's last column is 0,0,0,1)
+#if defined(MATHS_SIMD_SSE2)
+    __m128 aCol0 = simdLoad(a.cols[0]);
+    __m128 aCol1 = simdLoad(a.cols[1]);
+    __m128 aCol2 = simdLoad(a.cols[2]);
+    __m128 wMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    affine3x4 result;
+    for(int c=0; c<3; ++c)
+    {
+        __m128 bCol = simdLoad(b.cols[c]);
+        __m128 r = _mm_mul_ps(aCol0, simdSplat(bCol, 0));
+        r = simdMulAdd(aCol1, simdSplat(bCol, 1), r);
+        r = simdMulAdd(aCol2, simdSplat(bCol, 2), r);
+        r = _mm_add_ps(r, _mm_and_ps(bCol, wMask));
+        _mm_storeu_ps(&result.m[c][0], r);
+    }
+    return result;
+#else
+    return scalarMul(a, b);
+#endif
+}
+
+// Transforms point 'p' (w = 1, so translation applies)
+constexpr float3 transformPoint(float3 p, affine3x4 a) {
+    return {
+        p.x*a.m[0][0] + p.y*a.m[0][1] + p.z*a.m[0][2] + a.m[0][3],
+        p.x*a.m[1][0] + p.y*a.m[1][1] + p.z*a.m[1][2] + a.m[1][3],
+        p.x*a.m[2][0] + p.y*a.m[2][1] + p.z*a.m[2][2] + a.m[2][3]
+    };
+}
+
+// Transforms direction 'v' (w = 0, so translation is ignored)
+constexpr float3 transformVector(float3 v, affine3x4 a) {
+    return {
+        v.x*a.m[0][0] + v.y*a.m[0][1] + v.z*a.m[0][2],
+        v.x*a.m[1][0] + v.y*a.m[1][1] + v.z*a.m[1][2],
+        v.x*a.m[2][0] + v.y*a.m[2][1] + v.z*a.m[2][2]
+    };
+}
+
+// Analytic inverse of an affine transform with any (invertible)
+// rotation/scale/shear: the 3x3 part is inverted with cross products
+// (adjugate / determinant), then the translation is mapped through it.
+constexpr affine3x4 inverse(affine3x4 a) {
+    float3 col0 = {a.m[0][0], a.m[0][1], a.m[0][2]};
+    float3 col1 = {a.m[1][0], a.m[1][1], a.m[1][2]};
+    float3 col2 = {a.m[2][0], a.m[2][1], a.m[2][2]};
+    float3 translation = {a.m[0][3], a.m[1][3], a.m[2][3]};
+
+    // Rows of the inverse 3x3
+    float3 row0 = cross(col1, col2);
+    float3 row1 = cross(col2, col0);
+    float3 row2 = cross(col0, col1);
+    float invDet = 1.f / dot(col0, row0);
+    row0 = row0 * invDet;
+    row1 = row1 * invDet;
+    row2 = row2 * invDet;
+
+    // Columns of the inverse 3x3
+    float3 invCol0 = {row0.x, row1.x, row2.x};
+    float3 invCol1 = {row0.y, row1.y, row2.y};
+    float3 invCol2 = {row0.z, row1.z, row2.z};
+    return {
+        invCol0.x, invCol0.y, invCol0.z, -dot(translation, invCol0),
+        invCol1.x, invCol1.y, invCol1.z, -dot(translation, invCol1),
+        invCol2.x, invCol2.y, invCol2.z, -dot(translation, invCol2)
+    };
+}
+
+// Inverse of a rigid transform (rotation + translation only, no scale
+// or shear): the rotation is just transposed, no determinant needed
+constexpr affine3x4 inverseRigid(affine3x4 a) {
+    float3 translation = {a.m[0][3], a.m[1][3], a.m[2][3]};
+    float3 invCol0 = {a.m[0][0], a.m[1][0], a.m[2][0]};
+    float3 invCol1 = {a.m[0][1], a.m[1][1], a.m[2][1]};
+    float3 invCol2 = {a.m[0][2], a.m[1][2], a.m[2][2]};
+    return {
+        invCol0.x, invCol0.y, invCol0.z, -dot(translation, invCol0),
+        invCol1.x, invCol1.y, invCol1.z, -dot(translation, invCol1),
+        invCol2.x, invCol2.y, invCol2.z, -dot(translation, invCol2)
+    };
+}
+
+// Matrix for transforming normals by 'a': transpose(inverse(a)) of the
+// 3x3 part. The transpose of an inverse is the cofactor matrix divided
+// by the determinant, and for a 3x3 matrix the cofactor columns are
+// just cross products of the columns, so there's no full inverse or
+// transpose involved. Handles non-uniform scale and shear.
+constexpr float3x3 normalMatrix(affine3x4 a) {
+    float3 col0 = {a.m[0][0], a.m[0][1], a.m[0][2]};
+    float3 col1 = {a.m[1][0], a.m[1][1], a.m[1][2]};
+    float3 col2 = {a.m[2][0], a.m[2][1], a.m[2][2]};
+    float3 cofactor0 = cross(col1, col2);
+    float3 cofactor1 = cross(col2, col0);
+    float3 cofactor2 = cross(col0, col1);
+    float invDet = 1.f / dot(col0, cofactor0);
+    cofactor0 = cofactor0 * invDet;
+    cofactor1 = cofactor1 * invDet;
+    cofactor2 = cofactor2 * invDet;
+    float3x3 result = {
+        cofactor0.x, cofactor0.y, cofactor0.z, 0.0,
+        cofactor1.x, cofactor1.y, cofactor1.z, 0.0,
+        cofactor2.x, cofactor2.y, cofactor2.z, 0.0
+    };
+    return result;
+}
+
+// Uses the upper-left 3x3 of 'm', same result as
+// float4x4ToFloat3x3(transpose(inverse(m))) for affine 'm'
+inline float3x3 normalMatrix(float4x4 m) {
+    return normalMatrix(float4x4ToAffine3x4(m));
+}
+
+// Builds scale * rotation * translation directly, without any
+// matrix multiplies (scale is per-axis here, unlike scaleMat())
+constexpr affine3x4 trsAffine3x4(float3 translation, quat rotation, float3 scale) {
+    quat q = rotation;
+    float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    float3 s = scale;
+    return {
+        s.x*(1 - 2*(yy+zz)), s.y*2*(xy-wz), s.z*2*(xz+wy), translation.x,
+        s.x*2*(xy+wz), s.y*(1 - 2*(xx+zz)), s.z*2*(yz-wx), translation.y,
+        s.x*2*(xz-wy), s.y*2*(yz+wx), s.z*(1 - 2*(xx+yy)), translation.z
+    };
+}
+
+// Returns the inverse of trsAffine3x4(translation, rotation, scale), i.e.
+// translation(-translation) * rotation(conjugate(rotation)) * scale(1/scale)
+// built directly. The rotation part is transposed and each column
+// divided by its scale; the translation is rotated and scaled back.
+constexpr affine3x4 inverseTrsAffine3x4(float3 translation, quat rotation, float3 scale) {
+    quat q = rotation;
+    float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    float3 invS = {1.f / scale.x, 1.f / scale.y, 1.f / scale.z};
+
+    float3 col0 = float3{1 - 2*(yy+zz), 2*(xy+wz), 2*(xz-wy)} * invS.x;
+    float3 col1 = float3{2*(xy-wz), 1 - 2*(xx+zz), 2*(yz+wx)} * invS.y;
+    float3 col2 = float3{2*(xz+wy), 2*(yz-wx), 1 - 2*(xx+yy)} * invS.z;
+    return {
+        col0.x, col0.y, col0.z, -dot(translation, col0),
+        col1.x, col1.y, col1.z, -dot(translation, col1),
+        col2.x, col2.y, col2.z, -dot(translation, col2)
+    };
+}
+
+// Same as scaleMat(scale) * rotationMat(rotation) * translationMat(translation)
+// (scale is per-axis here), see trsAffine3x4()
+constexpr float4x4 trsMat(float3 translation, quat rotation, float3 scale) {
+    return affine3x4ToFloat4x4(trsAffine3x4(translation, rotation, scale));
+}
+
+// Inverse of trsMat(translation, rotation, scale), see inverseTrsAffine3x4()
+constexpr float4x4 inverseTrsMat(float3 translation, quat rotation, float3 scale) {
+    return affine3x4ToFloat4x4(inverseTrsAffine3x4(translation, rotation, scale));
+}
+
+// Compile-time checks. Each of these only compiles if the expression is
+// folded to a constant, so they also catch anything in the chain above
+// losing its constexpr.
+constexpr bool nearlyEqual(float a, float b, float tolerance) {
+    return (a - b <= tolerance) && (b - a <= tolerance);
+}
+
+static_assert(scaleMat(0.2f).m[1][1] == 0.2f, "scaleMat() should fold");
+static_assert(translationMat({1, 2, 3}).m[2][3] == 3.f, "translationMat() should fold");
+static_assert(nearlyEqual(rotateXMat((float)M_PI / 6).m[2][1], 0.5f, 1e-6f), "sinCos() should fold");
+static_assert(nearlyEqual(rotateYMat((float)M_PI / 3).m[0][0], 0.5f, 1e-6f), "sinCos() should fold");
+static_assert(nearlyEqual(makePerspectiveMat(1.f, (float)M_PI / 2, 0.1f, 1000.f).m[1][1], 1.f, 1e-6f), "makePerspectiveMat() should fold");
+// Reverse-Z: depth = m[2][3]/distance - m[2][2], 1 at zNear and 0 at zFar
+static_assert(nearlyEqual(makeReverseZPerspectiveMat(1.f, 1.f, 0.1f, 1000.f).m[2][3] / 0.1f - 
+                          makeReverseZPerspectiveMat(1.f, 1.f, 0.1f, 1000.f).m[2][2], 1.f, 1e-6f), "makeReverseZPerspectiveMat() should fold");
+static_assert(nearlyEqual(makeReverseZPerspectiveMat(1.f, 1.f, 0.1f, 1000.f).m[2][3] / 1000.f - 
+                          makeReverseZPerspectiveMat(1.f, 1.f, 0.1f, 1000.f).m[2][2], 0.f, 1e-6f), "makeReverseZPerspectiveMat() should fold");
+static_assert(makeInfiniteReverseZPerspectiveMat(1.f, 1.f, 0.1f).m[2][3] == 0.1f, "makeInfiniteReverseZPerspectiveMat() should fold");
+static_assert(scalarMul(scaleMat(2.f), translationMat({1, 2, 3})).m[0][3] == 1.f, "scalarMul() should fold");
+static_assert(scalarMul(translationMat({1, 2, 3}), scaleMat(2.f)).m[1][3] == 4.f, "scalarMul() should fold");
+static_assert(nearlyEqual(trsAffine3x4({1, 2, 3}, quatFromAxisAngle({0, 0, 1}, (float)M_PI / 2), {1, 1, 1}).m[1][0], 1.f, 1e-6f), 
+              "trsAffine3x4() should fold");
+static_assert(nearlyEqual(scalarMul(trsAffine3x4({1, 2, 3}, quatIdentity(), {2, 2, 2}), 
+                                    inverseTrsAffine3x4({1, 2, 3}, quatIdentity(), {2, 2, 2})).m[2][2], 1.f, 1e-6f), 
+              "inverseTrsAffine3x4() should fold");
@@ -1,9 +1,7 @@
 
 cbuffer vsConstants : register(b0)
 {
-    float4x4 modelViewProj;
-    float4x4 modelView;
-    float3x3 normalMatrix;
+    float4x4 projection;
 };
 
 struct DirectionalLight
@@ -12,23 +10,37 @@ struct DirectionalLight
     float4 color;
 };
 
-struct PointLight
-{
-    float4 posEye;
-    float4 color;
-};
-
 // Create Constant Buffer for our Blinn-Phong vertex shader
 cbuffer fsConstants : register(b0)
 {
     DirectionalLight dirLight;
-    PointLight pointLights[2];
+    // Light cluster grid (see ClusterGrid in LightClustering.h)
+    float4 clusterProjX;
+    float4 clusterProjY;
+    float4 clusterProjW;
+    float4 clusterDims;    // tilesX, tilesY, numSlices
+    float4 clusterSlicing; // sliceScale, sliceBias
+    uint4 lightCounts;     // numPointLights, numClusters, numLightIndices
 };
 
+// Per light: float4 posEye (w: radius), float4 color
+ByteAddressBuffer pointLights : register(t1);
+// Per cluster: uint offset | count << 16 into lightIndices
+ByteAddressBuffer clusters : register(t2);
+// Each cluster's light indices as uint16s, 2 to a uint
+ByteAddressBuffer lightIndices : register(t3);
+
 struct VS_Input {
     float3 pos : POS;
     float2 uv : TEX;
     float3 norm : NORM;
+    // Per-instance (see BlinnPhongInstance in InstancedDrawing.h)
+    float4 modelView0 : MODELVIEW0;
+    float4 modelView1 : MODELVIEW1;
+    float4 modelView2 : MODELVIEW2;
+    float3 normalMatrix0 : NORMALMATRIX0;
+    float3 normalMatrix1 : NORMALMATRIX1;
+    float3 normalMatrix2 : NORMALMATRIX2;
 };
 
 struct VS_Output {
@@ -41,11 +53,25 @@ struct VS_Output {
 Texture2D    mytexture : register(t0);
 SamplerState mysampler : register(s0);
 
+// Same as findCluster() in LightClustering.cpp
+uint findCluster(float3 posEye)
+{
+    float4 pos = float4(posEye, 1.0f);
+    float2 ndc = float2(dot(pos, clusterProjX), dot(pos, clusterProjY)) / dot(pos, clusterProjW);
+    float2 tile = clamp(floor((ndc * 0.5 + 0.5) * clusterDims.xy), 0, clusterDims.xy - 1);
+    float slice = clamp(floor(log2(-posEye.z) * clusterSlicing.x + clusterSlicing.y), 0, clusterDims.z - 1);
+    return (uint)((slice * clusterDims.y + tile.y) * clusterDims.x + tile.x);
+}
+
 VS_Output vs_main(VS_Input input)
 {
+    // Each per-instance vector is a column of the matrix (see affine3x4)
+    float4x3 modelView = transpose(float3x4(input.modelView0, input.modelView1, input.modelView2));
+    float3x3 normalMatrix = transpose(float3x3(input.normalMatrix0, input.normalMatrix1, input.normalMatrix2));
+
     VS_Output output;
-    output.pos = mul(float4(input.pos, 1.0f), modelViewProj);
-    output.posEye = mul(float4(input.pos, 1.0f), modelView).xyz;
+    output.posEye = mul(float4(input.pos, 1.0f), modelView);
+    output.pos = mul(float4(output.posEye, 1.0f), projection);
     output.normalEye = mul(input.norm, normalMatrix);
     output.uv = input.uv;
     return output;
@@ -77,17 +103,33 @@ float4 ps_main(VS_Output input) : SV_Target
 
         dirLightIntensity = (iAmbient + iDiffuse + iSpecular) * lightColor;
     }
-    // Point Light
+    // Point Lights, only those in this pixel's cluster
     float3 pointLightIntensity = float3(0,0,0);
-    for(int i=0; i<2; ++i)
+    uint cluster = min(findCluster(input.posEye), lightCounts.y - 1);
+    uint clusterLights = clusters.Load(4 * cluster);
+    uint firstIndex = min(clusterLights & 0xffff, lightCounts.z);
+    uint endIndex = min(firstIndex + (clusterLights >> 16), lightCounts.z);
+    for(uint k=firstIndex; k<endIndex; ++k)
     {
+        uint indexPair = lightIndices.Load(4 * (k >> 1));
+        uint i = (k & 1) ? (indexPair >> 16) : (indexPair & 0xffff);
+        if(i >= lightCounts.x)
+            continue;
+        float4 lightPosEye = asfloat(pointLights.Load4(32 * i));
+        float3 lightColor = asfloat(pointLights.Load3(32 * i + 16));
+
         float ambientStrength = 0.1;
         float specularStrength = 0.9;
         float specularExponent = 100;
-        float3 lightDirEye = pointLights[i].posEye.xyz - input.posEye;
-        float inverseDistance = 1 / length(lightDirEye);
+        float3 lightDirEye = lightPosEye.xyz - input.posEye;
+        float distance = length(lightDirEye);
+        float inverseDistance = 1 / distance;
         lightDirEye *= inverseDistance; //normalise
-        float3 lightColor = pointLights[i].color.xyz;
+
+        // Fade to 0 at the light's radius, so it can be left out of
+        // clusters beyond it
+        float distanceRatio = distance / lightPosEye.w;
+        float falloff = saturate(1 - distanceRatio * distanceRatio * distanceRatio * distanceRatio);
 
         float3 iAmbient = ambientStrength;
 
@@ -98,7 +140,7 @@ float4 ps_main(VS_Output input) : SV_Target
         float specularFactor = max(0.0, dot(halfwayEye, input.normalEye));
         float3 iSpecular = specularStrength * pow(specularFactor, 2*specularExponent);
 
-        pointLightIntensity += (iAmbient + iDiffuse + iSpecular) * lightColor * inverseDistance;
+        pointLightIntensity += (iAmbient + iDiffuse + iSpecular) * lightColor * inverseDistance * falloff * falloff;
     }
 
     float3 result = (dirLightIntensity + pointLightIntensity) * diffuseColor;
@@ -0,0 +1,125 @@
+#include "BlinnPhongShading.h"
+
+#include <math.h>
+
+// Constants from ps_main
+static const float AMBIENT_STRENGTH = 0.1f;
+static const float SPECULAR_STRENGTH = 0.9f;
+static const uint32_t SPECULAR_POWER = 2 * 100; // pow(specularFactor, 2*specularExponent)
+static const float SPECULAR_CUTOFF = 0.65f;
+
+static inline wfloat squared(wfloat x) { return x * x; }
+
+// One light's (ambient + diffuse + specular) intensity. 'toLight' and
+// 'toCamera' are unit vectors.
+static inline wfloat blinnPhongIntensity(const wfloat normal[3], const wfloat toCamera[3], const wfloat toLight[3])
+{
+    wfloat nDotL = wfloatMulAdd(normal[0], toLight[0], wfloatMulAdd(normal[1], toLight[1], normal[2] * toLight[2]));
+    wfloat diffuseFactor = wfloatMax(wfloatSet1(0.f), nDotL);
+
+    wfloat halfway[3] = { toCamera[0] + toLight[0], toCamera[1] + toLight[1], toCamera[2] + toLight[2] };
+    wfloat halfwayLengthSq = wfloatMulAdd(halfway[0], halfway[0], wfloatMulAdd(halfway[1], halfway[1], halfway[2] * halfway[2]));
+    wfloat nDotH = wfloatMulAdd(normal[0], halfway[0], wfloatMulAdd(normal[1], halfway[1], normal[2] * halfway[2]));
+    wfloat specularFactor = wfloatMax(wfloatSet1(0.f), nDotH / wfloatSqrt(halfwayLengthSq));
+
+    wfloat isLit = wfloatLess(wfloatSet1(SPECULAR_CUTOFF), specularFactor);
+    wfloat specular = wfloatPowInt(wfloatMax(specularFactor, wfloatSet1(SPECULAR_CUTOFF)), SPECULAR_POWER);
+    specular = wfloatAnd(isLit, specular);
+    return wfloatMulAdd(wfloatSet1(SPECULAR_STRENGTH), specular, wfloatSet1(AMBIENT_STRENGTH) + diffuseFactor);
+}
+
+void shadeBlinnPhong(const BlinnPhongLights* lights, const wfloat posEye[3], const wfloat normalEye[3],
+                     const wfloat diffuseColor[3], wfloat outColor[3])
+{
+    wfloat toCamera[3] = { -posEye[0], -posEye[1], -posEye[2] };
+    wfloat toCameraLengthSq = wfloatMulAdd(posEye[0], posEye[0], wfloatMulAdd(posEye[1], posEye[1], posEye[2] * posEye[2]));
+    wfloat invToCameraLength = wfloatSet1(1.f) / wfloatSqrt(toCameraLengthSq);
+    for(int i=0; i<3; ++i)
+        toCamera[i] = toCamera[i] * invToCameraLength;
+
+    wfloat dirLightDir[3] = { wfloatSet1(lights->dirLightDirEye.x), wfloatSet1(lights->dirLightDirEye.y), wfloatSet1(lights->dirLightDirEye.z) };
+    wfloat intensity = blinnPhongIntensity(normalEye, toCamera, dirLightDir);
+    wfloat result[3] = {
+        intensity * wfloatSet1(lights->dirLightColor.x),
+        intensity * wfloatSet1(lights->dirLightColor.y),
+        intensity * wfloatSet1(lights->dirLightColor.z)
+    };
+
+    for(uint32_t i=0; i<lights->numPointLights; ++i)
+    {
+        const BlinnPhongPointLight* light = &lights->pointLights[lights->pointLightIndices ? lights->pointLightIndices[i] : i];
+        wfloat toLight[3] = {
+            wfloatSet1(light->posEye.x) - posEye[0],
+            wfloatSet1(light->posEye.y) - posEye[1],
+            wfloatSet1(light->posEye.z) - posEye[2]
+        };
+        wfloat distanceSq = wfloatMulAdd(toLight[0], toLight[0], wfloatMulAdd(toLight[1], toLight[1], toLight[2] * toLight[2]));
+        wfloat inverseDistance = wfloatSet1(1.f) / wfloatSqrt(distanceSq);
+        for(int c=0; c<3; ++c)
+            toLight[c] = toLight[c] * inverseDistance;
+
+        wfloat falloff = wfloatMax(wfloatSet1(1.f) - squared(distanceSq * wfloatSet1(1.f / (light->posEye.w * light->posEye.w))), wfloatSet1(0.f));
+        intensity = blinnPhongIntensity(normalEye, toCamera, toLight) * (inverseDistance * squared(falloff));
+        result[0] = wfloatMulAdd(intensity, wfloatSet1(light->color.x), result[0]);
+        result[1] = wfloatMulAdd(intensity, wfloatSet1(light->color.y), result[1]);
+        result[2] = wfloatMulAdd(intensity, wfloatSet1(light->color.z), result[2]);
+    }
+
+    for(int c=0; c<3; ++c)
+        outColor[c] = result[c] * diffuseColor[c];
+}
+
+static float blinnPhongIntensityReference(float3 normal, float3 toCamera, float3 toLight)
+{
+    float diffuseFactor = fmaxf(0.f, dot(normal, toLight));
+    float3 halfway = normalise(toCamera + toLight);
+    float specularFactor = fmaxf(0.f, dot(halfway, normal));
+    return AMBIENT_STRENGTH + diffuseFactor + SPECULAR_STRENGTH * powf(specularFactor, (float)SPECULAR_POWER);
+}
+
+float3 shadeBlinnPhongReference(const BlinnPhongLights* lights, float3 posEye, float3 normalEye, float3 diffuseColor)
+{
+    float3 toCamera = normalise(-posEye);
+    float3 result = lights->dirLightColor.xyz * blinnPhongIntensityReference(normalEye, toCamera, lights->dirLightDirEye.xyz);
+    for(uint32_t i=0; i<lights->numPointLights; ++i)
+    {
+        const BlinnPhongPointLight* light = &lights->pointLights[lights->pointLightIndices ? lights->pointLightIndices[i] : i];
+        float3 toLight = light->posEye.xyz + (-posEye);
+        float distance = length(toLight);
+        float inverseDistance = 1.f / distance;
+        toLight = toLight * inverseDistance;
+        float ratio = distance / light->posEye.w;
+        float falloff = fmaxf(1.f - ratio * ratio * ratio * ratio, 0.f);
+        result += light->color.xyz * (blinnPhongIntensityReference(normalEye, toCamera, toLight) * inverseDistance * falloff * falloff);
+    }
+    return {result.x * diffuseColor.x, result.y * diffuseColor.y, result.z * diffuseColor.z};
+}
+
+void shadeBlinnPhongBatch(const BlinnPhongLights* lights, const BlinnPhongSurfaces* surfaces, float* const outColor[3], size_t count)
+{
+    for(size_t i=0; i<count; i+=WFLOAT_WIDTH)
+    {
+        // The tail is padded with a point one unit in front of the
+        // camera so the padding lanes stay finite
+        int n = (count - i < WFLOAT_WIDTH) ? (int)(count - i) : WFLOAT_WIDTH;
+        const float PAD_POS[3] = { 0.f, 0.f, -1.f };
+        wfloat posEye[3], normalEye[3], diffuseColor[3], color[3];
+        for(int c=0; c<3; ++c){
+            posEye[c] = wfloatLoadPartial(surfaces->posEye[c] + i, n, PAD_POS[c]);
+            normalEye[c] = wfloatLoadPartial(surfaces->normalEye[c] + i, n, 0.f);
+            diffuseColor[c] = wfloatLoadPartial(surfaces->diffuseColor[c] + i, n, 0.f);
+        }
+        shadeBlinnPhong(lights, posEye, normalEye, diffuseColor, color);
+        for(int c=0; c<3; ++c)
+        {
+            if(n == WFLOAT_WIDTH){
+                wfloatStore(outColor[c] + i, color[c]);
+                continue;
+            }
+            float lanes[WFLOAT_WIDTH];
+            wfloatStore(lanes, color[c]);
+            for(int j=0; j<n; ++j)
+                outColor[c][i + j] = lanes[j];
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "3DMaths.h"
+#include "SimdMaths.h"
+
+// ps_main from BlinnPhong.hlsl on the CPU, for the software render
+// device and for tools which bake or check lighting without a GPU.
+//
+// Every light adds (ambient + diffuse + specular) * color, point lights
+// scaled by 1/distance and faded out to nothing at their radius by
+// (1 - (distance/radius)^4)^2, with
+//   ambient  = 0.1
+//   diffuse  = max(0, dot(normal, toLight))
+//   specular = 0.9 * max(0, dot(normalize(toCamera + toLight), normal))^200
+// and the sum is multiplied by the surface's diffuse color. As in the
+// shader the normal isn't renormalised and everything is in eye space,
+// so the camera is at the origin.
+
+// Laid out like DirectionalLight/PointLight in BlinnPhong.hlsl, so
+// constant buffer contents can be used directly
+struct BlinnPhongPointLight
+{
+    float4 posEye; // w: radius, beyond which the light adds nothing
+    float4 color;  // w unused
+};
+
+struct BlinnPhongLights
+{
+    float4 dirLightDirEye; // Towards the light, w unused
+    float4 dirLightColor;
+    const BlinnPhongPointLight* pointLights;
+    // Which of 'pointLights' to use, e.g. a cluster's list from
+    // LightClustering.h. If NULL the first numPointLights are used.
+    const uint16_t* pointLightIndices;
+    uint32_t numPointLights;
+};
+
+// Shades WFLOAT_WIDTH pixels (8 with AVX, 4 with SSE2)
+// given as structure-of-arrays x, y, z / r, g, b. Writes linear RGB.
+// Specular factors below 0.65 count as 0: 0.65^200 is just above
+// FLT_MIN, so this only drops results the GPU would flush to zero and
+// keeps denormals out of the multiplies.
+void shadeBlinnPhong(const BlinnPhongLights* lights, const wfloat posEye[3], const wfloat normalEye[3],
+                     const wfloat diffuseColor[3], wfloat outColor[3]);
+
+// Scalar version using powf(), to check shadeBlinnPhong() against
+float3 shadeBlinnPhongReference(const BlinnPhongLights* lights, float3 posEye, float3 normalEye, float3 diffuseColor);
+
+// Separate x/y/z (r/g/b) arrays of 'count' points to shade
+struct BlinnPhongSurfaces
+{
+    const float* posEye[3];
+    const float* normalEye[3];
+    const float* diffuseColor[3];
+};
+
+// shadeBlinnPhong() over arrays, e.g. lightmap texels: outColor[c][i] is
+// channel c of point i
+void shadeBlinnPhongBatch(const BlinnPhongLights* lights, const BlinnPhongSurfaces* surfaces, float* const outColor[3], size_t count);
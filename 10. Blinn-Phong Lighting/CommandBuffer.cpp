@@ -0,0 +1,198 @@
+#include "CommandBuffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t SORT_KEY_MESH_SHIFT = SORT_KEY_DEPTH_BITS;
+static const uint32_t SORT_KEY_MATERIAL_SHIFT = SORT_KEY_MESH_SHIFT + SORT_KEY_MESH_BITS;
+static const uint32_t SORT_KEY_PIPELINE_SHIFT = SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS;
+static const uint32_t SORT_KEY_LAYER_SHIFT = SORT_KEY_PIPELINE_SHIFT + SORT_KEY_PIPELINE_BITS;
+static_assert(SORT_KEY_LAYER_SHIFT + SORT_KEY_LAYER_BITS == 64, "Sort key fields should fill 64 bits");
+
+uint64_t makeSortKey(RenderLayer layer, DrawPipeline pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+    assert((uint32_t)layer < (1u << SORT_KEY_LAYER_BITS));
+    assert((uint32_t)pipeline < (1u << SORT_KEY_PIPELINE_BITS));
+    assert(material < (1u << SORT_KEY_MATERIAL_BITS));
+    assert(mesh < (1u << SORT_KEY_MESH_BITS));
+
+    // Non-negative floats order the same as their bit patterns
+    uint32_t depthBits = 0;
+    if(depth > 0.f)
+        memcpy(&depthBits, &depth, sizeof(float));
+
+    return ((uint64_t)layer << SORT_KEY_LAYER_SHIFT) |
+           ((uint64_t)pipeline << SORT_KEY_PIPELINE_SHIFT) |
+           ((uint64_t)material << SORT_KEY_MATERIAL_SHIFT) |
+           ((uint64_t)mesh << SORT_KEY_MESH_SHIFT) |
+           depthBits;
+}
+
+uint32_t sortKeyPipeline(uint64_t key)
+{
+    return (uint32_t)(key >> SORT_KEY_PIPELINE_SHIFT) & ((1u << SORT_KEY_PIPELINE_BITS) - 1);
+}
+
+uint32_t sortKeyMaterial(uint64_t key)
+{
+    return (uint32_t)(key >> SORT_KEY_MATERIAL_SHIFT) & ((1u << SORT_KEY_MATERIAL_BITS) - 1);
+}
+
+uint32_t sortKeyMesh(uint64_t key)
+{
+    return (uint32_t)(key >> SORT_KEY_MESH_SHIFT) & ((1u << SORT_KEY_MESH_BITS) - 1);
+}
+
+CommandBuffer allocCommandBuffer(uint32_t maxPackets, uint32_t instanceCapacityBytes)
+{
+    CommandBuffer result = {};
+    result.maxPackets = maxPackets;
+    result.keys = (uint64_t*)malloc(maxPackets * sizeof(uint64_t));
+    result.packetIndices = (uint32_t*)malloc(maxPackets * sizeof(uint32_t));
+    result.packets = (DrawPacket*)malloc(maxPackets * sizeof(DrawPacket));
+    result.scratchKeys = (uint64_t*)malloc(maxPackets * sizeof(uint64_t));
+    result.scratchIndices = (uint32_t*)malloc(maxPackets * sizeof(uint32_t));
+    result.instanceBytes = (uint8_t*)malloc(instanceCapacityBytes);
+    result.instanceCapacityBytes = instanceCapacityBytes;
+    assert(result.keys && result.packetIndices && result.packets);
+    assert(result.scratchKeys && result.scratchIndices && result.instanceBytes);
+    return result;
+}
+
+void freeCommandBuffer(CommandBuffer commands)
+{
+    free(commands.keys);
+    free(commands.packetIndices);
+    free(commands.packets);
+    free(commands.scratchKeys);
+    free(commands.scratchIndices);
+    free(commands.instanceBytes);
+}
+
+void resetCommandBuffer(CommandBuffer* commands)
+{
+    commands->numPackets = 0;
+    commands->instanceSizeBytes = 0;
+}
+
+void* pushDrawPacket(CommandBuffer* commands, uint64_t sortKey, uint32_t instanceStride)
+{
+    assert(commands->numPackets < commands->maxPackets);
+    assert(commands->instanceSizeBytes + instanceStride <= commands->instanceCapacityBytes);
+
+    uint32_t index = commands->numPackets++;
+    commands->keys[index] = sortKey;
+    commands->packetIndices[index] = index;
+    commands->packets[index].instanceByteOffset = commands->instanceSizeBytes;
+    commands->packets[index].instanceStride = instanceStride;
+    void* result = commands->instanceBytes + commands->instanceSizeBytes;
+    commands->instanceSizeBytes += instanceStride;
+    return result;
+}
+
+void radixSortKeys(uint64_t* keys, uint32_t* values, uint64_t* scratchKeys, uint32_t* scratchValues, uint32_t count)
+{
+    // Histogram every byte position in one pass over the keys
+    uint32_t counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for(uint32_t i=0; i<count; ++i){
+        uint64_t key = keys[i];
+        for(int byteIndex=0; byteIndex<8; ++byteIndex)
+            ++counts[byteIndex][(key >> (8 * byteIndex)) & 0xff];
+    }
+
+    uint64_t* srcKeys = keys;
+    uint32_t* srcValues = values;
+    uint64_t* dstKeys = scratchKeys;
+    uint32_t* dstValues = scratchValues;
+    for(int byteIndex=0; byteIndex<8; ++byteIndex)
+    {
+        uint32_t* byteCounts = counts[byteIndex];
+        // If every key has the same byte here this pass wouldn't move
+        // anything. Unused key fields (few layers, materials, meshes)
+        // make this common.
+        if(count == 0 || byteCounts[(srcKeys[0] >> (8 * byteIndex)) & 0xff] == count)
+            continue;
+
+        uint32_t offsets[256];
+        uint32_t total = 0;
+        for(int digit=0; digit<256; ++digit){
+            offsets[digit] = total;
+            total += byteCounts[digit];
+        }
+        for(uint32_t i=0; i<count; ++i){
+            uint64_t key = srcKeys[i];
+            uint32_t destination = offsets[(key >> (8 * byteIndex)) & 0xff]++;
+            dstKeys[destination] = key;
+            dstValues[destination] = srcValues[i];
+        }
+
+        uint64_t* tempKeys = srcKeys; srcKeys = dstKeys; dstKeys = tempKeys;
+        uint32_t* tempValues = srcValues; srcValues = dstValues; dstValues = tempValues;
+    }
+
+    if(srcKeys != keys){
+        memcpy(keys, srcKeys, count * sizeof(uint64_t));
+        memcpy(values, srcValues, count * sizeof(uint32_t));
+    }
+}
+
+void sortCommandBuffer(CommandBuffer* commands)
+{
+    radixSortKeys(commands->keys, commands->packetIndices, commands->scratchKeys, commands->scratchIndices, commands->numPackets);
+}
+
+void buildInstancedDraws(const CommandBuffer* commands, InstancedDrawList* drawList)
+{
+    resetInstancedDrawList(drawList);
+    // Everything above the depth bits
+    const uint64_t STATE_MASK = ~0ull << SORT_KEY_DEPTH_BITS;
+
+    uint32_t runStart = 0;
+    while(runStart < commands->numPackets)
+    {
+        uint64_t runState = commands->keys[runStart] & STATE_MASK;
+        uint32_t runEnd = runStart + 1;
+        while(runEnd < commands->numPackets && (commands->keys[runEnd] & STATE_MASK) == runState)
+            ++runEnd;
+
+        uint32_t stride = commands->packets[commands->packetIndices[runStart]].instanceStride;
+        uint8_t* dst = (uint8_t*)pushInstancedDraw(drawList, (DrawPipeline)sortKeyPipeline(runState), sortKeyMaterial(runState),
+                                                   sortKeyMesh(runState), stride, runEnd - runStart);
+        for(uint32_t i=runStart; i<runEnd; ++i){
+            const DrawPacket* packet = &commands->packets[commands->packetIndices[i]];
+            assert(packet->instanceStride == stride);
+            memcpy(dst, commands->instanceBytes + packet->instanceByteOffset, stride);
+            dst += stride;
+        }
+        runStart = runEnd;
+    }
+}
+
+// The camera looks down -z in view space, so depth is -z of the
+// object's origin
+static float viewDepth(const affine3x4* modelView)
+{
+    return -modelView->m[2][3];
+}
+
+void pushLightPackets(CommandBuffer* commands, uint32_t mesh, affine3x4 viewMat,
+                      const affine3x4* worldMats, const uint32_t* nodes, const float4* colors, uint32_t numNodes)
+{
+    for(uint32_t i=0; i<numNodes; ++i){
+        LightInstance instance = makeLightInstance(worldMats[nodes[i]], viewMat, colors[i]);
+        uint64_t key = makeSortKey(RenderLayerOpaque, DrawPipelineLight, DRAW_NO_MATERIAL, mesh, viewDepth(&instance.modelView));
+        memcpy(pushDrawPacket(commands, key, sizeof(LightInstance)), &instance, sizeof(LightInstance));
+    }
+}
+
+void pushBlinnPhongPackets(CommandBuffer* commands, uint32_t material, uint32_t mesh, affine3x4 viewMat,
+                           const affine3x4* worldMats, const uint32_t* nodes, uint32_t numNodes)
+{
+    for(uint32_t i=0; i<numNodes; ++i){
+        BlinnPhongInstance instance = makeBlinnPhongInstance(worldMats[nodes[i]], viewMat);
+        uint64_t key = makeSortKey(RenderLayerOpaque, DrawPipelineBlinnPhong, material, mesh, viewDepth(&instance.modelView));
+        memcpy(pushDrawPacket(commands, key, sizeof(BlinnPhongInstance)), &instance, sizeof(BlinnPhongInstance));
+    }
+}
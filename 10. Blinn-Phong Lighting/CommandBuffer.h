@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include "3DMaths.h"
+#include "InstancedDrawing.h"
+
+// Render command buffer. Each object is recorded as a draw packet with
+// a 64-bit sort key and its per-instance data, in whatever order the
+// code visits objects. Before submission the packets are radix-sorted
+// by key, so draws that share state end up next to each other: runs of
+// packets with the same layer/pipeline/material/mesh are merged into a
+// single instanced draw, and pipeline/material binds are only flagged
+// when they actually change (see InstancedDraw::stateChanges).
+//
+// Sort key, most significant bits first:
+//   layer    4 bits  (e.g. opaque before transparent)
+//   pipeline 8 bits  (DrawPipeline: shaders + input layout)
+//   material 12 bits (textures/constants)
+//   mesh     8 bits
+//   depth    32 bits (view-space depth, front to back)
+// Depth is last so it only orders packets within a run of equal state,
+// which gives front-to-back instances inside each instanced draw.
+
+const uint32_t SORT_KEY_LAYER_BITS = 4;
+const uint32_t SORT_KEY_PIPELINE_BITS = 8;
+const uint32_t SORT_KEY_MATERIAL_BITS = 12;
+const uint32_t SORT_KEY_MESH_BITS = 8;
+const uint32_t SORT_KEY_DEPTH_BITS = 32;
+
+enum RenderLayer {
+    RenderLayerOpaque,
+    RenderLayerCount
+};
+
+// 'depth' is the distance in front of the camera; anything behind it
+// (or NaN) sorts first
+uint64_t makeSortKey(RenderLayer layer, DrawPipeline pipeline, uint32_t material, uint32_t mesh, float depth);
+uint32_t sortKeyPipeline(uint64_t key);
+uint32_t sortKeyMaterial(uint64_t key);
+uint32_t sortKeyMesh(uint64_t key);
+
+struct DrawPacket
+{
+    uint32_t instanceByteOffset; // Into CommandBuffer::instanceBytes
+    uint32_t instanceStride;
+};
+
+struct CommandBuffer
+{
+    uint32_t maxPackets;
+    uint32_t numPackets;
+    uint64_t* keys;
+    // Starts as 0..numPackets-1; sortCommandBuffer() permutes it along with 'keys'
+    uint32_t* packetIndices;
+    DrawPacket* packets;
+
+    uint8_t* instanceBytes;
+    uint32_t instanceCapacityBytes;
+    uint32_t instanceSizeBytes;
+
+    // Scratch space for the radix sort
+    uint64_t* scratchKeys;
+    uint32_t* scratchIndices;
+};
+
+// Allocates using malloc()
+CommandBuffer allocCommandBuffer(uint32_t maxPackets, uint32_t instanceCapacityBytes);
+void freeCommandBuffer(CommandBuffer commands);
+void resetCommandBuffer(CommandBuffer* commands);
+
+// Records a draw packet and returns where to write its 'instanceStride'
+// bytes of instance data
+void* pushDrawPacket(CommandBuffer* commands, uint64_t sortKey, uint32_t instanceStride);
+
+// Sorts the packets by key (stable, so equal keys keep recording order)
+void sortCommandBuffer(CommandBuffer* commands);
+
+// Turns the (sorted) packets into instanced draws. Consecutive packets
+// with the same layer/pipeline/material/mesh become one draw, with
+// their instance data copied back to back in sorted order.
+// Overwrites 'drawList', which needs room for all the instance data.
+void buildInstancedDraws(const CommandBuffer* commands, InstancedDrawList* drawList);
+
+// Records a packet for every object in 'nodes' (indices into
+// 'worldMats', e.g. TransformHierarchy::worldMats), computing each
+// object's instance data from its world matrix and 'viewMat'. Lights
+// are untextured, so their packets have DRAW_NO_MATERIAL.
+void pushLightPackets(CommandBuffer* commands, uint32_t mesh, affine3x4 viewMat,
+                      const affine3x4* worldMats, const uint32_t* nodes, const float4* colors, uint32_t numNodes);
+void pushBlinnPhongPackets(CommandBuffer* commands, uint32_t material, uint32_t mesh, affine3x4 viewMat,
+                           const affine3x4* worldMats, const uint32_t* nodes, uint32_t numNodes);
+
+// LSD radix sort of 'count' 64-bit keys, carrying 'values' along.
+// Stable. Skips byte positions where every key has the same value.
+// 'scratchKeys'/'scratchValues' need room for 'count' entries; the
+// result always ends up back in 'keys'/'values'.
+void radixSortKeys(uint64_t* keys, uint32_t* values, uint64_t* scratchKeys, uint32_t* scratchValues, uint32_t count);
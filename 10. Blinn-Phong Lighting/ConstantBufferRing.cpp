@@ -0,0 +1,104 @@
+#include "ConstantBufferRing.h"
+#include "Threading.h"
+
+#include <assert.h>
+
+ConstantBufferRing createConstantBufferRing(ConstantRingDevice device, uint32_t sizeBytes)
+{
+    assert(sizeBytes > 0 && sizeBytes % CONSTANT_RING_ALIGNMENT == 0);
+    ConstantBufferRing result = {};
+    result.device = device;
+    result.sizeBytes = sizeBytes;
+    return result;
+}
+
+// Moves the tail past every frame the GPU has finished
+static void retireCompletedFrames(ConstantBufferRing* ring)
+{
+    while(ring->numFramesInFlight > 0 && ring->device.isFenceComplete(ring->device.userData, ring->oldestFrameSlot)){
+        ring->tail = ring->frameEnds[ring->oldestFrameSlot];
+        ring->oldestFrameSlot = (ring->oldestFrameSlot + 1) % CONSTANT_RING_MAX_FRAMES_IN_FLIGHT;
+        --ring->numFramesInFlight;
+    }
+}
+
+// Blocks until the oldest in-flight frame is finished
+static void waitForOldestFrame(ConstantBufferRing* ring)
+{
+    assert(ring->numFramesInFlight > 0);
+    ++ring->numFenceWaits;
+    while(!ring->device.isFenceComplete(ring->device.userData, ring->oldestFrameSlot))
+        yieldThread();
+    retireCompletedFrames(ring);
+}
+
+void beginConstantRingWrites(ConstantBufferRing* ring)
+{
+    assert(!ring->mapped);
+    retireCompletedFrames(ring);
+    // D3D11 needs a WRITE_DISCARD before the first WRITE_NO_OVERWRITE
+    ring->mapped = (uint8_t*)ring->device.map(ring->device.userData, !ring->hasBeenMapped);
+    ring->hasBeenMapped = true;
+    assert(ring->mapped);
+}
+
+ConstantAllocation allocConstants(ConstantBufferRing* ring, uint32_t sizeBytes)
+{
+    assert(ring->mapped);
+    ConstantAllocation result = {};
+    uint32_t alignedSize = (sizeBytes + CONSTANT_RING_ALIGNMENT - 1) & ~(CONSTANT_RING_ALIGNMENT - 1);
+    if(alignedSize == 0 || alignedSize > ring->sizeBytes)
+        return result;
+
+    // Allocations can't straddle the end of the buffer, so skip the
+    // rest of it and start again from the beginning
+    uint64_t head = ring->head;
+    uint32_t offset = (uint32_t)(head % ring->sizeBytes);
+    if(offset + alignedSize > ring->sizeBytes){
+        head += ring->sizeBytes - offset;
+        offset = 0;
+    }
+
+    // Wait until [head, head + alignedSize) doesn't overlap anything
+    // the GPU may still be reading
+    while(head + alignedSize - ring->tail > ring->sizeBytes)
+    {
+        retireCompletedFrames(ring);
+        if(head + alignedSize - ring->tail <= ring->sizeBytes)
+            break;
+        if(ring->numFramesInFlight == 0)
+            return result; // Only this frame's own allocations are in the way
+        waitForOldestFrame(ring);
+    }
+
+    if(head != ring->head)
+        ++ring->numWraps;
+    ring->head = head + alignedSize;
+
+    result.data = ring->mapped + offset;
+    result.offsetBytes = offset;
+    result.sizeBytes = alignedSize;
+    result.firstConstant = offset / 16;
+    result.numConstants = alignedSize / 16;
+    return result;
+}
+
+void endConstantRingWrites(ConstantBufferRing* ring)
+{
+    assert(ring->mapped);
+    ring->device.unmap(ring->device.userData);
+    ring->mapped = 0;
+}
+
+void endConstantRingFrame(ConstantBufferRing* ring)
+{
+    assert(!ring->mapped);
+    retireCompletedFrames(ring);
+    if(ring->numFramesInFlight == CONSTANT_RING_MAX_FRAMES_IN_FLIGHT)
+        waitForOldestFrame(ring);
+
+    uint32_t slot = (ring->oldestFrameSlot + ring->numFramesInFlight) % CONSTANT_RING_MAX_FRAMES_IN_FLIGHT;
+    ring->frameEnds[slot] = ring->head;
+    ++ring->numFramesInFlight;
+    ring->device.signalFence(ring->device.userData, slot);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+// Per-frame linear allocator over one large dynamic constant buffer.
+// Instead of Map(WRITE_DISCARD)ing a small dedicated buffer for every
+// update (each of which makes the driver rename the buffer), constants
+// for the whole frame are sub-allocated from a ring and bound with the
+// D3D11.1 offset APIs (VSSetConstantBuffers1/PSSetConstantBuffers1),
+// which need offsets and sizes in multiples of 256 bytes.
+//
+// The buffer is mapped once per frame with WRITE_NO_OVERWRITE, so the
+// CPU must never write a range the GPU may still be reading. Each frame
+// ends with a fence; when an allocation would run into a range used by
+// a frame whose fence hasn't completed yet, we wait for that fence.
+//
+// The device is accessed through callbacks, so the allocator (and its
+// wraparound and fencing) runs against a mock device without a GPU.
+//
+// Usage, each frame:
+//   beginConstantRingWrites(&ring);
+//   ConstantAllocation a = allocConstants(&ring, sizeof(MyConstants));
+//   ... write a.data, more allocations ...
+//   endConstantRingWrites(&ring);
+//   ... VSSetConstantBuffers1(slot, 1, &buffer, &a.firstConstant, &a.numConstants), draws ...
+//   endConstantRingFrame(&ring);
+
+const uint32_t CONSTANT_RING_ALIGNMENT = 256; // Bytes, = 16 constants of 16 bytes
+const uint32_t CONSTANT_RING_MAX_FRAMES_IN_FLIGHT = 4;
+
+struct ConstantRingDevice
+{
+    void* userData;
+    // Maps the whole buffer for writing. With 'discard' the previous
+    // contents may be thrown away (WRITE_DISCARD); otherwise they must be
+    // kept because the GPU may still be reading them (WRITE_NO_OVERWRITE).
+    void* (*map)(void* userData, bool discard);
+    void (*unmap)(void* userData);
+    // Fences are identified by a slot in [0, CONSTANT_RING_MAX_FRAMES_IN_FLIGHT).
+    // signalFence() marks the end of the GPU work submitted so far;
+    // isFenceComplete() returns true once the GPU has finished it.
+    void (*signalFence)(void* userData, uint32_t fenceSlot);
+    bool (*isFenceComplete)(void* userData, uint32_t fenceSlot);
+};
+
+struct ConstantAllocation
+{
+    void* data;             // NULL if the allocation failed
+    uint32_t offsetBytes;
+    uint32_t sizeBytes;     // Rounded up to CONSTANT_RING_ALIGNMENT
+    // For VSSetConstantBuffers1()/PSSetConstantBuffers1(), in 16-byte constants
+    uint32_t firstConstant;
+    uint32_t numConstants;
+};
+
+struct ConstantBufferRing
+{
+    ConstantRingDevice device;
+    uint32_t sizeBytes;
+
+    // Positions count bytes handed out since creation; the offset in
+    // the buffer is position % sizeBytes
+    uint64_t head;  // Next free byte
+    uint64_t tail;  // The GPU has finished with everything before this
+
+    // In-flight frames, oldest first, as a ring of fence slots
+    uint64_t frameEnds[CONSTANT_RING_MAX_FRAMES_IN_FLIGHT];
+    uint32_t oldestFrameSlot;
+    uint32_t numFramesInFlight;
+
+    uint8_t* mapped; // Non-NULL between begin/endConstantRingWrites()
+    bool hasBeenMapped;
+
+    // Stats
+    uint64_t numWraps;
+    uint64_t numFenceWaits;
+};
+
+// 'sizeBytes' must be a multiple of CONSTANT_RING_ALIGNMENT
+ConstantBufferRing createConstantBufferRing(ConstantRingDevice device, uint32_t sizeBytes);
+void beginConstantRingWrites(ConstantBufferRing* ring);
+// May wait for the GPU if the ring is full. Returns data == NULL if
+// 'sizeBytes' can't fit even with the GPU idle (the ring is too small
+// for this frame).
+ConstantAllocation allocConstants(ConstantBufferRing* ring, uint32_t sizeBytes);
+void endConstantRingWrites(ConstantBufferRing* ring);
+// Call after submitting the frame's draws, fences this frame's allocations
+void endConstantRingFrame(ConstantBufferRing* ring);
@@ -0,0 +1,142 @@
+#include "Culling.h"
+#include "SimdMaths.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static uint32_t countTrailingZeros(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+Frustum makeFrustum(float4x4 viewProj)
+{
+    // Clip-space position of row vector v is v * viewProj, so each clip
+    // coordinate is dot(v, column). A point is inside when
+    // -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+    // With reverse-Z the last two planes swap roles (near <-> far) but
+    // are the same planes, so this works for every DepthMode.
+    float4 x = viewProj.cols[0];
+    float4 y = viewProj.cols[1];
+    float4 z = viewProj.cols[2];
+    float4 w = viewProj.cols[3];
+
+    Frustum result;
+    result.planes[0] = {w.x + x.x, w.y + x.y, w.z + x.z, w.w + x.w};
+    result.planes[1] = {w.x - x.x, w.y - x.y, w.z - x.z, w.w - x.w};
+    result.planes[2] = {w.x + y.x, w.y + y.y, w.z + y.z, w.w + y.w};
+    result.planes[3] = {w.x - y.x, w.y - y.y, w.z - y.z, w.w - y.w};
+    result.planes[4] = z;
+    result.planes[5] = {w.x - z.x, w.y - z.y, w.z - z.z, w.w - z.w};
+
+    for(int i=0; i<6; ++i){
+        float planeLength = length(result.planes[i].xyz);
+        // An infinite far plane comes out as (0, 0, 0, zNear): nothing is
+        // ever behind it, so make it a plane that always passes
+        if(planeLength > 0.f)
+            result.planes[i] = result.planes[i] * (1.f / planeLength);
+        else
+            result.planes[i] = {0, 0, 0, 1};
+    }
+    return result;
+}
+
+// Appends base + i for every set bit i of 'visibleBits'
+static uint32_t appendVisibleIndices(uint32_t visibleBits, uint32_t base, uint32_t* out)
+{
+    uint32_t numVisible = 0;
+    while(visibleBits){
+        out[numVisible++] = base + countTrailingZeros(visibleBits);
+        visibleBits &= visibleBits - 1;
+    }
+    return numVisible;
+}
+
+uint32_t cullSpheres(const Frustum* frustum, 
+                     const float* centerX, const float* centerY, const float* centerZ, const float* radius, 
+                     uint32_t count, uint32_t* outVisibleIndices)
+{
+    wfloat planes[6][4];
+    for(int p=0; p<6; ++p){
+        planes[p][0] = wfloatSet1(frustum->planes[p].x);
+        planes[p][1] = wfloatSet1(frustum->planes[p].y);
+        planes[p][2] = wfloatSet1(frustum->planes[p].z);
+        planes[p][3] = wfloatSet1(frustum->planes[p].w);
+    }
+
+    uint32_t numVisible = 0;
+    for(uint32_t base=0; base<count; base+=WFLOAT_WIDTH)
+    {
+        uint32_t remaining = count - base;
+        int n = (remaining < WFLOAT_WIDTH) ? (int)remaining : WFLOAT_WIDTH;
+
+        wfloat x = wfloatLoadPartial(centerX + base, n, 0.f);
+        wfloat y = wfloatLoadPartial(centerY + base, n, 0.f);
+        wfloat z = wfloatLoadPartial(centerZ + base, n, 0.f);
+        wfloat negRadius = -wfloatLoadPartial(radius + base, n, 0.f);
+
+        // Outside if entirely behind any plane
+        wfloat outside = wfloatSet1(0.f);
+        for(int p=0; p<6; ++p){
+            wfloat dist = wfloatMulAdd(planes[p][2], z, wfloatMulAdd(planes[p][1], y, wfloatMulAdd(planes[p][0], x, planes[p][3])));
+            outside = wfloatOr(outside, wfloatLess(dist, negRadius));
+        }
+
+        uint32_t laneBits = (1u << n) - 1;
+        uint32_t visibleBits = ~(uint32_t)wfloatMoveMask(outside) & laneBits;
+        numVisible += appendVisibleIndices(visibleBits, base, outVisibleIndices + numVisible);
+    }
+    return numVisible;
+}
+
+uint32_t cullAabbs(const Frustum* frustum, 
+                   const float* centerX, const float* centerY, const float* centerZ, 
+                   const float* extentX, const float* extentY, const float* extentZ, 
+                   uint32_t count, uint32_t* outVisibleIndices)
+{
+    wfloat planes[6][4];
+    wfloat absPlanes[6][3];
+    for(int p=0; p<6; ++p){
+        planes[p][0] = wfloatSet1(frustum->planes[p].x);
+        planes[p][1] = wfloatSet1(frustum->planes[p].y);
+        planes[p][2] = wfloatSet1(frustum->planes[p].z);
+        planes[p][3] = wfloatSet1(frustum->planes[p].w);
+        absPlanes[p][0] = wfloatSet1(fabsf(frustum->planes[p].x));
+        absPlanes[p][1] = wfloatSet1(fabsf(frustum->planes[p].y));
+        absPlanes[p][2] = wfloatSet1(fabsf(frustum->planes[p].z));
+    }
+
+    uint32_t numVisible = 0;
+    for(uint32_t base=0; base<count; base+=WFLOAT_WIDTH)
+    {
+        uint32_t remaining = count - base;
+        int n = (remaining < WFLOAT_WIDTH) ? (int)remaining : WFLOAT_WIDTH;
+
+        wfloat x = wfloatLoadPartial(centerX + base, n, 0.f);
+        wfloat y = wfloatLoadPartial(centerY + base, n, 0.f);
+        wfloat z = wfloatLoadPartial(centerZ + base, n, 0.f);
+        wfloat ex = wfloatLoadPartial(extentX + base, n, 0.f);
+        wfloat ey = wfloatLoadPartial(extentY + base, n, 0.f);
+        wfloat ez = wfloatLoadPartial(extentZ + base, n, 0.f);
+
+        // The box reaches |n.x|*ex + |n.y|*ey + |n.z|*ez towards each plane
+        wfloat outside = wfloatSet1(0.f);
+        for(int p=0; p<6; ++p){
+            wfloat dist = wfloatMulAdd(planes[p][2], z, wfloatMulAdd(planes[p][1], y, wfloatMulAdd(planes[p][0], x, planes[p][3])));
+            wfloat reach = wfloatMulAdd(absPlanes[p][2], ez, wfloatMulAdd(absPlanes[p][1], ey, absPlanes[p][0] * ex));
+            outside = wfloatOr(outside, wfloatLess(dist + reach, wfloatSet1(0.f)));
+        }
+
+        uint32_t laneBits = (1u << n) - 1;
+        uint32_t visibleBits = ~(uint32_t)wfloatMoveMask(outside) & laneBits;
+        numVisible += appendVisibleIndices(visibleBits, base, outVisibleIndices + numVisible);
+    }
+    return numVisible;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include "3DMaths.h"
+
+// View-frustum culling of bounding volumes, a full SIMD register of
+// objects (8 with AVX, 4 with SSE2) per iteration.
+
+// Planes are stored as (normal.xyz, distance), normalised so that
+// dot(plane.xyz, p) + plane.w is the signed distance of point p from
+// the plane, positive on the inside
+struct Frustum
+{
+    float4 planes[6]; // left, right, bottom, top, near, far (near/far swap with reverse-Z)
+};
+
+// Extracts the frustum planes from a combined view * projection matrix
+// (e.g. viewMat * makePerspectiveMat(...)), using D3D's [0,1] clip depth.
+// Handles standard, reverse-Z and infinite reverse-Z projections.
+// The planes are in whichever space the matrix transforms from, so pass
+// view * proj for world-space planes or proj alone for view-space planes.
+Frustum makeFrustum(float4x4 viewProj);
+
+// Tests 'count' bounding spheres against 'frustum'. The indices of the
+// spheres which are at least partially inside are written to
+// 'outVisibleIndices' in ascending order (so it needs room for 'count'
+// entries). Returns the number of visible spheres.
+uint32_t cullSpheres(const Frustum* frustum, 
+                     const float* centerX, const float* centerY, const float* centerZ, const float* radius, 
+                     uint32_t count, uint32_t* outVisibleIndices);
+
+// Same as cullSpheres() for axis-aligned bounding boxes given as
+// center and half-extents
+uint32_t cullAabbs(const Frustum* frustum, 
+                   const float* centerX, const float* centerY, const float* centerZ, 
+                   const float* extentX, const float* extentY, const float* extentZ, 
+                   uint32_t count, uint32_t* outVisibleIndices);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+// Decouples the simulation rate from the frame rate. Each frame adds
+// its real duration to an accumulator and the simulation takes as many
+// fixed steps as fit, so it advances at the same rate whether frames
+// are slow, fast or uneven. The time left over (less than one step) is
+// used to interpolate between the last two simulation states.
+//
+// Usage:
+//   uint32_t numSteps = advanceFixedTimestep(&timestep, frameSeconds);
+//   for(uint32_t i=0; i<numSteps; ++i){
+//       previousState = currentState;
+//       simulate(&currentState, timestep.stepSeconds);
+//   }
+//   render(interpolate(previousState, currentState, fixedTimestepAlpha(&timestep)));
+struct FixedTimestep
+{
+    double stepSeconds;
+    // Cap on steps per frame. After a long hitch the simulation would
+    // otherwise need more steps than it can run in a frame and fall
+    // further and further behind; instead time beyond the cap is dropped.
+    uint32_t maxStepsPerFrame;
+
+    double accumulator;
+    uint64_t numSteps;        // Total steps taken
+    double droppedSeconds;    // Total time dropped because of the cap
+};
+
+inline FixedTimestep makeFixedTimestep(double stepSeconds, uint32_t maxStepsPerFrame)
+{
+    FixedTimestep result = {};
+    result.stepSeconds = stepSeconds;
+    result.maxStepsPerFrame = maxStepsPerFrame;
+    return result;
+}
+
+// Adds 'frameSeconds' of real time, returns how many steps to simulate
+inline uint32_t advanceFixedTimestep(FixedTimestep* timestep, double frameSeconds)
+{
+    if(frameSeconds > 0)
+        timestep->accumulator += frameSeconds;
+
+    uint32_t numSteps = 0;
+    while(timestep->accumulator >= timestep->stepSeconds && numSteps < timestep->maxStepsPerFrame){
+        timestep->accumulator -= timestep->stepSeconds;
+        ++numSteps;
+    }
+    if(timestep->accumulator >= timestep->stepSeconds){
+        // Keep the fraction of a step so interpolation stays smooth
+        double excessSteps = (double)(uint64_t)(timestep->accumulator / timestep->stepSeconds);
+        timestep->droppedSeconds += excessSteps * timestep->stepSeconds;
+        timestep->accumulator -= excessSteps * timestep->stepSeconds;
+    }
+    timestep->numSteps += numSteps;
+    return numSteps;
+}
+
+// How far the current time is between the last two simulation states,
+// in [0, 1)
+inline float fixedTimestepAlpha(const FixedTimestep* timestep)
+{
+    return (float)(timestep->accumulator / timestep->stepSeconds);
+}
@@ -0,0 +1,323 @@
+#include "FormatConversion.h"
+#include "3DMaths.h" // For the MATHS_SIMD_* selection
+
+#include <string.h>
+
+static float floatFromBits(uint32_t bits) { float f; memcpy(&f, &bits, sizeof(f)); return f; }
+static uint32_t floatToBits(float f) { uint32_t bits; memcpy(&bits, &f, sizeof(bits)); return bits; }
+
+// Checked on the bits because /fp:fast doesn't guarantee NaN comparisons
+static bool isNan(float f) { return (floatToBits(f) & 0x7fffffff) > 0x7f800000; }
+
+// Half conversions use the bit tricks from Fabian Giesen's "float->half
+// variants" (round to nearest even, handles denormals, inf and NaN).
+
+uint16_t floatToHalf(float f)
+{
+    const uint32_t f32Infinity = 255 << 23;
+    const uint32_t f16Max = (127 + 16) << 23;           // Everything from here up is inf in fp16
+    const uint32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+    const uint32_t minNormal = (127 - 14) << 23;         // Smallest float that's a normal fp16
+
+    uint32_t bits = floatToBits(f);
+    uint32_t sign = bits & 0x80000000;
+    bits ^= sign;
+
+    uint32_t result;
+    if(bits >= f16Max){
+        result = (bits > f32Infinity) ? 0x7e00 : 0x7c00; // NaN stays NaN, the rest is inf
+    }
+    else if(bits < minNormal){
+        // Denormal (or zero) fp16: adding the magic number lines the fp16
+        // mantissa up with the float's and lets the FPU do the rounding
+        result = floatToBits(floatFromBits(bits) + floatFromBits(denormMagic)) - denormMagic;
+    }
+    else{
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        // Rebias the exponent and round; the carry handles mantissa overflow
+        bits += ((uint32_t)(15 - 127) << 23) + 0xfff;
+        bits += mantissaOdd;
+        result = bits >> 13;
+    }
+    return (uint16_t)(result | (sign >> 16));
+}
+
+float halfToFloat(uint16_t h)
+{
+    const float magic = floatFromBits((254 - 15) << 23);
+    const float wasInfNan = floatFromBits((127 + 16) << 23);
+
+    // Shift exponent and mantissa into place, then rescale the exponent
+    // with a multiply, which also normalises fp16 denormals
+    float result = floatFromBits((uint32_t)(h & 0x7fff) << 13) * magic;
+    uint32_t bits = floatToBits(result);
+    if(result >= wasInfNan)
+        bits |= 255 << 23;
+    bits |= (uint32_t)(h & 0x8000) << 16;
+    return floatFromBits(bits);
+}
+
+static float clampToUnorm(float f)
+{
+    if(isNan(f) || f < 0.f)
+        return 0.f;
+    return (f < 1.f) ? f : 1.f;
+}
+
+static float clampToSnorm(float f)
+{
+    if(isNan(f))
+        return 0.f;
+    if(f < -1.f)
+        return -1.f;
+    return (f < 1.f) ? f : 1.f;
+}
+
+#if defined(MATHS_SIMD_SSE2)
+
+#if !defined(MATHS_SIMD_F16C)
+// 4 floats to 4 halfs in the low 16 bits of each lane, sign-extended so
+// that _mm_packs_epi32() narrows them without saturating
+static __m128i floatToHalfSSE2(__m128 f)
+{
+    __m128i f16Max = _mm_set1_epi32((127 + 16) << 23);
+    __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+    __m128i denormMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+    __m128 sign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000)));
+    __m128 absF = _mm_xor_ps(f, sign);
+    __m128i absBits = _mm_castps_si128(absF);
+
+    __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absF, absF));
+    __m128i isRegular = _mm_cmpgt_epi32(f16Max, absBits);
+    __m128i isDenormal = _mm_cmpgt_epi32(minNormal, absBits);
+    __m128i infOrNan = _mm_or_si128(_mm_and_si128(isNan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+    __m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(denormMagic))), denormMagic);
+
+    __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31); // -1 if odd
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absBits, normalBias), mantissaOdd), 13);
+
+    __m128i finite = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+    __m128i result = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infOrNan));
+    return _mm_or_si128(result, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+// 4 halfs (low 16 bits of each lane, upper bits zero) to 4 floats
+static __m128 halfToFloatSSE2(__m128i h)
+{
+    __m128i expMantissa = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMantissa), 16);
+    __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMantissa, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+    __m128i wasInfNan = _mm_cmpgt_epi32(expMantissa, _mm_set1_epi32(0x7bff));
+    __m128 infNanExponent = _mm_and_ps(_mm_castsi128_ps(wasInfNan), _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+    return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infNanExponent));
+}
+#endif
+
+// Clamp to [0,1], scale and round. _mm_max_ps returns its second
+// operand when either is NaN, so NaN lanes become 0 here.
+static __m128i floatToUnormSSE2(__m128 f, __m128 scale)
+{
+    f = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    return _mm_cvtps_epi32(_mm_mul_ps(f, scale));
+}
+
+// Clamp to [-1,1], scale and round. NaN lanes are zeroed first,
+// clamping alone would turn them into -1.
+static __m128i floatToSnormSSE2(__m128 f, __m128 scale)
+{
+    f = _mm_and_ps(f, _mm_cmpord_ps(f, f));
+    f = _mm_min_ps(_mm_max_ps(f, _mm_set1_ps(-1.f)), _mm_set1_ps(1.f));
+    return _mm_cvtps_epi32(_mm_mul_ps(f, scale));
+}
+
+#endif
+
+void floatToHalfArray(const float* in, uint16_t* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_F16C)
+    for(; i + 8 <= count; i += 8)
+        _mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+#elif defined(MATHS_SIMD_SSE2)
+    for(; i + 8 <= count; i += 8){
+        __m128i lo = floatToHalfSSE2(_mm_loadu_ps(in + i));
+        __m128i hi = floatToHalfSSE2(_mm_loadu_ps(in + i + 4));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for(; i < count; ++i)
+        out[i] = floatToHalf(in[i]);
+}
+
+void halfToFloatArray(const uint16_t* in, float* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_F16C)
+    for(; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+#elif defined(MATHS_SIMD_SSE2)
+    for(; i + 8 <= count; i += 8){
+        __m128i h = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm_storeu_ps(out + i, halfToFloatSSE2(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+        _mm_storeu_ps(out + i + 4, halfToFloatSSE2(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+    }
+#endif
+    for(; i < count; ++i)
+        out[i] = halfToFloat(in[i]);
+}
+
+void floatToUnorm8Array(const float* in, uint8_t* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_SSE2)
+    __m128 scale = _mm_set1_ps(255.f);
+    for(; i + 16 <= count; i += 16){
+        __m128i a = floatToUnormSSE2(_mm_loadu_ps(in + i), scale);
+        __m128i b = floatToUnormSSE2(_mm_loadu_ps(in + i + 4), scale);
+        __m128i c = floatToUnormSSE2(_mm_loadu_ps(in + i + 8), scale);
+        __m128i d = floatToUnormSSE2(_mm_loadu_ps(in + i + 12), scale);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+#endif
+    for(; i < count; ++i)
+        out[i] = (uint8_t)lrintf(clampToUnorm(in[i]) * 255.f);
+}
+
+void unorm8ToFloatArray(const uint8_t* in, float* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_SSE2)
+    __m128 scale = _mm_set1_ps(255.f);
+    __m128i zero = _mm_setzero_si128();
+    for(; i + 16 <= count; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_ps(out + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+        _mm_storeu_ps(out + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+        _mm_storeu_ps(out + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+        _mm_storeu_ps(out + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+    }
+#endif
+    for(; i < count; ++i)
+        out[i] = (float)in[i] / 255.f;
+}
+
+void floatToUnorm16Array(const float* in, uint16_t* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_SSE2)
+    // SSE2 only has a signed 32->16 pack, so pack v - 32768 and flip the
+    // top bit back afterwards
+    __m128 scale = _mm_set1_ps(65535.f);
+    __m128i bias = _mm_set1_epi32(32768);
+    __m128i topBit = _mm_set1_epi16(-32768);
+    for(; i + 8 <= count; i += 8){
+        __m128i lo = _mm_sub_epi32(floatToUnormSSE2(_mm_loadu_ps(in + i), scale), bias);
+        __m128i hi = _mm_sub_epi32(floatToUnormSSE2(_mm_loadu_ps(in + i + 4), scale), bias);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(_mm_packs_epi32(lo, hi), topBit));
+    }
+#endif
+    for(; i < count; ++i)
+        out[i] = (uint16_t)lrintf(clampToUnorm(in[i]) * 65535.f);
+}
+
+void unorm16ToFloatArray(const uint16_t* in, float* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_SSE2)
+    __m128 scale = _mm_set1_ps(65535.f);
+    __m128i zero = _mm_setzero_si128();
+    for(; i + 8 <= count; i += 8){
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm_storeu_ps(out + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+        _mm_storeu_ps(out + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+    }
+#endif
+    for(; i < count; ++i)
+        out[i] = (float)in[i] / 65535.f;
+}
+
+void floatToSnorm8Array(const float* in, int8_t* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_SSE2)
+    __m128 scale = _mm_set1_ps(127.f);
+    for(; i + 16 <= count; i += 16){
+        __m128i a = floatToSnormSSE2(_mm_loadu_ps(in + i), scale);
+        __m128i b = floatToSnormSSE2(_mm_loadu_ps(in + i + 4), scale);
+        __m128i c = floatToSnormSSE2(_mm_loadu_ps(in + i + 8), scale);
+        __m128i d = floatToSnormSSE2(_mm_loadu_ps(in + i + 12), scale);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+#endif
+    for(; i < count; ++i)
+        out[i] = (int8_t)lrintf(clampToSnorm(in[i]) * 127.f);
+}
+
+void snorm8ToFloatArray(const int8_t* in, float* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_SSE2)
+    // -128 and -127 both decode to -1
+    __m128 scale = _mm_set1_ps(127.f);
+    __m128 minusOne = _mm_set1_ps(-1.f);
+    for(; i + 16 <= count; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        // Sign-extend by unpacking each value into the top half of a
+        // wider lane and shifting it back down arithmetically
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+        __m128i v32[4] = {
+            _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16),
+            _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16),
+            _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16),
+            _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)
+        };
+        for(int j=0; j<4; ++j)
+            _mm_storeu_ps(out + i + 4*j, _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(v32[j]), scale), minusOne));
+    }
+#endif
+    for(; i < count; ++i){
+        float f = (float)in[i] / 127.f;
+        out[i] = (f < -1.f) ? -1.f : f;
+    }
+}
+
+void floatToSnorm16Array(const float* in, int16_t* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_SSE2)
+    __m128 scale = _mm_set1_ps(32767.f);
+    for(; i + 8 <= count; i += 8){
+        __m128i lo = floatToSnormSSE2(_mm_loadu_ps(in + i), scale);
+        __m128i hi = floatToSnormSSE2(_mm_loadu_ps(in + i + 4), scale);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for(; i < count; ++i)
+        out[i] = (int16_t)lrintf(clampToSnorm(in[i]) * 32767.f);
+}
+
+void snorm16ToFloatArray(const int16_t* in, float* out, size_t count)
+{
+    size_t i = 0;
+#if defined(MATHS_SIMD_SSE2)
+    __m128 scale = _mm_set1_ps(32767.f);
+    __m128 minusOne = _mm_set1_ps(-1.f);
+    for(; i + 8 <= count; i += 8){
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(lo), scale), minusOne));
+        _mm_storeu_ps(out + i + 4, _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(hi), scale), minusOne));
+    }
+#endif
+    for(; i < count; ++i){
+        float f = (float)in[i] / 32767.f;
+        out[i] = (f < -1.f) ? -1.f : f;
+    }
+}
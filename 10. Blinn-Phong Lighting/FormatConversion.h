@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Conversions between float and the compact formats used for vertex,
+// texture and constant data. The bulk versions use F16C for halfs when
+// it's enabled (see 3DMaths.h) and SSE2 otherwise, and all of them give
+// the same results as the scalar versions.
+//
+// Rounding follows the D3D conversion rules:
+//   float -> half:       round to nearest even, overflow -> inf, NaN -> NaN
+//   float -> unorm/snorm: NaN -> 0, clamp to [0,1] / [-1,1], scale by
+//                         2^n-1 / 2^(n-1)-1, round to nearest even
+//   unorm/snorm -> float: v / (2^n-1) or max(v / (2^(n-1)-1), -1),
+//                         correctly rounded
+
+uint16_t floatToHalf(float f);
+float halfToFloat(uint16_t h);
+
+void floatToHalfArray(const float* in, uint16_t* out, size_t count);
+void halfToFloatArray(const uint16_t* in, float* out, size_t count);
+
+void floatToUnorm8Array(const float* in, uint8_t* out, size_t count);
+void unorm8ToFloatArray(const uint8_t* in, float* out, size_t count);
+void floatToUnorm16Array(const float* in, uint16_t* out, size_t count);
+void unorm16ToFloatArray(const uint16_t* in, float* out, size_t count);
+
+void floatToSnorm8Array(const float* in, int8_t* out, size_t count);
+void snorm8ToFloatArray(const int8_t* in, float* out, size_t count);
+void floatToSnorm16Array(const float* in, int16_t* out, size_t count);
+void snorm16ToFloatArray(const int16_t* in, float* out, size_t count);
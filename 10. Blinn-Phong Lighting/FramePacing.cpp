@@ -0,0 +1,164 @@
+#include "FramePacing.h"
+
+#include <assert.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <mmsystem.h> // timeBeginPeriod()
+#pragma comment(lib, "winmm.lib")
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <time.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAME_PACING_SPIN_PAUSE() _mm_pause()
+#else
+#define FRAME_PACING_SPIN_PAUSE() ((void)0)
+#endif
+
+// Bounds for the adaptive spin tail
+static const double MIN_SPIN_SECONDS = 0.00005;
+static const double MAX_SPIN_SECONDS = 0.004;
+
+FramePacer createFramePacer(const Clock* clock, double targetFrameSeconds)
+{
+    FramePacer result = {};
+    result.clock = clock;
+    result.adaptiveSpin = true;
+#if defined(_WIN32)
+    // High-resolution timers need Windows 10 1803. Without one, Sleep()
+    // is only as precise as the system timer, which we raise to 1ms.
+    result.sleepTimer = CreateWaitableTimerExW(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if(!result.sleepTimer)
+        timeBeginPeriod(1);
+    result.spinSeconds = result.sleepTimer ? 0.001 : 0.002;
+#else
+    result.spinSeconds = 0.00025;
+#endif
+    result.previousFrameTicks = readClockTicks(clock);
+    setFramePacerTarget(&result, targetFrameSeconds);
+    return result;
+}
+
+void destroyFramePacer(FramePacer* pacer)
+{
+#if defined(_WIN32)
+    if(pacer->sleepTimer)
+        CloseHandle((HANDLE)pacer->sleepTimer);
+    else
+        timeEndPeriod(1);
+#endif
+    pacer->sleepTimer = 0;
+}
+
+void setFramePacerTarget(FramePacer* pacer, double targetFrameSeconds)
+{
+    pacer->targetFrameSeconds = targetFrameSeconds;
+    // Restart the schedule from the last frame
+    uint64_t targetTicks = targetFrameSeconds > 0 ? (uint64_t)(targetFrameSeconds * (double)pacer->clock->ticksPerSecond) : 0;
+    pacer->nextDeadlineTicks = pacer->previousFrameTicks + targetTicks;
+}
+
+void resetFramePacerStats(FramePacer* pacer)
+{
+    pacer->numFrames = 0;
+    pacer->numLateFrames = 0;
+    pacer->sumAbsErrorSeconds = 0;
+    pacer->maxErrorSeconds = 0;
+}
+
+void framePacerSleep(FramePacer* pacer, double seconds)
+{
+    if(seconds <= 0)
+        return;
+#if defined(_WIN32)
+    if(pacer->sleepTimer)
+    {
+        LARGE_INTEGER dueTime;
+        dueTime.QuadPart = -(LONGLONG)(seconds * 10000000.0); // Negative = relative, in 100ns units
+        if(SetWaitableTimer((HANDLE)pacer->sleepTimer, &dueTime, 0, 0, 0, FALSE)){
+            WaitForSingleObject((HANDLE)pacer->sleepTimer, INFINITE);
+            return;
+        }
+    }
+    DWORD ms = (DWORD)(seconds * 1000.0);
+    if(ms > 0)
+        Sleep(ms);
+#else
+    (void)pacer;
+    timespec duration;
+    duration.tv_sec = (time_t)seconds;
+    duration.tv_nsec = (long)((seconds - (double)duration.tv_sec) * 1e9);
+    nanosleep(&duration, 0);
+#endif
+}
+
+double waitForNextFrame(FramePacer* pacer)
+{
+    const Clock* clock = pacer->clock;
+    double ticksPerSecond = (double)clock->ticksPerSecond;
+    uint64_t now = readClockTicks(clock);
+
+    if(pacer->targetFrameSeconds <= 0){
+        pacer->previousFrameTicks = now;
+        pacer->nextDeadlineTicks = now;
+        return 0;
+    }
+
+    uint64_t deadline = pacer->nextDeadlineTicks;
+    bool isLate = now > deadline;
+    if(!isLate)
+    {
+        double remainingSeconds = (double)(deadline - now) / ticksPerSecond;
+        double sleepSeconds = remainingSeconds - pacer->spinSeconds;
+        if(sleepSeconds > 0)
+        {
+            framePacerSleep(pacer, sleepSeconds);
+            uint64_t wakeTicks = readClockTicks(clock);
+            if(pacer->adaptiveSpin)
+            {
+                // Grow the tail quickly when a sleep overshoots by more
+                // than we budgeted for and shrink it slowly. Not all the
+                // way at once, so one preemption doesn't leave us
+                // spinning for milliseconds on every frame after it.
+                double oversleepSeconds = (double)(wakeTicks - now) / ticksPerSecond - sleepSeconds;
+                double neededSpin = 1.5 * oversleepSeconds + MIN_SPIN_SECONDS;
+                if(neededSpin > MAX_SPIN_SECONDS)
+                    neededSpin = MAX_SPIN_SECONDS;
+                double rate = neededSpin > pacer->spinSeconds ? 0.25 : 0.02;
+                pacer->spinSeconds += rate * (neededSpin - pacer->spinSeconds);
+                if(pacer->spinSeconds < MIN_SPIN_SECONDS)
+                    pacer->spinSeconds = MIN_SPIN_SECONDS;
+                if(pacer->spinSeconds > MAX_SPIN_SECONDS)
+                    pacer->spinSeconds = MAX_SPIN_SECONDS;
+            }
+        }
+        while(readClockTicks(clock) < deadline)
+            FRAME_PACING_SPIN_PAUSE();
+    }
+
+    uint64_t frameEnd = readClockTicks(clock);
+    double errorSeconds = (double)(frameEnd - pacer->previousFrameTicks) / ticksPerSecond - pacer->targetFrameSeconds;
+    pacer->previousFrameTicks = frameEnd;
+
+    ++pacer->numFrames;
+    if(isLate)
+        ++pacer->numLateFrames;
+    pacer->sumAbsErrorSeconds += errorSeconds < 0 ? -errorSeconds : errorSeconds;
+    if(errorSeconds > pacer->maxErrorSeconds)
+        pacer->maxErrorSeconds = errorSeconds;
+
+    // Schedule from the deadline, not from frameEnd, so we don't drift.
+    // If we've fallen more than a frame behind, start over from now.
+    uint64_t targetTicks = (uint64_t)(pacer->targetFrameSeconds * ticksPerSecond);
+    pacer->nextDeadlineTicks = deadline + targetTicks;
+    if(frameEnd > pacer->nextDeadlineTicks)
+        pacer->nextDeadlineTicks = frameEnd + targetTicks;
+    return errorSeconds;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include "Timing.h"
+
+// Frame limiter for when vsync is off or there's no display at all.
+// Spinning until the deadline is precise but burns a core, and OS
+// sleeps alone are cheap but can overshoot by a millisecond or more.
+// So we sleep until shortly before the deadline, then spin the
+// remaining "tail". The tail length adapts to how late the OS sleeps
+// have actually been waking us up.
+//
+// Deadlines advance by exactly one target frame time each frame rather
+// than being measured from when the wait finished, so small errors
+// don't accumulate into drift. After a hitch longer than a frame the
+// schedule is reset instead of rushing out frames to catch up.
+//
+// Usage, once per frame:
+//   double errorSeconds = waitForNextFrame(&pacer);
+
+struct FramePacer
+{
+    const Clock* clock;
+    double targetFrameSeconds;  // <= 0 to disable limiting
+    double spinSeconds;         // Spin tail before each deadline
+    bool adaptiveSpin;          // Adjust spinSeconds from observed oversleep
+    uint64_t nextDeadlineTicks;
+    uint64_t previousFrameTicks;
+    void* sleepTimer;           // High-resolution waitable timer on Windows
+
+    // Error between target and actual frame time (actual - target),
+    // since creation or resetFramePacerStats()
+    uint64_t numFrames;
+    uint64_t numLateFrames;     // Frames that finished after their deadline
+    double sumAbsErrorSeconds;
+    double maxErrorSeconds;
+};
+
+// 'clock' must outlive the pacer
+FramePacer createFramePacer(const Clock* clock, double targetFrameSeconds);
+void destroyFramePacer(FramePacer* pacer);
+// Takes effect from the next frame
+void setFramePacerTarget(FramePacer* pacer, double targetFrameSeconds);
+void resetFramePacerStats(FramePacer* pacer);
+
+// Blocks until the current frame's deadline, then schedules the next.
+// Returns the error between this frame's time and the target, in seconds.
+double waitForNextFrame(FramePacer* pacer);
+
+// Puts the thread to sleep for about 'seconds' using the pacer's
+// high-resolution timer where available. May oversleep.
+void framePacerSleep(FramePacer* pacer, double seconds);
@@ -0,0 +1,381 @@
+#include "FrameRenderer.h"
+#include "ObjLoading.h"
+#include "Culling.h"
+#include "LightClustering.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <assert.h>
+#include <stddef.h> // offsetof()
+#include <stdio.h>  // snprintf()
+#include <stdlib.h> // free()
+#include <string.h> // memcpy()
+
+const uint32_t INSTANCE_BUFFER_BYTES = 64 * 1024;
+const uint32_t MAX_DRAW_PACKETS = 1024;
+const uint32_t MAX_DRAWS = 64;
+
+// With fewer lights than this, one cluster holding every light in view
+// is as cheap to shade and costs next to nothing to build, so that's
+// what FrameLightClusteringAuto picks. The grid is 16:9 tiles, slices
+// spread over where the scene's lights can be.
+const uint32_t CLUSTERED_MIN_LIGHTS = 16;
+const uint32_t CLUSTER_GRID_TILES_X = 16;
+const uint32_t CLUSTER_GRID_TILES_Y = 9;
+const uint32_t CLUSTER_GRID_SLICES = 24;
+const float CLUSTER_NEAR_Z = 0.5f;
+const float CLUSTER_FAR_Z = 100.f;
+// Light indices are addressed by 16-bit offsets
+const uint32_t MAX_CLUSTER_LIGHT_INDICES = 32768;
+// Far enough that the fade out barely touches the lit cubes
+const float POINT_LIGHT_RADIUS = 20.f;
+
+static_assert(SCENE_NUM_LIGHTS <= 65536, "Light indices are uint16s");
+
+const uint32_t CUBE_MESH = 0;
+const uint32_t TEST_TEXTURE_MATERIAL = 1;
+
+// Constants shared by our light and Blinn-Phong vertex shaders.
+// Everything per-object comes from the instance buffer.
+struct FrameVSConstants
+{
+    float4x4 projection;
+};
+
+struct DirectionalLight
+{
+    float4 dirEye; //NOTE: Direction towards the light
+    float4 color;
+};
+
+struct PointLight
+{
+    float4 posEye; // w: radius
+    float4 color;
+};
+
+// Constants for our Blinn-Phong pixel shader. The point lights, each
+// cluster's offset | count << 16 and the clusters' uint16 light indices
+// go in raw buffers 1-3, read up to the counts here.
+struct BlinnPhongPSConstants
+{
+    DirectionalLight dirLight;
+    // See ClusterGrid
+    float4 clusterProjX, clusterProjY, clusterProjW;
+    float4 clusterDims;    // tilesX, tilesY, numSlices
+    float4 clusterSlicing; // sliceScale, sliceBias
+    uint32_t numPointLights, numClusters, numLightIndices, pad;
+};
+
+// The ring holds one FrameVSConstants and one BlinnPhongPSConstants a
+// frame; room for every frame in flight plus the one being written means
+// it never waits on a fence the frame loop isn't already waiting on
+const uint32_t CONSTANT_RING_FRAME_BYTES =
+    (sizeof(FrameVSConstants) + CONSTANT_RING_ALIGNMENT - 1) / CONSTANT_RING_ALIGNMENT * CONSTANT_RING_ALIGNMENT +
+    (sizeof(BlinnPhongPSConstants) + CONSTANT_RING_ALIGNMENT - 1) / CONSTANT_RING_ALIGNMENT * CONSTANT_RING_ALIGNMENT;
+const uint32_t CONSTANT_RING_BYTES = (CONSTANT_RING_MAX_FRAMES_IN_FLIGHT + 1) * CONSTANT_RING_FRAME_BYTES;
+
+// ConstantRingDevice callbacks, forwarded to the render device
+static void* constantRingMap(void* userData, bool discard)
+{
+    FrameRenderer* renderer = (FrameRenderer*)userData;
+    return renderer->device->mapBuffer(renderer->device, renderer->constantBuffer, discard ? RenderMapWriteDiscard : RenderMapWriteNoOverwrite);
+}
+
+static void constantRingUnmap(void* userData)
+{
+    FrameRenderer* renderer = (FrameRenderer*)userData;
+    renderer->device->unmapBuffer(renderer->device, renderer->constantBuffer);
+}
+
+static void constantRingSignalFence(void* userData, uint32_t fenceSlot)
+{
+    FrameRenderer* renderer = (FrameRenderer*)userData;
+    renderer->device->signalFence(renderer->device, renderer->constantFences[fenceSlot]);
+}
+
+static bool constantRingIsFenceComplete(void* userData, uint32_t fenceSlot)
+{
+    FrameRenderer* renderer = (FrameRenderer*)userData;
+    return renderer->device->isFenceComplete(renderer->device, renderer->constantFences[fenceSlot]);
+}
+
+bool createFrameRenderer(FrameRenderer* renderer, RenderDevice* device, const char* assetDirectory, JobSystem* jobSystem,
+                         FrameLightClustering lightClustering)
+{
+    *renderer = {};
+    renderer->device = device;
+    renderer->jobSystem = jobSystem;
+    if(lightClustering == FrameLightClusteringAuto)
+        lightClustering = (SCENE_NUM_LIGHTS >= CLUSTERED_MIN_LIGHTS) ? FrameLightClusteringGrid : FrameLightClusteringOneCluster;
+    bool grid = (lightClustering == FrameLightClusteringGrid);
+    renderer->clusterTilesX = grid ? CLUSTER_GRID_TILES_X : 1;
+    renderer->clusterTilesY = grid ? CLUSTER_GRID_TILES_Y : 1;
+    renderer->clusterSlices = grid ? CLUSTER_GRID_SLICES : 1;
+
+    // Light pipeline. Slot 0: mesh vertices, slot 1: LightInstance
+    {
+        RenderVertexElement elements[] =
+        {
+            { "POS", 0, RenderVertexFormatFloat3, 0, offsetof(VertexData, pos), false },
+            { "MODELVIEW", 0, RenderVertexFormatFloat4, 1, offsetof(LightInstance, modelView.cols[0]), true },
+            { "MODELVIEW", 1, RenderVertexFormatFloat4, 1, offsetof(LightInstance, modelView.cols[1]), true },
+            { "MODELVIEW", 2, RenderVertexFormatFloat4, 1, offsetof(LightInstance, modelView.cols[2]), true },
+            { "COLOR", 0, RenderVertexFormatFloat4, 1, offsetof(LightInstance, color), true }
+        };
+        RenderPipelineDesc desc = { "Lights.hlsl", "vs_main", "ps_main", elements, sizeof(elements) / sizeof(elements[0]) };
+        renderer->lightPipeline = device->createPipeline(device, &desc);
+    }
+
+    // Blinn-Phong pipeline
+    {
+        RenderVertexElement elements[] =
+        {
+            { "POS", 0, RenderVertexFormatFloat3, 0, offsetof(VertexData, pos), false },
+            { "TEX", 0, RenderVertexFormatFloat2, 0, offsetof(VertexData, uv), false },
+            { "NORM", 0, RenderVertexFormatFloat3, 0, offsetof(VertexData, norm), false },
+            // Slot 1: BlinnPhongInstance. float3x3 columns are padded to
+            // 16 bytes, so these need explicit offsets.
+            { "MODELVIEW", 0, RenderVertexFormatFloat4, 1, offsetof(BlinnPhongInstance, modelView.cols[0]), true },
+            { "MODELVIEW", 1, RenderVertexFormatFloat4, 1, offsetof(BlinnPhongInstance, modelView.cols[1]), true },
+            { "MODELVIEW", 2, RenderVertexFormatFloat4, 1, offsetof(BlinnPhongInstance, modelView.cols[2]), true },
+            { "NORMALMATRIX", 0, RenderVertexFormatFloat3, 1, offsetof(BlinnPhongInstance, normalMatrix.m[0]), true },
+            { "NORMALMATRIX", 1, RenderVertexFormatFloat3, 1, offsetof(BlinnPhongInstance, normalMatrix.m[1]), true },
+            { "NORMALMATRIX", 2, RenderVertexFormatFloat3, 1, offsetof(BlinnPhongInstance, normalMatrix.m[2]), true }
+        };
+        RenderPipelineDesc desc = { "BlinnPhong.hlsl", "vs_main", "ps_main", elements, sizeof(elements) / sizeof(elements[0]) };
+        renderer->blinnPhongPipeline = device->createPipeline(device, &desc);
+    }
+    if(!renderer->lightPipeline || !renderer->blinnPhongPipeline)
+        return false;
+
+    char path[512];
+
+    // Vertex and Index Buffer
+    {
+        snprintf(path, sizeof(path), "%s%s", assetDirectory, "cube.obj");
+        LoadedObj obj = loadObj(path);
+        renderer->cubeNumIndices = obj.numIndices;
+        renderer->cubeVertexBuffer = device->createBuffer(device, RenderBufferTypeVertex, RenderBufferUsageImmutable,
+                                                          obj.numVertices * sizeof(VertexData), obj.vertexBuffer);
+        renderer->cubeIndexBuffer = device->createBuffer(device, RenderBufferTypeIndex, RenderBufferUsageImmutable,
+                                                         obj.numIndices * sizeof(uint16_t), obj.indexBuffer);
+        freeLoadedObj(obj);
+    }
+
+    // Texture
+    {
+        snprintf(path, sizeof(path), "%s%s", assetDirectory, "test.png");
+        int texWidth, texHeight, texNumChannels;
+        int texForceNumChannels = 4;
+        unsigned char* testTextureBytes = stbi_load(path, &texWidth, &texHeight,
+                                                    &texNumChannels, texForceNumChannels);
+        assert(testTextureBytes);
+        renderer->testTexture = device->createTexture(device, texWidth, texHeight, testTextureBytes);
+        free(testTextureBytes);
+    }
+
+    renderer->instanceBuffer = device->createBuffer(device, RenderBufferTypeVertex, RenderBufferUsageDynamic, INSTANCE_BUFFER_BYTES, 0);
+    renderer->commands = allocCommandBuffer(MAX_DRAW_PACKETS, INSTANCE_BUFFER_BYTES);
+    renderer->drawList = allocInstancedDrawList(INSTANCE_BUFFER_BYTES, MAX_DRAWS);
+
+    renderer->constantBuffer = device->createBuffer(device, RenderBufferTypeConstant, RenderBufferUsageDynamic, CONSTANT_RING_BYTES, 0);
+    for(uint32_t i=0; i<CONSTANT_RING_MAX_FRAMES_IN_FLIGHT; ++i)
+        renderer->constantFences[i] = device->createFence(device);
+    {
+        ConstantRingDevice ringDevice;
+        ringDevice.userData = renderer;
+        ringDevice.map = constantRingMap;
+        ringDevice.unmap = constantRingUnmap;
+        ringDevice.signalFence = constantRingSignalFence;
+        ringDevice.isFenceComplete = constantRingIsFenceComplete;
+        renderer->constantRing = createConstantBufferRing(ringDevice, CONSTANT_RING_BYTES);
+    }
+    // Room for every light in every cluster
+    uint32_t numClusters = renderer->clusterTilesX * renderer->clusterTilesY * renderer->clusterSlices;
+    uint32_t maxLightIndices = (SCENE_NUM_LIGHTS * numClusters < MAX_CLUSTER_LIGHT_INDICES) ? SCENE_NUM_LIGHTS * numClusters : MAX_CLUSTER_LIGHT_INDICES;
+    renderer->lightClusters = allocLightClusters(renderer->clusterTilesX, renderer->clusterTilesY, renderer->clusterSlices,
+                                                 SCENE_NUM_LIGHTS, maxLightIndices);
+    // Light indices are read in pairs
+    renderer->pointLightBuffer = device->createBuffer(device, RenderBufferTypeRaw, RenderBufferUsageDynamic,
+                                                      SCENE_NUM_LIGHTS * sizeof(PointLight), 0);
+    renderer->clusterBuffer = device->createBuffer(device, RenderBufferTypeRaw, RenderBufferUsageDynamic,
+                                                   numClusters * sizeof(uint32_t), 0);
+    renderer->lightIndexBuffer = device->createBuffer(device, RenderBufferTypeRaw, RenderBufferUsageDynamic,
+                                                      (maxLightIndices + 1) / 2 * sizeof(uint32_t), 0);
+
+    return renderer->cubeVertexBuffer && renderer->cubeIndexBuffer && renderer->testTexture &&
+           renderer->instanceBuffer && renderer->constantBuffer &&
+           renderer->pointLightBuffer && renderer->clusterBuffer && renderer->lightIndexBuffer;
+}
+
+void freeFrameRenderer(FrameRenderer* renderer)
+{
+    // GPU objects belong to the device and go when it's destroyed
+    freeInstancedDrawList(renderer->drawList);
+    freeCommandBuffer(renderer->commands);
+    freeLightClusters(renderer->lightClusters);
+}
+
+void getPointLightPositionsEye(const Scene* scene, affine3x4 viewMat, float4* positionsEye)
+{
+    for(int i=0; i<SCENE_NUM_LIGHTS; ++i)
+    {
+        // The eye-space position is the model-view translation, m[c][3]
+        // (see affine3x4). cols[3] of the float4x4 is always (0,0,0,1).
+        affine3x4 lightModelViewMat = scene->transforms.worldMats[scene->lightNodes[i]] * viewMat;
+        positionsEye[i] = {lightModelViewMat.m[0][3], lightModelViewMat.m[1][3], lightModelViewMat.m[2][3], 1.f};
+    }
+}
+
+void renderFrame(FrameRenderer* renderer, const Scene* scene, affine3x4 viewMat, float4x4 perspectiveMat)
+{
+    RenderDevice* device = renderer->device;
+    const int NUM_CUBES = SCENE_NUM_CUBES;
+    const int NUM_LIGHTS = SCENE_NUM_LIGHTS;
+
+    // Find visible cubes
+    uint32_t visibleCubeNodes[NUM_CUBES];
+    uint32_t numVisibleCubes;
+    {
+        // Cull cubes against the camera's view frustum (in world space)
+        // using their bounding spheres
+        float cubeCenterX[NUM_CUBES], cubeCenterY[NUM_CUBES], cubeCenterZ[NUM_CUBES], cubeRadius[NUM_CUBES];
+        for(int i=0; i<NUM_CUBES; ++i){
+            const affine3x4* modelMat = &scene->transforms.worldMats[scene->cubeNodes[i]];
+            cubeCenterX[i] = modelMat->m[0][3];
+            cubeCenterY[i] = modelMat->m[1][3];
+            cubeCenterZ[i] = modelMat->m[2][3];
+            cubeRadius[i] = 0.866f; // Half the diagonal of a unit cube
+        }
+        Frustum frustum = makeFrustum(affine3x4ToFloat4x4(viewMat) * perspectiveMat);
+        uint32_t visibleCubes[NUM_CUBES];
+        numVisibleCubes = cullSpheres(&frustum, cubeCenterX, cubeCenterY, cubeCenterZ, cubeRadius, NUM_CUBES, visibleCubes);
+        for(uint32_t j=0; j<numVisibleCubes; ++j)
+            visibleCubeNodes[j] = scene->cubeNodes[visibleCubes[j]];
+    }
+
+    // Calculate matrices for the point lights
+    float4 lightColor[NUM_LIGHTS] = {
+        {0.1f, 0.4f, 0.9f, 1.f},
+        {0.9f, 0.1f, 0.6f, 1.f}
+    };
+    float4 pointLightPosEye[NUM_LIGHTS];
+    getPointLightPositionsEye(scene, viewMat, pointLightPosEye);
+    for(int i=0; i<NUM_LIGHTS; ++i)
+        pointLightPosEye[i].w = POINT_LIGHT_RADIUS;
+
+    // Find which lights reach each cluster
+    LightClusters* lightClusters = &renderer->lightClusters;
+    ClusterGrid clusterGrid = makeClusterGrid(perspectiveMat, CLUSTER_NEAR_Z, CLUSTER_FAR_Z,
+                                              renderer->clusterTilesX, renderer->clusterTilesY, renderer->clusterSlices);
+    const uint32_t numClusters = clusterGridSize(&clusterGrid);
+    {
+        float lightX[NUM_LIGHTS], lightY[NUM_LIGHTS], lightZ[NUM_LIGHTS], lightRadius[NUM_LIGHTS];
+        for(int i=0; i<NUM_LIGHTS; ++i){
+            lightX[i] = pointLightPosEye[i].x;
+            lightY[i] = pointLightPosEye[i].y;
+            lightZ[i] = pointLightPosEye[i].z;
+            lightRadius[i] = pointLightPosEye[i].w;
+        }
+        ClusterLightSpheres spheres = { lightX, lightY, lightZ, lightRadius, NUM_LIGHTS };
+        assignLightsToClusters(lightClusters, &clusterGrid, &spheres, renderer->jobSystem);
+    }
+
+    // Record a packet per object in any order, sort them by state
+    // then depth and merge them into one instanced draw per
+    // pipeline/material/mesh. Upload all the instance data in one go.
+    CommandBuffer* commands = &renderer->commands;
+    InstancedDrawList* drawList = &renderer->drawList;
+    resetCommandBuffer(commands);
+    pushBlinnPhongPackets(commands, TEST_TEXTURE_MATERIAL, CUBE_MESH, viewMat, scene->transforms.worldMats, visibleCubeNodes, numVisibleCubes);
+    pushLightPackets(commands, CUBE_MESH, viewMat, scene->transforms.worldMats, scene->lightNodes, lightColor, NUM_LIGHTS);
+    sortCommandBuffer(commands);
+    buildInstancedDraws(commands, drawList);
+    if(drawList->instanceSizeBytes > 0)
+    {
+        void* instanceData = device->mapBuffer(device, renderer->instanceBuffer, RenderMapWriteDiscard);
+        memcpy(instanceData, drawList->instanceBytes, drawList->instanceSizeBytes);
+        device->unmapBuffer(device, renderer->instanceBuffer);
+    }
+
+    // Write this frame's constants into the ring
+    ConstantAllocation frameVSConstants, blinnPhongPSConstants;
+    {
+        ConstantBufferRing* constantRing = &renderer->constantRing;
+        beginConstantRingWrites(constantRing);
+        frameVSConstants = allocConstants(constantRing, sizeof(FrameVSConstants));
+        blinnPhongPSConstants = allocConstants(constantRing, sizeof(BlinnPhongPSConstants));
+        assert(frameVSConstants.data && blinnPhongPSConstants.data);
+
+        FrameVSConstants* vsConstants = (FrameVSConstants*)frameVSConstants.data;
+        vsConstants->projection = perspectiveMat;
+
+        BlinnPhongPSConstants* psConstants = (BlinnPhongPSConstants*)blinnPhongPSConstants.data;
+        psConstants->dirLight.dirEye = normalise(float4{1.f, 1.f, 1.f, 0.f});
+        psConstants->dirLight.color = {0.7f, 0.8f, 0.2f, 1.f};
+        psConstants->clusterProjX = clusterGrid.projX;
+        psConstants->clusterProjY = clusterGrid.projY;
+        psConstants->clusterProjW = clusterGrid.projW;
+        psConstants->clusterDims = {(float)clusterGrid.tilesX, (float)clusterGrid.tilesY, (float)clusterGrid.numSlices, 0.f};
+        psConstants->clusterSlicing = {clusterGrid.sliceScale, clusterGrid.sliceBias, 0.f, 0.f};
+        psConstants->numPointLights = NUM_LIGHTS;
+        psConstants->numClusters = numClusters;
+        psConstants->numLightIndices = lightClusters->numLightIndices;
+        endConstantRingWrites(constantRing);
+    }
+
+    // Rewrite the light buffers, each sized for this scene
+    {
+        PointLight* pointLights = (PointLight*)device->mapBuffer(device, renderer->pointLightBuffer, RenderMapWriteDiscard);
+        for(int i=0; i<NUM_LIGHTS; ++i){
+            pointLights[i].posEye = pointLightPosEye[i];
+            pointLights[i].color = lightColor[i];
+        }
+        device->unmapBuffer(device, renderer->pointLightBuffer);
+
+        // Offsets fit in 16 bits as there are at most 32768 indices
+        uint32_t* clusters = (uint32_t*)device->mapBuffer(device, renderer->clusterBuffer, RenderMapWriteDiscard);
+        for(uint32_t i=0; i<numClusters; ++i)
+            clusters[i] = lightClusters->offsets[i] | (lightClusters->counts[i] << 16);
+        device->unmapBuffer(device, renderer->clusterBuffer);
+
+        void* lightIndices = device->mapBuffer(device, renderer->lightIndexBuffer, RenderMapWriteDiscard);
+        memcpy(lightIndices, lightClusters->lightIndices, lightClusters->numLightIndices * sizeof(uint16_t));
+        device->unmapBuffer(device, renderer->lightIndexBuffer);
+    }
+
+    float backgroundColor[4] = { 0.1f, 0.2f, 0.6f, 1.0f };
+    device->beginFrame(device, backgroundColor);
+
+    device->setConstantBuffer(device, RenderShaderStageVertex, 0, renderer->constantBuffer, frameVSConstants.firstConstant, frameVSConstants.numConstants);
+    device->setConstantBuffer(device, RenderShaderStagePixel, 0, renderer->constantBuffer, blinnPhongPSConstants.firstConstant, blinnPhongPSConstants.numConstants);
+    device->setRawBuffer(device, 1, renderer->pointLightBuffer);
+    device->setRawBuffer(device, 2, renderer->clusterBuffer);
+    device->setRawBuffer(device, 3, renderer->lightIndexBuffer);
+
+    // Draw lights and cubes, only binding state that differs from
+    // the previous draw
+    for(uint32_t i=0; i<drawList->numDraws; ++i)
+    {
+        const InstancedDraw* draw = &drawList->draws[i];
+        if(draw->stateChanges & DrawStateChangePipeline)
+            device->setPipeline(device, draw->pipeline == DrawPipelineLight ? renderer->lightPipeline : renderer->blinnPhongPipeline);
+        if((draw->stateChanges & DrawStateChangeMaterial) && draw->material != DRAW_NO_MATERIAL)
+        {
+            assert(draw->material == TEST_TEXTURE_MATERIAL);
+            device->setTexture(device, 0, renderer->testTexture);
+        }
+        if(draw->stateChanges & DrawStateChangeMesh)
+        {
+            assert(draw->mesh == CUBE_MESH);
+            device->setVertexBuffer(device, 0, renderer->cubeVertexBuffer, sizeof(VertexData), 0);
+            device->setIndexBuffer(device, renderer->cubeIndexBuffer);
+        }
+
+        device->setVertexBuffer(device, 1, renderer->instanceBuffer, draw->instanceStride, draw->instanceByteOffset);
+        device->drawIndexedInstanced(device, renderer->cubeNumIndices, draw->numInstances);
+    }
+    endConstantRingFrame(&renderer->constantRing);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "3DMaths.h"
+#include "RenderDevice.h"
+#include "CommandBuffer.h"
+#include "ConstantBufferRing.h"
+#include "LightClustering.h"
+#include "Scene.h"
+
+struct JobSystem;
+
+// How createFrameRenderer() splits the view into light clusters
+enum FrameLightClustering
+{
+    // One cluster holding every light in view when the scene has fewer
+    // than 16 lights (as the sample does), otherwise the grid
+    FrameLightClusteringAuto,
+    FrameLightClusteringOneCluster,
+    // 16:9 tiles times depth slices, so pixels only loop over the lights
+    // near them. Works with any number of lights.
+    FrameLightClusteringGrid
+};
+
+// The sample's per-frame rendering, written against RenderDevice.h so it
+// runs the same on D3D11 and on the recording backend: frustum culling,
+// recording/sorting/merging draw packets, assigning point lights to
+// clusters, uploading instance data and constants, and submitting the
+// draws.
+struct FrameRenderer
+{
+    RenderDevice* device;
+    JobSystem* jobSystem; // May be NULL
+
+    RenderPipeline lightPipeline;
+    RenderPipeline blinnPhongPipeline;
+    RenderBuffer cubeVertexBuffer;
+    RenderBuffer cubeIndexBuffer;
+    uint32_t cubeNumIndices;
+    RenderTexture testTexture;
+
+    // Rewritten once per frame from 'drawList'. Draw packets are recorded
+    // into 'commands', sorted, then merged into instanced draws in 'drawList'.
+    RenderBuffer instanceBuffer;
+    CommandBuffer commands;
+    InstancedDrawList drawList;
+
+    // Every constant buffer update is sub-allocated from one big dynamic
+    // buffer and bound at an offset (see ConstantBufferRing.h)
+    RenderBuffer constantBuffer;
+    RenderFence constantFences[CONSTANT_RING_MAX_FRAMES_IN_FLIGHT];
+    ConstantBufferRing constantRing;
+
+    // Point lights per froxel of the view frustum, uploaded each frame for
+    // BlinnPhong.hlsl to loop over only the lights reaching the pixel
+    uint32_t clusterTilesX, clusterTilesY, clusterSlices;
+    LightClusters lightClusters;
+    RenderBuffer pointLightBuffer;
+    RenderBuffer clusterBuffer;
+    RenderBuffer lightIndexBuffer;
+};
+
+// Loads cube.obj and test.png from 'assetDirectory' ("" for the working
+// directory, otherwise ending in a slash). Returns false if the device
+// couldn't create something. The ring's callbacks point at 'renderer',
+// so it mustn't move afterwards. Lights are assigned to clusters on
+// 'jobSystem' if it isn't NULL, so renderFrame() must then be called
+// from a thread which may run jobs. The cluster grid is fixed here, as
+// the light buffers are sized for it.
+bool createFrameRenderer(FrameRenderer* renderer, RenderDevice* device, const char* assetDirectory, JobSystem* jobSystem,
+                         FrameLightClustering lightClustering);
+void freeFrameRenderer(FrameRenderer* renderer);
+
+// Draws 'scene' as last posed by applySceneState(). Doesn't present.
+void renderFrame(FrameRenderer* renderer, const Scene* scene, affine3x4 viewMat, float4x4 perspectiveMat);
+
+// Writes the eye-space position of each of the scene's SCENE_NUM_LIGHTS
+// point lights, as uploaded to the pixel shader by renderFrame()
+void getPointLightPositionsEye(const Scene* scene, affine3x4 viewMat, float4* positionsEye);
@@ -0,0 +1,80 @@
+#include "InstancedDrawing.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+InstancedDrawList allocInstancedDrawList(uint32_t instanceCapacityBytes, uint32_t maxDraws)
+{
+    InstancedDrawList result = {};
+    result.instanceBytes = (uint8_t*)malloc(instanceCapacityBytes);
+    result.instanceCapacityBytes = instanceCapacityBytes;
+    result.draws = (InstancedDraw*)malloc(maxDraws * sizeof(InstancedDraw));
+    result.maxDraws = maxDraws;
+    assert(result.instanceBytes && result.draws);
+    return result;
+}
+
+void freeInstancedDrawList(InstancedDrawList drawList)
+{
+    free(drawList.instanceBytes);
+    free(drawList.draws);
+}
+
+void resetInstancedDrawList(InstancedDrawList* drawList)
+{
+    drawList->instanceSizeBytes = 0;
+    drawList->numDraws = 0;
+}
+
+void* pushInstancedDraw(InstancedDrawList* drawList, DrawPipeline pipeline, uint32_t material, uint32_t mesh,
+                        uint32_t instanceStride, uint32_t numInstances)
+{
+    if(numInstances == 0)
+        return 0;
+    // Vertex buffer offsets only need 4-byte alignment, but keep each
+    // draw's instances 16-byte aligned for the SIMD matrix stores
+    uint32_t offset = (drawList->instanceSizeBytes + 15) & ~15u;
+    uint32_t sizeBytes = instanceStride * numInstances;
+    assert(drawList->numDraws < drawList->maxDraws);
+    assert(offset + sizeBytes <= drawList->instanceCapacityBytes);
+
+    // Work out which binds the submission can skip
+    uint32_t stateChanges = DrawStateChangePipeline | DrawStateChangeMaterial | DrawStateChangeMesh;
+    if(drawList->numDraws > 0){
+        const InstancedDraw* previous = &drawList->draws[drawList->numDraws - 1];
+        stateChanges = 0;
+        if(previous->pipeline != pipeline)
+            stateChanges |= DrawStateChangePipeline;
+        if(previous->material != material)
+            stateChanges |= DrawStateChangeMaterial;
+        if(previous->mesh != mesh)
+            stateChanges |= DrawStateChangeMesh;
+    }
+
+    InstancedDraw* draw = &drawList->draws[drawList->numDraws++];
+    draw->pipeline = pipeline;
+    draw->material = material;
+    draw->mesh = mesh;
+    draw->stateChanges = stateChanges;
+    draw->instanceStride = instanceStride;
+    draw->instanceByteOffset = offset;
+    draw->numInstances = numInstances;
+    drawList->instanceSizeBytes = offset + sizeBytes;
+    return drawList->instanceBytes + offset;
+}
+
+LightInstance makeLightInstance(affine3x4 worldMat, affine3x4 viewMat, float4 color)
+{
+    LightInstance result;
+    result.modelView = worldMat * viewMat;
+    result.color = color;
+    return result;
+}
+
+BlinnPhongInstance makeBlinnPhongInstance(affine3x4 worldMat, affine3x4 viewMat)
+{
+    BlinnPhongInstance result;
+    result.modelView = worldMat * viewMat;
+    result.normalMatrix = normalMatrix(result.modelView);
+    return result;
+}
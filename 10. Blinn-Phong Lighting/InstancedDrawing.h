@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include "3DMaths.h"
+
+// Per-frame list of instanced draws. Instead of updating a constant
+// buffer and issuing a draw per object, each frame the per-instance
+// data for every object is appended to one block of memory, which is
+// uploaded to the instance vertex buffer in a single Map(), and each
+// mesh/pipeline pair becomes one DrawIndexedInstanced() call.
+//
+// Building the list is plain CPU code, so it runs (and can be checked)
+// without a GPU; FrameRenderer.cpp does the upload and the draw calls.
+// Draws are usually built from a sorted CommandBuffer (see
+// CommandBuffer.h) so that state changes between them are minimal.
+
+enum DrawPipeline {
+    DrawPipelineLight,      // Lights.hlsl, unlit with a per-instance color
+    DrawPipelineBlinnPhong, // BlinnPhong.hlsl
+    DrawPipelineCount
+};
+
+// Material of draws which sample no textures, e.g. the unlit lights.
+// Other material indices are up to the caller.
+const uint32_t DRAW_NO_MATERIAL = 0;
+
+// Per-instance vertex data. The layouts must match the per-instance
+// elements of the pipelines in FrameRenderer.cpp and the shaders' VS inputs.
+struct LightInstance
+{
+    affine3x4 modelView;
+    float4 color;
+};
+
+struct BlinnPhongInstance
+{
+    affine3x4 modelView;
+    float3x3 normalMatrix;
+};
+
+// Which bindings differ from the previous draw in the list
+enum DrawStateChange {
+    DrawStateChangePipeline = 1 << 0,
+    DrawStateChangeMaterial = 1 << 1,
+    DrawStateChangeMesh     = 1 << 2
+};
+
+struct InstancedDraw
+{
+    DrawPipeline pipeline;
+    uint32_t material;           // Caller-defined material index or DRAW_NO_MATERIAL
+    uint32_t mesh;               // Caller-defined mesh index
+    uint32_t stateChanges;       // DrawStateChange flags, all set for the first draw
+    uint32_t instanceStride;
+    uint32_t instanceByteOffset; // Into InstancedDrawList::instanceBytes
+    uint32_t numInstances;
+};
+
+struct InstancedDrawList
+{
+    uint8_t* instanceBytes;
+    uint32_t instanceCapacityBytes;
+    uint32_t instanceSizeBytes;
+
+    InstancedDraw* draws;
+    uint32_t maxDraws;
+    uint32_t numDraws;
+};
+
+// Allocates using malloc()
+InstancedDrawList allocInstancedDrawList(uint32_t instanceCapacityBytes, uint32_t maxDraws);
+void freeInstancedDrawList(InstancedDrawList drawList);
+// Empties the list for the next frame
+void resetInstancedDrawList(InstancedDrawList* drawList);
+
+// Records one draw of 'numInstances' instances and returns where to
+// write their data ('numInstances' * 'instanceStride' bytes).
+// Returns NULL and records nothing if 'numInstances' is 0.
+void* pushInstancedDraw(InstancedDrawList* drawList, DrawPipeline pipeline, uint32_t material, uint32_t mesh,
+                        uint32_t instanceStride, uint32_t numInstances);
+
+// Instance data for one object from its world matrix and the view matrix
+LightInstance makeLightInstance(affine3x4 worldMat, affine3x4 viewMat, float4 color);
+BlinnPhongInstance makeBlinnPhongInstance(affine3x4 worldMat, affine3x4 viewMat);
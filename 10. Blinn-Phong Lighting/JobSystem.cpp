@@ -0,0 +1,462 @@
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// Just the atomics the scheduler needs. Loads are acquire, stores are
+// release and read-modify-writes and fences are sequentially consistent.
+// NOTE: On x86/x64 MSVC plain volatile loads and stores already have
+// acquire/release semantics, so those only need a compiler barrier.
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline int64_t atomicLoad(const volatile int64_t* p) { int64_t v = *p; _ReadWriteBarrier(); return v; }
+static inline void atomicStore(volatile int64_t* p, int64_t v) { _ReadWriteBarrier(); *p = v; }
+static inline bool atomicCompareExchange(volatile int64_t* p, int64_t expected, int64_t desired) {
+    return _InterlockedCompareExchange64(p, desired, expected) == expected;
+}
+static inline int32_t atomicLoad32(const volatile int32_t* p) { int32_t v = *p; _ReadWriteBarrier(); return v; }
+static inline void atomicStore32(volatile int32_t* p, int32_t v) { _ReadWriteBarrier(); *p = v; }
+static inline bool atomicCompareExchange32(volatile int32_t* p, int32_t expected, int32_t desired) {
+    return _InterlockedCompareExchange((volatile long*)p, desired, expected) == expected;
+}
+// Returns the new value
+static inline int32_t atomicAdd32(volatile int32_t* p, int32_t v) { return _InterlockedExchangeAdd((volatile long*)p, v) + v; }
+static inline void atomicFence() { _mm_mfence(); }
+static inline void cpuPause() { _mm_pause(); }
+#else
+static inline int64_t atomicLoad(const volatile int64_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void atomicStore(volatile int64_t* p, int64_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline bool atomicCompareExchange(volatile int64_t* p, int64_t expected, int64_t desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+static inline int32_t atomicLoad32(const volatile int32_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void atomicStore32(volatile int32_t* p, int32_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline bool atomicCompareExchange32(volatile int32_t* p, int32_t expected, int32_t desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+static inline int32_t atomicAdd32(volatile int32_t* p, int32_t v) { return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST); }
+static inline void atomicFence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#if defined(__x86_64__) || defined(__i386__)
+static inline void cpuPause() { __builtin_ia32_pause(); }
+#else
+static inline void cpuPause() {}
+#endif
+#endif
+
+static const uint32_t JOB_DEQUE_SIZE = 4096; // Must be a power of two
+static const uint32_t JOB_SPIN_COUNT = 256;  // findJob() attempts before sleeping/yielding
+static const uint32_t CACHE_LINE_SIZE = 64;
+
+struct Job
+{
+    ParallelTaskProc* proc;
+    void* userData;
+    uint32_t firstTask;
+    uint32_t numTasks;
+    JobCounter* counter;
+};
+
+// Chase-Lev deque, with the memory ordering from "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (Le et al. 2013). The owner
+// works on 'bottom', thieves take from 'top' with a CAS. Fixed size:
+// if it's full the owner runs the job straight away instead.
+struct JobDeque
+{
+    volatile int64_t top;
+    char topPadding[CACHE_LINE_SIZE - sizeof(int64_t)];
+    volatile int64_t bottom;
+    char bottomPadding[CACHE_LINE_SIZE - sizeof(int64_t)];
+    Job jobs[JOB_DEQUE_SIZE];
+};
+
+struct JobWorker
+{
+    JobSystem* jobSystem;
+    uint32_t threadIndex;
+};
+
+struct JobSystem
+{
+    uint32_t numThreads; // Thread 0 is the one which created the job system
+    JobDeque* deques;
+    JobWorker* workers;
+    Thread* threads;
+
+    Semaphore wakeSemaphore;
+    volatile int32_t numSleeping;
+    volatile int32_t quit;
+};
+
+// Which job system (and which of its deques) the current thread uses
+static thread_local JobSystem* currentJobSystem;
+static thread_local uint32_t currentThreadIndex;
+
+static bool pushJob(JobDeque* deque, const Job* job)
+{
+    int64_t b = atomicLoad(&deque->bottom);
+    int64_t t = atomicLoad(&deque->top);
+    if(b - t >= (int64_t)JOB_DEQUE_SIZE)
+        return false;
+    deque->jobs[b & (JOB_DEQUE_SIZE-1)] = *job;
+    atomicStore(&deque->bottom, b + 1);
+    return true;
+}
+
+static bool popJob(JobDeque* deque, Job* outJob)
+{
+    int64_t b = atomicLoad(&deque->bottom) - 1;
+    atomicStore(&deque->bottom, b);
+    atomicFence();
+    int64_t t = atomicLoad(&deque->top);
+    if(t > b){
+        // Empty
+        atomicStore(&deque->bottom, b + 1);
+        return false;
+    }
+    *outJob = deque->jobs[b & (JOB_DEQUE_SIZE-1)];
+    if(t == b){
+        // Last job, race any thieves for it
+        bool won = atomicCompareExchange(&deque->top, t, t + 1);
+        atomicStore(&deque->bottom, b + 1);
+        return won;
+    }
+    return true;
+}
+
+static bool stealJob(JobDeque* deque, Job* outJob)
+{
+    int64_t t = atomicLoad(&deque->top);
+    atomicFence();
+    int64_t b = atomicLoad(&deque->bottom);
+    if(t >= b)
+        return false;
+    // The slot can't be reused until 'top' moves past it, so if the
+    // CAS succeeds this copy is intact
+    *outJob = deque->jobs[t & (JOB_DEQUE_SIZE-1)];
+    return atomicCompareExchange(&deque->top, t, t + 1);
+}
+
+static void wakeOneWorker(JobSystem* jobSystem)
+{
+    // The job was published with a release store to 'bottom', which on
+    // its own may be reordered after the load of 'numSleeping' below. A
+    // worker going to sleep increments 'numSleeping' and then checks the
+    // deques, so without the fence both could miss each other: the
+    // pusher sees no sleepers and the sleeper sees no job.
+    atomicFence();
+    for(;;){
+        int32_t numSleeping = atomicLoad32(&jobSystem->numSleeping);
+        if(numSleeping <= 0)
+            return;
+        if(atomicCompareExchange32(&jobSystem->numSleeping, numSleeping, numSleeping - 1)){
+            signalSemaphore(jobSystem->wakeSemaphore, 1);
+            return;
+        }
+    }
+}
+
+static uint32_t xorshift32(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Own deque first, then the others starting from a random victim
+static bool findJob(JobSystem* jobSystem, uint32_t threadIndex, uint32_t* rngState, Job* outJob)
+{
+    if(popJob(&jobSystem->deques[threadIndex], outJob))
+        return true;
+    uint32_t numThreads = jobSystem->numThreads;
+    uint32_t victim = xorshift32(rngState) % numThreads;
+    for(uint32_t i=0; i<numThreads; ++i){
+        if(victim != threadIndex && stealJob(&jobSystem->deques[victim], outJob))
+            return true;
+        if(++victim == numThreads)
+            victim = 0;
+    }
+    return false;
+}
+
+static void scheduleJob(JobSystem* jobSystem, const Job* job);
+
+// A job queued by runJobsAfter()
+struct JobContinuation
+{
+    Job job;
+    JobContinuation* next;
+};
+
+// Only held for a few instructions, but yield if the holder seems to
+// have been preempted
+static void lockCounter(JobCounter* counter)
+{
+    uint32_t numAttempts = 0;
+    while(!atomicCompareExchange32(&counter->lock, 0, 1)){
+        if(++numAttempts < JOB_SPIN_COUNT)
+            cpuPause();
+        else
+            yieldThread();
+    }
+}
+
+static void unlockCounter(JobCounter* counter)
+{
+    atomicStore32(&counter->lock, 0);
+}
+
+// Decrements the counter of a finished job. The decrement to zero is
+// done holding the counter's lock, which waitForCounter() also waits
+// for, so the counter (often on the waiter's stack) is no longer
+// touched once it returns. The continuations are then scheduled from
+// this thread.
+static void finishJob(JobSystem* jobSystem, JobCounter* counter)
+{
+    for(;;){
+        int32_t count = atomicLoad32(&counter->count);
+        if(count > 1){
+            if(atomicCompareExchange32(&counter->count, count, count - 1))
+                return;
+            continue;
+        }
+
+        lockCounter(counter);
+        // More jobs may have been added since the load above
+        if(atomicAdd32(&counter->count, -1) > 0){
+            unlockCounter(counter);
+            return;
+        }
+        JobContinuation* continuation = counter->continuations;
+        counter->continuations = 0;
+        unlockCounter(counter);
+
+        while(continuation){
+            JobContinuation* next = continuation->next;
+            scheduleJob(jobSystem, &continuation->job);
+            free(continuation);
+            continuation = next;
+        }
+        return;
+    }
+}
+
+static void executeJob(JobSystem* jobSystem, Job job)
+{
+    // Split off the upper half until one task is left, so the biggest
+    // pieces end up at the top of the deque where thieves look
+    while(job.numTasks > 1){
+        uint32_t half = job.numTasks / 2;
+        Job upper = job;
+        upper.firstTask += half;
+        upper.numTasks -= half;
+        job.numTasks = half;
+        scheduleJob(jobSystem, &upper);
+    }
+    job.proc(job.userData, job.firstTask);
+    if(job.counter)
+        finishJob(jobSystem, job.counter);
+}
+
+static void scheduleJob(JobSystem* jobSystem, const Job* job)
+{
+    assert(currentJobSystem == jobSystem);
+    if(pushJob(&jobSystem->deques[currentThreadIndex], job))
+        wakeOneWorker(jobSystem);
+    else
+        executeJob(jobSystem, *job);
+}
+
+static void workerThreadProc(void* userData)
+{
+    JobWorker* worker = (JobWorker*)userData;
+    JobSystem* jobSystem = worker->jobSystem;
+    uint32_t threadIndex = worker->threadIndex;
+    currentJobSystem = jobSystem;
+    currentThreadIndex = threadIndex;
+    uint32_t rngState = 0x9E3779B9u * (threadIndex + 1);
+
+    while(!atomicLoad32(&jobSystem->quit))
+    {
+        Job job;
+        bool foundJob = false;
+        // Jobs tend to arrive in bursts, so spin for a bit before sleeping
+        for(uint32_t spin=0; spin<JOB_SPIN_COUNT && !foundJob; ++spin){
+            foundJob = findJob(jobSystem, threadIndex, &rngState, &job);
+            if(!foundJob)
+                cpuPause();
+        }
+
+        if(!foundJob)
+        {
+            // Announce that we're going to sleep, then look once more so
+            // that a job pushed in between isn't missed
+            atomicAdd32(&jobSystem->numSleeping, 1);
+            foundJob = findJob(jobSystem, threadIndex, &rngState, &job);
+            if(foundJob || atomicLoad32(&jobSystem->quit)){
+                // Take the announcement back, unless a pusher already
+                // did and signalled, in which case consume the signal
+                for(;;){
+                    int32_t numSleeping = atomicLoad32(&jobSystem->numSleeping);
+                    if(numSleeping <= 0){
+                        waitSemaphore(jobSystem->wakeSemaphore);
+                        break;
+                    }
+                    if(atomicCompareExchange32(&jobSystem->numSleeping, numSleeping, numSleeping - 1))
+                        break;
+                }
+            }
+            else {
+                waitSemaphore(jobSystem->wakeSemaphore);
+            }
+        }
+
+        if(foundJob)
+            executeJob(jobSystem, job);
+    }
+}
+
+JobSystem* createJobSystem(uint32_t numWorkerThreads)
+{
+    assert(!currentJobSystem);
+    if(numWorkerThreads == 0){
+        uint32_t numProcessors = getNumLogicalProcessors();
+        numWorkerThreads = (numProcessors > 1) ? numProcessors - 1 : 0;
+    }
+
+    JobSystem* jobSystem = (JobSystem*)calloc(1, sizeof(JobSystem));
+    assert(jobSystem);
+    jobSystem->numThreads = numWorkerThreads + 1;
+    jobSystem->deques = (JobDeque*)calloc(jobSystem->numThreads, sizeof(JobDeque));
+    jobSystem->workers = (JobWorker*)malloc(jobSystem->numThreads * sizeof(JobWorker));
+    jobSystem->threads = (Thread*)malloc(jobSystem->numThreads * sizeof(Thread));
+    assert(jobSystem->deques && jobSystem->workers && jobSystem->threads);
+    jobSystem->wakeSemaphore = createSemaphore();
+
+    currentJobSystem = jobSystem;
+    currentThreadIndex = 0;
+    for(uint32_t i=1; i<jobSystem->numThreads; ++i){
+        jobSystem->workers[i].jobSystem = jobSystem;
+        jobSystem->workers[i].threadIndex = i;
+        jobSystem->threads[i] = createThread(workerThreadProc, &jobSystem->workers[i]);
+    }
+    return jobSystem;
+}
+
+void destroyJobSystem(JobSystem* jobSystem)
+{
+    assert(currentJobSystem == jobSystem && currentThreadIndex == 0);
+    atomicStore32(&jobSystem->quit, 1);
+    // Enough signals to wake every worker, whether or not it has
+    // announced that it's sleeping yet
+    signalSemaphore(jobSystem->wakeSemaphore, jobSystem->numThreads - 1);
+    for(uint32_t i=1; i<jobSystem->numThreads; ++i)
+        joinThread(jobSystem->threads[i]);
+
+    destroySemaphore(jobSystem->wakeSemaphore);
+    free(jobSystem->deques);
+    free(jobSystem->workers);
+    free(jobSystem->threads);
+    free(jobSystem);
+    currentJobSystem = 0;
+}
+
+uint32_t getNumJobThreads(const JobSystem* jobSystem)
+{
+    return jobSystem->numThreads;
+}
+
+void runJob(JobSystem* jobSystem, ParallelTaskProc* proc, void* userData, uint32_t taskIndex, JobCounter* counter)
+{
+    if(counter)
+        atomicAdd32(&counter->count, 1);
+    Job job = {proc, userData, taskIndex, 1, counter};
+    scheduleJob(jobSystem, &job);
+}
+
+void runJobs(JobSystem* jobSystem, ParallelTaskProc* proc, void* userData, uint32_t numTasks, JobCounter* counter)
+{
+    if(numTasks == 0)
+        return;
+    if(counter)
+        atomicAdd32(&counter->count, (int32_t)numTasks);
+    Job job = {proc, userData, 0, numTasks, counter};
+    scheduleJob(jobSystem, &job);
+}
+
+void runJobsAfter(JobSystem* jobSystem, JobCounter* dependency, ParallelTaskProc* proc, void* userData,
+                  uint32_t numTasks, JobCounter* counter)
+{
+    if(numTasks == 0)
+        return;
+    if(counter)
+        atomicAdd32(&counter->count, (int32_t)numTasks);
+    Job job = {proc, userData, 0, numTasks, counter};
+
+    // Under the lock the count can't reach zero without the finishing
+    // job seeing this continuation
+    lockCounter(dependency);
+    if(atomicLoad32(&dependency->count) > 0){
+        JobContinuation* continuation = (JobContinuation*)malloc(sizeof(JobContinuation));
+        assert(continuation);
+        continuation->job = job;
+        continuation->next = dependency->continuations;
+        dependency->continuations = continuation;
+        unlockCounter(dependency);
+        return;
+    }
+    unlockCounter(dependency);
+    scheduleJob(jobSystem, &job);
+}
+
+void waitForCounter(JobSystem* jobSystem, JobCounter* counter)
+{
+    assert(currentJobSystem == jobSystem);
+    uint32_t rngState = 0x9E3779B9u * (currentThreadIndex + 1);
+    uint32_t numFailedAttempts = 0;
+    // The lock is held by the job which brought the count to zero until
+    // it's done with the counter
+    while(atomicLoad32(&counter->count) > 0 || atomicLoad32(&counter->lock))
+    {
+        Job job;
+        if(findJob(jobSystem, currentThreadIndex, &rngState, &job)){
+            executeJob(jobSystem, job);
+            numFailedAttempts = 0;
+        }
+        else if(++numFailedAttempts < JOB_SPIN_COUNT){
+            cpuPause();
+        }
+        else {
+            // The remaining jobs are running on other threads
+            yieldThread();
+        }
+    }
+}
+
+struct ParallelForContext
+{
+    ParallelForProc* proc;
+    void* userData;
+    uint32_t count;
+    uint32_t batchSize;
+};
+
+static void parallelForTask(void* userData, uint32_t batchIndex)
+{
+    ParallelForContext* ctx = (ParallelForContext*)userData;
+    uint32_t begin = batchIndex * ctx->batchSize;
+    uint32_t end = (ctx->count - begin > ctx->batchSize) ? begin + ctx->batchSize : ctx->count;
+    ctx->proc(ctx->userData, begin, end);
+}
+
+void parallelFor(JobSystem* jobSystem, ParallelForProc* proc, void* userData, uint32_t count, uint32_t batchSize)
+{
+    assert(batchSize > 0);
+    ParallelForContext ctx = {proc, userData, count, batchSize};
+    uint32_t numBatches = (uint32_t)(((uint64_t)count + batchSize - 1) / batchSize);
+    JobCounter counter = {};
+    runJobs(jobSystem, parallelForTask, &ctx, numBatches, &counter);
+    waitForCounter(jobSystem, &counter);
+}
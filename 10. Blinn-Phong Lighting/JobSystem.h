@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include "Threading.h"
+
+// Work-stealing job scheduler.
+//
+// Every thread in the system (the thread which created it plus the
+// worker threads) owns a lock-free deque of jobs. A thread pushes and
+// pops jobs at the bottom of its own deque, so nested work is done
+// depth-first and stays in cache, while idle threads steal from the
+// top of other deques, which holds the oldest (and usually largest)
+// jobs. Idle workers spin briefly and then sleep until jobs are added.
+//
+// Jobs use the same signature as runTasksInParallel() tasks. Completion
+// is tracked with JobCounters: each job decrements its counter when it
+// finishes, and waitForCounter() runs other jobs until the counter hits
+// zero. A job which depends on others can either wait on their counter,
+// e.g.
+//   JobCounter counter = {};
+//   runJobs(jobSystem, cullTask, &cullData, numBatches, &counter);
+//   waitForCounter(jobSystem, &counter);
+// or be scheduled with runJobsAfter(), which queues it on the counter
+// and lets the job that brings the count to zero start it, so no thread
+// has to block in between:
+//   runJobsAfter(jobSystem, &counter, drawTask, &drawData, numBatches, &drawCounter);
+//
+// runJob(), runJobs(), runJobsAfter(), waitForCounter() and parallelFor()
+// may only be called from the thread which created the job system or
+// from inside a job, since they use the calling thread's deque.
+struct JobSystem;
+struct JobContinuation;
+
+// Zero-initialise. Only 'count' is meant to be read from outside.
+struct JobCounter
+{
+    volatile int32_t count; // Unfinished jobs
+    volatile int32_t lock;  // Guards 'continuations' and the last decrement
+    JobContinuation* continuations; // Jobs from runJobsAfter() waiting for zero
+};
+
+// Starts 'numWorkerThreads' workers (0 = one per logical processor,
+// minus one for the calling thread). Allocates using malloc().
+JobSystem* createJobSystem(uint32_t numWorkerThreads);
+// Waits for the workers to finish their current jobs and exit. There
+// must be no jobs left to run.
+void destroyJobSystem(JobSystem* jobSystem);
+// Number of threads which run jobs, including the creating thread
+uint32_t getNumJobThreads(const JobSystem* jobSystem);
+
+// Schedules proc(userData, taskIndex). 'counter' may be NULL.
+void runJob(JobSystem* jobSystem, ParallelTaskProc* proc, void* userData, uint32_t taskIndex, JobCounter* counter);
+// Schedules proc(userData, taskIndex) for every taskIndex in
+// [0, numTasks). This is one job which is split in half every time it's
+// taken off a deque, so thieves take big chunks of work and scheduling
+// costs O(numTasks) pushes spread over all threads instead of numTasks
+// pushes on the calling thread.
+void runJobs(JobSystem* jobSystem, ParallelTaskProc* proc, void* userData, uint32_t numTasks, JobCounter* counter);
+// Schedules proc(userData, taskIndex) for every taskIndex in
+// [0, numTasks) like runJobs(), but only once dependency->count reaches
+// zero (straight away if it already has). 'counter' is incremented now,
+// so waiting on it also waits for the dependency. Every job counted by
+// 'dependency' must have been scheduled before this is called.
+void runJobsAfter(JobSystem* jobSystem, JobCounter* dependency, ParallelTaskProc* proc, void* userData,
+                  uint32_t numTasks, JobCounter* counter);
+// Runs jobs until counter->count reaches zero
+void waitForCounter(JobSystem* jobSystem, JobCounter* counter);
+
+// Calls proc(userData, begin, end) over [0, count) in ranges of up to
+// 'batchSize' items, on all threads, and returns once they're done
+typedef void ParallelForProc(void* userData, uint32_t begin, uint32_t end);
+void parallelFor(JobSystem* jobSystem, ParallelForProc* proc, void* userData, uint32_t count, uint32_t batchSize);
@@ -0,0 +1,448 @@
+#include "LightClustering.h"
+#include "SimdMaths.h"
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Per-slice candidate lights are stored as CANDIDATE_ARRAYS arrays of
+// candidateStride floats each: position xyz, radius squared, then the
+// column and row ranges
+enum CandidateArray
+{
+    CandidatePosX,
+    CandidatePosY,
+    CandidatePosZ,
+    CandidateRadiusSq,
+    CandidateColumnMin,
+    CandidateColumnMax,
+    CandidateRowMin,
+    CandidateRowMax,
+    CANDIDATE_ARRAYS
+};
+
+// lightRanges holds these per light
+enum LightRange
+{
+    LightRangeColumnMin,
+    LightRangeColumnMax,
+    LightRangeRowMin,
+    LightRangeRowMax,
+    LightRangeSliceMin,
+    LightRangeSliceMax,
+    LIGHT_RANGES
+};
+
+static uint32_t countTrailingZeros(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+// Room for every light plus padding to a whole wfloat
+static uint32_t candidateStride(uint32_t maxLights)
+{
+    return (maxLights + WFLOAT_WIDTH - 1) / WFLOAT_WIDTH * WFLOAT_WIDTH;
+}
+
+ClusterGrid makeClusterGrid(float4x4 projection, float nearZ, float farZ, uint32_t tilesX, uint32_t tilesY, uint32_t numSlices)
+{
+    assert(tilesX > 0 && tilesX <= CLUSTER_MAX_TILES);
+    assert(tilesY > 0 && tilesY <= CLUSTER_MAX_TILES);
+    assert(numSlices > 0 && numSlices <= CLUSTER_MAX_TILES);
+    assert(nearZ > 0.f && farZ > nearZ);
+    ClusterGrid grid;
+    grid.tilesX = tilesX;
+    grid.tilesY = tilesY;
+    grid.numSlices = numSlices;
+    grid.projX = projection.cols[0];
+    grid.projY = projection.cols[1];
+    grid.projW = projection.cols[3];
+    // Cluster bounds assume clip x doesn't depend on eye y and the other
+    // way round, which holds for every perspective matrix we make
+    assert(grid.projX.y == 0.f && grid.projY.x == 0.f && grid.projW.x == 0.f && grid.projW.y == 0.f);
+    grid.nearZ = nearZ;
+    grid.farZ = farZ;
+    grid.sliceScale = (float)numSlices / log2f(farZ / nearZ);
+    grid.sliceBias = -log2f(nearZ) * grid.sliceScale;
+    return grid;
+}
+
+static uint32_t findSlice(const ClusterGrid* grid, float depth)
+{
+    if(!(depth > 0.f))
+        return 0;
+    float slice = floorf(log2f(depth) * grid->sliceScale + grid->sliceBias);
+    return (uint32_t)fminf(fmaxf(slice, 0.f), (float)(grid->numSlices - 1));
+}
+
+uint32_t findCluster(const ClusterGrid* grid, float3 posEye)
+{
+    float4 pos = { posEye.x, posEye.y, posEye.z, 1.f };
+    float w = dot(pos, grid->projW);
+    float column = floorf((dot(pos, grid->projX) / w * 0.5f + 0.5f) * (float)grid->tilesX);
+    float row = floorf((dot(pos, grid->projY) / w * 0.5f + 0.5f) * (float)grid->tilesY);
+    uint32_t x = (uint32_t)fmaxf(fminf(column, (float)(grid->tilesX - 1)), 0.f);
+    uint32_t y = (uint32_t)fmaxf(fminf(row, (float)(grid->tilesY - 1)), 0.f);
+    uint32_t z = findSlice(grid, -posEye.z);
+    return (z * grid->tilesY + y) * grid->tilesX + x;
+}
+
+LightClusters allocLightClusters(uint32_t tilesX, uint32_t tilesY, uint32_t numSlices, uint32_t maxLights, uint32_t maxLightIndices)
+{
+    assert(maxLights > 0 && maxLights <= 65536);
+    LightClusters clusters = {};
+    clusters.tilesX = tilesX;
+    clusters.tilesY = tilesY;
+    clusters.numSlices = numSlices;
+    clusters.maxLights = maxLights;
+    clusters.maxLightIndices = maxLightIndices;
+    uint32_t numClusters = tilesX * tilesY * numSlices;
+    uint32_t stride = candidateStride(maxLights);
+    clusters.offsets = (uint32_t*)malloc(numClusters * sizeof(uint32_t));
+    clusters.counts = (uint32_t*)malloc(numClusters * sizeof(uint32_t));
+    clusters.lightIndices = (uint16_t*)malloc(maxLightIndices * sizeof(uint16_t));
+    clusters.lightRanges = (uint8_t*)malloc(maxLights * LIGHT_RANGES);
+    clusters.candidates = (float*)malloc((size_t)numSlices * CANDIDATE_ARRAYS * stride * sizeof(float));
+    clusters.candidateLights = (uint16_t*)malloc((size_t)numSlices * stride * sizeof(uint16_t));
+    assert(clusters.offsets && clusters.counts && clusters.lightIndices && clusters.lightRanges &&
+           clusters.candidates && clusters.candidateLights);
+    return clusters;
+}
+
+void freeLightClusters(LightClusters clusters)
+{
+    free(clusters.offsets);
+    free(clusters.counts);
+    free(clusters.lightIndices);
+    free(clusters.lightRanges);
+    free(clusters.candidates);
+    free(clusters.candidateLights);
+}
+
+struct ClusterJob
+{
+    LightClusters* clusters;
+    const ClusterGrid* grid;
+    const ClusterLightSpheres* lights;
+    // Tile boundary planes, normalised, positive towards higher columns/rows:
+    // boundary i is at ndc -1 + 2i/tiles
+    float4 columnPlanes[CLUSTER_MAX_TILES + 1];
+    float4 rowPlanes[CLUSTER_MAX_TILES + 1];
+    bool fill; // Second pass: write the lists instead of counting
+    // Slices some light reaches, in order. The rest are empty and
+    // never visited.
+    uint32_t slices[CLUSTER_MAX_TILES];
+    uint32_t numSlices;
+};
+
+// The plane through the camera where clip 'axis' / clip w = 'ndc'
+static float4 tileBoundaryPlane(float4 axis, float4 w, float ndc)
+{
+    float4 plane = { axis.x - ndc * w.x, axis.y - ndc * w.y, axis.z - ndc * w.z, axis.w - ndc * w.w };
+    float inverseLength = 1.f / length(plane.xyz);
+    return { plane.x * inverseLength, plane.y * inverseLength, plane.z * inverseLength, plane.w * inverseLength };
+}
+
+// Step 1: column, row and slice ranges of lights [begin, end)
+static void findLightRanges(void* userData, uint32_t begin, uint32_t end)
+{
+    const ClusterJob* job = (const ClusterJob*)userData;
+    const ClusterGrid* grid = job->grid;
+    const ClusterLightSpheres* lights = job->lights;
+    for(uint32_t i=begin; i<end; i+=WFLOAT_WIDTH)
+    {
+        int n = (end - i < WFLOAT_WIDTH) ? (int)(end - i) : WFLOAT_WIDTH;
+        wfloat x = wfloatLoadPartial(lights->posX + i, n, 0.f);
+        wfloat y = wfloatLoadPartial(lights->posY + i, n, 0.f);
+        wfloat z = wfloatLoadPartial(lights->posZ + i, n, 0.f);
+        wfloat radius = wfloatLoadPartial(lights->radius + i, n, 0.f);
+        wfloat negRadius = -radius;
+
+        // A sphere entirely on the positive side of boundary b can't
+        // reach columns before b, and one entirely on the negative side
+        // can't reach columns from b on
+        wfloat columnMin = wfloatSet1(0.f);
+        wfloat columnMax = wfloatSet1((float)(grid->tilesX - 1));
+        for(uint32_t b=1; b<grid->tilesX; ++b){
+            float4 plane = job->columnPlanes[b];
+            wfloat distance = wfloatMulAdd(wfloatSet1(plane.x), x, wfloatMulAdd(wfloatSet1(plane.z), z, wfloatSet1(plane.w)));
+            columnMin = wfloatSelect(wfloatLess(radius, distance), wfloatSet1((float)b), columnMin);
+            columnMax = wfloatSelect(wfloatLess(distance, negRadius), wfloatMin(columnMax, wfloatSet1((float)(b - 1))), columnMax);
+        }
+        wfloat rowMin = wfloatSet1(0.f);
+        wfloat rowMax = wfloatSet1((float)(grid->tilesY - 1));
+        for(uint32_t b=1; b<grid->tilesY; ++b){
+            float4 plane = job->rowPlanes[b];
+            wfloat distance = wfloatMulAdd(wfloatSet1(plane.y), y, wfloatMulAdd(wfloatSet1(plane.z), z, wfloatSet1(plane.w)));
+            rowMin = wfloatSelect(wfloatLess(radius, distance), wfloatSet1((float)b), rowMin);
+            rowMax = wfloatSelect(wfloatLess(distance, negRadius), wfloatMin(rowMax, wfloatSet1((float)(b - 1))), rowMax);
+        }
+
+        float ranges[4][WFLOAT_WIDTH];
+        wfloatStore(ranges[0], columnMin);
+        wfloatStore(ranges[1], columnMax);
+        wfloatStore(ranges[2], rowMin);
+        wfloatStore(ranges[3], rowMax);
+        for(int lane=0; lane<n; ++lane)
+        {
+            uint8_t* range = job->clusters->lightRanges + LIGHT_RANGES * (i + lane);
+            float depth = -lights->posZ[i + lane];
+            float lightRadius = lights->radius[i + lane];
+            range[LightRangeColumnMin] = (uint8_t)ranges[0][lane];
+            range[LightRangeColumnMax] = (uint8_t)ranges[1][lane];
+            range[LightRangeRowMin] = (uint8_t)ranges[2][lane];
+            range[LightRangeRowMax] = (uint8_t)ranges[3][lane];
+            range[LightRangeSliceMin] = (uint8_t)findSlice(grid, depth - lightRadius);
+            range[LightRangeSliceMax] = (uint8_t)findSlice(grid, depth + lightRadius);
+            // Behind the camera or between two planes: reaches nothing
+            if(!(depth + lightRadius > 0.f) || ranges[0][lane] > ranges[1][lane] || ranges[2][lane] > ranges[3][lane]){
+                range[LightRangeSliceMin] = 1;
+                range[LightRangeSliceMax] = 0;
+            }
+        }
+    }
+}
+
+// Gathers the lights whose ranges include 'slice' into its candidate
+// arrays, padded to a whole wfloat with lights that reach nothing, and
+// the union of their column and row ranges into 'tileRange'. Returns
+// the padded count.
+static uint32_t gatherSliceCandidates(const ClusterJob* job, uint32_t slice, uint8_t* tileRange)
+{
+    LightClusters* clusters = job->clusters;
+    const ClusterLightSpheres* lights = job->lights;
+    uint32_t stride = candidateStride(clusters->maxLights);
+    float* candidates = clusters->candidates + (size_t)slice * CANDIDATE_ARRAYS * stride;
+    uint16_t* candidateLights = clusters->candidateLights + (size_t)slice * stride;
+    uint32_t count = 0;
+    tileRange[LightRangeColumnMin] = tileRange[LightRangeRowMin] = 0xff;
+    tileRange[LightRangeColumnMax] = tileRange[LightRangeRowMax] = 0;
+    for(uint32_t i=0; i<lights->count; ++i)
+    {
+        const uint8_t* range = clusters->lightRanges + LIGHT_RANGES * i;
+        if(slice < range[LightRangeSliceMin] || slice > range[LightRangeSliceMax])
+            continue;
+        for(int r=LightRangeColumnMin; r<=LightRangeRowMax; r+=2){
+            if(range[r] < tileRange[r])
+                tileRange[r] = range[r];
+            if(range[r + 1] > tileRange[r + 1])
+                tileRange[r + 1] = range[r + 1];
+        }
+        candidates[CandidatePosX * stride + count] = lights->posX[i];
+        candidates[CandidatePosY * stride + count] = lights->posY[i];
+        candidates[CandidatePosZ * stride + count] = lights->posZ[i];
+        candidates[CandidateRadiusSq * stride + count] = lights->radius[i] * lights->radius[i];
+        candidates[CandidateColumnMin * stride + count] = range[LightRangeColumnMin];
+        candidates[CandidateColumnMax * stride + count] = range[LightRangeColumnMax];
+        candidates[CandidateRowMin * stride + count] = range[LightRangeRowMin];
+        candidates[CandidateRowMax * stride + count] = range[LightRangeRowMax];
+        candidateLights[count++] = (uint16_t)i;
+    }
+    for(; count % WFLOAT_WIDTH != 0; ++count){
+        for(int a=0; a<CANDIDATE_ARRAYS; ++a)
+            candidates[a * stride + count] = 0.f;
+        candidates[CandidateRadiusSq * stride + count] = -1.f;
+        candidates[CandidateColumnMin * stride + count] = 1.f;
+        candidateLights[count] = 0;
+    }
+    return count;
+}
+
+// Eye-space x (or y) of tile boundary 'plane' at 'depth'. The plane
+// has no y (or x) component, see makeClusterGrid().
+static float boundaryAtDepth(float4 plane, float planeAxis, float depth)
+{
+    return (plane.z * depth - plane.w) / planeAxis;
+}
+
+// Step 2: counts (first pass) or lists (second pass) of the clusters
+// in job->slices[sliceIndex]
+static void assignSlice(void* userData, uint32_t sliceIndex)
+{
+    const ClusterJob* job = (const ClusterJob*)userData;
+    LightClusters* clusters = job->clusters;
+    const ClusterGrid* grid = job->grid;
+    uint32_t slice = job->slices[sliceIndex];
+    uint32_t stride = candidateStride(clusters->maxLights);
+    const float* candidates = clusters->candidates + (size_t)slice * CANDIDATE_ARRAYS * stride;
+    const uint16_t* candidateLights = clusters->candidateLights + (size_t)slice * stride;
+    uint8_t* tileRange = clusters->sliceTileRanges[slice];
+    // The counting pass gathers the candidates and zeroes the clusters
+    // none of them can reach, the filling pass reuses them and only
+    // visits clusters with lights
+    if(!job->fill)
+    {
+        clusters->numSliceCandidates[slice] = gatherSliceCandidates(job, slice, tileRange);
+        for(uint32_t row=0; row<grid->tilesY; ++row){
+            uint32_t* counts = clusters->counts + (slice * grid->tilesY + row) * grid->tilesX;
+            if(row < tileRange[LightRangeRowMin] || row > tileRange[LightRangeRowMax]){
+                memset(counts, 0, grid->tilesX * sizeof(uint32_t));
+                continue;
+            }
+            for(uint32_t column=0; column<grid->tilesX; ++column)
+                if(column < tileRange[LightRangeColumnMin] || column > tileRange[LightRangeColumnMax])
+                    counts[column] = 0;
+        }
+    }
+    uint32_t numCandidates = clusters->numSliceCandidates[slice];
+
+    // Depth range of the slice. The last one is unbounded, so only the
+    // column and row ranges are tested there.
+    bool testBounds = slice + 1 < grid->numSlices;
+    float nearDepth = (slice == 0) ? 0.f : exp2f(((float)slice - grid->sliceBias) / grid->sliceScale);
+    float farDepth = testBounds ? exp2f(((float)(slice + 1) - grid->sliceBias) / grid->sliceScale) : 0.f;
+
+    for(uint32_t row=tileRange[LightRangeRowMin]; row<=tileRange[LightRangeRowMax]; ++row)
+    {
+        float4 bottom = job->rowPlanes[row];
+        float4 top = job->rowPlanes[row + 1];
+        float yBounds[4] = {
+            boundaryAtDepth(bottom, bottom.y, nearDepth), boundaryAtDepth(bottom, bottom.y, farDepth),
+            boundaryAtDepth(top, top.y, nearDepth), boundaryAtDepth(top, top.y, farDepth)
+        };
+        float minY = fminf(fminf(yBounds[0], yBounds[1]), fminf(yBounds[2], yBounds[3]));
+        float maxY = fmaxf(fmaxf(yBounds[0], yBounds[1]), fmaxf(yBounds[2], yBounds[3]));
+        for(uint32_t column=tileRange[LightRangeColumnMin]; column<=tileRange[LightRangeColumnMax]; ++column)
+        {
+            uint32_t cluster = (slice * grid->tilesY + row) * grid->tilesX + column;
+            if(job->fill && clusters->counts[cluster] == 0)
+                continue;
+            float4 left = job->columnPlanes[column];
+            float4 right = job->columnPlanes[column + 1];
+            float xBounds[4] = {
+                boundaryAtDepth(left, left.x, nearDepth), boundaryAtDepth(left, left.x, farDepth),
+                boundaryAtDepth(right, right.x, nearDepth), boundaryAtDepth(right, right.x, farDepth)
+            };
+            wfloat boxMin[3] = {
+                wfloatSet1(fminf(fminf(xBounds[0], xBounds[1]), fminf(xBounds[2], xBounds[3]))), wfloatSet1(minY), wfloatSet1(-farDepth)
+            };
+            wfloat boxMax[3] = {
+                wfloatSet1(fmaxf(fmaxf(xBounds[0], xBounds[1]), fmaxf(xBounds[2], xBounds[3]))), wfloatSet1(maxY), wfloatSet1(-nearDepth)
+            };
+            wfloat columnIndex = wfloatSet1((float)column);
+            wfloat rowIndex = wfloatSet1((float)row);
+
+            uint32_t count = 0;
+            uint32_t maxCount = job->fill ? clusters->counts[cluster] : 0xffffffff;
+            uint16_t* out = clusters->lightIndices + (job->fill ? clusters->offsets[cluster] : 0);
+            for(uint32_t i=0; i<numCandidates && count<maxCount; i+=WFLOAT_WIDTH)
+            {
+                wfloat inRange = wfloatAnd(
+                    wfloatAnd(wfloatLessEqual(wfloatLoad(candidates + CandidateColumnMin * stride + i), columnIndex),
+                              wfloatLessEqual(columnIndex, wfloatLoad(candidates + CandidateColumnMax * stride + i))),
+                    wfloatAnd(wfloatLessEqual(wfloatLoad(candidates + CandidateRowMin * stride + i), rowIndex),
+                              wfloatLessEqual(rowIndex, wfloatLoad(candidates + CandidateRowMax * stride + i))));
+                if(testBounds)
+                {
+                    // Squared distance from the sphere's centre to the box
+                    wfloat distanceSq = wfloatSet1(0.f);
+                    for(int a=0; a<3; ++a){
+                        wfloat centre = wfloatLoad(candidates + (CandidatePosX + a) * stride + i);
+                        wfloat outside = wfloatMax(boxMin[a] - centre, wfloatSet1(0.f)) + wfloatMax(centre - boxMax[a], wfloatSet1(0.f));
+                        distanceSq = wfloatMulAdd(outside, outside, distanceSq);
+                    }
+                    inRange = wfloatAnd(inRange, wfloatLessEqual(distanceSq, wfloatLoad(candidates + CandidateRadiusSq * stride + i)));
+                }
+                uint32_t mask = (uint32_t)wfloatMoveMask(inRange);
+                while(mask && count < maxCount)
+                {
+                    if(job->fill)
+                        out[count] = candidateLights[i + countTrailingZeros(mask)];
+                    ++count;
+                    mask &= mask - 1;
+                }
+            }
+            if(!job->fill)
+                clusters->counts[cluster] = count;
+        }
+    }
+}
+
+static void runSliceJobs(ClusterJob* job, JobSystem* jobSystem)
+{
+    if(jobSystem && job->numSlices > 1){
+        JobCounter counter = {};
+        runJobs(jobSystem, assignSlice, job, job->numSlices, &counter);
+        waitForCounter(jobSystem, &counter);
+    }
+    else {
+        for(uint32_t i=0; i<job->numSlices; ++i)
+            assignSlice(job, i);
+    }
+}
+
+void assignLightsToClusters(LightClusters* clusters, const ClusterGrid* grid, const ClusterLightSpheres* lights, JobSystem* jobSystem)
+{
+    assert(grid->tilesX <= clusters->tilesX && grid->tilesY <= clusters->tilesY && grid->numSlices <= clusters->numSlices);
+    assert(lights->count <= clusters->maxLights);
+    uint32_t numClusters = clusterGridSize(grid);
+    clusters->numLightIndices = 0;
+    clusters->numDroppedIndices = 0;
+    if(lights->count == 0){
+        memset(clusters->counts, 0, numClusters * sizeof(uint32_t));
+        memset(clusters->offsets, 0, numClusters * sizeof(uint32_t));
+        return;
+    }
+
+    ClusterJob job;
+    job.clusters = clusters;
+    job.grid = grid;
+    job.lights = lights;
+    job.fill = false;
+    for(uint32_t i=0; i<=grid->tilesX; ++i)
+        job.columnPlanes[i] = tileBoundaryPlane(grid->projX, grid->projW, -1.f + 2.f * (float)i / (float)grid->tilesX);
+    for(uint32_t i=0; i<=grid->tilesY; ++i)
+        job.rowPlanes[i] = tileBoundaryPlane(grid->projY, grid->projW, -1.f + 2.f * (float)i / (float)grid->tilesY);
+
+    const uint32_t LIGHTS_PER_JOB = 256;
+    if(jobSystem)
+        parallelFor(jobSystem, findLightRanges, &job, lights->count, LIGHTS_PER_JOB);
+    else
+        findLightRanges(&job, 0, lights->count);
+
+    // Only visit slices inside some light's slice range
+    uint64_t occupiedSlices = 0;
+    for(uint32_t i=0; i<lights->count; ++i){
+        const uint8_t* range = clusters->lightRanges + LIGHT_RANGES * i;
+        if(range[LightRangeSliceMin] <= range[LightRangeSliceMax])
+            occupiedSlices |= (~0ull >> (63 - range[LightRangeSliceMax])) & (~0ull << range[LightRangeSliceMin]);
+    }
+    uint32_t clustersPerSlice = grid->tilesX * grid->tilesY;
+    job.numSlices = 0;
+    for(uint32_t slice=0; slice<grid->numSlices; ++slice){
+        if(occupiedSlices & (1ull << slice))
+            job.slices[job.numSlices++] = slice;
+        else
+            memset(clusters->counts + slice * clustersPerSlice, 0, clustersPerSlice * sizeof(uint32_t));
+    }
+
+    // Count, lay the lists out one after another (dropping whatever
+    // doesn't fit), then fill them in
+    runSliceJobs(&job, jobSystem);
+    uint32_t offset = 0;
+    for(uint32_t i=0; i<numClusters; ++i){
+        uint32_t count = clusters->counts[i];
+        if(count > clusters->maxLightIndices - offset){
+            clusters->numDroppedIndices += count - (clusters->maxLightIndices - offset);
+            count = clusters->maxLightIndices - offset;
+        }
+        clusters->offsets[i] = offset;
+        clusters->counts[i] = count;
+        offset += count;
+    }
+    clusters->numLightIndices = offset;
+    job.fill = true;
+    runSliceJobs(&job, jobSystem);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include "3DMaths.h"
+
+struct JobSystem;
+
+// Clustered light assignment, so a pixel shader only loops over the
+// point lights which can reach it instead of every light in the scene.
+//
+// The view frustum is split into froxels ("clusters"): tilesX x tilesY
+// tiles in normalised device coordinates (row 0 at the bottom, ndc
+// y = -1) times numSlices depth slices spaced exponentially between
+// nearZ and farZ. The first slice reaches the camera and the last one
+// goes on forever, so every point in front of the camera has a cluster.
+// Clusters are numbered (slice * tilesY + row) * tilesX + column.
+//
+// Lights are spheres in eye space. assignLightsToClusters() works in
+// two steps:
+//   1. Per light, WFLOAT_WIDTH lights at a time: the range of columns,
+//      rows and slices the sphere overlaps, from its distance to each
+//      tile boundary plane and its depth range.
+//   2. Per slice some light reaches, one job each: every cluster inside
+//      the slice's lights' column and row ranges tests the lights whose
+//      ranges include it, WFLOAT_WIDTH at a time, against the cluster's
+//      eye-space bounding box.
+// Both are conservative: a light which reaches any point of a cluster
+// is always in that cluster's list.
+
+struct ClusterGrid
+{
+    uint32_t tilesX, tilesY, numSlices;
+    // Columns of the projection giving clip x, y and w (see Frustum)
+    float4 projX, projY, projW;
+    float nearZ, farZ;
+    // slice = floor(log2(depth) * sliceScale + sliceBias), clamped
+    float sliceScale, sliceBias;
+};
+
+// 'projection' is any makePerspectiveMat() matrix (every DepthMode
+// works, only x, y and w are used). nearZ and farZ are eye-space
+// distances to spread the slices over, independent of the projection's
+// clip planes. Tiles and slices must be at most CLUSTER_MAX_TILES.
+const uint32_t CLUSTER_MAX_TILES = 64;
+ClusterGrid makeClusterGrid(float4x4 projection, float nearZ, float farZ, uint32_t tilesX, uint32_t tilesY, uint32_t numSlices);
+
+inline uint32_t clusterGridSize(const ClusterGrid* grid) { return grid->tilesX * grid->tilesY * grid->numSlices; }
+// Cluster containing eye-space point 'posEye', in front of the camera.
+// Same calculation as BlinnPhong.hlsl.
+uint32_t findCluster(const ClusterGrid* grid, float3 posEye);
+
+// Eye-space light spheres, as separate arrays
+struct ClusterLightSpheres
+{
+    const float* posX;
+    const float* posY;
+    const float* posZ;
+    const float* radius;
+    uint32_t count;
+};
+
+struct LightClusters
+{
+    uint32_t tilesX, tilesY, numSlices;
+    uint32_t maxLights;
+    uint32_t maxLightIndices;
+
+    // Cluster c's lights are lightIndices[offsets[c]] onwards, counts[c]
+    // of them, in ascending order
+    uint32_t* offsets;
+    uint32_t* counts;
+    uint16_t* lightIndices;
+    uint32_t numLightIndices;
+    // Light/cluster pairs which didn't fit in maxLightIndices. The last
+    // clusters miss those lights.
+    uint32_t numDroppedIndices;
+
+    // Scratch
+    uint8_t* lightRanges;      // Column, row and slice min/max of each light
+    float* candidates;         // Per slice, the lights which reach it (see LightClustering.cpp)
+    uint16_t* candidateLights;
+    uint32_t numSliceCandidates[CLUSTER_MAX_TILES];
+    uint8_t sliceTileRanges[CLUSTER_MAX_TILES][4]; // Union of the candidates' column and row ranges
+};
+
+// For grids of tilesX x tilesY x numSlices and up to 'maxLights'
+// lights (at most 65536). Allocates using malloc().
+LightClusters allocLightClusters(uint32_t tilesX, uint32_t tilesY, uint32_t numSlices, uint32_t maxLights, uint32_t maxLightIndices);
+void freeLightClusters(LightClusters clusters);
+
+// Fills in the cluster lists of 'clusters' for 'lights', whose count
+// must be at most maxLights. The grid's tiles and slices must be at
+// most the ones 'clusters' was allocated for; a smaller (coarser) grid
+// uses the start of offsets and counts. Runs on 'jobSystem' if it isn't
+// NULL, in which case it must be called from a thread which may run jobs.
+//
+// The cost goes with the clusters the lights reach: slices no light
+// reaches and tiles outside a slice's lights are skipped, and no lights
+// returns straight away.
+void assignLightsToClusters(LightClusters* clusters, const ClusterGrid* grid, const ClusterLightSpheres* lights, JobSystem* jobSystem);
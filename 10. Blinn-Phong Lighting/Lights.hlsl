@@ -1,12 +1,16 @@
 
 cbuffer constants : register(b0)
 {
-    float4x4 modelViewProj;
-    float4 color;
+    float4x4 projection;
 };
 
 struct VertexShaderInput {
     float3 pos : POS;
+    // Per-instance (see LightInstance in InstancedDrawing.h)
+    float4 modelView0 : MODELVIEW0;
+    float4 modelView1 : MODELVIEW1;
+    float4 modelView2 : MODELVIEW2;
+    float4 color : COLOR;
 };
 
 struct VertexShaderOutput {
@@ -16,9 +20,13 @@ struct VertexShaderOutput {
 
 VertexShaderOutput vs_main(VertexShaderInput input)
 {
+    // Each per-instance vector is a column of the matrix (see affine3x4)
+    float4x3 modelView = transpose(float3x4(input.modelView0, input.modelView1, input.modelView2));
+
     VertexShaderOutput output;
-    output.pos = mul(float4(input.pos, 1.0f), modelViewProj);
-    output.color = color;
+    float3 posEye = mul(float4(input.pos, 1.0f), modelView);
+    output.pos = mul(float4(posEye, 1.0f), projection);
+    output.color = input.color;
     return output;
 }
 
@@ -1,4 +1,5 @@
 #include "ObjLoading.h"
+#include "JobSystem.h"
 
 #pragma warning(push)
 #pragma warning(disable:4996) // disable warning that fopen() is unsafe
@@ -136,9 +137,9 @@ static int fixupIndex(int index, size_t size)
     return (index >= 0) ? index - 1 : int(size) + index;
 }
 
-static bool areAlmostEqual(float a, float b)
+static bool areAlmostEqual(float a, float b, float tolerance)
 {
-    return (fabs(a-b) < 0.00001f);
+    return (fabs(a-b) < tolerance);
 }
 
 static void growArray(void** array, size_t* capacity, size_t itemSize)
@@ -148,7 +149,437 @@ static void growArray(void** array, size_t* capacity, size_t itemSize)
     assert(*array);
 }
 
-LoadedObj loadObj(const char* filename)
+// Vertex welding via quantized keys + parallel radix sort
+//
+// Every step is split into one contiguous chunk per job thread, run as
+// jobs on the caller's JobSystem.
+//
+// 1. Every corner's attributes are snapped to integer grid coordinates
+//    and hashed to 32 bits.
+// 2. (hash, cornerIndex) pairs are sorted with a stable LSD radix sort.
+//    Each pass builds per-thread histograms over contiguous chunks and
+//    scatters in thread order, so the result never depends on the
+//    number of threads.
+// 3. Runs of equal hashes are split by comparing the full grid keys
+//    (so hash collisions can't merge different vertices). Every corner
+//    gets a representative: the lowest corner index with the same key.
+// 4. Representatives are numbered in corner order with a parallel
+//    prefix sum, which gives vertices in order of first use.
+// 5. Corners are remapped and degenerate triangles are compacted away.
+
+static const uint32_t WELD_RADIX_BITS = 11;
+static const uint32_t WELD_RADIX_SIZE = 1 << WELD_RADIX_BITS;
+static const uint32_t WELD_NUM_KEY_COMPONENTS = 9;
+static const uint32_t WELD_MIN_CORNERS_PER_THREAD = 16384;
+
+struct WeldSortItem
+{
+    uint32_t hash;
+    uint32_t cornerIndex;
+};
+
+struct WeldContext
+{
+    const VertexData* corners;
+    const uint8_t* cornerIsSmooth;
+    uint32_t numCorners;
+    uint32_t numTriangles;
+    // Per attribute
+    float invPositionGridSize, invUvGridSize, invNormalGridSize;
+    JobSystem* jobSystem; // NULL to run everything on the calling thread
+    uint32_t numThreads;  // Chunks each step is split into
+
+    WeldSortItem* sortItems;
+    WeldSortItem* sortScratch;
+    uint32_t* histograms; // WELD_RADIX_SIZE entries per thread
+    uint32_t radixShift;
+
+    uint32_t* runStarts; // numThreads+1 entries, aligned to hash runs
+    uint32_t* representatives;
+    float* normalSums;
+
+    uint32_t* threadCounts;
+    uint32_t* threadOffsets;
+    uint32_t* vertexIndices;
+
+    VertexData* outVertices;
+    uint32_t* outIndices;
+};
+
+// Runs proc(ctx, threadIndex) for every chunk and waits for them all
+static void runWeldStep(WeldContext* ctx, ParallelTaskProc* proc)
+{
+    if(!ctx->jobSystem || ctx->numThreads == 1){
+        for(uint32_t t=0; t<ctx->numThreads; ++t)
+            proc(ctx, t);
+        return;
+    }
+    JobCounter counter = {};
+    runJobs(ctx->jobSystem, proc, ctx, ctx->numThreads, &counter);
+    waitForCounter(ctx->jobSystem, &counter);
+}
+
+static void getThreadRange(uint32_t count, uint32_t numThreads, uint32_t threadIndex, uint32_t* begin, uint32_t* end)
+{
+    *begin = (uint32_t)(((uint64_t)count * threadIndex) / numThreads);
+    *end = (uint32_t)(((uint64_t)count * (threadIndex+1)) / numThreads);
+}
+
+static int32_t quantize(float f, float invGridSize)
+{
+    // Round half away from zero; the cast truncates, which is much
+    // cheaper than calling floor(). Clamp so the cast can't overflow.
+    float q = f * invGridSize;
+    q += (q >= 0) ? 0.5f : -0.5f;
+    if(q > 2147483520.f) q = 2147483520.f;
+    if(q < -2147483520.f) q = -2147483520.f;
+    return (int32_t)q;
+}
+
+static void getWeldKey(const WeldContext* ctx, uint32_t cornerIndex, int32_t key[WELD_NUM_KEY_COMPONENTS])
+{
+    const VertexData* v = ctx->corners + cornerIndex;
+    bool isSmooth = ctx->cornerIsSmooth && ctx->cornerIsSmooth[cornerIndex];
+    key[0] = quantize(v->pos[0], ctx->invPositionGridSize);
+    key[1] = quantize(v->pos[1], ctx->invPositionGridSize);
+    key[2] = quantize(v->pos[2], ctx->invPositionGridSize);
+    key[3] = quantize(v->uv[0], ctx->invUvGridSize);
+    key[4] = quantize(v->uv[1], ctx->invUvGridSize);
+    // Smooth corners merge regardless of normal
+    key[5] = isSmooth ? 0 : quantize(v->norm[0], ctx->invNormalGridSize);
+    key[6] = isSmooth ? 0 : quantize(v->norm[1], ctx->invNormalGridSize);
+    key[7] = isSmooth ? 0 : quantize(v->norm[2], ctx->invNormalGridSize);
+    key[8] = isSmooth;
+}
+
+static void weldBuildSortItems(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin, end;
+    getThreadRange(ctx->numCorners, ctx->numThreads, threadIndex, &begin, &end);
+
+    for(uint32_t i=begin; i<end; ++i)
+    {
+        int32_t key[WELD_NUM_KEY_COMPONENTS];
+        getWeldKey(ctx, i, key);
+
+        // Murmur3-style mixing of each key component
+        uint32_t hash = 0x9747b28c;
+        for(uint32_t k=0; k<WELD_NUM_KEY_COMPONENTS; ++k){
+            uint32_t h = (uint32_t)key[k] * 0xcc9e2d51;
+            h = (h << 15) | (h >> 17);
+            hash ^= h * 0x1b873593;
+            hash = ((hash << 13) | (hash >> 19)) * 5 + 0xe6546b64;
+        }
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6b;
+        hash ^= hash >> 13;
+        hash *= 0xc2b2ae35;
+        hash ^= hash >> 16;
+
+        ctx->sortItems[i] = {hash, i};
+    }
+}
+
+static void weldRadixHistogram(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin, end;
+    getThreadRange(ctx->numCorners, ctx->numThreads, threadIndex, &begin, &end);
+
+    uint32_t* histogram = ctx->histograms + threadIndex * WELD_RADIX_SIZE;
+    for(uint32_t i=0; i<WELD_RADIX_SIZE; ++i)
+        histogram[i] = 0;
+    for(uint32_t i=begin; i<end; ++i)
+        ++histogram[(ctx->sortItems[i].hash >> ctx->radixShift) & (WELD_RADIX_SIZE-1)];
+}
+
+static void weldRadixScatter(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin, end;
+    getThreadRange(ctx->numCorners, ctx->numThreads, threadIndex, &begin, &end);
+
+    // Histogram has been converted to output offsets by now
+    uint32_t* offsets = ctx->histograms + threadIndex * WELD_RADIX_SIZE;
+    for(uint32_t i=begin; i<end; ++i){
+        WeldSortItem item = ctx->sortItems[i];
+        ctx->sortScratch[offsets[(item.hash >> ctx->radixShift) & (WELD_RADIX_SIZE-1)]++] = item;
+    }
+}
+
+static void weldGroupRuns(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin = ctx->runStarts[threadIndex];
+    uint32_t end = ctx->runStarts[threadIndex+1];
+
+    // The scratch sort buffer is free now, so representatives are first
+    // written to it in sorted order (sequential writes) and scattered back
+    // to corner order afterwards by weldScatterRepresentatives().
+    WeldSortItem* sortedReps = ctx->sortScratch;
+
+    uint32_t runStart = begin;
+    while(runStart < end)
+    {
+        uint32_t runEnd = runStart + 1;
+        while(runEnd < end && ctx->sortItems[runEnd].hash == ctx->sortItems[runStart].hash)
+            ++runEnd;
+
+        for(uint32_t i=runStart; i<runEnd; ++i)
+            sortedReps[i].cornerIndex = UINT32_MAX;
+
+        // Split run by exact key (more than one group only happens on a
+        // hash collision). The sort is stable so the first unassigned
+        // item of each group has the lowest corner index.
+        for(uint32_t i=runStart; i<runEnd; ++i)
+        {
+            if(sortedReps[i].cornerIndex != UINT32_MAX)
+                continue;
+
+            uint32_t rep = ctx->sortItems[i].cornerIndex;
+            int32_t repKey[WELD_NUM_KEY_COMPONENTS];
+            getWeldKey(ctx, rep, repKey);
+
+            float* normalSum = ctx->normalSums + 3*rep;
+            normalSum[0] = normalSum[1] = normalSum[2] = 0;
+            for(uint32_t j=i; j<runEnd; ++j)
+            {
+                if(sortedReps[j].cornerIndex != UINT32_MAX)
+                    continue;
+
+                uint32_t corner = ctx->sortItems[j].cornerIndex;
+                if(j != i)
+                {
+                    int32_t key[WELD_NUM_KEY_COMPONENTS];
+                    getWeldKey(ctx, corner, key);
+                    bool keysMatch = true;
+                    for(uint32_t k=0; k<WELD_NUM_KEY_COMPONENTS; ++k)
+                        keysMatch &= (key[k] == repKey[k]);
+                    if(!keysMatch)
+                        continue;
+                }
+                sortedReps[j].cornerIndex = rep;
+                normalSum[0] += ctx->corners[corner].norm[0];
+                normalSum[1] += ctx->corners[corner].norm[1];
+                normalSum[2] += ctx->corners[corner].norm[2];
+            }
+        }
+        runStart = runEnd;
+    }
+}
+
+static void weldScatterRepresentatives(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin, end;
+    getThreadRange(ctx->numCorners, ctx->numThreads, threadIndex, &begin, &end);
+
+    for(uint32_t i=begin; i<end; ++i)
+        ctx->representatives[ctx->sortItems[i].cornerIndex] = ctx->sortScratch[i].cornerIndex;
+}
+
+static void weldCountVertices(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin, end;
+    getThreadRange(ctx->numCorners, ctx->numThreads, threadIndex, &begin, &end);
+
+    uint32_t count = 0;
+    for(uint32_t i=begin; i<end; ++i)
+        count += (ctx->representatives[i] == i);
+    ctx->threadCounts[threadIndex] = count;
+}
+
+static void weldEmitVertices(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin, end;
+    getThreadRange(ctx->numCorners, ctx->numThreads, threadIndex, &begin, &end);
+
+    uint32_t vertexIndex = ctx->threadOffsets[threadIndex];
+    for(uint32_t i=begin; i<end; ++i)
+    {
+        if(ctx->representatives[i] != i)
+            continue;
+        ctx->vertexIndices[i] = vertexIndex;
+
+        VertexData v = ctx->corners[i];
+        const float* normalSum = ctx->normalSums + 3*i;
+        float normLength = sqrtf(normalSum[0]*normalSum[0] 
+                         + normalSum[1]*normalSum[1]
+                         + normalSum[2]*normalSum[2]);
+        if(normLength > 0){
+            float invNormLength = 1.f / normLength;
+            v.norm[0] = normalSum[0] * invNormLength;
+            v.norm[1] = normalSum[1] * invNormLength;
+            v.norm[2] = normalSum[2] * invNormLength;
+        }
+        ctx->outVertices[vertexIndex++] = v;
+    }
+}
+
+static void weldCountTriangles(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin, end;
+    getThreadRange(ctx->numTriangles, ctx->numThreads, threadIndex, &begin, &end);
+
+    uint32_t count = 0;
+    for(uint32_t i=begin; i<end; ++i)
+    {
+        uint32_t a = ctx->vertexIndices[ctx->representatives[3*i]];
+        uint32_t b = ctx->vertexIndices[ctx->representatives[3*i+1]];
+        uint32_t c = ctx->vertexIndices[ctx->representatives[3*i+2]];
+        count += (a != b && b != c && c != a);
+    }
+    ctx->threadCounts[threadIndex] = count;
+}
+
+static void weldEmitTriangles(void* userData, uint32_t threadIndex)
+{
+    WeldContext* ctx = (WeldContext*)userData;
+    uint32_t begin, end;
+    getThreadRange(ctx->numTriangles, ctx->numThreads, threadIndex, &begin, &end);
+
+    uint32_t* out = ctx->outIndices + 3*ctx->threadOffsets[threadIndex];
+    for(uint32_t i=begin; i<end; ++i)
+    {
+        uint32_t a = ctx->vertexIndices[ctx->representatives[3*i]];
+        uint32_t b = ctx->vertexIndices[ctx->representatives[3*i+1]];
+        uint32_t c = ctx->vertexIndices[ctx->representatives[3*i+2]];
+        if(a == b || b == c || c == a)
+            continue;
+        *out++ = a;
+        *out++ = b;
+        *out++ = c;
+    }
+}
+
+// Converts threadCounts into exclusive prefix sums in threadOffsets,
+// returns the total
+static uint32_t weldPrefixSumThreadCounts(WeldContext* ctx)
+{
+    uint32_t total = 0;
+    for(uint32_t i=0; i<ctx->numThreads; ++i){
+        ctx->threadOffsets[i] = total;
+        total += ctx->threadCounts[i];
+    }
+    return total;
+}
+
+WeldedMesh weldVertices(const VertexData* corners, const uint8_t* cornerIsSmooth, uint32_t numCorners, WeldTolerances tolerances, JobSystem* jobSystem)
+{
+    assert(numCorners % 3 == 0);
+    assert(tolerances.position > 0 && tolerances.uv > 0 && tolerances.normal > 0);
+
+    uint32_t numThreads = jobSystem ? getNumJobThreads(jobSystem) : 1;
+    uint32_t maxUsefulThreads = numCorners / WELD_MIN_CORNERS_PER_THREAD;
+    if(numThreads > maxUsefulThreads)
+        numThreads = maxUsefulThreads;
+    if(numThreads < 1)
+        numThreads = 1;
+
+    WeldContext ctx = {};
+    ctx.corners = corners;
+    ctx.cornerIsSmooth = cornerIsSmooth;
+    ctx.numCorners = numCorners;
+    ctx.numTriangles = numCorners / 3;
+    ctx.invPositionGridSize = 1.f / tolerances.position;
+    ctx.invUvGridSize = 1.f / tolerances.uv;
+    ctx.invNormalGridSize = 1.f / tolerances.normal;
+    ctx.jobSystem = jobSystem;
+    ctx.numThreads = numThreads;
+
+    ctx.sortItems = (WeldSortItem*)malloc(numCorners * sizeof(WeldSortItem));
+    ctx.sortScratch = (WeldSortItem*)malloc(numCorners * sizeof(WeldSortItem));
+    ctx.histograms = (uint32_t*)malloc(numThreads * WELD_RADIX_SIZE * sizeof(uint32_t));
+    ctx.runStarts = (uint32_t*)malloc((numThreads + 1) * sizeof(uint32_t));
+    ctx.representatives = (uint32_t*)malloc(numCorners * sizeof(uint32_t));
+    ctx.normalSums = (float*)malloc(numCorners * 3 * sizeof(float));
+    ctx.threadCounts = (uint32_t*)malloc(numThreads * sizeof(uint32_t));
+    ctx.threadOffsets = (uint32_t*)malloc(numThreads * sizeof(uint32_t));
+    ctx.vertexIndices = (uint32_t*)malloc(numCorners * sizeof(uint32_t));
+    assert(ctx.sortItems && ctx.sortScratch && ctx.histograms && ctx.runStarts);
+    assert(ctx.representatives && ctx.normalSums && ctx.threadCounts && ctx.threadOffsets && ctx.vertexIndices);
+
+    runWeldStep(&ctx, weldBuildSortItems);
+
+    // Stable LSD radix sort on the 32-bit hash
+    for(ctx.radixShift = 0; ctx.radixShift < 32; ctx.radixShift += WELD_RADIX_BITS)
+    {
+        runWeldStep(&ctx, weldRadixHistogram);
+
+        // Turn histograms into scatter offsets: digit-major, then thread order
+        uint32_t offset = 0;
+        for(uint32_t digit=0; digit<WELD_RADIX_SIZE; ++digit){
+            for(uint32_t t=0; t<numThreads; ++t){
+                uint32_t* bucket = ctx.histograms + t * WELD_RADIX_SIZE + digit;
+                uint32_t count = *bucket;
+                *bucket = offset;
+                offset += count;
+            }
+        }
+
+        runWeldStep(&ctx, weldRadixScatter);
+
+        WeldSortItem* temp = ctx.sortItems;
+        ctx.sortItems = ctx.sortScratch;
+        ctx.sortScratch = temp;
+    }
+
+    // Split sorted items between threads without breaking up hash runs
+    ctx.runStarts[0] = 0;
+    for(uint32_t t=1; t<numThreads; ++t){
+        uint32_t begin, end;
+        getThreadRange(numCorners, numThreads, t, &begin, &end);
+        if(begin < ctx.runStarts[t-1])
+            begin = ctx.runStarts[t-1];
+        while(begin > 0 && begin < numCorners && ctx.sortItems[begin].hash == ctx.sortItems[begin-1].hash)
+            ++begin;
+        ctx.runStarts[t] = begin;
+    }
+    ctx.runStarts[numThreads] = numCorners;
+    runWeldStep(&ctx, weldGroupRuns);
+    runWeldStep(&ctx, weldScatterRepresentatives);
+
+    runWeldStep(&ctx, weldCountVertices);
+    uint32_t numVertices = weldPrefixSumThreadCounts(&ctx);
+    ctx.outVertices = (VertexData*)malloc(numVertices * sizeof(VertexData));
+    assert(ctx.outVertices || numVertices == 0);
+    runWeldStep(&ctx, weldEmitVertices);
+
+    runWeldStep(&ctx, weldCountTriangles);
+    uint32_t numTriangles = weldPrefixSumThreadCounts(&ctx);
+    ctx.outIndices = (uint32_t*)malloc(numTriangles * 3 * sizeof(uint32_t));
+    assert(ctx.outIndices || numTriangles == 0);
+    runWeldStep(&ctx, weldEmitTriangles);
+
+    free(ctx.sortItems);
+    free(ctx.sortScratch);
+    free(ctx.histograms);
+    free(ctx.runStarts);
+    free(ctx.representatives);
+    free(ctx.normalSums);
+    free(ctx.threadCounts);
+    free(ctx.threadOffsets);
+    free(ctx.vertexIndices);
+
+    WeldedMesh result;
+    result.numVertices = numVertices;
+    result.numIndices = numTriangles * 3;
+    result.vertexBuffer = ctx.outVertices;
+    result.indexBuffer = ctx.outIndices;
+    return result;
+}
+
+void freeWeldedMesh(WeldedMesh weldedMesh)
+{
+    free(weldedMesh.vertexBuffer);
+    free(weldedMesh.indexBuffer);
+}
+
+LoadedObj loadObj(const char* filename, ObjWeldMode weldMode, JobSystem* jobSystem)
 {
     LoadedObj result = {};
 
@@ -203,7 +634,16 @@ LoadedObj loadObj(const char* filename)
     VertexData* outVertexBuffer = NULL;
     uint16_t* outIndexBuffer = NULL;
 
+    // Only used with ObjWeldModeQuantized
+    size_t cornerCapacity = 0;
+    size_t smoothFlagCapacity = 0;
+    size_t numCorners = 0;
+    VertexData* corners = NULL;
+    uint8_t* cornerIsSmooth = NULL;
+
     bool smoothNormals = false;
+    // Set once the mesh has more vertices than 16-bit indices can address
+    bool tooManyVertices = false;
 
     const char* s = fileBytes;
     while(*s)
@@ -247,19 +687,33 @@ LoadedObj loadObj(const char* filename)
                     vnBuffer[3*vnIdx], vnBuffer[3*vnIdx+1], vnBuffer[3*vnIdx+2],
                 };
 
+                if(weldMode == ObjWeldModeQuantized)
+                {
+                    // Defer welding until all corners are known
+                    if(numCorners + 1 > cornerCapacity){
+                        growArray((void**)(&corners), &cornerCapacity, sizeof(VertexData));
+                        growArray((void**)(&cornerIsSmooth), &smoothFlagCapacity, sizeof(uint8_t));
+                    }
+                    corners[numCorners] = newVert;
+                    cornerIsSmooth[numCorners] = smoothNormals;
+                    ++numCorners;
+                    continue;
+                }
+
                 // Search vertexBuffer for matching vertex
                 uint32_t index;
                 for(index=0; index<vertexBufferSize; ++index) 
                 {
                     VertexData* v = outVertexBuffer + index;
-                    bool posMatch = areAlmostEqual(v->pos[0], newVert.pos[0])
-                                 && areAlmostEqual(v->pos[1], newVert.pos[1])
-                                 && areAlmostEqual(v->pos[2], newVert.pos[2]);
-                    bool uvMatch = areAlmostEqual(v->uv[0], newVert.uv[0])
-                                && areAlmostEqual(v->uv[1], newVert.uv[1]);
-                    bool normMatch = areAlmostEqual(v->norm[0], newVert.norm[0])
-                                  && areAlmostEqual(v->norm[1], newVert.norm[1])
-                                  && areAlmostEqual(v->norm[2], newVert.norm[2]);
+                    const WeldTolerances* tol = &OBJ_WELD_TOLERANCES;
+                    bool posMatch = areAlmostEqual(v->pos[0], newVert.pos[0], tol->position)
+                                 && areAlmostEqual(v->pos[1], newVert.pos[1], tol->position)
+                                 && areAlmostEqual(v->pos[2], newVert.pos[2], tol->position);
+                    bool uvMatch = areAlmostEqual(v->uv[0], newVert.uv[0], tol->uv)
+                                && areAlmostEqual(v->uv[1], newVert.uv[1], tol->uv);
+                    bool normMatch = areAlmostEqual(v->norm[0], newVert.norm[0], tol->normal)
+                                  && areAlmostEqual(v->norm[1], newVert.norm[1], tol->normal)
+                                  && areAlmostEqual(v->norm[2], newVert.norm[2], tol->normal);
                     if(posMatch && uvMatch)
                     {
                         if(normMatch || smoothNormals){
@@ -270,6 +724,10 @@ LoadedObj loadObj(const char* filename)
                         }
                     }
                 }
+                if(index == OBJ_MAX_VERTICES){
+                    tooManyVertices = true;
+                    break;
+                }
                 if(index == vertexBufferSize){
                     if(vertexBufferSize + 1 > vertexBufferCapacity){
                         growArray((void**)(&outVertexBuffer), &vertexBufferCapacity, sizeof(VertexData));
@@ -281,6 +739,8 @@ LoadedObj loadObj(const char* filename)
                 }
                 outIndexBuffer[indexBufferSize++] = (uint16_t)index;
             }
+            if(tooManyVertices)
+                break;
         }
         else if(currChar == 's' && *(++s) == ' ')
         {
@@ -296,6 +756,38 @@ LoadedObj loadObj(const char* filename)
         while(*s != 0 && *s++ != '\n');
     }
 
+    if(weldMode == ObjWeldModeQuantized)
+    {
+        WeldedMesh welded = weldVertices(corners, cornerIsSmooth, (uint32_t)numCorners, OBJ_WELD_TOLERANCES, jobSystem);
+        if(welded.numVertices > OBJ_MAX_VERTICES){
+            tooManyVertices = true;
+            freeWeldedMesh(welded);
+        }
+        else {
+            vertexBufferSize = welded.numVertices;
+            indexBufferSize = welded.numIndices;
+            outVertexBuffer = welded.vertexBuffer;
+            outIndexBuffer = (uint16_t*)malloc(indexBufferSize * sizeof(uint16_t));
+            assert(outIndexBuffer || indexBufferSize == 0);
+            for(size_t i=0; i<indexBufferSize; ++i)
+                outIndexBuffer[i] = (uint16_t)welded.indexBuffer[i];
+            free(welded.indexBuffer);
+        }
+        free(corners);
+        free(cornerIsSmooth);
+    }
+
+    free(vpBuffer);
+    free(vtBuffer);
+    free(vnBuffer);
+    free(fileBytes);
+
+    if(tooManyVertices){
+        free(outVertexBuffer);
+        free(outIndexBuffer);
+        return result;
+    }
+
     // Normalise the normals
     for(uint32_t i=0; i<vertexBufferSize; ++i){
         VertexData* v = outVertexBuffer + i;
@@ -308,11 +800,6 @@ LoadedObj loadObj(const char* filename)
         v->norm[2] *= invNormLength;
     }
 
-    free(vpBuffer);
-    free(vtBuffer);
-    free(vnBuffer);
-    free(fileBytes);
-
     result.numVertices = vertexBufferSize;
     result.numIndices = indexBufferSize;
     result.vertexBuffer = outVertexBuffer;
@@ -2,6 +2,8 @@
 
 #include <stdint.h>
 
+struct JobSystem;
+
 // NOTE: This is in no way a complete .obj parser.
 // I just did the minimum required to load simple .obj files,
 // for simplicity it always returns a vertex buffer containing
@@ -32,15 +34,77 @@ struct LoadedObj
     uint16_t* indexBuffer;
 };
 
+// LoadedObj uses 16-bit indices
+const uint32_t OBJ_MAX_VERTICES = 65536;
+
+// How close two values of each attribute must be to be welded, in the
+// attribute's own units
+struct WeldTolerances
+{
+    float position; // Model units
+    float uv;       // 1 = the width of the texture
+    float normal;   // Per component of a unit vector
+};
+
+// Used by loadObj() for both weld modes. The same 0.00001 the loader has
+// always compared every attribute with, so models weld as they did.
+const WeldTolerances OBJ_WELD_TOLERANCES = { 0.00001f, 0.00001f, 0.00001f };
+
+// How loadObj() merges face corners into unique vertices
+enum ObjWeldMode
+{
+    // Linear search of previously added vertices using an epsilon
+    // comparison. O(n^2) and the result depends on face order.
+    ObjWeldModeEpsilon,
+    // Snaps corners to a grid and groups them using weldVertices().
+    // Scales to very large meshes and also drops triangles which
+    // become degenerate after welding.
+    ObjWeldModeQuantized
+};
+
 // Returns a vertex and index buffer loaded from .obj file 'filename'.
 // Vertex buffer format: (tightly packed)
 //   vp.x, vp.y, vp.z, vt.u, vt.v, vn.x, vn.y, vn.z ...
-// Allocates buffers using malloc().
+// Allocates buffers using malloc(). If the mesh has more than
+// OBJ_MAX_VERTICES vertices after welding, returns a LoadedObj with no
+// vertices, no indices and NULL buffers.
 //
 // Usage:
 // LoadedObj myObj = loadObj("test.obj");
 // ... // Send myObj.vertexBuffer to GPU
 // ... // Send myObj.indexBuffer to GPU
 // freeLoadedObj(myObj);
-LoadedObj loadObj(const char* filename);
-void freeLoadedObj(LoadedObj loadedObj);
\ No newline at end of file
+//
+// ObjWeldModeQuantized welds on 'jobSystem' if it isn't NULL (see
+// weldVertices()).
+LoadedObj loadObj(const char* filename, ObjWeldMode weldMode = ObjWeldModeEpsilon, JobSystem* jobSystem = 0);
+void freeLoadedObj(LoadedObj loadedObj);
+
+struct WeldedMesh
+{
+    uint32_t numVertices;
+    uint32_t numIndices;
+
+    VertexData* vertexBuffer;
+    uint32_t* indexBuffer;
+};
+
+// Merges the face corners of a triangle list into unique vertices.
+// Each attribute is quantized to a grid with cells the size of its
+// tolerance and corners with identical grid keys become one vertex, so
+// two values only merge if they round to the same grid cell (unlike the
+// epsilon comparison they can be arbitrarily close yet straddle a cell
+// boundary).
+// 'cornerIsSmooth' (optional) marks corners from a smoothing group;
+// these ignore their normal when matching and the normals of merged
+// corners are averaged. Triangles which end up with repeated indices
+// are removed.
+//
+// Keys are radix sorted on every thread of 'jobSystem' (so this must be
+// called from a thread which may run its jobs), or on the calling thread
+// alone if it's NULL. The output is identical for any thread count:
+// vertices appear in order of first use and keep the attributes of that
+// corner.
+// Allocates buffers using malloc(), free with freeWeldedMesh().
+WeldedMesh weldVertices(const VertexData* corners, const uint8_t* cornerIsSmooth, uint32_t numCorners, WeldTolerances tolerances, JobSystem* jobSystem);
+void freeWeldedMesh(WeldedMesh weldedMesh);
\ No newline at end of file
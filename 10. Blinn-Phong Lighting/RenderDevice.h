@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdint.h>
+
+// Thin rendering interface covering what the frame loop uses: buffers,
+// Map/Unmap, pipelines (shaders + input layout), textures, binding,
+// draws, fences and Present.
+//
+// Backends:
+//   RenderDeviceD3D11.h     - the real thing (Windows)
+//   RenderDeviceRecording.h - no GPU; counts and optionally logs every
+//                             command, so the scene update and submission
+//                             path can run and be timed headless
+//   RenderDeviceSoftware.h  - no GPU; tiled CPU rasterizer with C++
+//                             versions of the sample's shaders, for
+//                             rendering images headless
+//
+// A backend fills in the function pointers and keeps its own state in
+// 'backend'. Everything is called through the struct, e.g.
+//   device->drawIndexedInstanced(device, numIndices, numInstances);
+//
+// Objects are referred to by handles; 0 is never a valid handle.
+
+typedef uint32_t RenderBuffer;
+typedef uint32_t RenderPipeline;
+typedef uint32_t RenderTexture;
+typedef uint32_t RenderFence;
+
+enum RenderBufferType
+{
+    RenderBufferTypeVertex,
+    RenderBufferTypeIndex,    // 16-bit indices
+    RenderBufferTypeConstant,
+    RenderBufferTypeRaw,      // Read by pixel shaders as a ByteAddressBuffer; size a multiple of 4
+    RenderBufferTypeCount
+};
+
+enum RenderBufferUsage
+{
+    RenderBufferUsageImmutable, // Contents given at creation, can't be mapped
+    RenderBufferUsageDynamic    // CPU-writable through mapBuffer()
+};
+
+enum RenderMapMode
+{
+    RenderMapWriteDiscard,    // Previous contents are thrown away
+    RenderMapWriteNoOverwrite // Previous contents kept; don't touch anything the GPU may be reading
+};
+
+enum RenderShaderStage
+{
+    RenderShaderStageVertex,
+    RenderShaderStagePixel
+};
+
+enum RenderVertexFormat
+{
+    RenderVertexFormatFloat2,
+    RenderVertexFormatFloat3,
+    RenderVertexFormatFloat4
+};
+
+struct RenderVertexElement
+{
+    const char* semantic;
+    uint32_t semanticIndex;
+    RenderVertexFormat format;
+    uint32_t slot;         // Vertex buffer slot
+    uint32_t offsetBytes;  // Within a vertex/instance
+    bool perInstance;
+};
+
+// Shaders plus input layout. All pipelines use triangle lists, back-face
+// culling with counter-clockwise front faces and the device's depth test.
+struct RenderPipelineDesc
+{
+    const char* shaderFile;     // e.g. "BlinnPhong.hlsl"
+    const char* vertexEntry;
+    const char* pixelEntry;
+    const RenderVertexElement* elements;
+    uint32_t numElements;
+};
+
+struct RenderDevice
+{
+    void* backend;
+
+    // Creation. Return 0 on failure (backends report the error).
+    // 'initialData' may be NULL for dynamic buffers.
+    RenderBuffer (*createBuffer)(RenderDevice* device, RenderBufferType type, RenderBufferUsage usage, uint32_t sizeBytes, const void* initialData);
+    RenderPipeline (*createPipeline)(RenderDevice* device, const RenderPipelineDesc* desc);
+    // Tightly packed sRGB RGBA8, sampled with point filtering and a white border
+    RenderTexture (*createTexture)(RenderDevice* device, uint32_t width, uint32_t height, const void* pixels);
+    RenderFence (*createFence)(RenderDevice* device);
+
+    // Maps the whole buffer for writing
+    void* (*mapBuffer)(RenderDevice* device, RenderBuffer buffer, RenderMapMode mode);
+    void (*unmapBuffer)(RenderDevice* device, RenderBuffer buffer);
+
+    // Call after the window changes size
+    void (*resize)(RenderDevice* device, uint32_t width, uint32_t height);
+    // Binds the back buffer and depth buffer, sets the viewport to cover
+    // them and clears both
+    void (*beginFrame)(RenderDevice* device, const float clearColor[4]);
+
+    void (*setPipeline)(RenderDevice* device, RenderPipeline pipeline);
+    void (*setVertexBuffer)(RenderDevice* device, uint32_t slot, RenderBuffer buffer, uint32_t strideBytes, uint32_t offsetBytes);
+    void (*setIndexBuffer)(RenderDevice* device, RenderBuffer buffer);
+    // Binds [firstConstant, firstConstant + numConstants) of 'buffer', in
+    // 16-byte constants; both must be multiples of 16 (256 bytes)
+    void (*setConstantBuffer)(RenderDevice* device, RenderShaderStage stage, uint32_t slot, RenderBuffer buffer,
+                              uint32_t firstConstant, uint32_t numConstants);
+    void (*setTexture)(RenderDevice* device, uint32_t slot, RenderTexture texture);
+    // Binds a whole RenderBufferTypeRaw buffer to pixel shader resource
+    // 'slot' (register tN, shared with setTexture())
+    void (*setRawBuffer)(RenderDevice* device, uint32_t slot, RenderBuffer buffer);
+    void (*drawIndexedInstanced)(RenderDevice* device, uint32_t numIndices, uint32_t numInstances);
+
+    // signalFence() marks the end of the commands submitted so far;
+    // isFenceComplete() returns true once the GPU has finished them.
+    void (*signalFence)(RenderDevice* device, RenderFence fence);
+    bool (*isFenceComplete)(RenderDevice* device, RenderFence fence);
+
+    void (*present)(RenderDevice* device, uint32_t syncInterval);
+    void (*destroy)(RenderDevice* device);
+};
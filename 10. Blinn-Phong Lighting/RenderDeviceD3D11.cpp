@@ -0,0 +1,619 @@
+#include "RenderDeviceD3D11.h"
+
+#include <d3d11_1.h>
+#pragma comment(lib, "d3d11.lib")
+#include <d3dcompiler.h>
+#pragma comment(lib, "d3dcompiler.lib")
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static const uint32_t D3D11_MAX_BUFFERS = 64;
+static const uint32_t D3D11_MAX_PIPELINES = 16;
+static const uint32_t D3D11_MAX_TEXTURES = 16;
+static const uint32_t D3D11_MAX_FENCES = 16;
+static const uint32_t D3D11_MAX_VERTEX_ELEMENTS = 16;
+
+// Depth buffer convention. The depth buffer format, depth test and clear
+// value all come from here so they can't disagree with the projection.
+// Infinite reverse-Z keeps precision roughly constant with distance and
+// removes the far plane.
+struct DepthConvention
+{
+    DXGI_FORMAT bufferFormat;
+    D3D11_COMPARISON_FUNC comparisonFunc;
+    float clearValue;
+};
+
+static DepthConvention getDepthConvention(DepthMode depthMode)
+{
+    if(depthMode == DepthModeStandard)
+        return { DXGI_FORMAT_D24_UNORM_S8_UINT, D3D11_COMPARISON_LESS, 1.f };
+    return { DXGI_FORMAT_D32_FLOAT, D3D11_COMPARISON_GREATER, 0.f };
+}
+
+struct D3D11Buffer
+{
+    ID3D11Buffer* buffer;
+    RenderBufferType type;
+    ID3D11ShaderResourceView* rawView; // RenderBufferTypeRaw only
+};
+
+struct D3D11Pipeline
+{
+    ID3D11VertexShader* vertexShader;
+    ID3D11PixelShader* pixelShader;
+    ID3D11InputLayout* inputLayout;
+};
+
+struct D3D11Device
+{
+    RenderDevice device;
+    DepthConvention depthConvention;
+
+    ID3D11Device1* d3d11Device;
+    ID3D11DeviceContext1* d3d11DeviceContext;
+    IDXGISwapChain1* d3d11SwapChain;
+    ID3D11RenderTargetView* d3d11FrameBufferView;
+    ID3D11DepthStencilView* depthBufferView;
+    uint32_t width, height;
+
+    ID3D11RasterizerState* rasterizerState;
+    ID3D11DepthStencilState* depthStencilState;
+    ID3D11SamplerState* samplerState;
+    // Without MapNoOverwriteOnDynamicConstantBuffer constant buffers
+    // are always mapped with discard. That's still correct, the driver
+    // just renames the whole buffer.
+    bool canMapConstantsNoOverwrite;
+
+    // Handle h is index h-1
+    D3D11Buffer buffers[D3D11_MAX_BUFFERS];
+    uint32_t numBuffers;
+    D3D11Pipeline pipelines[D3D11_MAX_PIPELINES];
+    uint32_t numPipelines;
+    ID3D11ShaderResourceView* textures[D3D11_MAX_TEXTURES];
+    uint32_t numTextures;
+    ID3D11Query* fences[D3D11_MAX_FENCES];
+    uint32_t numFences;
+};
+
+static D3D11Device* getD3D11Device(RenderDevice* device)
+{
+    return (D3D11Device*)device->backend;
+}
+
+static ID3D11Buffer* getD3D11Buffer(D3D11Device* d3d11, RenderBuffer buffer)
+{
+    assert(buffer > 0 && buffer <= d3d11->numBuffers);
+    return d3d11->buffers[buffer - 1].buffer;
+}
+
+static bool win32CreateD3D11RenderTargets(D3D11Device* d3d11)
+{
+    ID3D11Texture2D* d3d11FrameBuffer;
+    HRESULT hResult = d3d11->d3d11SwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&d3d11FrameBuffer);
+    assert(SUCCEEDED(hResult));
+
+    hResult = d3d11->d3d11Device->CreateRenderTargetView(d3d11FrameBuffer, 0, &d3d11->d3d11FrameBufferView);
+    assert(SUCCEEDED(hResult));
+
+    D3D11_TEXTURE2D_DESC depthBufferDesc;
+    d3d11FrameBuffer->GetDesc(&depthBufferDesc);
+
+    d3d11FrameBuffer->Release();
+
+    d3d11->width = depthBufferDesc.Width;
+    d3d11->height = depthBufferDesc.Height;
+    depthBufferDesc.Format = d3d11->depthConvention.bufferFormat;
+    depthBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+
+    ID3D11Texture2D* depthBuffer;
+    d3d11->d3d11Device->CreateTexture2D(&depthBufferDesc, nullptr, &depthBuffer);
+
+    d3d11->d3d11Device->CreateDepthStencilView(depthBuffer, nullptr, &d3d11->depthBufferView);
+
+    depthBuffer->Release();
+
+    return true;
+}
+
+static RenderBuffer d3d11CreateBuffer(RenderDevice* device, RenderBufferType type, RenderBufferUsage usage, uint32_t sizeBytes, const void* initialData)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(d3d11->numBuffers < D3D11_MAX_BUFFERS);
+
+    const D3D11_BIND_FLAG BIND_FLAGS[RenderBufferTypeCount] = { D3D11_BIND_VERTEX_BUFFER, D3D11_BIND_INDEX_BUFFER, D3D11_BIND_CONSTANT_BUFFER,
+                                                                  D3D11_BIND_SHADER_RESOURCE };
+    D3D11_BUFFER_DESC bufferDesc = {};
+    // Constant buffer sizes must be a multiple of 16, per the docs
+    bufferDesc.ByteWidth = (type == RenderBufferTypeConstant) ? (sizeBytes + 0xf & 0xfffffff0) : sizeBytes;
+    bufferDesc.BindFlags = BIND_FLAGS[type];
+    if(type == RenderBufferTypeRaw)
+        bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+    if(usage == RenderBufferUsageDynamic){
+        bufferDesc.Usage          = D3D11_USAGE_DYNAMIC;
+        bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    }
+    else {
+        bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    }
+
+    D3D11_SUBRESOURCE_DATA subresourceData = { initialData };
+    ID3D11Buffer* buffer;
+    HRESULT hResult = d3d11->d3d11Device->CreateBuffer(&bufferDesc, initialData ? &subresourceData : nullptr, &buffer);
+    if(FAILED(hResult))
+        return 0;
+
+    // Raw buffers are read through a view of the whole buffer as uint32s
+    ID3D11ShaderResourceView* rawView = nullptr;
+    if(type == RenderBufferTypeRaw)
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+        viewDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+        viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+        viewDesc.BufferEx.NumElements = sizeBytes / 4;
+        viewDesc.BufferEx.Flags = D3D11_BUFFEREX_SRV_FLAG_RAW;
+        hResult = d3d11->d3d11Device->CreateShaderResourceView(buffer, &viewDesc, &rawView);
+        if(FAILED(hResult)){
+            buffer->Release();
+            return 0;
+        }
+    }
+
+    d3d11->buffers[d3d11->numBuffers].buffer = buffer;
+    d3d11->buffers[d3d11->numBuffers].type = type;
+    d3d11->buffers[d3d11->numBuffers].rawView = rawView;
+    return ++d3d11->numBuffers;
+}
+
+// Returns NULL after showing the compiler's errors if it fails
+static ID3DBlob* compileShader(const char* shaderFile, const char* entryPoint, const char* target)
+{
+    UINT shaderCompileFlags = 0;
+    // Compiling with this flag allows debugging shaders with Visual Studio
+    #if defined(DEBUG_BUILD)
+    shaderCompileFlags |= D3DCOMPILE_DEBUG;
+    #endif
+
+    wchar_t wideShaderFile[MAX_PATH];
+    MultiByteToWideChar(CP_UTF8, 0, shaderFile, -1, wideShaderFile, MAX_PATH);
+
+    ID3DBlob* code;
+    ID3DBlob* compileErrors;
+    HRESULT hResult = D3DCompileFromFile(wideShaderFile, nullptr, nullptr, entryPoint, target, shaderCompileFlags, 0, &code, &compileErrors);
+    if(FAILED(hResult))
+    {
+        const char* errorString = NULL;
+        if(hResult == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+            errorString = "Could not compile shader; file not found";
+        else if(compileErrors){
+            errorString = (const char*)compileErrors->GetBufferPointer();
+        }
+        MessageBoxA(0, errorString, "Shader Compiler Error", MB_ICONERROR | MB_OK);
+        return NULL;
+    }
+    return code;
+}
+
+static RenderPipeline d3d11CreatePipeline(RenderDevice* device, const RenderPipelineDesc* desc)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(d3d11->numPipelines < D3D11_MAX_PIPELINES);
+    assert(desc->numElements <= D3D11_MAX_VERTEX_ELEMENTS);
+    D3D11Pipeline* pipeline = &d3d11->pipelines[d3d11->numPipelines];
+
+    ID3DBlob* vsCode = compileShader(desc->shaderFile, desc->vertexEntry, "vs_5_0");
+    if(!vsCode)
+        return 0;
+    HRESULT hResult = d3d11->d3d11Device->CreateVertexShader(vsCode->GetBufferPointer(), vsCode->GetBufferSize(), nullptr, &pipeline->vertexShader);
+    assert(SUCCEEDED(hResult));
+
+    ID3DBlob* psCode = compileShader(desc->shaderFile, desc->pixelEntry, "ps_5_0");
+    if(!psCode){
+        vsCode->Release();
+        return 0;
+    }
+    hResult = d3d11->d3d11Device->CreatePixelShader(psCode->GetBufferPointer(), psCode->GetBufferSize(), nullptr, &pipeline->pixelShader);
+    assert(SUCCEEDED(hResult));
+    psCode->Release();
+
+    const DXGI_FORMAT FORMATS[] = { DXGI_FORMAT_R32G32_FLOAT, DXGI_FORMAT_R32G32B32_FLOAT, DXGI_FORMAT_R32G32B32A32_FLOAT };
+    D3D11_INPUT_ELEMENT_DESC inputElementDesc[D3D11_MAX_VERTEX_ELEMENTS];
+    for(uint32_t i=0; i<desc->numElements; ++i){
+        const RenderVertexElement* element = &desc->elements[i];
+        inputElementDesc[i].SemanticName = element->semantic;
+        inputElementDesc[i].SemanticIndex = element->semanticIndex;
+        inputElementDesc[i].Format = FORMATS[element->format];
+        inputElementDesc[i].InputSlot = element->slot;
+        inputElementDesc[i].AlignedByteOffset = element->offsetBytes;
+        inputElementDesc[i].InputSlotClass = element->perInstance ? D3D11_INPUT_PER_INSTANCE_DATA : D3D11_INPUT_PER_VERTEX_DATA;
+        inputElementDesc[i].InstanceDataStepRate = element->perInstance ? 1 : 0;
+    }
+    hResult = d3d11->d3d11Device->CreateInputLayout(inputElementDesc, desc->numElements, vsCode->GetBufferPointer(), vsCode->GetBufferSize(), &pipeline->inputLayout);
+    assert(SUCCEEDED(hResult));
+    vsCode->Release();
+
+    return ++d3d11->numPipelines;
+}
+
+static RenderTexture d3d11CreateTexture(RenderDevice* device, uint32_t width, uint32_t height, const void* pixels)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(d3d11->numTextures < D3D11_MAX_TEXTURES);
+
+    D3D11_TEXTURE2D_DESC textureDesc = {};
+    textureDesc.Width              = width;
+    textureDesc.Height             = height;
+    textureDesc.MipLevels          = 1;
+    textureDesc.ArraySize          = 1;
+    textureDesc.Format             = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    textureDesc.SampleDesc.Count   = 1;
+    textureDesc.Usage              = D3D11_USAGE_IMMUTABLE;
+    textureDesc.BindFlags          = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA textureSubresourceData = {};
+    textureSubresourceData.pSysMem = pixels;
+    textureSubresourceData.SysMemPitch = 4 * width;
+
+    ID3D11Texture2D* texture;
+    HRESULT hResult = d3d11->d3d11Device->CreateTexture2D(&textureDesc, &textureSubresourceData, &texture);
+    if(FAILED(hResult))
+        return 0;
+
+    d3d11->d3d11Device->CreateShaderResourceView(texture, nullptr, &d3d11->textures[d3d11->numTextures]);
+    texture->Release();
+    return ++d3d11->numTextures;
+}
+
+static RenderFence d3d11CreateFence(RenderDevice* device)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(d3d11->numFences < D3D11_MAX_FENCES);
+
+    D3D11_QUERY_DESC queryDesc = {};
+    queryDesc.Query = D3D11_QUERY_EVENT;
+    HRESULT hResult = d3d11->d3d11Device->CreateQuery(&queryDesc, &d3d11->fences[d3d11->numFences]);
+    if(FAILED(hResult))
+        return 0;
+    return ++d3d11->numFences;
+}
+
+static void* d3d11MapBuffer(RenderDevice* device, RenderBuffer buffer, RenderMapMode mode)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    ID3D11Buffer* d3d11Buffer = getD3D11Buffer(d3d11, buffer);
+    bool isConstantBuffer = d3d11->buffers[buffer - 1].type == RenderBufferTypeConstant;
+    bool discard = mode == RenderMapWriteDiscard || (isConstantBuffer && !d3d11->canMapConstantsNoOverwrite);
+
+    D3D11_MAPPED_SUBRESOURCE mappedSubresource;
+    HRESULT hResult = d3d11->d3d11DeviceContext->Map(d3d11Buffer, 0, discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mappedSubresource);
+    assert(SUCCEEDED(hResult));
+    return mappedSubresource.pData;
+}
+
+static void d3d11UnmapBuffer(RenderDevice* device, RenderBuffer buffer)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    d3d11->d3d11DeviceContext->Unmap(getD3D11Buffer(d3d11, buffer), 0);
+}
+
+static void d3d11Resize(RenderDevice* device, uint32_t width, uint32_t height)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    d3d11->d3d11DeviceContext->OMSetRenderTargets(0, 0, 0);
+    d3d11->d3d11FrameBufferView->Release();
+    d3d11->depthBufferView->Release();
+
+    // The swap chain takes the window's size
+    (void)width;
+    (void)height;
+    HRESULT res = d3d11->d3d11SwapChain->ResizeBuffers(0, 0, 0, DXGI_FORMAT_UNKNOWN, 0);
+    assert(SUCCEEDED(res));
+
+    win32CreateD3D11RenderTargets(d3d11);
+}
+
+static void d3d11BeginFrame(RenderDevice* device, const float clearColor[4])
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    ID3D11DeviceContext1* d3d11DeviceContext = d3d11->d3d11DeviceContext;
+
+    d3d11DeviceContext->ClearRenderTargetView(d3d11->d3d11FrameBufferView, clearColor);
+
+    d3d11DeviceContext->ClearDepthStencilView(d3d11->depthBufferView, D3D11_CLEAR_DEPTH, d3d11->depthConvention.clearValue, 0);
+
+    D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (FLOAT)d3d11->width, (FLOAT)d3d11->height, 0.0f, 1.0f };
+    d3d11DeviceContext->RSSetViewports(1, &viewport);
+
+    d3d11DeviceContext->RSSetState(d3d11->rasterizerState);
+    d3d11DeviceContext->OMSetDepthStencilState(d3d11->depthStencilState, 0);
+
+    d3d11DeviceContext->OMSetRenderTargets(1, &d3d11->d3d11FrameBufferView, d3d11->depthBufferView);
+
+    d3d11DeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+static void d3d11SetPipeline(RenderDevice* device, RenderPipeline pipeline)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(pipeline > 0 && pipeline <= d3d11->numPipelines);
+    const D3D11Pipeline* d3d11Pipeline = &d3d11->pipelines[pipeline - 1];
+    d3d11->d3d11DeviceContext->IASetInputLayout(d3d11Pipeline->inputLayout);
+    d3d11->d3d11DeviceContext->VSSetShader(d3d11Pipeline->vertexShader, nullptr, 0);
+    d3d11->d3d11DeviceContext->PSSetShader(d3d11Pipeline->pixelShader, nullptr, 0);
+}
+
+static void d3d11SetVertexBuffer(RenderDevice* device, uint32_t slot, RenderBuffer buffer, uint32_t strideBytes, uint32_t offsetBytes)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    ID3D11Buffer* d3d11Buffer = getD3D11Buffer(d3d11, buffer);
+    UINT stride = strideBytes;
+    UINT offset = offsetBytes;
+    d3d11->d3d11DeviceContext->IASetVertexBuffers(slot, 1, &d3d11Buffer, &stride, &offset);
+}
+
+static void d3d11SetIndexBuffer(RenderDevice* device, RenderBuffer buffer)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    d3d11->d3d11DeviceContext->IASetIndexBuffer(getD3D11Buffer(d3d11, buffer), DXGI_FORMAT_R16_UINT, 0);
+}
+
+static void d3d11SetConstantBuffer(RenderDevice* device, RenderShaderStage stage, uint32_t slot, RenderBuffer buffer,
+                                   uint32_t firstConstant, uint32_t numConstants)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    ID3D11Buffer* d3d11Buffer = getD3D11Buffer(d3d11, buffer);
+    UINT first = firstConstant;
+    UINT count = numConstants;
+    if(stage == RenderShaderStageVertex)
+        d3d11->d3d11DeviceContext->VSSetConstantBuffers1(slot, 1, &d3d11Buffer, &first, &count);
+    else
+        d3d11->d3d11DeviceContext->PSSetConstantBuffers1(slot, 1, &d3d11Buffer, &first, &count);
+}
+
+static void d3d11SetTexture(RenderDevice* device, uint32_t slot, RenderTexture texture)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(texture > 0 && texture <= d3d11->numTextures);
+    d3d11->d3d11DeviceContext->PSSetShaderResources(slot, 1, &d3d11->textures[texture - 1]);
+    d3d11->d3d11DeviceContext->PSSetSamplers(slot, 1, &d3d11->samplerState);
+}
+
+static void d3d11SetRawBuffer(RenderDevice* device, uint32_t slot, RenderBuffer buffer)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(buffer > 0 && buffer <= d3d11->numBuffers && d3d11->buffers[buffer - 1].type == RenderBufferTypeRaw);
+    d3d11->d3d11DeviceContext->PSSetShaderResources(slot, 1, &d3d11->buffers[buffer - 1].rawView);
+}
+
+static void d3d11DrawIndexedInstanced(RenderDevice* device, uint32_t numIndices, uint32_t numInstances)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    d3d11->d3d11DeviceContext->DrawIndexedInstanced(numIndices, numInstances, 0, 0, 0);
+}
+
+static void d3d11SignalFence(RenderDevice* device, RenderFence fence)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(fence > 0 && fence <= d3d11->numFences);
+    d3d11->d3d11DeviceContext->End(d3d11->fences[fence - 1]);
+}
+
+static bool d3d11IsFenceComplete(RenderDevice* device, RenderFence fence)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    assert(fence > 0 && fence <= d3d11->numFences);
+    // No D3D11_ASYNC_GETDATA_DONOTFLUSH: if we end up waiting on this
+    // fence the commands before it need to reach the GPU
+    return d3d11->d3d11DeviceContext->GetData(d3d11->fences[fence - 1], nullptr, 0, 0) == S_OK;
+}
+
+static void d3d11Present(RenderDevice* device, uint32_t syncInterval)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    d3d11->d3d11SwapChain->Present(syncInterval, 0);
+}
+
+static void d3d11Destroy(RenderDevice* device)
+{
+    D3D11Device* d3d11 = getD3D11Device(device);
+    for(uint32_t i=0; i<d3d11->numBuffers; ++i){
+        if(d3d11->buffers[i].rawView)
+            d3d11->buffers[i].rawView->Release();
+        d3d11->buffers[i].buffer->Release();
+    }
+    for(uint32_t i=0; i<d3d11->numPipelines; ++i){
+        d3d11->pipelines[i].vertexShader->Release();
+        d3d11->pipelines[i].pixelShader->Release();
+        d3d11->pipelines[i].inputLayout->Release();
+    }
+    for(uint32_t i=0; i<d3d11->numTextures; ++i)
+        d3d11->textures[i]->Release();
+    for(uint32_t i=0; i<d3d11->numFences; ++i)
+        d3d11->fences[i]->Release();
+    d3d11->samplerState->Release();
+    d3d11->depthStencilState->Release();
+    d3d11->rasterizerState->Release();
+    d3d11->depthBufferView->Release();
+    d3d11->d3d11FrameBufferView->Release();
+    d3d11->d3d11SwapChain->Release();
+    d3d11->d3d11DeviceContext->Release();
+    d3d11->d3d11Device->Release();
+    free(d3d11);
+}
+
+RenderDevice* createD3D11RenderDevice(HWND hwnd, DepthMode depthMode)
+{
+    D3D11Device* d3d11 = (D3D11Device*)calloc(1, sizeof(D3D11Device));
+    assert(d3d11);
+    d3d11->depthConvention = getDepthConvention(depthMode);
+
+    // Create D3D11 Device and Context
+    {
+        ID3D11Device* baseDevice;
+        ID3D11DeviceContext* baseDeviceContext;
+        D3D_FEATURE_LEVEL featureLevels[] = { D3D_FEATURE_LEVEL_11_0 };
+        UINT creationFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
+        #if defined(DEBUG_BUILD)
+        creationFlags |= D3D11_CREATE_DEVICE_DEBUG;
+        #endif
+
+        HRESULT hResult = D3D11CreateDevice(0, D3D_DRIVER_TYPE_HARDWARE,
+                                            0, creationFlags,
+                                            featureLevels, ARRAYSIZE(featureLevels),
+                                            D3D11_SDK_VERSION, &baseDevice,
+                                            0, &baseDeviceContext);
+        if(FAILED(hResult)){
+            MessageBoxA(0, "D3D11CreateDevice() failed", "Fatal Error", MB_OK);
+            free(d3d11);
+            return NULL;
+        }
+
+        // Get 1.1 interface of D3D11 Device and Context
+        hResult = baseDevice->QueryInterface(__uuidof(ID3D11Device1), (void**)&d3d11->d3d11Device);
+        assert(SUCCEEDED(hResult));
+        baseDevice->Release();
+
+        hResult = baseDeviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&d3d11->d3d11DeviceContext);
+        assert(SUCCEEDED(hResult));
+        baseDeviceContext->Release();
+    }
+    ID3D11Device1* d3d11Device = d3d11->d3d11Device;
+
+#ifdef DEBUG_BUILD
+    // Set up debug layer to break on D3D11 errors
+    ID3D11Debug *d3dDebug = nullptr;
+    d3d11Device->QueryInterface(__uuidof(ID3D11Debug), (void**)&d3dDebug);
+    if (d3dDebug)
+    {
+        ID3D11InfoQueue *d3dInfoQueue = nullptr;
+        if (SUCCEEDED(d3dDebug->QueryInterface(__uuidof(ID3D11InfoQueue), (void**)&d3dInfoQueue)))
+        {
+            d3dInfoQueue->SetBreakOnSeverity(D3D11_MESSAGE_SEVERITY_CORRUPTION, true);
+            d3dInfoQueue->SetBreakOnSeverity(D3D11_MESSAGE_SEVERITY_ERROR, true);
+            d3dInfoQueue->Release();
+        }
+        d3dDebug->Release();
+    }
+#endif
+
+    // Constants are sub-allocated from big buffers and bound at offsets
+    // (see ConstantBufferRing.h), which needs D3D11.1 driver support
+    {
+        D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+        HRESULT hResult = d3d11Device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+        if(FAILED(hResult) || !options.ConstantBufferOffsetting){
+            MessageBoxA(0, "Constant buffer offsetting not supported", "Fatal Error", MB_OK);
+            d3d11->d3d11DeviceContext->Release();
+            d3d11Device->Release();
+            free(d3d11);
+            return NULL;
+        }
+        d3d11->canMapConstantsNoOverwrite = options.MapNoOverwriteOnDynamicConstantBuffer;
+    }
+
+    // Create Swap Chain
+    {
+        // Get DXGI Factory (needed to create Swap Chain)
+        IDXGIFactory2* dxgiFactory;
+        {
+            IDXGIDevice1* dxgiDevice;
+            HRESULT hResult = d3d11Device->QueryInterface(__uuidof(IDXGIDevice1), (void**)&dxgiDevice);
+            assert(SUCCEEDED(hResult));
+
+            IDXGIAdapter* dxgiAdapter;
+            hResult = dxgiDevice->GetAdapter(&dxgiAdapter);
+            assert(SUCCEEDED(hResult));
+            dxgiDevice->Release();
+
+            DXGI_ADAPTER_DESC adapterDesc;
+            dxgiAdapter->GetDesc(&adapterDesc);
+
+            OutputDebugStringA("Graphics Device: ");
+            OutputDebugStringW(adapterDesc.Description);
+
+            hResult = dxgiAdapter->GetParent(__uuidof(IDXGIFactory2), (void**)&dxgiFactory);
+            assert(SUCCEEDED(hResult));
+            dxgiAdapter->Release();
+        }
+
+        DXGI_SWAP_CHAIN_DESC1 d3d11SwapChainDesc = {};
+        d3d11SwapChainDesc.Width = 0; // use window width
+        d3d11SwapChainDesc.Height = 0; // use window height
+        d3d11SwapChainDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+        d3d11SwapChainDesc.SampleDesc.Count = 1;
+        d3d11SwapChainDesc.SampleDesc.Quality = 0;
+        d3d11SwapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+        d3d11SwapChainDesc.BufferCount = 2;
+        d3d11SwapChainDesc.Scaling = DXGI_SCALING_STRETCH;
+        d3d11SwapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+        d3d11SwapChainDesc.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
+        d3d11SwapChainDesc.Flags = 0;
+
+        HRESULT hResult = dxgiFactory->CreateSwapChainForHwnd(d3d11Device, hwnd, &d3d11SwapChainDesc, 0, 0, &d3d11->d3d11SwapChain);
+        assert(SUCCEEDED(hResult));
+
+        dxgiFactory->Release();
+    }
+
+    // Create Render Target and Depth Buffer
+    win32CreateD3D11RenderTargets(d3d11);
+
+    // Create Sampler State
+    {
+        D3D11_SAMPLER_DESC samplerDesc = {};
+        samplerDesc.Filter         = D3D11_FILTER_MIN_MAG_MIP_POINT;
+        samplerDesc.AddressU       = D3D11_TEXTURE_ADDRESS_BORDER;
+        samplerDesc.AddressV       = D3D11_TEXTURE_ADDRESS_BORDER;
+        samplerDesc.AddressW       = D3D11_TEXTURE_ADDRESS_BORDER;
+        samplerDesc.BorderColor[0] = 1.0f;
+        samplerDesc.BorderColor[1] = 1.0f;
+        samplerDesc.BorderColor[2] = 1.0f;
+        samplerDesc.BorderColor[3] = 1.0f;
+        samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+
+        d3d11Device->CreateSamplerState(&samplerDesc, &d3d11->samplerState);
+    }
+
+    {
+        D3D11_RASTERIZER_DESC rasterizerDesc = {};
+        rasterizerDesc.FillMode = D3D11_FILL_SOLID;
+        rasterizerDesc.CullMode = D3D11_CULL_BACK;
+        rasterizerDesc.FrontCounterClockwise = TRUE;
+
+        d3d11Device->CreateRasterizerState(&rasterizerDesc, &d3d11->rasterizerState);
+    }
+
+    {
+        D3D11_DEPTH_STENCIL_DESC depthStencilDesc = {};
+        depthStencilDesc.DepthEnable    = TRUE;
+        depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+        depthStencilDesc.DepthFunc      = d3d11->depthConvention.comparisonFunc;
+
+        d3d11Device->CreateDepthStencilState(&depthStencilDesc, &d3d11->depthStencilState);
+    }
+
+    RenderDevice* device = &d3d11->device;
+    device->backend = d3d11;
+    device->createBuffer = d3d11CreateBuffer;
+    device->createPipeline = d3d11CreatePipeline;
+    device->createTexture = d3d11CreateTexture;
+    device->createFence = d3d11CreateFence;
+    device->mapBuffer = d3d11MapBuffer;
+    device->unmapBuffer = d3d11UnmapBuffer;
+    device->resize = d3d11Resize;
+    device->beginFrame = d3d11BeginFrame;
+    device->setPipeline = d3d11SetPipeline;
+    device->setVertexBuffer = d3d11SetVertexBuffer;
+    device->setIndexBuffer = d3d11SetIndexBuffer;
+    device->setConstantBuffer = d3d11SetConstantBuffer;
+    device->setTexture = d3d11SetTexture;
+    device->setRawBuffer = d3d11SetRawBuffer;
+    device->drawIndexedInstanced = d3d11DrawIndexedInstanced;
+    device->signalFence = d3d11SignalFence;
+    device->isFenceComplete = d3d11IsFenceComplete;
+    device->present = d3d11Present;
+    device->destroy = d3d11Destroy;
+    return device;
+}
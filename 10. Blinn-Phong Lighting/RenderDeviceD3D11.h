@@ -0,0 +1,15 @@
+#pragma once
+
+#include "RenderDevice.h"
+#include "3DMaths.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+// D3D11.1 implementation of RenderDevice.h, presenting to 'hwnd'.
+// 'depthMode' picks the depth buffer format, depth test and clear value
+// to match makePerspectiveMat(depthMode, ...).
+// Returns NULL (after showing a message box) if the device can't be
+// created or lacks constant buffer offsetting.
+RenderDevice* createD3D11RenderDevice(HWND hwnd, DepthMode depthMode);
@@ -0,0 +1,385 @@
+#include "RenderDeviceRecording.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char* RENDER_COMMAND_NAMES[RenderCommandCount] = {
+    "create_buffer", "create_pipeline", "create_texture", "create_fence",
+    "map_buffer", "unmap_buffer", "resize", "begin_frame",
+    "set_pipeline", "set_vertex_buffer", "set_index_buffer", "set_constant_buffer", "set_texture", "set_raw_buffer",
+    "draw_indexed_instanced", "signal_fence", "is_fence_complete", "present"
+};
+
+static const uint32_t RECORDING_MAX_BUFFERS = 64;
+static const uint32_t RECORDING_MAX_PIPELINES = 16;
+static const uint32_t RECORDING_MAX_VERTEX_SLOTS = 4;
+
+struct RecordedBuffer
+{
+    RenderBufferType type;
+    RenderBufferUsage usage;
+    uint32_t sizeBytes;
+    uint8_t* bytes;
+    bool isMapped;
+};
+
+struct RecordedPipeline
+{
+    bool slotIsPerInstance[RECORDING_MAX_VERTEX_SLOTS];
+};
+
+struct RecordingDevice
+{
+    RenderDevice device;
+    FILE* log;
+    uint32_t width, height;
+
+    // Handle h is index h-1
+    RecordedBuffer buffers[RECORDING_MAX_BUFFERS];
+    uint32_t numBuffers;
+    RecordedPipeline pipelines[RECORDING_MAX_PIPELINES];
+    uint32_t numPipelines;
+    uint32_t numTextures;
+    uint32_t numFences;
+    uint32_t numMappedBuffers;
+
+    // Bound state
+    RenderPipeline pipeline;
+    RenderBuffer indexBuffer;
+    uint32_t vertexStrides[RECORDING_MAX_VERTEX_SLOTS];
+    RenderBuffer vertexBuffers[RECORDING_MAX_VERTEX_SLOTS];
+
+    uint64_t frameIndex;
+    RecordingStats stats;
+};
+
+static RecordingDevice* getRecordingDevice(const RenderDevice* device)
+{
+    return (RecordingDevice*)device->backend;
+}
+
+static void recordCommand(RecordingDevice* recording, RenderCommand command, const char* format, ...)
+{
+    ++recording->stats.numCommands[command];
+    if(!recording->log)
+        return;
+    fprintf(recording->log, "%llu %s", (unsigned long long)recording->frameIndex, RENDER_COMMAND_NAMES[command]);
+    if(format){
+        va_list args;
+        va_start(args, format);
+        fputc(' ', recording->log);
+        vfprintf(recording->log, format, args);
+        va_end(args);
+    }
+    fputc('\n', recording->log);
+}
+
+static void recordError(RecordingDevice* recording, const char* message)
+{
+    ++recording->stats.numErrors;
+    if(recording->log)
+        fprintf(recording->log, "%llu ERROR %s\n", (unsigned long long)recording->frameIndex, message);
+}
+
+static RecordedBuffer* findBuffer(RecordingDevice* recording, RenderBuffer buffer)
+{
+    if(buffer == 0 || buffer > recording->numBuffers){
+        recordError(recording, "invalid buffer handle");
+        return 0;
+    }
+    return &recording->buffers[buffer - 1];
+}
+
+static RenderBuffer recordingCreateBuffer(RenderDevice* device, RenderBufferType type, RenderBufferUsage usage, uint32_t sizeBytes, const void* initialData)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandCreateBuffer, "type=%d usage=%d bytes=%u", (int)type, (int)usage, sizeBytes);
+    if(recording->numBuffers == RECORDING_MAX_BUFFERS || sizeBytes == 0 || (type == RenderBufferTypeRaw && sizeBytes % 4 != 0)){
+        recordError(recording, "can't create buffer");
+        return 0;
+    }
+    if(usage == RenderBufferUsageImmutable && !initialData){
+        recordError(recording, "immutable buffer without initial data");
+        return 0;
+    }
+
+    RecordedBuffer* buffer = &recording->buffers[recording->numBuffers++];
+    buffer->type = type;
+    buffer->usage = usage;
+    buffer->sizeBytes = sizeBytes;
+    buffer->bytes = (uint8_t*)calloc(sizeBytes, 1);
+    buffer->isMapped = false;
+    assert(buffer->bytes);
+    if(initialData){
+        memcpy(buffer->bytes, initialData, sizeBytes);
+        recording->stats.bytesCreated += sizeBytes;
+    }
+    return recording->numBuffers;
+}
+
+static RenderPipeline recordingCreatePipeline(RenderDevice* device, const RenderPipelineDesc* desc)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandCreatePipeline, "shader=%s elements=%u", desc->shaderFile, desc->numElements);
+    if(recording->numPipelines == RECORDING_MAX_PIPELINES){
+        recordError(recording, "too many pipelines");
+        return 0;
+    }
+    RecordedPipeline* pipeline = &recording->pipelines[recording->numPipelines++];
+    memset(pipeline, 0, sizeof(RecordedPipeline));
+    for(uint32_t i=0; i<desc->numElements; ++i){
+        const RenderVertexElement* element = &desc->elements[i];
+        if(element->slot >= RECORDING_MAX_VERTEX_SLOTS){
+            recordError(recording, "vertex element slot out of range");
+            continue;
+        }
+        if(element->perInstance)
+            pipeline->slotIsPerInstance[element->slot] = true;
+    }
+    return recording->numPipelines;
+}
+
+static RenderTexture recordingCreateTexture(RenderDevice* device, uint32_t width, uint32_t height, const void* pixels)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandCreateTexture, "width=%u height=%u", width, height);
+    if(!pixels || width == 0 || height == 0){
+        recordError(recording, "texture without pixels");
+        return 0;
+    }
+    recording->stats.bytesCreated += (uint64_t)width * height * 4;
+    return ++recording->numTextures;
+}
+
+static RenderFence recordingCreateFence(RenderDevice* device)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandCreateFence, 0);
+    return ++recording->numFences;
+}
+
+static void* recordingMapBuffer(RenderDevice* device, RenderBuffer buffer, RenderMapMode mode)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandMapBuffer, "buffer=%u mode=%s", buffer, mode == RenderMapWriteDiscard ? "discard" : "no_overwrite");
+    RecordedBuffer* recorded = findBuffer(recording, buffer);
+    if(!recorded)
+        return 0;
+    if(recorded->usage != RenderBufferUsageDynamic){
+        recordError(recording, "mapping an immutable buffer");
+        return 0;
+    }
+    if(recorded->isMapped){
+        recordError(recording, "buffer is already mapped");
+        return 0;
+    }
+    recorded->isMapped = true;
+    ++recording->numMappedBuffers;
+    recording->stats.bytesMapped += recorded->sizeBytes;
+    return recorded->bytes;
+}
+
+static void recordingUnmapBuffer(RenderDevice* device, RenderBuffer buffer)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandUnmapBuffer, "buffer=%u", buffer);
+    RecordedBuffer* recorded = findBuffer(recording, buffer);
+    if(!recorded)
+        return;
+    if(!recorded->isMapped){
+        recordError(recording, "unmapping a buffer that isn't mapped");
+        return;
+    }
+    recorded->isMapped = false;
+    --recording->numMappedBuffers;
+}
+
+static void recordingResize(RenderDevice* device, uint32_t width, uint32_t height)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandResize, "width=%u height=%u", width, height);
+    recording->width = width;
+    recording->height = height;
+}
+
+static void recordingBeginFrame(RenderDevice* device, const float clearColor[4])
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandBeginFrame, "clear=%.2f,%.2f,%.2f,%.2f viewport=%ux%u",
+                  clearColor[0], clearColor[1], clearColor[2], clearColor[3], recording->width, recording->height);
+}
+
+static void recordingSetPipeline(RenderDevice* device, RenderPipeline pipeline)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandSetPipeline, "pipeline=%u", pipeline);
+    if(pipeline == 0 || pipeline > recording->numPipelines)
+        recordError(recording, "invalid pipeline handle");
+    recording->pipeline = pipeline;
+}
+
+static void recordingSetVertexBuffer(RenderDevice* device, uint32_t slot, RenderBuffer buffer, uint32_t strideBytes, uint32_t offsetBytes)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandSetVertexBuffer, "slot=%u buffer=%u stride=%u offset=%u", slot, buffer, strideBytes, offsetBytes);
+    RecordedBuffer* recorded = findBuffer(recording, buffer);
+    if(!recorded)
+        return;
+    if(slot >= RECORDING_MAX_VERTEX_SLOTS || recorded->type != RenderBufferTypeVertex || offsetBytes >= recorded->sizeBytes){
+        recordError(recording, "bad vertex buffer binding");
+        return;
+    }
+    recording->vertexBuffers[slot] = buffer;
+    recording->vertexStrides[slot] = strideBytes;
+}
+
+static void recordingSetIndexBuffer(RenderDevice* device, RenderBuffer buffer)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandSetIndexBuffer, "buffer=%u", buffer);
+    RecordedBuffer* recorded = findBuffer(recording, buffer);
+    if(!recorded)
+        return;
+    if(recorded->type != RenderBufferTypeIndex){
+        recordError(recording, "index buffer isn't an index buffer");
+        return;
+    }
+    recording->indexBuffer = buffer;
+}
+
+static void recordingSetConstantBuffer(RenderDevice* device, RenderShaderStage stage, uint32_t slot, RenderBuffer buffer,
+                                       uint32_t firstConstant, uint32_t numConstants)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandSetConstantBuffer, "stage=%s slot=%u buffer=%u first=%u count=%u",
+                  stage == RenderShaderStageVertex ? "vs" : "ps", slot, buffer, firstConstant, numConstants);
+    RecordedBuffer* recorded = findBuffer(recording, buffer);
+    if(!recorded)
+        return;
+    if(recorded->type != RenderBufferTypeConstant || firstConstant % 16 != 0 || numConstants % 16 != 0 || numConstants == 0 ||
+       16ull * (firstConstant + numConstants) > recorded->sizeBytes){
+        recordError(recording, "bad constant buffer range");
+        return;
+    }
+    recording->stats.constantBytesBound += 16ull * numConstants;
+}
+
+static void recordingSetTexture(RenderDevice* device, uint32_t slot, RenderTexture texture)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandSetTexture, "slot=%u texture=%u", slot, texture);
+    if(texture == 0 || texture > recording->numTextures)
+        recordError(recording, "invalid texture handle");
+}
+
+static void recordingSetRawBuffer(RenderDevice* device, uint32_t slot, RenderBuffer buffer)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandSetRawBuffer, "slot=%u buffer=%u", slot, buffer);
+    RecordedBuffer* recorded = findBuffer(recording, buffer);
+    if(!recorded)
+        return;
+    if(recorded->type != RenderBufferTypeRaw){
+        recordError(recording, "raw buffer isn't a raw buffer");
+        return;
+    }
+    recording->stats.rawBytesBound += recorded->sizeBytes;
+}
+
+static void recordingDrawIndexedInstanced(RenderDevice* device, uint32_t numIndices, uint32_t numInstances)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandDrawIndexedInstanced, "indices=%u instances=%u", numIndices, numInstances);
+    if(recording->pipeline == 0 || recording->indexBuffer == 0){
+        recordError(recording, "draw without a pipeline or index buffer");
+        return;
+    }
+    if(recording->numMappedBuffers > 0)
+        recordError(recording, "draw while a buffer is mapped");
+
+    recording->stats.indexBytesDrawn += numIndices * sizeof(uint16_t);
+    recording->stats.numInstancesDrawn += numInstances;
+    const RecordedPipeline* pipeline = &recording->pipelines[recording->pipeline - 1];
+    for(uint32_t slot=0; slot<RECORDING_MAX_VERTEX_SLOTS; ++slot){
+        if(pipeline->slotIsPerInstance[slot])
+            recording->stats.instanceBytesDrawn += (uint64_t)numInstances * recording->vertexStrides[slot];
+    }
+}
+
+static void recordingSignalFence(RenderDevice* device, RenderFence fence)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandSignalFence, "fence=%u", fence);
+    if(fence == 0 || fence > recording->numFences)
+        recordError(recording, "invalid fence handle");
+}
+
+// There's no GPU to wait for
+static bool recordingIsFenceComplete(RenderDevice* device, RenderFence fence)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandIsFenceComplete, "fence=%u", fence);
+    (void)fence;
+    return true;
+}
+
+static void recordingPresent(RenderDevice* device, uint32_t syncInterval)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    recordCommand(recording, RenderCommandPresent, "sync=%u", syncInterval);
+    if(recording->numMappedBuffers > 0)
+        recordError(recording, "present while a buffer is mapped");
+    ++recording->frameIndex;
+}
+
+static void recordingDestroy(RenderDevice* device)
+{
+    RecordingDevice* recording = getRecordingDevice(device);
+    for(uint32_t i=0; i<recording->numBuffers; ++i)
+        free(recording->buffers[i].bytes);
+    free(recording);
+}
+
+RenderDevice* createRecordingRenderDevice(uint32_t width, uint32_t height, FILE* log)
+{
+    RecordingDevice* recording = (RecordingDevice*)calloc(1, sizeof(RecordingDevice));
+    assert(recording);
+    recording->log = log;
+    recording->width = width;
+    recording->height = height;
+
+    RenderDevice* device = &recording->device;
+    device->backend = recording;
+    device->createBuffer = recordingCreateBuffer;
+    device->createPipeline = recordingCreatePipeline;
+    device->createTexture = recordingCreateTexture;
+    device->createFence = recordingCreateFence;
+    device->mapBuffer = recordingMapBuffer;
+    device->unmapBuffer = recordingUnmapBuffer;
+    device->resize = recordingResize;
+    device->beginFrame = recordingBeginFrame;
+    device->setPipeline = recordingSetPipeline;
+    device->setVertexBuffer = recordingSetVertexBuffer;
+    device->setIndexBuffer = recordingSetIndexBuffer;
+    device->setConstantBuffer = recordingSetConstantBuffer;
+    device->setTexture = recordingSetTexture;
+    device->setRawBuffer = recordingSetRawBuffer;
+    device->drawIndexedInstanced = recordingDrawIndexedInstanced;
+    device->signalFence = recordingSignalFence;
+    device->isFenceComplete = recordingIsFenceComplete;
+    device->present = recordingPresent;
+    device->destroy = recordingDestroy;
+    return device;
+}
+
+RecordingStats getRecordingStats(const RenderDevice* device)
+{
+    return getRecordingDevice(device)->stats;
+}
+
+void resetRecordingStats(RenderDevice* device)
+{
+    memset(&getRecordingDevice(device)->stats, 0, sizeof(RecordingStats));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "RenderDevice.h"
+
+#include <stdio.h>
+
+// Render device with no GPU behind it. Buffers live in CPU memory (so
+// mapped writes land somewhere real), fences complete immediately and
+// every command is counted and checked for misuse (mapping an immutable
+// buffer, drawing while a buffer is mapped, unaligned constant ranges,
+// ...). With a log file every command is also written out as a line of
+// text. Used to run and benchmark the frame loop without a window.
+
+enum RenderCommand
+{
+    RenderCommandCreateBuffer,
+    RenderCommandCreatePipeline,
+    RenderCommandCreateTexture,
+    RenderCommandCreateFence,
+    RenderCommandMapBuffer,
+    RenderCommandUnmapBuffer,
+    RenderCommandResize,
+    RenderCommandBeginFrame,
+    RenderCommandSetPipeline,
+    RenderCommandSetVertexBuffer,
+    RenderCommandSetIndexBuffer,
+    RenderCommandSetConstantBuffer,
+    RenderCommandSetTexture,
+    RenderCommandSetRawBuffer,
+    RenderCommandDrawIndexedInstanced,
+    RenderCommandSignalFence,
+    RenderCommandIsFenceComplete,
+    RenderCommandPresent,
+    RenderCommandCount
+};
+
+extern const char* RENDER_COMMAND_NAMES[RenderCommandCount];
+
+struct RecordingStats
+{
+    uint64_t numCommands[RenderCommandCount];
+    uint64_t bytesCreated;        // Initial data of buffers and textures
+    uint64_t bytesMapped;         // Whole size of every buffer mapped
+    uint64_t constantBytesBound;  // Constant buffer ranges bound
+    uint64_t rawBytesBound;       // Whole size of every raw buffer bound
+    // What the GPU would fetch for the draws
+    uint64_t indexBytesDrawn;
+    uint64_t instanceBytesDrawn;
+    uint64_t numInstancesDrawn;
+    uint64_t numErrors;           // Misuse of the interface, see the log for details
+};
+
+// 'log' may be NULL. 'width'/'height' are the size of the pretend back buffer.
+RenderDevice* createRecordingRenderDevice(uint32_t width, uint32_t height, FILE* log);
+// Only valid for devices from createRecordingRenderDevice()
+RecordingStats getRecordingStats(const RenderDevice* device);
+void resetRecordingStats(RenderDevice* device);
@@ -0,0 +1,1303 @@
+#include "RenderDeviceSoftware.h"
+#include "BlinnPhongShading.h"
+#include "LightClustering.h"
+#include "SimdMaths.h"
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t SOFTWARE_MAX_BUFFERS = 64;
+static const uint32_t SOFTWARE_MAX_PIPELINES = 16;
+static const uint32_t SOFTWARE_MAX_TEXTURES = 16;
+static const uint32_t SOFTWARE_MAX_FENCES = 16;
+static const uint32_t SOFTWARE_MAX_VERTEX_SLOTS = 4;
+static const uint32_t SOFTWARE_MAX_VERTEX_ELEMENTS = 16;
+// Pixel shader resource slots: t0 is the texture, the rest raw buffers
+static const uint32_t SOFTWARE_MAX_RESOURCE_SLOTS = 4;
+static const uint32_t SOFTWARE_MAX_VARYINGS = 8;
+static const uint32_t SOFTWARE_MAX_PLANES = 2 + SOFTWARE_MAX_VARYINGS;
+// Clipping a triangle against 6 planes adds at most one vertex per plane
+static const uint32_t SOFTWARE_MAX_CLIPPED_VERTICES = 3 + 6;
+
+static const int32_t TILE_SIZE = 64;
+// Vertices are snapped to 1/SUBPIXEL_STEPS pixel, and the edge functions
+// are evaluated exactly in those fixed point units
+static const int32_t SUBPIXEL_STEPS = 256;
+// Triangles are only clipped against the sides of the screen if they
+// reach this far outside it, which keeps snapped coordinates exact in
+// floats and edge function products far inside int64
+static const float GUARD_BAND_PIXELS = 4096.f;
+static const uint32_t SRGB_TABLE_SIZE = 4096;
+
+static_assert(TILE_SIZE % WFLOAT_WIDTH == 0, "Tiles must be whole blocks of pixels");
+
+struct SoftwareTexture
+{
+    uint32_t width, height;
+    float4* texels; // Linear RGBA, decoded from sRGB at creation
+};
+
+// A light cluster's bounds in ndc and eye-space depth. Clusters at the
+// edges of the grid extend to infinity, as findCluster() clamps to them.
+struct SoftwareClusterBounds
+{
+    uint32_t cluster;
+    float ndcMin[2], ndcMax[2];
+    float depthMin, depthMax;
+};
+
+// What a pixel shader can read besides its varyings
+struct SoftwarePixelContext
+{
+    const uint8_t* constants;       // Pixel shader constant buffer 0
+    const SoftwareTexture* texture; // Slot 0, may be NULL
+    // Raw buffers by slot, from 1. Unbound slots have size 0.
+    const uint8_t* rawBuffers[SOFTWARE_MAX_RESOURCE_SLOTS];
+    uint32_t rawBufferSizes[SOFTWARE_MAX_RESOURCE_SLOTS];
+    // Scratch kept from one block of a triangle's pixels to the next:
+    // the cluster BlinnPhong.hlsl last found, initially one containing
+    // nothing
+    SoftwareClusterBounds lastCluster;
+};
+
+// ByteAddressBuffer.Load(): the uint32_t at byte 'address' of a raw
+// buffer. Like D3D11, reads past the end return 0.
+static uint32_t loadRawUint(const SoftwarePixelContext* context, uint32_t slot, uint32_t address)
+{
+    if(address / 4 >= context->rawBufferSizes[slot] / 4)
+        return 0;
+    uint32_t value;
+    memcpy(&value, context->rawBuffers[slot] + address / 4 * 4, sizeof(value));
+    return value;
+}
+
+// 'attributes' are the pipeline's vertex elements in order, widened to
+// float4 with the missing components from (0,0,0,1) like the input
+// assembler does. Returns the clip space position.
+typedef float4 SoftwareVertexShader(const float4* attributes, const uint8_t* constants, float* outVaryings);
+// Shades WFLOAT_WIDTH pixels. Lanes whose bit isn't set in 'laneMask'
+// are discarded, so needn't be shaded. Writes linear RGB.
+typedef void SoftwarePixelShader(const wfloat* varyings, int laneMask, SoftwarePixelContext* context, wfloat outColor[3]);
+
+// C++ stand-in for an HLSL file
+struct SoftwareShader
+{
+    const char* shaderFile;
+    uint32_t numElements; // Vertex elements the vertex shader reads
+    uint32_t numVaryings;
+    SoftwareVertexShader* vertexShader;
+    SoftwarePixelShader* pixelShader;
+};
+
+// Point filtering with a white border, like the D3D11 backend's sampler
+static float4 sampleTexture(const SoftwareTexture* texture, float u, float v)
+{
+    if(!texture)
+        return {1.f, 1.f, 1.f, 1.f};
+    float x = floorf(u * (float)texture->width);
+    float y = floorf(v * (float)texture->height);
+    if(!(x >= 0.f && x < (float)texture->width && y >= 0.f && y < (float)texture->height))
+        return {1.f, 1.f, 1.f, 1.f};
+    return texture->texels[(uint32_t)y * texture->width + (uint32_t)x];
+}
+
+// Lights.hlsl
+static float4 lightsVertexShader(const float4* attributes, const uint8_t* constants, float* outVaryings)
+{
+    const float4x4* projection = (const float4x4*)constants;
+    // Each per-instance vector is a column of the matrix (see affine3x4)
+    float4 pos = attributes[0];
+    float4 posEye = { dot(pos, attributes[1]), dot(pos, attributes[2]), dot(pos, attributes[3]), 1.f };
+    memcpy(outVaryings, &attributes[4], sizeof(float4));
+    return posEye * *projection;
+}
+
+static void lightsPixelShader(const wfloat* varyings, int laneMask, SoftwarePixelContext* context, wfloat outColor[3])
+{
+    (void)laneMask;
+    (void)context;
+    outColor[0] = varyings[0];
+    outColor[1] = varyings[1];
+    outColor[2] = varyings[2];
+}
+
+// BlinnPhong.hlsl. Varyings: posEye xyz, normalEye xyz, uv.
+// Pixel shader constants. Raw buffer 1 is the point lights, 2 each
+// cluster's offset | count << 16 and 3 the clusters' uint16 light
+// indices (see LightClustering.h), filled in up to the counts here.
+struct SoftwareBlinnPhongConstants
+{
+    float4 dirLightDirEye; // Towards the light
+    float4 dirLightColor;
+    float4 clusterProjX, clusterProjY, clusterProjW;
+    float4 clusterDims;    // tilesX, tilesY, numSlices
+    float4 clusterSlicing; // sliceScale, sliceBias
+    uint32_t numPointLights, numClusters, numLightIndices, pad;
+};
+
+static float4 blinnPhongVertexShader(const float4* attributes, const uint8_t* constants, float* outVaryings)
+{
+    const float4x4* projection = (const float4x4*)constants;
+    float4 pos = attributes[0];
+    float3 norm = attributes[2].xyz;
+    float3 posEye = { dot(pos, attributes[3]), dot(pos, attributes[4]), dot(pos, attributes[5]) };
+    float3 normalEye = { dot(norm, attributes[6].xyz), dot(norm, attributes[7].xyz), dot(norm, attributes[8].xyz) };
+    outVaryings[0] = posEye.x;
+    outVaryings[1] = posEye.y;
+    outVaryings[2] = posEye.z;
+    outVaryings[3] = normalEye.x;
+    outVaryings[4] = normalEye.y;
+    outVaryings[5] = normalEye.z;
+    outVaryings[6] = attributes[1].x;
+    outVaryings[7] = attributes[1].y;
+    return float4{posEye.x, posEye.y, posEye.z, 1.f} * *projection;
+}
+
+// Point lights of 'cluster', clamped to the counts like BlinnPhong.hlsl
+// and to what's bound. The shader skips bad light indices, here the
+// list is cut short at the first one instead.
+static void getClusterLights(const SoftwarePixelContext* context, uint32_t cluster, BlinnPhongLights* lights)
+{
+    const SoftwareBlinnPhongConstants* constants = (const SoftwareBlinnPhongConstants*)context->constants;
+    uint32_t numLights = constants->numPointLights;
+    uint32_t numIndices = constants->numLightIndices;
+    if(numLights > context->rawBufferSizes[1] / sizeof(BlinnPhongPointLight))
+        numLights = context->rawBufferSizes[1] / sizeof(BlinnPhongPointLight);
+    if(numIndices > context->rawBufferSizes[3] / sizeof(uint16_t))
+        numIndices = context->rawBufferSizes[3] / sizeof(uint16_t);
+    if(cluster >= constants->numClusters)
+        cluster = constants->numClusters - 1;
+    uint32_t packed = loadRawUint(context, 2, cluster * 4);
+    uint32_t offset = packed & 0xffff;
+    uint32_t end = offset + (packed >> 16);
+    offset = (offset < numIndices) ? offset : numIndices;
+    end = (end < numIndices) ? end : numIndices;
+    uint32_t count = end - offset;
+    const uint16_t* indices = (const uint16_t*)context->rawBuffers[3] + offset;
+    for(uint32_t i=0; i<count; ++i)
+        count = (indices[i] < numLights) ? count : i;
+    lights->pointLights = (const BlinnPhongPointLight*)context->rawBuffers[1];
+    lights->pointLightIndices = indices;
+    lights->numPointLights = count;
+}
+
+static SoftwareClusterBounds getClusterBounds(const ClusterGrid* grid, uint32_t cluster)
+{
+    uint32_t tiles[2] = { grid->tilesX, grid->tilesY };
+    uint32_t tile[2] = { cluster % grid->tilesX, (cluster / grid->tilesX) % grid->tilesY };
+    uint32_t slice = cluster / (grid->tilesX * grid->tilesY);
+    SoftwareClusterBounds bounds;
+    bounds.cluster = cluster;
+    for(int i=0; i<2; ++i){
+        bounds.ndcMin[i] = (tile[i] == 0) ? -INFINITY : 2.f * (float)tile[i] / (float)tiles[i] - 1.f;
+        bounds.ndcMax[i] = (tile[i] + 1 == tiles[i]) ? INFINITY : 2.f * (float)(tile[i] + 1) / (float)tiles[i] - 1.f;
+    }
+    bounds.depthMin = (slice == 0) ? -INFINITY : exp2f(((float)slice - grid->sliceBias) / grid->sliceScale);
+    bounds.depthMax = (slice + 1 == grid->numSlices) ? INFINITY : exp2f(((float)(slice + 1) - grid->sliceBias) / grid->sliceScale);
+    return bounds;
+}
+
+// Lanes inside 'bounds'. Much cheaper than findCluster() per lane.
+static wfloat inClusterBounds(const ClusterGrid* grid, const SoftwareClusterBounds* bounds, const wfloat posEye[3])
+{
+    // ndc = clip / w, with w > 0 for anything in front of the camera
+    const float4* proj[3] = { &grid->projX, &grid->projY, &grid->projW };
+    wfloat clip[3];
+    for(int i=0; i<3; ++i)
+        clip[i] = wfloatMulAdd(posEye[0], wfloatSet1(proj[i]->x), wfloatMulAdd(posEye[1], wfloatSet1(proj[i]->y),
+                  wfloatMulAdd(posEye[2], wfloatSet1(proj[i]->z), wfloatSet1(proj[i]->w))));
+    wfloat depth = wfloatSet1(0.f) - posEye[2];
+    wfloat inside = wfloatAnd(wfloatLessEqual(wfloatSet1(bounds->depthMin), depth), wfloatLess(depth, wfloatSet1(bounds->depthMax)));
+    for(int i=0; i<2; ++i){
+        inside = wfloatAnd(inside, wfloatLessEqual(wfloatSet1(bounds->ndcMin[i]) * clip[2], clip[i]));
+        inside = wfloatAnd(inside, wfloatLess(clip[i], wfloatSet1(bounds->ndcMax[i]) * clip[2]));
+    }
+    return inside;
+}
+
+static void blinnPhongPixelShader(const wfloat* varyings, int laneMask, SoftwarePixelContext* context, wfloat outColor[3])
+{
+    const SoftwareBlinnPhongConstants* constants = (const SoftwareBlinnPhongConstants*)context->constants;
+    ClusterGrid grid = {};
+    grid.tilesX = (uint32_t)constants->clusterDims.x;
+    grid.tilesY = (uint32_t)constants->clusterDims.y;
+    grid.numSlices = (uint32_t)constants->clusterDims.z;
+    grid.projX = constants->clusterProjX;
+    grid.projY = constants->clusterProjY;
+    grid.projW = constants->clusterProjW;
+    grid.sliceScale = constants->clusterSlicing.x;
+    grid.sliceBias = constants->clusterSlicing.y;
+
+    // Only the texture fetch is per lane
+    float u[WFLOAT_WIDTH], v[WFLOAT_WIDTH];
+    float diffuse[3][WFLOAT_WIDTH] = {};
+    wfloatStore(u, varyings[6]);
+    wfloatStore(v, varyings[7]);
+    for(int lane=0; lane<WFLOAT_WIDTH; ++lane)
+    {
+        if(!(laneMask & (1 << lane)))
+            continue;
+        float4 texel = sampleTexture(context->texture, u[lane], v[lane]);
+        diffuse[0][lane] = texel.x;
+        diffuse[1][lane] = texel.y;
+        diffuse[2][lane] = texel.z;
+    }
+    wfloat diffuseColor[3] = { wfloatLoad(diffuse[0]), wfloatLoad(diffuse[1]), wfloatLoad(diffuse[2]) };
+
+    // Shade all the lanes once per distinct cluster among them (usually
+    // just one, and the same as the last block's) with that cluster's
+    // lights, keeping the lanes in it
+    BlinnPhongLights lights = { constants->dirLightDirEye, constants->dirLightColor, 0, 0, 0 };
+    SoftwareClusterBounds* cluster = &context->lastCluster;
+    int remaining = laneMask;
+    for(int c=0; c<3; ++c)
+        outColor[c] = wfloatSet1(0.f);
+    while(remaining)
+    {
+        int lanes = wfloatMoveMask(inClusterBounds(&grid, cluster, &varyings[0])) & remaining;
+        if(!lanes)
+        {
+            int first = 0;
+            while(!(remaining & (1 << first)))
+                ++first;
+            float posEye[3][WFLOAT_WIDTH];
+            for(int c=0; c<3; ++c)
+                wfloatStore(posEye[c], varyings[c]);
+            *cluster = getClusterBounds(&grid, findCluster(&grid, float3{posEye[0][first], posEye[1][first], posEye[2][first]}));
+            // The lane findCluster() put here counts even if rounding
+            // puts it just outside the bounds
+            lanes = (wfloatMoveMask(inClusterBounds(&grid, cluster, &varyings[0])) & remaining) | (1 << first);
+        }
+        remaining &= ~lanes;
+
+        getClusterLights(context, cluster->cluster, &lights);
+        if(lanes == laneMask){
+            shadeBlinnPhong(&lights, &varyings[0], &varyings[3], diffuseColor, outColor);
+            break;
+        }
+        float laneIsIn[WFLOAT_WIDTH];
+        for(int lane=0; lane<WFLOAT_WIDTH; ++lane)
+            laneIsIn[lane] = (lanes & (1 << lane)) ? 1.f : 0.f;
+        wfloat select = wfloatLess(wfloatSet1(0.f), wfloatLoad(laneIsIn));
+        wfloat color[3];
+        shadeBlinnPhong(&lights, &varyings[0], &varyings[3], diffuseColor, color);
+        for(int c=0; c<3; ++c)
+            outColor[c] = wfloatSelect(select, color[c], outColor[c]);
+    }
+}
+
+static const SoftwareShader SOFTWARE_SHADERS[] =
+{
+    { "Lights.hlsl", 5, 4, lightsVertexShader, lightsPixelShader },
+    { "BlinnPhong.hlsl", 9, 8, blinnPhongVertexShader, blinnPhongPixelShader }
+};
+
+struct SoftwareBuffer
+{
+    RenderBufferType type;
+    RenderBufferUsage usage;
+    uint32_t sizeBytes;
+    uint8_t* bytes;
+    bool isMapped;
+};
+
+struct SoftwarePipeline
+{
+    const SoftwareShader* shader;
+    RenderVertexElement elements[SOFTWARE_MAX_VERTEX_ELEMENTS];
+    uint32_t numElements;
+};
+
+struct SoftwareConstantBinding
+{
+    RenderBuffer buffer;
+    uint32_t firstConstant;
+    uint32_t numConstants;
+};
+
+// Post vertex shader
+struct SoftwareVertex
+{
+    float4 pos;
+    float varyings[SOFTWARE_MAX_VARYINGS];
+};
+
+// State a draw's triangles need until they're rasterized
+struct SoftwareDraw
+{
+    const SoftwareShader* shader;
+    const SoftwareTexture* texture;
+    // Into the frame's copy of pixel shader constants and raw buffers
+    uint32_t constantsOffset;
+    uint32_t rawBufferOffsets[SOFTWARE_MAX_RESOURCE_SLOTS];
+    uint32_t rawBufferSizes[SOFTWARE_MAX_RESOURCE_SLOTS];
+};
+
+// Screen space triangle, set up for rasterizing. Vertices are snapped to
+// 1/256 pixel and ordered so the edge functions are positive inside.
+struct SoftwareTriangle
+{
+    uint32_t drawIndex;
+    uint32_t numPlanes;
+    int32_t fixedX[3], fixedY[3]; // In 1/SUBPIXEL_STEPS pixels
+    float x[3], y[3];             // The same in pixels
+    int32_t minX, minY, maxX, maxY; // Inclusive pixel bounds, within the viewport
+    // Value at vertex 0 and gradients in x and y of: depth, 1/w, then
+    // each varying divided by w
+    float planes[SOFTWARE_MAX_PLANES][3];
+};
+
+// Triangles touching a tile, in submission order
+struct SoftwareTileBin
+{
+    uint32_t* triangles;
+    uint32_t count;
+    uint32_t capacity;
+    bool isClear; // Holds nothing but the clear colour and depth
+    uint64_t numPixelsCovered;
+    uint64_t numPixelsShaded;
+};
+
+struct SoftwareDevice
+{
+    RenderDevice device;
+    JobSystem* jobSystem;
+    bool reverseDepth; // GREATER instead of LESS
+    float depthClearValue;
+
+    // Render targets are padded to whole tiles
+    uint32_t width, height;
+    uint32_t rowPitch;
+    uint32_t tilesX, tilesY;
+    uint32_t* colorBuffer;
+    float* depthBuffer;
+    SoftwareTileBin* bins;
+
+    // Handle h is index h-1
+    SoftwareBuffer buffers[SOFTWARE_MAX_BUFFERS];
+    uint32_t numBuffers;
+    SoftwarePipeline pipelines[SOFTWARE_MAX_PIPELINES];
+    uint32_t numPipelines;
+    SoftwareTexture textures[SOFTWARE_MAX_TEXTURES];
+    uint32_t numTextures;
+    uint64_t fenceFrames[SOFTWARE_MAX_FENCES]; // Frame each fence was last signalled in
+    uint32_t numFences;
+    uint32_t numMappedBuffers;
+
+    // Bound state
+    RenderPipeline pipeline;
+    RenderBuffer indexBuffer;
+    RenderBuffer vertexBuffers[SOFTWARE_MAX_VERTEX_SLOTS];
+    uint32_t vertexStrides[SOFTWARE_MAX_VERTEX_SLOTS];
+    uint32_t vertexOffsets[SOFTWARE_MAX_VERTEX_SLOTS];
+    SoftwareConstantBinding vertexConstants;
+    SoftwareConstantBinding pixelConstants;
+    RenderTexture texture;
+    RenderBuffer rawBuffers[SOFTWARE_MAX_RESOURCE_SLOTS];
+
+    // This frame's work, rasterized by present()
+    uint64_t frameIndex;
+    bool clearPending;
+    uint32_t clearColor;
+    uint32_t previousClearColor;
+    SoftwareDraw* draws;
+    uint32_t numDraws, drawCapacity;
+    uint8_t* drawConstants; // Pixel shader constants and raw buffers
+    uint32_t drawConstantsSize, drawConstantsCapacity;
+    // Latest copy of each
+    uint32_t drawConstantsOffset;
+    uint32_t drawRawBufferOffsets[SOFTWARE_MAX_RESOURCE_SLOTS];
+    bool pixelInputsChanged;
+    SoftwareTriangle* triangles;
+    uint32_t numTriangles, triangleCapacity;
+    SoftwareVertex* vertices; // Scratch for one instance of a draw
+    uint32_t vertexCapacity;
+
+    uint8_t linearToSrgb[SRGB_TABLE_SIZE];
+    float srgbToLinear[256];
+    SoftwareRenderStats stats;
+};
+
+static SoftwareDevice* getSoftwareDevice(const RenderDevice* device)
+{
+    return (SoftwareDevice*)device->backend;
+}
+
+static void softwareError(const char* message)
+{
+    fprintf(stderr, "Software render device: %s\n", message);
+}
+
+// Makes room for 'needed' elements, doubling the capacity
+static void* growArray(void* array, uint32_t* capacity, uint32_t needed, size_t elementSize)
+{
+    if(needed <= *capacity)
+        return array;
+    uint32_t newCapacity = *capacity ? *capacity : 64;
+    while(newCapacity < needed)
+        newCapacity *= 2;
+    array = realloc(array, newCapacity * elementSize);
+    assert(array);
+    *capacity = newCapacity;
+    return array;
+}
+
+static SoftwareBuffer* findBuffer(SoftwareDevice* software, RenderBuffer buffer)
+{
+    if(buffer == 0 || buffer > software->numBuffers){
+        softwareError("invalid buffer handle");
+        return 0;
+    }
+    return &software->buffers[buffer - 1];
+}
+
+static uint32_t packSrgb(const SoftwareDevice* software, float r, float g, float b, float a)
+{
+    const float SCALE = (float)(SRGB_TABLE_SIZE - 1);
+    uint32_t ri = (uint32_t)(fminf(fmaxf(r, 0.f), 1.f) * SCALE + 0.5f);
+    uint32_t gi = (uint32_t)(fminf(fmaxf(g, 0.f), 1.f) * SCALE + 0.5f);
+    uint32_t bi = (uint32_t)(fminf(fmaxf(b, 0.f), 1.f) * SCALE + 0.5f);
+    uint32_t ai = (uint32_t)(fminf(fmaxf(a, 0.f), 1.f) * 255.f + 0.5f); // Alpha is linear
+    return software->linearToSrgb[ri] | (software->linearToSrgb[gi] << 8) | (software->linearToSrgb[bi] << 16) | (ai << 24);
+}
+
+static RenderBuffer softwareCreateBuffer(RenderDevice* device, RenderBufferType type, RenderBufferUsage usage, uint32_t sizeBytes, const void* initialData)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    if(software->numBuffers == SOFTWARE_MAX_BUFFERS || sizeBytes == 0 || (usage == RenderBufferUsageImmutable && !initialData) ||
+       (type == RenderBufferTypeRaw && sizeBytes % 4 != 0)){
+        softwareError("can't create buffer");
+        return 0;
+    }
+    SoftwareBuffer* buffer = &software->buffers[software->numBuffers++];
+    buffer->type = type;
+    buffer->usage = usage;
+    buffer->sizeBytes = sizeBytes;
+    buffer->bytes = (uint8_t*)calloc(sizeBytes, 1);
+    buffer->isMapped = false;
+    assert(buffer->bytes);
+    if(initialData)
+        memcpy(buffer->bytes, initialData, sizeBytes);
+    return software->numBuffers;
+}
+
+static RenderPipeline softwareCreatePipeline(RenderDevice* device, const RenderPipelineDesc* desc)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    const SoftwareShader* shader = 0;
+    for(uint32_t i=0; i<sizeof(SOFTWARE_SHADERS) / sizeof(SOFTWARE_SHADERS[0]); ++i){
+        if(strcmp(SOFTWARE_SHADERS[i].shaderFile, desc->shaderFile) == 0)
+            shader = &SOFTWARE_SHADERS[i];
+    }
+    if(!shader){
+        softwareError("no built-in version of the pipeline's shader");
+        return 0;
+    }
+    if(software->numPipelines == SOFTWARE_MAX_PIPELINES || desc->numElements != shader->numElements){
+        softwareError("can't create pipeline");
+        return 0;
+    }
+    for(uint32_t i=0; i<desc->numElements; ++i){
+        if(desc->elements[i].slot >= SOFTWARE_MAX_VERTEX_SLOTS){
+            softwareError("vertex element slot out of range");
+            return 0;
+        }
+    }
+    SoftwarePipeline* pipeline = &software->pipelines[software->numPipelines++];
+    pipeline->shader = shader;
+    pipeline->numElements = desc->numElements;
+    memcpy(pipeline->elements, desc->elements, desc->numElements * sizeof(RenderVertexElement));
+    return software->numPipelines;
+}
+
+static RenderTexture softwareCreateTexture(RenderDevice* device, uint32_t width, uint32_t height, const void* pixels)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    if(software->numTextures == SOFTWARE_MAX_TEXTURES || !pixels || width == 0 || height == 0){
+        softwareError("can't create texture");
+        return 0;
+    }
+    SoftwareTexture* texture = &software->textures[software->numTextures++];
+    texture->width = width;
+    texture->height = height;
+    texture->texels = (float4*)malloc((size_t)width * height * sizeof(float4));
+    assert(texture->texels);
+    const uint8_t* bytes = (const uint8_t*)pixels;
+    for(size_t i=0; i<(size_t)width * height; ++i){
+        texture->texels[i].x = software->srgbToLinear[bytes[4*i + 0]];
+        texture->texels[i].y = software->srgbToLinear[bytes[4*i + 1]];
+        texture->texels[i].z = software->srgbToLinear[bytes[4*i + 2]];
+        texture->texels[i].w = bytes[4*i + 3] / 255.f;
+    }
+    return software->numTextures;
+}
+
+static RenderFence softwareCreateFence(RenderDevice* device)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    if(software->numFences == SOFTWARE_MAX_FENCES){
+        softwareError("too many fences");
+        return 0;
+    }
+    software->fenceFrames[software->numFences] = 0;
+    return ++software->numFences;
+}
+
+static void* softwareMapBuffer(RenderDevice* device, RenderBuffer buffer, RenderMapMode mode)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    SoftwareBuffer* mapped = findBuffer(software, buffer);
+    if(!mapped)
+        return 0;
+    if(mapped->usage != RenderBufferUsageDynamic || mapped->isMapped){
+        softwareError("can't map buffer");
+        return 0;
+    }
+    // Draws copy out what they need when they're submitted, so the old
+    // contents can be handed back for either mode. The next draw needs a
+    // fresh copy if this is bound for the pixel shader.
+    (void)mode;
+    if(software->pixelConstants.buffer == buffer)
+        software->pixelInputsChanged = true;
+    for(uint32_t slot=1; slot<SOFTWARE_MAX_RESOURCE_SLOTS; ++slot)
+        if(software->rawBuffers[slot] == buffer)
+            software->pixelInputsChanged = true;
+    mapped->isMapped = true;
+    ++software->numMappedBuffers;
+    return mapped->bytes;
+}
+
+static void softwareUnmapBuffer(RenderDevice* device, RenderBuffer buffer)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    SoftwareBuffer* mapped = findBuffer(software, buffer);
+    if(!mapped || !mapped->isMapped)
+        return;
+    mapped->isMapped = false;
+    --software->numMappedBuffers;
+}
+
+// Drops any work for the current frame
+static void resetFrame(SoftwareDevice* software)
+{
+    software->clearPending = false;
+    software->numDraws = 0;
+    software->drawConstantsSize = 0;
+    software->pixelInputsChanged = true;
+    software->numTriangles = 0;
+    for(uint32_t i=0; i<software->tilesX * software->tilesY; ++i)
+        software->bins[i].count = 0;
+}
+
+static void softwareResize(RenderDevice* device, uint32_t width, uint32_t height)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    for(uint32_t i=0; i<software->tilesX * software->tilesY; ++i)
+        free(software->bins[i].triangles);
+    free(software->bins);
+    free(software->colorBuffer);
+    free(software->depthBuffer);
+
+    software->width = width ? width : 1;
+    software->height = height ? height : 1;
+    software->tilesX = (software->width + TILE_SIZE - 1) / TILE_SIZE;
+    software->tilesY = (software->height + TILE_SIZE - 1) / TILE_SIZE;
+    software->rowPitch = software->tilesX * TILE_SIZE;
+    size_t numPixels = (size_t)software->rowPitch * software->tilesY * TILE_SIZE;
+    software->colorBuffer = (uint32_t*)calloc(numPixels, sizeof(uint32_t));
+    software->depthBuffer = (float*)calloc(numPixels, sizeof(float));
+    software->bins = (SoftwareTileBin*)calloc(software->tilesX * software->tilesY, sizeof(SoftwareTileBin));
+    assert(software->colorBuffer && software->depthBuffer && software->bins);
+    resetFrame(software);
+}
+
+static void softwareBeginFrame(RenderDevice* device, const float clearColor[4])
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    // Anything drawn before now would be cleared anyway
+    resetFrame(software);
+    software->clearPending = true;
+    software->clearColor = packSrgb(software, clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+}
+
+static void softwareSetPipeline(RenderDevice* device, RenderPipeline pipeline)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    if(pipeline == 0 || pipeline > software->numPipelines)
+        softwareError("invalid pipeline handle");
+    software->pipeline = pipeline;
+}
+
+static void softwareSetVertexBuffer(RenderDevice* device, uint32_t slot, RenderBuffer buffer, uint32_t strideBytes, uint32_t offsetBytes)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    SoftwareBuffer* bound = findBuffer(software, buffer);
+    if(!bound)
+        return;
+    if(slot >= SOFTWARE_MAX_VERTEX_SLOTS || bound->type != RenderBufferTypeVertex){
+        softwareError("bad vertex buffer binding");
+        return;
+    }
+    software->vertexBuffers[slot] = buffer;
+    software->vertexStrides[slot] = strideBytes;
+    software->vertexOffsets[slot] = offsetBytes;
+}
+
+static void softwareSetIndexBuffer(RenderDevice* device, RenderBuffer buffer)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    SoftwareBuffer* bound = findBuffer(software, buffer);
+    if(!bound)
+        return;
+    if(bound->type != RenderBufferTypeIndex){
+        softwareError("index buffer isn't an index buffer");
+        return;
+    }
+    software->indexBuffer = buffer;
+}
+
+static void softwareSetConstantBuffer(RenderDevice* device, RenderShaderStage stage, uint32_t slot, RenderBuffer buffer,
+                                      uint32_t firstConstant, uint32_t numConstants)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    SoftwareBuffer* bound = findBuffer(software, buffer);
+    if(!bound)
+        return;
+    if(slot != 0 || bound->type != RenderBufferTypeConstant || numConstants == 0 ||
+       16ull * (firstConstant + numConstants) > bound->sizeBytes){
+        softwareError("bad constant buffer range");
+        return;
+    }
+    SoftwareConstantBinding binding = { buffer, firstConstant, numConstants };
+    if(stage == RenderShaderStageVertex){
+        software->vertexConstants = binding;
+    }
+    else {
+        software->pixelConstants = binding;
+        software->pixelInputsChanged = true;
+    }
+}
+
+static void softwareSetTexture(RenderDevice* device, uint32_t slot, RenderTexture texture)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    if(slot != 0 || texture == 0 || texture > software->numTextures){
+        softwareError("bad texture binding");
+        return;
+    }
+    software->texture = texture;
+}
+
+static void softwareSetRawBuffer(RenderDevice* device, uint32_t slot, RenderBuffer buffer)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    SoftwareBuffer* bound = findBuffer(software, buffer);
+    if(!bound)
+        return;
+    if(slot == 0 || slot >= SOFTWARE_MAX_RESOURCE_SLOTS || bound->type != RenderBufferTypeRaw){
+        softwareError("bad raw buffer binding");
+        return;
+    }
+    software->rawBuffers[slot] = buffer;
+    software->pixelInputsChanged = true;
+}
+
+// Signed distances to the clip volume: 0 <= z <= w, and the guard band
+// in x and y
+static void clipDistances(float4 pos, float guardX, float guardY, float outDistances[6])
+{
+    outDistances[0] = pos.z;
+    outDistances[1] = pos.w - pos.z;
+    outDistances[2] = guardX * pos.w - pos.x;
+    outDistances[3] = guardX * pos.w + pos.x;
+    outDistances[4] = guardY * pos.w - pos.y;
+    outDistances[5] = guardY * pos.w + pos.y;
+}
+
+static SoftwareVertex lerpVertex(const SoftwareVertex* a, const SoftwareVertex* b, float t, uint32_t numVaryings)
+{
+    SoftwareVertex result;
+    result.pos.x = a->pos.x + (b->pos.x - a->pos.x) * t;
+    result.pos.y = a->pos.y + (b->pos.y - a->pos.y) * t;
+    result.pos.z = a->pos.z + (b->pos.z - a->pos.z) * t;
+    result.pos.w = a->pos.w + (b->pos.w - a->pos.w) * t;
+    for(uint32_t i=0; i<numVaryings; ++i)
+        result.varyings[i] = a->varyings[i] + (b->varyings[i] - a->varyings[i]) * t;
+    return result;
+}
+
+// Projects a triangle to the screen, culls it if it's back-facing,
+// empty or off screen, and bins it to every tile it may touch
+static void setupTriangle(SoftwareDevice* software, uint32_t drawIndex, uint32_t numVaryings, const SoftwareVertex* vertices[3])
+{
+    int32_t fixedX[3], fixedY[3];
+    float z[3], invW[3];
+    for(int i=0; i<3; ++i){
+        const float4 pos = vertices[i]->pos;
+        invW[i] = 1.f / pos.w;
+        float screenX = (pos.x * invW[i] * 0.5f + 0.5f) * (float)software->width;
+        float screenY = (0.5f - pos.y * invW[i] * 0.5f) * (float)software->height;
+        fixedX[i] = (int32_t)floorf(screenX * (float)SUBPIXEL_STEPS + 0.5f);
+        fixedY[i] = (int32_t)floorf(screenY * (float)SUBPIXEL_STEPS + 0.5f);
+        z[i] = pos.z * invW[i];
+    }
+
+    // Counter-clockwise on screen (y down) is front-facing and has a
+    // negative area. Swap two vertices of front faces so the area and
+    // the edge functions are positive inside.
+    int64_t fixedArea = (int64_t)(fixedX[1] - fixedX[0]) * (fixedY[2] - fixedY[0]) -
+                        (int64_t)(fixedX[2] - fixedX[0]) * (fixedY[1] - fixedY[0]);
+    if(fixedArea >= 0){
+        ++software->stats.numTrianglesCulled;
+        return;
+    }
+    double area = -(double)fixedArea / ((double)SUBPIXEL_STEPS * SUBPIXEL_STEPS);
+    int order[3] = { 0, 2, 1 };
+
+    SoftwareTriangle tri;
+    tri.drawIndex = drawIndex;
+    tri.numPlanes = 2 + numVaryings;
+    for(int i=0; i<3; ++i){
+        tri.fixedX[i] = fixedX[order[i]];
+        tri.fixedY[i] = fixedY[order[i]];
+        tri.x[i] = (float)tri.fixedX[i] / (float)SUBPIXEL_STEPS;
+        tri.y[i] = (float)tri.fixedY[i] / (float)SUBPIXEL_STEPS;
+    }
+    float minX = fminf(fminf(tri.x[0], tri.x[1]), tri.x[2]);
+    float maxX = fmaxf(fmaxf(tri.x[0], tri.x[1]), tri.x[2]);
+    float minY = fminf(fminf(tri.y[0], tri.y[1]), tri.y[2]);
+    float maxY = fmaxf(fmaxf(tri.y[0], tri.y[1]), tri.y[2]);
+    // Pixels whose centres may be inside
+    tri.minX = (int32_t)fmaxf(floorf(minX - 0.5f), 0.f);
+    tri.minY = (int32_t)fmaxf(floorf(minY - 0.5f), 0.f);
+    tri.maxX = (int32_t)fminf(ceilf(maxX - 0.5f), (float)software->width - 1.f);
+    tri.maxY = (int32_t)fminf(ceilf(maxY - 0.5f), (float)software->height - 1.f);
+    if(tri.minX > tri.maxX || tri.minY > tri.maxY){
+        ++software->stats.numTrianglesCulled;
+        return;
+    }
+
+    // Screen space planes for depth, 1/w and the varyings over w
+    {
+        float ex1 = tri.x[1] - tri.x[0], ey1 = tri.y[1] - tri.y[0];
+        float ex2 = tri.x[2] - tri.x[0], ey2 = tri.y[2] - tri.y[0];
+        float invArea = (float)(1.0 / area);
+        float values[SOFTWARE_MAX_PLANES][3];
+        for(int i=0; i<3; ++i){
+            int v = order[i];
+            values[0][i] = z[v];
+            values[1][i] = invW[v];
+            for(uint32_t j=0; j<numVaryings; ++j)
+                values[2 + j][i] = vertices[v]->varyings[j] * invW[v];
+        }
+        for(uint32_t p=0; p<tri.numPlanes; ++p){
+            float d1 = values[p][1] - values[p][0];
+            float d2 = values[p][2] - values[p][0];
+            tri.planes[p][0] = values[p][0];
+            tri.planes[p][1] = (d1 * ey2 - d2 * ey1) * invArea;
+            tri.planes[p][2] = (d2 * ex1 - d1 * ex2) * invArea;
+        }
+    }
+
+    software->triangles = (SoftwareTriangle*)growArray(software->triangles, &software->triangleCapacity,
+                                                        software->numTriangles + 1, sizeof(SoftwareTriangle));
+    uint32_t triangleIndex = software->numTriangles++;
+    software->triangles[triangleIndex] = tri;
+
+    // Bin to the tiles the bounds touch, skipping tiles which are
+    // entirely outside an edge
+    int32_t tileX0 = tri.minX / TILE_SIZE, tileX1 = tri.maxX / TILE_SIZE;
+    int32_t tileY0 = tri.minY / TILE_SIZE, tileY1 = tri.maxY / TILE_SIZE;
+    bool testTiles = (tileX1 > tileX0) && (tileY1 > tileY0);
+    for(int32_t tileY=tileY0; tileY<=tileY1; ++tileY)
+    {
+        for(int32_t tileX=tileX0; tileX<=tileX1; ++tileX)
+        {
+            if(testTiles){
+                bool outside = false;
+                for(int e=0; e<3 && !outside; ++e){
+                    int next = (e + 1) % 3;
+                    int64_t a = tri.fixedY[e] - tri.fixedY[next];
+                    int64_t b = tri.fixedX[next] - tri.fixedX[e];
+                    // Pixel centre in the tile with the largest value
+                    int64_t px = (int64_t)(tileX * TILE_SIZE + (a > 0 ? TILE_SIZE - 1 : 0)) * SUBPIXEL_STEPS + SUBPIXEL_STEPS / 2;
+                    int64_t py = (int64_t)(tileY * TILE_SIZE + (b > 0 ? TILE_SIZE - 1 : 0)) * SUBPIXEL_STEPS + SUBPIXEL_STEPS / 2;
+                    outside = a * (px - tri.fixedX[e]) + b * (py - tri.fixedY[e]) < 0;
+                }
+                if(outside)
+                    continue;
+            }
+            SoftwareTileBin* bin = &software->bins[tileY * software->tilesX + tileX];
+            bin->triangles = (uint32_t*)growArray(bin->triangles, &bin->capacity, bin->count + 1, sizeof(uint32_t));
+            bin->triangles[bin->count++] = triangleIndex;
+        }
+    }
+}
+
+// Clips a triangle to the clip volume if it needs it, then sets up what's left
+static void processTriangle(SoftwareDevice* software, uint32_t drawIndex, uint32_t numVaryings, const SoftwareVertex* a, const SoftwareVertex* b, const SoftwareVertex* c)
+{
+    float guardX = 1.f + 2.f * GUARD_BAND_PIXELS / (float)software->width;
+    float guardY = 1.f + 2.f * GUARD_BAND_PIXELS / (float)software->height;
+    const SoftwareVertex* input[3] = { a, b, c };
+    float distances[3][6];
+    uint32_t outside[3] = {};
+    for(int i=0; i<3; ++i){
+        clipDistances(input[i]->pos, guardX, guardY, distances[i]);
+        for(int p=0; p<6; ++p)
+            outside[i] |= (distances[i][p] < 0.f) << p;
+    }
+    if(outside[0] & outside[1] & outside[2]){
+        ++software->stats.numTrianglesCulled;
+        return;
+    }
+    if((outside[0] | outside[1] | outside[2]) == 0){
+        setupTriangle(software, drawIndex, numVaryings, input);
+        return;
+    }
+
+    // Sutherland-Hodgman against each plane the triangle crosses
+    SoftwareVertex polygons[2][SOFTWARE_MAX_CLIPPED_VERTICES];
+    uint32_t numVertices = 3;
+    SoftwareVertex* polygon = polygons[0];
+    for(int i=0; i<3; ++i)
+        polygon[i] = *input[i];
+    for(int p=0; p<6; ++p)
+    {
+        if(!((outside[0] | outside[1] | outside[2]) & (1 << p)))
+            continue;
+        SoftwareVertex* clipped = (polygon == polygons[0]) ? polygons[1] : polygons[0];
+        uint32_t numClipped = 0;
+        for(uint32_t i=0; i<numVertices; ++i)
+        {
+            const SoftwareVertex* from = &polygon[i];
+            const SoftwareVertex* to = &polygon[(i + 1) % numVertices];
+            float fromDistances[6], toDistances[6];
+            clipDistances(from->pos, guardX, guardY, fromDistances);
+            clipDistances(to->pos, guardX, guardY, toDistances);
+            float d0 = fromDistances[p], d1 = toDistances[p];
+            if(d0 >= 0.f)
+                clipped[numClipped++] = *from;
+            if((d0 >= 0.f) != (d1 >= 0.f))
+                clipped[numClipped++] = lerpVertex(from, to, d0 / (d0 - d1), numVaryings);
+        }
+        polygon = clipped;
+        numVertices = numClipped;
+        if(numVertices < 3){
+            ++software->stats.numTrianglesCulled;
+            return;
+        }
+    }
+    for(uint32_t i=1; i+1<numVertices; ++i){
+        const SoftwareVertex* fan[3] = { &polygon[0], &polygon[i], &polygon[i + 1] };
+        setupTriangle(software, drawIndex, numVaryings, fan);
+    }
+}
+
+// Copies 'size' bytes to the end of this frame's pixel shader inputs,
+// returning where they went
+static uint32_t appendDrawConstants(SoftwareDevice* software, const uint8_t* bytes, uint32_t size)
+{
+    uint32_t offset = software->drawConstantsSize;
+    software->drawConstants = (uint8_t*)growArray(software->drawConstants, &software->drawConstantsCapacity, offset + size, 1);
+    memcpy(software->drawConstants + offset, bytes, size);
+    software->drawConstantsSize += size;
+    return offset;
+}
+
+static void softwareDrawIndexedInstanced(RenderDevice* device, uint32_t numIndices, uint32_t numInstances)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    if(software->pipeline == 0 || software->pipeline > software->numPipelines || software->indexBuffer == 0 ||
+       software->vertexConstants.buffer == 0 || software->pixelConstants.buffer == 0){
+        softwareError("draw without a pipeline, index buffer or constants");
+        return;
+    }
+    if(software->numMappedBuffers > 0){
+        softwareError("draw while a buffer is mapped");
+        return;
+    }
+    const SoftwarePipeline* pipeline = &software->pipelines[software->pipeline - 1];
+    const SoftwareShader* shader = pipeline->shader;
+    const SoftwareBuffer* indexBuffer = &software->buffers[software->indexBuffer - 1];
+    if(numIndices * sizeof(uint16_t) > indexBuffer->sizeBytes){
+        softwareError("draw reads past the end of the index buffer");
+        return;
+    }
+    const uint16_t* indices = (const uint16_t*)indexBuffer->bytes;
+    uint32_t numVertices = 0;
+    for(uint32_t i=0; i<numIndices; ++i)
+        numVertices = (indices[i] >= numVertices) ? indices[i] + 1u : numVertices;
+
+    // Where each vertex element comes from, checking every fetch stays
+    // inside its buffer
+    const uint8_t* elementBytes[SOFTWARE_MAX_VERTEX_ELEMENTS];
+    uint32_t elementStrides[SOFTWARE_MAX_VERTEX_ELEMENTS];
+    uint32_t elementSizes[SOFTWARE_MAX_VERTEX_ELEMENTS];
+    for(uint32_t i=0; i<pipeline->numElements; ++i)
+    {
+        const RenderVertexElement* element = &pipeline->elements[i];
+        RenderBuffer buffer = software->vertexBuffers[element->slot];
+        uint32_t count = element->perInstance ? numInstances : numVertices;
+        elementSizes[i] = (2 + (uint32_t)element->format) * sizeof(float);
+        elementStrides[i] = software->vertexStrides[element->slot];
+        if(buffer == 0 || count == 0){
+            softwareError("vertex buffer slot isn't bound");
+            return;
+        }
+        const SoftwareBuffer* vertexBuffer = &software->buffers[buffer - 1];
+        uint64_t start = (uint64_t)software->vertexOffsets[element->slot] + element->offsetBytes;
+        if(start + (uint64_t)elementStrides[i] * (count - 1) + elementSizes[i] > vertexBuffer->sizeBytes){
+            softwareError("draw reads past the end of a vertex buffer");
+            return;
+        }
+        elementBytes[i] = vertexBuffer->bytes + start;
+    }
+
+    const SoftwareBuffer* vertexConstantBuffer = &software->buffers[software->vertexConstants.buffer - 1];
+    const uint8_t* vertexConstants = vertexConstantBuffer->bytes + 16 * software->vertexConstants.firstConstant;
+
+    // The pixel shader runs at present(), after its constants and raw
+    // buffers may have been rewritten, so it gets a copy of them
+    if(software->pixelInputsChanged)
+    {
+        const SoftwareBuffer* pixelConstantBuffer = &software->buffers[software->pixelConstants.buffer - 1];
+        software->drawConstantsOffset = appendDrawConstants(software, pixelConstantBuffer->bytes + 16 * software->pixelConstants.firstConstant,
+                                                            16 * software->pixelConstants.numConstants);
+        for(uint32_t slot=1; slot<SOFTWARE_MAX_RESOURCE_SLOTS; ++slot){
+            RenderBuffer rawBuffer = software->rawBuffers[slot];
+            if(rawBuffer)
+                software->drawRawBufferOffsets[slot] = appendDrawConstants(software, software->buffers[rawBuffer - 1].bytes,
+                                                                           software->buffers[rawBuffer - 1].sizeBytes);
+        }
+        software->pixelInputsChanged = false;
+    }
+    software->draws = (SoftwareDraw*)growArray(software->draws, &software->drawCapacity, software->numDraws + 1, sizeof(SoftwareDraw));
+    uint32_t drawIndex = software->numDraws++;
+    SoftwareDraw* draw = &software->draws[drawIndex];
+    draw->shader = shader;
+    draw->texture = software->texture ? &software->textures[software->texture - 1] : 0;
+    draw->constantsOffset = software->drawConstantsOffset;
+    for(uint32_t slot=0; slot<SOFTWARE_MAX_RESOURCE_SLOTS; ++slot){
+        RenderBuffer rawBuffer = software->rawBuffers[slot];
+        draw->rawBufferOffsets[slot] = rawBuffer ? software->drawRawBufferOffsets[slot] : 0;
+        draw->rawBufferSizes[slot] = rawBuffer ? software->buffers[rawBuffer - 1].sizeBytes : 0;
+    }
+
+    software->vertices = (SoftwareVertex*)growArray(software->vertices, &software->vertexCapacity, numVertices, sizeof(SoftwareVertex));
+    for(uint32_t instance=0; instance<numInstances; ++instance)
+    {
+        for(uint32_t v=0; v<numVertices; ++v)
+        {
+            float4 attributes[SOFTWARE_MAX_VERTEX_ELEMENTS];
+            for(uint32_t i=0; i<pipeline->numElements; ++i){
+                uint32_t index = pipeline->elements[i].perInstance ? instance : v;
+                attributes[i] = {0.f, 0.f, 0.f, 1.f};
+                memcpy(&attributes[i], elementBytes[i] + (size_t)elementStrides[i] * index, elementSizes[i]);
+            }
+            SoftwareVertex* vertex = &software->vertices[v];
+            vertex->pos = shader->vertexShader(attributes, vertexConstants, vertex->varyings);
+        }
+        for(uint32_t i=0; i+2<numIndices; i+=3){
+            processTriangle(software, drawIndex, shader->numVaryings, &software->vertices[indices[i]],
+                            &software->vertices[indices[i + 1]], &software->vertices[indices[i + 2]]);
+        }
+        software->stats.numTriangles += numIndices / 3;
+    }
+}
+
+// Rounds towards minus infinity, for 'denominator' > 0
+static int64_t floorDiv(int64_t numerator, int64_t denominator)
+{
+    int64_t quotient = numerator / denominator;
+    return (numerator % denominator < 0) ? quotient - 1 : quotient;
+}
+
+static uint32_t countLanes(int mask)
+{
+    uint32_t count = 0;
+    for(; mask; mask &= mask - 1)
+        ++count;
+    return count;
+}
+
+// Rasterizes every triangle binned to one tile, in order
+static void rasterizeTile(void* userData, uint32_t tileIndex)
+{
+    SoftwareDevice* software = (SoftwareDevice*)userData;
+    SoftwareTileBin* bin = &software->bins[tileIndex];
+    int32_t tileX = (int32_t)(tileIndex % software->tilesX) * TILE_SIZE;
+    int32_t tileY = (int32_t)(tileIndex / software->tilesX) * TILE_SIZE;
+    uint32_t* colorTile = software->colorBuffer + (size_t)tileY * software->rowPitch + tileX;
+    float* depthTile = software->depthBuffer + (size_t)tileY * software->rowPitch + tileX;
+
+    // Most tiles are empty and stay cleared from one frame to the next,
+    // so only clear tiles which have been drawn to
+    if(software->clearPending && !(bin->isClear && software->clearColor == software->previousClearColor)){
+        for(int32_t y=0; y<TILE_SIZE; ++y){
+            for(int32_t x=0; x<TILE_SIZE; ++x){
+                colorTile[y * software->rowPitch + x] = software->clearColor;
+                depthTile[y * software->rowPitch + x] = software->depthClearValue;
+            }
+        }
+        bin->isClear = true;
+    }
+    if(bin->count > 0)
+        bin->isClear = false;
+
+    float laneOffsets[WFLOAT_WIDTH];
+    for(int i=0; i<WFLOAT_WIDTH; ++i)
+        laneOffsets[i] = (float)i;
+    const wfloat laneX = wfloatLoad(laneOffsets);
+    const wfloat zero = wfloatSet1(0.f);
+    const wfloat srgbScale = wfloatSet1((float)(SRGB_TABLE_SIZE - 1));
+    uint64_t numPixelsCovered = 0, numPixelsShaded = 0;
+
+    for(uint32_t t=0; t<bin->count; ++t)
+    {
+        const SoftwareTriangle* tri = &software->triangles[bin->triangles[t]];
+        const SoftwareDraw* draw = &software->draws[tri->drawIndex];
+        SoftwarePixelContext context;
+        context.constants = software->drawConstants + draw->constantsOffset;
+        context.texture = draw->texture;
+        for(uint32_t slot=0; slot<SOFTWARE_MAX_RESOURCE_SLOTS; ++slot){
+            context.rawBuffers[slot] = software->drawConstants + draw->rawBufferOffsets[slot];
+            context.rawBufferSizes[slot] = draw->rawBufferSizes[slot];
+        }
+        context.lastCluster = { 0xffffffff, {INFINITY, INFINITY}, {-INFINITY, -INFINITY}, INFINITY, -INFINITY };
+
+        // Edge functions in fixed point at the centre of the tile's first
+        // pixel, with steps of one pixel in x and y. All exact in int64,
+        // so an edge shared by two triangles gives exactly opposite values
+        // in both and every pixel centre on it goes to one of them: the
+        // top-left rule takes 1 off the other edges, so every edge is
+        // inside at >= 0.
+        int64_t edgeStepX[3], edgeStepY[3], edgeC[3];
+        for(int e=0; e<3; ++e){
+            int next = (e + 1) % 3;
+            int64_t a = tri->fixedY[e] - tri->fixedY[next];
+            int64_t b = tri->fixedX[next] - tri->fixedX[e];
+            bool isTopLeft = (a > 0) || (a == 0 && b > 0);
+            edgeStepX[e] = a * SUBPIXEL_STEPS;
+            edgeStepY[e] = b * SUBPIXEL_STEPS;
+            edgeC[e] = a * ((int64_t)tileX * SUBPIXEL_STEPS + SUBPIXEL_STEPS / 2 - tri->fixedX[e]) +
+                       b * ((int64_t)tileY * SUBPIXEL_STEPS + SUBPIXEL_STEPS / 2 - tri->fixedY[e]) - (isTopLeft ? 0 : 1);
+        }
+        float planeAtTile[SOFTWARE_MAX_PLANES];
+        for(uint32_t p=0; p<tri->numPlanes; ++p)
+            planeAtTile[p] = tri->planes[p][0] + tri->planes[p][1] * (tileX + 0.5f - tri->x[0]) + tri->planes[p][2] * (tileY + 0.5f - tri->y[0]);
+
+        int32_t startX = (tri->minX > tileX ? tri->minX : tileX) - tileX;
+        int32_t endX = (tri->maxX < tileX + TILE_SIZE - 1 ? tri->maxX : tileX + TILE_SIZE - 1) - tileX;
+        int32_t startY = (tri->minY > tileY ? tri->minY : tileY) - tileY;
+        int32_t endY = (tri->maxY < tileY + TILE_SIZE - 1 ? tri->maxY : tileY + TILE_SIZE - 1) - tileY;
+        int64_t rowEdges[3];
+        for(int e=0; e<3; ++e)
+            rowEdges[e] = edgeC[e] + edgeStepY[e] * startY;
+
+        for(int32_t y=startY; y<=endY; ++y)
+        {
+            // The row's span of pixels inside all three edges, solved
+            // exactly from rowEdge + stepX * x >= 0
+            int64_t spanStart = startX, spanEnd = endX;
+            for(int e=0; e<3; ++e){
+                int64_t rowEdge = rowEdges[e];
+                rowEdges[e] += edgeStepY[e];
+                if(edgeStepX[e] > 0){
+                    int64_t first = -floorDiv(rowEdge, edgeStepX[e]);
+                    spanStart = first > spanStart ? first : spanStart;
+                }else if(edgeStepX[e] < 0){
+                    int64_t last = floorDiv(rowEdge, -edgeStepX[e]);
+                    spanEnd = last < spanEnd ? last : spanEnd;
+                }else if(rowEdge < 0){
+                    spanEnd = -1;
+                }
+            }
+            if(spanStart > spanEnd)
+                continue;
+            const wfloat firstX = wfloatSet1((float)spanStart - 0.5f);
+            const wfloat lastX = wfloatSet1((float)spanEnd + 0.5f);
+            float rowPlanes[SOFTWARE_MAX_PLANES];
+            for(uint32_t p=0; p<tri->numPlanes; ++p)
+                rowPlanes[p] = planeAtTile[p] + tri->planes[p][2] * (float)y;
+            uint32_t* colorRow = colorTile + (size_t)y * software->rowPitch;
+            float* depthRow = depthTile + (size_t)y * software->rowPitch;
+
+            for(int32_t x=(int32_t)spanStart & ~(WFLOAT_WIDTH - 1); x<=(int32_t)spanEnd; x+=WFLOAT_WIDTH)
+            {
+                wfloat px = laneX + wfloatSet1((float)x);
+                wfloat covered = wfloatAnd(wfloatLess(firstX, px), wfloatLess(px, lastX));
+                int coveredMask = wfloatMoveMask(covered);
+
+                wfloat depth = wfloatMulAdd(wfloatSet1(tri->planes[0][1]), px, wfloatSet1(rowPlanes[0]));
+                wfloat oldDepth = wfloatLoad(depthRow + x);
+                wfloat passed = software->reverseDepth ? wfloatLess(oldDepth, depth) : wfloatLess(depth, oldDepth);
+                passed = wfloatAnd(passed, covered);
+                int passedMask = wfloatMoveMask(passed);
+                numPixelsCovered += countLanes(coveredMask);
+                numPixelsShaded += countLanes(passedMask);
+                if(!passedMask)
+                    continue;
+                wfloatStore(depthRow + x, wfloatSelect(passed, depth, oldDepth));
+
+                // Perspective-correct varyings
+                wfloat w = wfloatSet1(1.f) / wfloatMulAdd(wfloatSet1(tri->planes[1][1]), px, wfloatSet1(rowPlanes[1]));
+                wfloat varyings[SOFTWARE_MAX_VARYINGS];
+                for(uint32_t p=2; p<tri->numPlanes; ++p)
+                    varyings[p - 2] = wfloatMulAdd(wfloatSet1(tri->planes[p][1]), px, wfloatSet1(rowPlanes[p])) * w;
+
+                wfloat color[3];
+                draw->shader->pixelShader(varyings, passedMask, &context, color);
+                // Clamp and scale to sRGB table indices for all lanes at once
+                float srgbIndices[3][WFLOAT_WIDTH];
+                for(int c=0; c<3; ++c){
+                    wfloat clamped = wfloatMin(wfloatMax(color[c], zero), wfloatSet1(1.f));
+                    wfloatStore(srgbIndices[c], wfloatMulAdd(clamped, srgbScale, wfloatSet1(0.5f)));
+                }
+                for(int lane=0; lane<WFLOAT_WIDTH; ++lane){
+                    if(passedMask & (1 << lane)){
+                        colorRow[x + lane] = software->linearToSrgb[(uint32_t)srgbIndices[0][lane]] |
+                                             (software->linearToSrgb[(uint32_t)srgbIndices[1][lane]] << 8) |
+                                             (software->linearToSrgb[(uint32_t)srgbIndices[2][lane]] << 16) | 0xff000000;
+                    }
+                }
+            }
+        }
+    }
+    bin->numPixelsCovered = numPixelsCovered;
+    bin->numPixelsShaded = numPixelsShaded;
+}
+
+static void softwareSignalFence(RenderDevice* device, RenderFence fence)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    if(fence == 0 || fence > software->numFences){
+        softwareError("invalid fence handle");
+        return;
+    }
+    software->fenceFrames[fence - 1] = software->frameIndex;
+}
+
+// Work is finished when the frame it was submitted in has been presented
+static bool softwareIsFenceComplete(RenderDevice* device, RenderFence fence)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    if(fence == 0 || fence > software->numFences)
+        return true;
+    return software->fenceFrames[fence - 1] < software->frameIndex;
+}
+
+static void softwarePresent(RenderDevice* device, uint32_t syncInterval)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    (void)syncInterval;
+    if(software->numMappedBuffers > 0)
+        softwareError("present while a buffer is mapped");
+
+    uint32_t numTiles = software->tilesX * software->tilesY;
+    if(software->clearPending || software->numTriangles > 0)
+    {
+        if(software->jobSystem){
+            JobCounter counter = {};
+            runJobs(software->jobSystem, rasterizeTile, software, numTiles, &counter);
+            waitForCounter(software->jobSystem, &counter);
+        }
+        else {
+            for(uint32_t i=0; i<numTiles; ++i)
+                rasterizeTile(software, i);
+        }
+        for(uint32_t i=0; i<numTiles; ++i){
+            software->stats.numTileBins += software->bins[i].count;
+            software->stats.numPixelsCovered += software->bins[i].numPixelsCovered;
+            software->stats.numPixelsShaded += software->bins[i].numPixelsShaded;
+        }
+        if(software->clearPending)
+            software->previousClearColor = software->clearColor;
+    }
+    resetFrame(software);
+    ++software->frameIndex;
+}
+
+static void softwareDestroy(RenderDevice* device)
+{
+    SoftwareDevice* software = getSoftwareDevice(device);
+    for(uint32_t i=0; i<software->numBuffers; ++i)
+        free(software->buffers[i].bytes);
+    for(uint32_t i=0; i<software->numTextures; ++i)
+        free(software->textures[i].texels);
+    for(uint32_t i=0; i<software->tilesX * software->tilesY; ++i)
+        free(software->bins[i].triangles);
+    free(software->bins);
+    free(software->colorBuffer);
+    free(software->depthBuffer);
+    free(software->draws);
+    free(software->drawConstants);
+    free(software->triangles);
+    free(software->vertices);
+    free(software);
+}
+
+RenderDevice* createSoftwareRenderDevice(uint32_t width, uint32_t height, DepthMode depthMode, JobSystem* jobSystem)
+{
+    SoftwareDevice* software = (SoftwareDevice*)calloc(1, sizeof(SoftwareDevice));
+    assert(software);
+    software->jobSystem = jobSystem;
+    software->reverseDepth = (depthMode != DepthModeStandard);
+    software->depthClearValue = software->reverseDepth ? 0.f : 1.f;
+    for(uint32_t i=0; i<SRGB_TABLE_SIZE; ++i){
+        float linear = (float)i / (float)(SRGB_TABLE_SIZE - 1);
+        float srgb = (linear <= 0.0031308f) ? linear * 12.92f : 1.055f * powf(linear, 1.f / 2.4f) - 0.055f;
+        software->linearToSrgb[i] = (uint8_t)(srgb * 255.f + 0.5f);
+    }
+    for(uint32_t i=0; i<256; ++i){
+        float srgb = (float)i / 255.f;
+        software->srgbToLinear[i] = (srgb <= 0.04045f) ? srgb / 12.92f : powf((srgb + 0.055f) / 1.055f, 2.4f);
+    }
+
+    RenderDevice* device = &software->device;
+    device->backend = software;
+    device->createBuffer = softwareCreateBuffer;
+    device->createPipeline = softwareCreatePipeline;
+    device->createTexture = softwareCreateTexture;
+    device->createFence = softwareCreateFence;
+    device->mapBuffer = softwareMapBuffer;
+    device->unmapBuffer = softwareUnmapBuffer;
+    device->resize = softwareResize;
+    device->beginFrame = softwareBeginFrame;
+    device->setPipeline = softwareSetPipeline;
+    device->setVertexBuffer = softwareSetVertexBuffer;
+    device->setIndexBuffer = softwareSetIndexBuffer;
+    device->setConstantBuffer = softwareSetConstantBuffer;
+    device->setTexture = softwareSetTexture;
+    device->setRawBuffer = softwareSetRawBuffer;
+    device->drawIndexedInstanced = softwareDrawIndexedInstanced;
+    device->signalFence = softwareSignalFence;
+    device->isFenceComplete = softwareIsFenceComplete;
+    device->present = softwarePresent;
+    device->destroy = softwareDestroy;
+    softwareResize(device, width, height);
+    return device;
+}
+
+const uint32_t* getSoftwareFrame(const RenderDevice* device, uint32_t* outWidth, uint32_t* outHeight, uint32_t* outRowPitch)
+{
+    const SoftwareDevice* software = getSoftwareDevice(device);
+    *outWidth = software->width;
+    *outHeight = software->height;
+    *outRowPitch = software->rowPitch;
+    return software->colorBuffer;
+}
+
+SoftwareRenderStats getSoftwareRenderStats(const RenderDevice* device)
+{
+    return getSoftwareDevice(device)->stats;
+}
+
+void resetSoftwareRenderStats(RenderDevice* device)
+{
+    memset(&getSoftwareDevice(device)->stats, 0, sizeof(SoftwareRenderStats));
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "RenderDevice.h"
+#include "3DMaths.h"
+
+struct JobSystem;
+
+// CPU implementation of RenderDevice.h, for rendering without a GPU
+// (thumbnails, regression images, servers).
+//
+// Draws are processed as they're submitted: vertices are transformed,
+// clipped, projected and snapped to 1/256 pixel, back faces (clockwise
+// on screen) are culled and the triangles left are set up and binned
+// into 64x64 pixel screen tiles. present() rasterizes the tiles, one job
+// per tile on 'jobSystem': each tile is cleared, then every triangle
+// binned to it is rasterized a row at a time, with edge functions
+// evaluated exactly in fixed point (top-left fill rule, so meshes are
+// watertight), then WFLOAT_WIDTH pixels at a time depth tested, shaded
+// and written out as sRGB.
+//
+// HLSL can't run here, so pipelines are matched by shader file to
+// built-in C++ versions of Lights.hlsl and BlinnPhong.hlsl. Creating a
+// pipeline with any other shader fails.
+//
+// The depth buffer is 32-bit float for every 'depthMode', with the test
+// and clear value matching makePerspectiveMat(depthMode, ...): LESS and
+// 1 for DepthModeStandard, GREATER and 0 for the reverse-Z modes.
+struct SoftwareRenderStats
+{
+    uint64_t numTriangles;        // Submitted by draws
+    uint64_t numTrianglesCulled;  // Back-facing, zero area or clipped away
+    uint64_t numTileBins;         // Triangle-tile pairs rasterized
+    uint64_t numPixelsCovered;    // Inside a triangle (before the depth test)
+    uint64_t numPixelsShaded;     // Passed the depth test
+};
+
+// 'jobSystem' may be NULL, then tiles are rasterized on the calling
+// thread. Otherwise present() must be called from the thread which
+// created the job system.
+RenderDevice* createSoftwareRenderDevice(uint32_t width, uint32_t height, DepthMode depthMode, JobSystem* jobSystem);
+// The last presented frame as sRGB RGBA8, rows top to bottom,
+// 'outRowPitch' pixels apart. Only valid for devices from
+// createSoftwareRenderDevice(), until the next present() or resize().
+const uint32_t* getSoftwareFrame(const RenderDevice* device, uint32_t* outWidth, uint32_t* outHeight, uint32_t* outRowPitch);
+SoftwareRenderStats getSoftwareRenderStats(const RenderDevice* device);
+void resetSoftwareRenderStats(RenderDevice* device);
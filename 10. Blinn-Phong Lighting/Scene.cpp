@@ -0,0 +1,170 @@
+#include "Scene.h"
+
+SceneState makeInitialSceneState()
+{
+    SceneState state = {};
+    state.time = 0.0;
+    state.cameraPos = {0, 0, 2};
+    state.cameraPitch = 0.f;
+    state.cameraYaw = 0.f;
+    for(int i=0; i<SCENE_NUM_CUBES; ++i)
+        state.cubeRotations[i] = {0, 0, 0, 1};
+    for(int i=0; i<SCENE_NUM_LIGHTS; ++i)
+        state.lightPivotRotations[i] = {0, 0, 0, 1};
+    // Pose the animations at time 0
+    stepScene(&state, 0, 0.f);
+    return state;
+}
+
+static quat sceneCameraRotation(const SceneState* state)
+{
+    return quatFromAxisAngle({1, 0, 0}, state->cameraPitch) * quatFromAxisAngle({0, 1, 0}, state->cameraYaw);
+}
+
+// float4x4 viewMat = inverse(rotateXMat(cameraPitch) * rotateYMat(cameraYaw) * translationMat(cameraPos));
+// NOTE: We can simplify this calculation to avoid inverse()!
+// Applying the rule inverse(A*B) = inverse(B) * inverse(A) gives:
+// float4x4 viewMat = inverse(translationMat(cameraPos)) * inverse(rotateYMat(cameraYaw)) * inverse(rotateXMat(cameraPitch));
+// The inverse of a rotation/translation is a negated rotation/translation.
+// inverseTrsAffine3x4() builds exactly that from the camera's rotation
+// quaternion in one step, with no matrix multiplies:
+affine3x4 sceneViewMatrix(const SceneState* state)
+{
+    return inverseTrsAffine3x4(state->cameraPos, sceneCameraRotation(state), {1, 1, 1});
+}
+
+float3 sceneCameraForward(const SceneState* state)
+{
+    affine3x4 viewMat = sceneViewMatrix(state);
+    return {-viewMat.m[2][0], -viewMat.m[2][1], -viewMat.m[2][2]};
+}
+
+void stepScene(SceneState* state, const bool keyIsDown[GameActionCount], float dt)
+{
+    state->time += dt;
+
+    // Update camera
+    if(keyIsDown)
+    {
+        float3 cameraFwd = sceneCameraForward(state);
+        float3 camFwdXZ = normalise(float3{cameraFwd.x, 0, cameraFwd.z});
+        float3 cameraRightXZ = cross(camFwdXZ, {0, 1, 0});
+
+        const float CAM_MOVE_SPEED = 5.f; // in metres per second
+        const float CAM_MOVE_AMOUNT = CAM_MOVE_SPEED * dt;
+        if(keyIsDown[GameActionMoveCamFwd])
+            state->cameraPos += camFwdXZ * CAM_MOVE_AMOUNT;
+        if(keyIsDown[GameActionMoveCamBack])
+            state->cameraPos -= camFwdXZ * CAM_MOVE_AMOUNT;
+        if(keyIsDown[GameActionMoveCamLeft])
+            state->cameraPos -= cameraRightXZ * CAM_MOVE_AMOUNT;
+        if(keyIsDown[GameActionMoveCamRight])
+            state->cameraPos += cameraRightXZ * CAM_MOVE_AMOUNT;
+        if(keyIsDown[GameActionRaiseCam])
+            state->cameraPos.y += CAM_MOVE_AMOUNT;
+        if(keyIsDown[GameActionLowerCam])
+            state->cameraPos.y -= CAM_MOVE_AMOUNT;
+
+        const float CAM_TURN_SPEED = M_PI; // in radians per second
+        const float CAM_TURN_AMOUNT = CAM_TURN_SPEED * dt;
+        if(keyIsDown[GameActionTurnCamLeft])
+            state->cameraYaw += CAM_TURN_AMOUNT;
+        if(keyIsDown[GameActionTurnCamRight])
+            state->cameraYaw -= CAM_TURN_AMOUNT;
+        if(keyIsDown[GameActionLookUp])
+            state->cameraPitch += CAM_TURN_AMOUNT;
+        if(keyIsDown[GameActionLookDown])
+            state->cameraPitch -= CAM_TURN_AMOUNT;
+
+        // Wrap yaw to avoid floating-point errors if we turn too far
+        while(state->cameraYaw >= 2*M_PI)
+            state->cameraYaw -= 2*M_PI;
+        while(state->cameraYaw <= -2*M_PI)
+            state->cameraYaw += 2*M_PI;
+
+        // Clamp pitch to stop camera flipping upside down
+        if(state->cameraPitch > degreesToRadians(85))
+            state->cameraPitch = degreesToRadians(85);
+        if(state->cameraPitch < -degreesToRadians(85))
+            state->cameraPitch = -degreesToRadians(85);
+    }
+
+    // Spin the cubes
+    float modelXRotation = 0.2f * (float)(M_PI * state->time);
+    float modelYRotation = 0.1f * (float)(M_PI * state->time);
+    for(int i=0; i<SCENE_NUM_CUBES; ++i)
+    {
+        modelXRotation += 0.6f*i; // Add an offset so cubes have different phases
+        modelYRotation += 0.6f*i;
+        state->cubeRotations[i] = quatFromAxisAngle({1, 0, 0}, modelXRotation) * quatFromAxisAngle({0, 1, 0}, modelYRotation);
+    }
+
+    // Move the point lights
+    float lightRotation = -0.3f * (float)(M_PI * state->time);
+    for(int i=0; i<SCENE_NUM_LIGHTS; ++i)
+    {
+        lightRotation += 0.5f*i; // Add an offset so lights have different phases
+        state->lightPivotRotations[i] = quatFromAxisAngle({0, 1, 0}, lightRotation);
+    }
+}
+
+SceneState interpolateSceneStates(const SceneState* a, const SceneState* b, float alpha)
+{
+    SceneState result;
+    result.time = a->time + (b->time - a->time) * alpha;
+    result.cameraPos = a->cameraPos * (1.f - alpha) + b->cameraPos * alpha;
+    result.cameraPitch = a->cameraPitch + (b->cameraPitch - a->cameraPitch) * alpha;
+
+    // Yaw may have wrapped around between the two states
+    float yawDelta = b->cameraYaw - a->cameraYaw;
+    if(yawDelta > (float)M_PI)
+        yawDelta -= 2*(float)M_PI;
+    if(yawDelta < -(float)M_PI)
+        yawDelta += 2*(float)M_PI;
+    result.cameraYaw = a->cameraYaw + yawDelta * alpha;
+
+    for(int i=0; i<SCENE_NUM_CUBES; ++i)
+        result.cubeRotations[i] = nlerp(a->cubeRotations[i], b->cubeRotations[i], alpha);
+    for(int i=0; i<SCENE_NUM_LIGHTS; ++i)
+        result.lightPivotRotations[i] = nlerp(a->lightPivotRotations[i], b->lightPivotRotations[i], alpha);
+    return result;
+}
+
+Scene createScene()
+{
+    Scene scene;
+    scene.transforms = allocTransformHierarchy(SCENE_NUM_CUBES + 2*SCENE_NUM_LIGHTS);
+
+    const quat noRotation = {0, 0, 0, 1};
+    const float3 cubePositions[SCENE_NUM_CUBES] = {
+        {0.f, 0.f, 0.f},
+        {-3.f, 0.f, -1.5f},
+        {4.5f, 0.2f, -3.f}
+    };
+    for(int i=0; i<SCENE_NUM_CUBES; ++i)
+        scene.cubeNodes[i] = addTransformNode(&scene.transforms, TRANSFORM_NO_PARENT, cubePositions[i], noRotation, {1, 1, 1});
+
+    const float3 lightPositions[SCENE_NUM_LIGHTS] = {
+        {1, 0.5f, 0},
+        {-1, 0.7f, -1.2f}
+    };
+    for(int i=0; i<SCENE_NUM_LIGHTS; ++i){
+        scene.lightPivotNodes[i] = addTransformNode(&scene.transforms, TRANSFORM_NO_PARENT, {0, 0, 0}, noRotation, {1, 1, 1});
+        scene.lightNodes[i] = addTransformNode(&scene.transforms, scene.lightPivotNodes[i], lightPositions[i], noRotation, {0.2f, 0.2f, 0.2f});
+    }
+    return scene;
+}
+
+void freeScene(Scene scene)
+{
+    freeTransformHierarchy(scene.transforms);
+}
+
+void applySceneState(Scene* scene, const SceneState* state)
+{
+    for(int i=0; i<SCENE_NUM_CUBES; ++i)
+        setLocalRotation(&scene->transforms, scene->cubeNodes[i], state->cubeRotations[i]);
+    for(int i=0; i<SCENE_NUM_LIGHTS; ++i)
+        setLocalRotation(&scene->transforms, scene->lightPivotNodes[i], state->lightPivotRotations[i]);
+    updateWorldTransforms(&scene->transforms);
+}
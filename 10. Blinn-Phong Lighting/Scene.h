@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include "3DMaths.h"
+#include "TransformHierarchy.h"
+
+// The sample's scene (a camera, spinning cubes and orbiting point
+// lights) split into simulation and presentation, so it can run on a
+// fixed timestep and without a window:
+//   SceneState holds everything the simulation advances. stepScene()
+//   moves it forward by a fixed dt and knows nothing about rendering.
+//   Scene holds the transform hierarchy the renderer reads from.
+//   applySceneState() poses it from a (usually interpolated) state.
+
+// Input
+enum GameAction {
+    GameActionMoveCamFwd,
+    GameActionMoveCamBack,
+    GameActionMoveCamLeft,
+    GameActionMoveCamRight,
+    GameActionTurnCamLeft,
+    GameActionTurnCamRight,
+    GameActionLookUp,
+    GameActionLookDown,
+    GameActionRaiseCam,
+    GameActionLowerCam,
+    GameActionCount
+};
+
+const int SCENE_NUM_CUBES = 3;
+const int SCENE_NUM_LIGHTS = 2;
+
+struct SceneState
+{
+    double time; // Simulated seconds
+
+    float3 cameraPos;
+    float cameraPitch;
+    float cameraYaw;
+
+    quat cubeRotations[SCENE_NUM_CUBES];
+    quat lightPivotRotations[SCENE_NUM_LIGHTS];
+};
+
+SceneState makeInitialSceneState();
+// Advances 'state' by 'dt' seconds with the keys in 'keyIsDown' held
+void stepScene(SceneState* state, const bool keyIsDown[GameActionCount], float dt);
+// 'alpha' = 0 gives 'a', 1 gives 'b'. Rotations use nlerp, which is
+// accurate for the small changes between consecutive steps.
+SceneState interpolateSceneStates(const SceneState* a, const SceneState* b, float alpha);
+
+// View matrix and forward vector of the camera in 'state'
+affine3x4 sceneViewMatrix(const SceneState* state);
+float3 sceneCameraForward(const SceneState* state);
+
+struct Scene
+{
+    TransformHierarchy transforms;
+    uint32_t cubeNodes[SCENE_NUM_CUBES];
+    // Each light hangs off its own pivot node at the origin, which
+    // spins it around the y axis
+    uint32_t lightPivotNodes[SCENE_NUM_LIGHTS];
+    uint32_t lightNodes[SCENE_NUM_LIGHTS];
+};
+
+// Allocates using malloc()
+Scene createScene();
+void freeScene(Scene scene);
+// Sets the animated nodes from 'state' and updates world transforms
+void applySceneState(Scene* scene, const SceneState* state);
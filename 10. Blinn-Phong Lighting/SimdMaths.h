@@ -0,0 +1,366 @@
+#pragma once
+
+#include "3DMaths.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// 'wfloat' holds WFLOAT_WIDTH floats and is used to write batch
+// (structure-of-arrays) kernels once for every instruction set:
+//   AVX:    8 lanes (__m256)
+//   SSE2:   4 lanes (__m128)
+//   scalar: 1 lane  (MATHS_NO_SIMD or no SSE2)
+// The instruction set is picked by 3DMaths.h from the compiler flags.
+
+#if defined(MATHS_SIMD_AVX)
+
+#define WFLOAT_WIDTH 8
+struct wfloat { __m256 v; };
+
+inline wfloat wfloatSet1(float f) { return {_mm256_set1_ps(f)}; }
+inline wfloat wfloatLoad(const float* p) { return {_mm256_loadu_ps(p)}; }
+inline void wfloatStore(float* p, wfloat a) { _mm256_storeu_ps(p, a.v); }
+inline wfloat operator+ (wfloat a, wfloat b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline wfloat operator- (wfloat a, wfloat b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline wfloat operator* (wfloat a, wfloat b) { return {_mm256_mul_ps(a.v, b.v)}; }
+inline wfloat operator/ (wfloat a, wfloat b) { return {_mm256_div_ps(a.v, b.v)}; }
+inline wfloat wfloatMin(wfloat a, wfloat b) { return {_mm256_min_ps(a.v, b.v)}; }
+inline wfloat wfloatMax(wfloat a, wfloat b) { return {_mm256_max_ps(a.v, b.v)}; }
+inline wfloat wfloatSqrt(wfloat a) { return {_mm256_sqrt_ps(a.v)}; }
+// Comparisons return all bits set in lanes where they hold, zero elsewhere
+inline wfloat wfloatLess(wfloat a, wfloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline wfloat wfloatLessEqual(wfloat a, wfloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+inline wfloat wfloatAnd(wfloat a, wfloat b) { return {_mm256_and_ps(a.v, b.v)}; }
+inline wfloat wfloatOr(wfloat a, wfloat b) { return {_mm256_or_ps(a.v, b.v)}; }
+inline wfloat wfloatAbs(wfloat a) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v)}; }
+// Bit i of the result is set if lane i of mask 'a' is set
+inline int wfloatMoveMask(wfloat a) { return _mm256_movemask_ps(a.v); }
+// Returns 'a' in lanes where 'mask' is set, 'b' elsewhere
+inline wfloat wfloatSelect(wfloat mask, wfloat a, wfloat b) { return {_mm256_blendv_ps(b.v, a.v, mask.v)}; }
+// Rounds to the nearest integer (ties to even)
+inline wfloat wfloatRound(wfloat a) { return {_mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)}; }
+// Returns a*b + c
+inline wfloat wfloatMulAdd(wfloat a, wfloat b, wfloat c) {
+#if defined(MATHS_SIMD_FMA)
+    return {_mm256_fmadd_ps(a.v, b.v, c.v)};
+#else
+    return {_mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v)};
+#endif
+}
+
+#elif defined(MATHS_SIMD_SSE2)
+
+#define WFLOAT_WIDTH 4
+struct wfloat { __m128 v; };
+
+inline wfloat wfloatSet1(float f) { return {_mm_set1_ps(f)}; }
+inline wfloat wfloatLoad(const float* p) { return {_mm_loadu_ps(p)}; }
+inline void wfloatStore(float* p, wfloat a) { _mm_storeu_ps(p, a.v); }
+inline wfloat operator+ (wfloat a, wfloat b) { return {_mm_add_ps(a.v, b.v)}; }
+inline wfloat operator- (wfloat a, wfloat b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline wfloat operator* (wfloat a, wfloat b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline wfloat operator/ (wfloat a, wfloat b) { return {_mm_div_ps(a.v, b.v)}; }
+inline wfloat wfloatMin(wfloat a, wfloat b) { return {_mm_min_ps(a.v, b.v)}; }
+inline wfloat wfloatMax(wfloat a, wfloat b) { return {_mm_max_ps(a.v, b.v)}; }
+inline wfloat wfloatSqrt(wfloat a) { return {_mm_sqrt_ps(a.v)}; }
+inline wfloat wfloatLess(wfloat a, wfloat b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline wfloat wfloatLessEqual(wfloat a, wfloat b) { return {_mm_cmple_ps(a.v, b.v)}; }
+inline wfloat wfloatAnd(wfloat a, wfloat b) { return {_mm_and_ps(a.v, b.v)}; }
+inline wfloat wfloatOr(wfloat a, wfloat b) { return {_mm_or_ps(a.v, b.v)}; }
+inline wfloat wfloatAbs(wfloat a) { return {_mm_andnot_ps(_mm_set1_ps(-0.f), a.v)}; }
+inline int wfloatMoveMask(wfloat a) { return _mm_movemask_ps(a.v); }
+inline wfloat wfloatSelect(wfloat mask, wfloat a, wfloat b) { return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))}; }
+// Only valid for |a| < 2^31, which is all the callers need
+inline wfloat wfloatRound(wfloat a) { return {_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))}; }
+inline wfloat wfloatMulAdd(wfloat a, wfloat b, wfloat c) { return {simdMulAdd(a.v, b.v, c.v)}; }
+
+#else
+
+#define WFLOAT_WIDTH 1
+struct wfloat { float v; };
+
+inline wfloat wfloatSet1(float f) { return {f}; }
+inline wfloat wfloatLoad(const float* p) { return {*p}; }
+inline void wfloatStore(float* p, wfloat a) { *p = a.v; }
+inline wfloat operator+ (wfloat a, wfloat b) { return {a.v + b.v}; }
+inline wfloat operator- (wfloat a, wfloat b) { return {a.v - b.v}; }
+inline wfloat operator* (wfloat a, wfloat b) { return {a.v * b.v}; }
+inline wfloat operator/ (wfloat a, wfloat b) { return {a.v / b.v}; }
+inline wfloat wfloatMin(wfloat a, wfloat b) { return {a.v < b.v ? a.v : b.v}; }
+inline wfloat wfloatMax(wfloat a, wfloat b) { return {a.v > b.v ? a.v : b.v}; }
+inline wfloat wfloatSqrt(wfloat a) { return {sqrtf(a.v)}; }
+// Masks are stored as the float with all bits set (a NaN) or 0
+inline float wfloatFromBits(uint32_t bits) { float f; memcpy(&f, &bits, sizeof(f)); return f; }
+inline uint32_t wfloatToBits(float f) { uint32_t bits; memcpy(&bits, &f, sizeof(bits)); return bits; }
+inline wfloat wfloatLess(wfloat a, wfloat b) { return {wfloatFromBits(a.v < b.v ? 0xffffffff : 0)}; }
+inline wfloat wfloatLessEqual(wfloat a, wfloat b) { return {wfloatFromBits(a.v <= b.v ? 0xffffffff : 0)}; }
+inline wfloat wfloatAnd(wfloat a, wfloat b) { return {wfloatFromBits(wfloatToBits(a.v) & wfloatToBits(b.v))}; }
+inline wfloat wfloatOr(wfloat a, wfloat b) { return {wfloatFromBits(wfloatToBits(a.v) | wfloatToBits(b.v))}; }
+inline wfloat wfloatAbs(wfloat a) { return {fabsf(a.v)}; }
+inline int wfloatMoveMask(wfloat a) { return (int)(wfloatToBits(a.v) >> 31); }
+inline wfloat wfloatSelect(wfloat mask, wfloat a, wfloat b) { return {wfloatToBits(mask.v) ? a.v : b.v}; }
+inline wfloat wfloatRound(wfloat a) { return {nearbyintf(a.v)}; }
+inline wfloat wfloatMulAdd(wfloat a, wfloat b, wfloat c) { return {a.v * b.v + c.v}; }
+
+#endif
+
+inline wfloat operator- (wfloat a) { return wfloatSet1(0.f) - a; }
+
+// Loads the first 'n' (up to WFLOAT_WIDTH) floats from 'p' and fills
+// the remaining lanes with 'padValue'. For the tail of a batch.
+inline wfloat wfloatLoadPartial(const float* p, int n, float padValue)
+{
+    if(n == WFLOAT_WIDTH)
+        return wfloatLoad(p);
+    float lanes[WFLOAT_WIDTH];
+    for(int i=0; i<WFLOAT_WIDTH; ++i)
+        lanes[i] = (i < n) ? p[i] : padValue;
+    return wfloatLoad(lanes);
+}
+
+// Interleaves four lane-per-object values into float4s in an
+// array-of-structures buffer: for each object i < n (n <= WFLOAT_WIDTH)
+//   out[i*stride + 0..3] = {x[i], y[i], z[i], w[i]}
+// 'stride' is in floats. Used to write matrix columns for a batch.
+inline void wfloatStoreInterleaved4(float* out, size_t stride, wfloat x, wfloat y, wfloat z, wfloat w, int n)
+{
+#if defined(MATHS_SIMD_AVX)
+    __m256 xy0 = _mm256_unpacklo_ps(x.v, y.v);
+    __m256 xy1 = _mm256_unpackhi_ps(x.v, y.v);
+    __m256 zw0 = _mm256_unpacklo_ps(z.v, w.v);
+    __m256 zw1 = _mm256_unpackhi_ps(z.v, w.v);
+    // Each register holds object i in its low half and object i+4 in its high half
+    __m256 objs[4] = {
+        _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(1, 0, 1, 0)),
+        _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(3, 2, 3, 2)),
+        _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(1, 0, 1, 0)),
+        _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(3, 2, 3, 2))
+    };
+    for(int i=0; i<n && i<4; ++i)
+        _mm_storeu_ps(out + i*stride, _mm256_castps256_ps128(objs[i]));
+    for(int i=4; i<n; ++i)
+        _mm_storeu_ps(out + i*stride, _mm256_extractf128_ps(objs[i-4], 1));
+#elif defined(MATHS_SIMD_SSE2)
+    _MM_TRANSPOSE4_PS(x.v, y.v, z.v, w.v);
+    __m128 objs[4] = { x.v, y.v, z.v, w.v };
+    for(int i=0; i<n; ++i)
+        _mm_storeu_ps(out + i*stride, objs[i]);
+#else
+    if(n > 0){
+        out[0] = x.v;
+        out[1] = y.v;
+        out[2] = z.v;
+        out[3] = w.v;
+    }
+    (void)stride;
+#endif
+}
+
+#if defined(MATHS_SIMD_SSE2)
+// Non-temporal stores write around the cache, so they skip reading each
+// line in before overwriting it. 'p' must be 16-byte aligned, and
+// wfloatStoreFence() must run before anything reads the data back.
+inline void wfloatStoreFloat4(float* p, __m128 v, bool nonTemporal)
+{
+    if(nonTemporal)
+        _mm_stream_ps(p, v);
+    else
+        _mm_storeu_ps(p, v);
+}
+inline void wfloatStoreFence() { _mm_sfence(); }
+#else
+inline void wfloatStoreFence() {}
+#endif
+
+// wfloatStoreInterleaved4() for a whole matrix: for each object i < n
+//   out[i*stride + 4*c + 0..3] = {cols[c][0][i], .., cols[c][3][i]}
+// for every column c < numCols (at most 4). Transposes every column first,
+// then writes each object's matrix in one contiguous run, instead of
+// revisiting every object's cache line once per column.
+// 'nonTemporal' streams the matrices out (see wfloatStoreFloat4()), which
+// needs 'out' 32-byte aligned and 'stride' a multiple of 4.
+inline void wfloatStoreColumns(float* out, size_t stride, const wfloat cols[][4], int numCols, int n, bool nonTemporal)
+{
+#if defined(MATHS_SIMD_AVX)
+    // objs[c][i] holds column c of object i in its low half and of
+    // object i+4 in its high half
+    __m256 objs[4][4];
+    for(int c=0; c<numCols; ++c){
+        __m256 xy0 = _mm256_unpacklo_ps(cols[c][0].v, cols[c][1].v);
+        __m256 xy1 = _mm256_unpackhi_ps(cols[c][0].v, cols[c][1].v);
+        __m256 zw0 = _mm256_unpacklo_ps(cols[c][2].v, cols[c][3].v);
+        __m256 zw1 = _mm256_unpackhi_ps(cols[c][2].v, cols[c][3].v);
+        objs[c][0] = _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(1, 0, 1, 0));
+        objs[c][1] = _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(3, 2, 3, 2));
+        objs[c][2] = _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(1, 0, 1, 0));
+        objs[c][3] = _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    if(nonTemporal && stride % 8 == 0 && numCols == 4){
+        // float4x4s: two columns per 32-byte store
+        for(int i=0; i<n && i<4; ++i){
+            _mm256_stream_ps(out + i*stride, _mm256_permute2f128_ps(objs[0][i], objs[1][i], 0x20));
+            _mm256_stream_ps(out + i*stride + 8, _mm256_permute2f128_ps(objs[2][i], objs[3][i], 0x20));
+        }
+        for(int i=4; i<n; ++i){
+            _mm256_stream_ps(out + i*stride, _mm256_permute2f128_ps(objs[0][i-4], objs[1][i-4], 0x31));
+            _mm256_stream_ps(out + i*stride + 8, _mm256_permute2f128_ps(objs[2][i-4], objs[3][i-4], 0x31));
+        }
+        return;
+    }
+    if(nonTemporal && stride == 12 && numCols == 3){
+        // float3x3s: each pair of objects is three aligned 32-byte stores
+        int i = 0;
+        for(; i+1<n && i+1<4; i+=2){
+            _mm256_stream_ps(out + i*stride, _mm256_permute2f128_ps(objs[0][i], objs[1][i], 0x20));
+            _mm256_stream_ps(out + i*stride + 8, _mm256_permute2f128_ps(objs[2][i], objs[0][i+1], 0x20));
+            _mm256_stream_ps(out + i*stride + 16, _mm256_permute2f128_ps(objs[1][i+1], objs[2][i+1], 0x20));
+        }
+        for(; i+1<n; i+=2){
+            _mm256_stream_ps(out + i*stride, _mm256_permute2f128_ps(objs[0][i-4], objs[1][i-4], 0x31));
+            _mm256_stream_ps(out + i*stride + 8, _mm256_permute2f128_ps(objs[2][i-4], objs[0][i-3], 0x31));
+            _mm256_stream_ps(out + i*stride + 16, _mm256_permute2f128_ps(objs[1][i-3], objs[2][i-3], 0x31));
+        }
+        if(i < n)
+            for(int c=0; c<3; ++c)
+                _mm_stream_ps(out + i*stride + 4*c, (i < 4) ? _mm256_castps256_ps128(objs[c][i]) : _mm256_extractf128_ps(objs[c][i-4], 1));
+        return;
+    }
+    if(nonTemporal){
+        // Any other layout, 16 bytes at a time
+        for(int i=0; i<n && i<4; ++i)
+            for(int c=0; c<numCols; ++c)
+                _mm_stream_ps(out + i*stride + 4*c, _mm256_castps256_ps128(objs[c][i]));
+        for(int i=4; i<n; ++i)
+            for(int c=0; c<numCols; ++c)
+                _mm_stream_ps(out + i*stride + 4*c, _mm256_extractf128_ps(objs[c][i-4], 1));
+        return;
+    }
+    for(int i=0; i<n; ++i){
+        float* dst = out + i*stride;
+        int half = i >> 2;
+        int c = 0;
+        // Two columns per 256-bit store
+        for(; c+1 < numCols; c+=2){
+            __m256 pair = half ? _mm256_permute2f128_ps(objs[c][i&3], objs[c+1][i&3], 0x31)
+                               : _mm256_permute2f128_ps(objs[c][i&3], objs[c+1][i&3], 0x20);
+            _mm256_storeu_ps(dst + 4*c, pair);
+        }
+        if(c < numCols)
+            _mm_storeu_ps(dst + 4*c, half ? _mm256_extractf128_ps(objs[c][i&3], 1) : _mm256_castps256_ps128(objs[c][i&3]));
+    }
+#elif defined(MATHS_SIMD_SSE2)
+    __m128 objs[4][4];
+    for(int c=0; c<numCols; ++c){
+        objs[c][0] = cols[c][0].v;
+        objs[c][1] = cols[c][1].v;
+        objs[c][2] = cols[c][2].v;
+        objs[c][3] = cols[c][3].v;
+        _MM_TRANSPOSE4_PS(objs[c][0], objs[c][1], objs[c][2], objs[c][3]);
+    }
+    for(int i=0; i<n; ++i)
+        for(int c=0; c<numCols; ++c)
+            wfloatStoreFloat4(out + i*stride + 4*c, objs[c][i], nonTemporal);
+#else
+    if(n > 0){
+        for(int c=0; c<numCols; ++c){
+            out[4*c + 0] = cols[c][0].v;
+            out[4*c + 1] = cols[c][1].v;
+            out[4*c + 2] = cols[c][2].v;
+            out[4*c + 3] = cols[c][3].v;
+        }
+    }
+    (void)stride;
+    (void)nonTemporal;
+#endif
+}
+
+// sinCos() from 3DMaths.h for WFLOAT_WIDTH angles at once.
+// Same range reduction and polynomials, so the same error bound
+// (1e-7 absolute for |rad| <= 8192).
+inline void wfloatSinCos(wfloat rad, wfloat* outSin, wfloat* outCos)
+{
+    wfloat j = wfloatRound(rad * wfloatSet1(SINCOS_TWO_OVER_PI));
+    wfloat r = rad - j * wfloatSet1(SINCOS_PIO2_A);
+    r = r - j * wfloatSet1(SINCOS_PIO2_B);
+    r = r - j * wfloatSet1(SINCOS_PIO2_C);
+    wfloat r2 = r * r;
+
+    wfloat sinPoly = wfloatMulAdd(r2, wfloatSet1(SINCOS_SIN_3), wfloatSet1(SINCOS_SIN_2));
+    sinPoly = wfloatMulAdd(r2, sinPoly, wfloatSet1(SINCOS_SIN_1));
+    wfloat s = wfloatMulAdd(r * r2, sinPoly, r);
+
+    wfloat cosPoly = wfloatMulAdd(r2, wfloatSet1(SINCOS_COS_3), wfloatSet1(SINCOS_COS_2));
+    cosPoly = wfloatMulAdd(r2, cosPoly, wfloatSet1(SINCOS_COS_1));
+    wfloat c = wfloatMulAdd(r2 * r2, cosPoly, wfloatSet1(1.f) - wfloatSet1(0.5f) * r2);
+
+    // quadrant = j mod 4, computed in floats since AVX1 has no 256-bit
+    // integer ops. floor(j/4) == round((j - 1.5)/4) for integer j.
+    wfloat quadrant = j - wfloatSet1(4.f) * wfloatRound((j - wfloatSet1(1.5f)) * wfloatSet1(0.25f));
+    wfloat isOdd = wfloatOr(wfloatAnd(wfloatLess(wfloatSet1(0.5f), quadrant), wfloatLess(quadrant, wfloatSet1(1.5f))),
+                            wfloatLess(wfloatSet1(2.5f), quadrant));
+    wfloat negateSin = wfloatLess(wfloatSet1(1.5f), quadrant);
+    wfloat negateCos = wfloatAnd(wfloatLess(wfloatSet1(0.5f), quadrant), wfloatLess(quadrant, wfloatSet1(2.5f)));
+
+    wfloat sinResult = wfloatSelect(isOdd, c, s);
+    wfloat cosResult = wfloatSelect(isOdd, s, c);
+    *outSin = wfloatSelect(negateSin, -sinResult, sinResult);
+    *outCos = wfloatSelect(negateCos, -cosResult, cosResult);
+}
+
+// Computes outSin[i] = sin(angles[i]), outCos[i] = cos(angles[i]) for
+// 'count' angles. Same error bound as sinCos().
+inline void sinCosBatch(const float* angles, float* outSin, float* outCos, size_t count)
+{
+    size_t i = 0;
+#if WFLOAT_WIDTH > 1
+    for(; i + WFLOAT_WIDTH <= count; i += WFLOAT_WIDTH){
+        wfloat s, c;
+        wfloatSinCos(wfloatLoad(angles + i), &s, &c);
+        wfloatStore(outSin + i, s);
+        wfloatStore(outCos + i, c);
+    }
+#endif
+    // With one lane the selects above cost more than the branchless
+    // sinCos(), which the compiler can vectorise in this loop itself
+    for(; i < count; ++i)
+        sinCos(angles[i], &outSin[i], &outCos[i]);
+}
+
+// x^exponent by repeated squaring: about 2*log2(exponent) multiplies
+// (9 for x^200) instead of exp2(exponent * log2(x)). Each squaring
+// doubles the relative error so far, giving about 1e-5 for x^200.
+// When inlined with a constant exponent the loop unrolls to
+// straight-line multiplies.
+inline wfloat wfloatPowInt(wfloat x, uint32_t exponent)
+{
+    wfloat result = wfloatSet1(1.f);
+    while(exponent){
+        if(exponent & 1)
+            result = result * x;
+        exponent >>= 1;
+        if(exponent)
+            x = x * x;
+    }
+    return result;
+}
+
+// Rotation matrix of WFLOAT_WIDTH unit quaternions, for row vectors:
+// outRot[r][c] is (row r, column c), same as rotationMat() in 3DMaths.h
+inline void wfloatQuatToRotation(wfloat qx, wfloat qy, wfloat qz, wfloat qw, wfloat outRot[3][3])
+{
+    const wfloat one = wfloatSet1(1.f);
+    const wfloat two = wfloatSet1(2.f);
+    wfloat x2 = qx * two, y2 = qy * two, z2 = qz * two;
+    wfloat xx = qx * x2, yy = qy * y2, zz = qz * z2;
+    wfloat xy = qx * y2, xz = qx * z2, yz = qy * z2;
+    wfloat wx = qw * x2, wy = qw * y2, wz = qw * z2;
+    outRot[0][0] = one - (yy + zz);
+    outRot[0][1] = xy + wz;
+    outRot[0][2] = xz - wy;
+    outRot[1][0] = xy - wz;
+    outRot[1][1] = one - (xx + zz);
+    outRot[1][2] = yz + wx;
+    outRot[2][0] = xz + wy;
+    outRot[2][1] = yz - wx;
+    outRot[2][2] = one - (xx + yy);
+}
@@ -0,0 +1,159 @@
+#include "Skinning.h"
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <string.h> // memcpy()
+
+// Enough work per job to hide the cost of scheduling it
+static const uint32_t SKINNING_VERTICES_PER_JOB = 4096;
+
+// A bone matrix transposed into rows, so that transforming a point is
+//   x*rows[0] + y*rows[1] + z*rows[2] + rows[3]
+// which needs only splats and multiply-adds (no horizontal sums), and
+// blending bones is a weighted sum of their rows. The w lanes are 0.
+struct SkinningBone
+{
+    float4 rows[4];
+};
+
+static void makeSkinningBones(const affine3x4* bones, uint32_t numBones, SkinningBone* outBones)
+{
+    for(uint32_t i=0; i<numBones; ++i){
+        for(int r=0; r<4; ++r)
+            outBones[i].rows[r] = {bones[i].m[0][r], bones[i].m[1][r], bones[i].m[2][r], 0.f};
+    }
+}
+
+// NOTE: VertexData is pos[3], uv[2], norm[3]: exactly two float4s
+//   {pos.x, pos.y, pos.z, uv.x} and {uv.y, norm.x, norm.y, norm.z}
+// and SkinnedVertexData starts with the same 32 bytes, so each vertex is
+// loaded and stored as two unaligned float4s with the uvs passed through.
+static void skinRange(const SkinnedVertexData* vertices, uint32_t numVertices,
+                      const SkinningBone* bones, VertexData* outVertices)
+{
+#if defined(MATHS_SIMD_SSE2)
+    const __m128 laneWMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const __m128 laneXMask = _mm_castsi128_ps(_mm_set_epi32(0, 0, 0, -1));
+    const __m128 weightScale = _mm_set1_ps(1.f / 255.f);
+    const __m128 minLengthSq = _mm_set1_ps(1e-30f);
+    const __m128i zero = _mm_setzero_si128();
+
+    for(uint32_t i=0; i<numVertices; ++i)
+    {
+        const SkinnedVertexData* v = vertices + i;
+        __m128 in0 = _mm_loadu_ps(&v->pos[0]);
+        __m128 in1 = _mm_loadu_ps(&v->uv[1]);
+
+        // unorm8 x4 -> float x4
+        int packedWeights;
+        memcpy(&packedWeights, v->boneWeights, sizeof(packedWeights));
+        __m128i weights32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packedWeights), zero), zero);
+        __m128 weights = _mm_mul_ps(_mm_cvtepi32_ps(weights32), weightScale);
+
+        // Blend the four bones: 16 multiply-adds
+        __m128 w[SKINNING_INFLUENCES_PER_VERTEX] = {
+            simdSplat(weights, 0), simdSplat(weights, 1), simdSplat(weights, 2), simdSplat(weights, 3)
+        };
+        __m128 blended[4];
+        const float4* rows = bones[v->boneIndices[0]].rows;
+        for(int r=0; r<4; ++r)
+            blended[r] = _mm_mul_ps(simdLoad(rows[r]), w[0]);
+        for(int k=1; k<SKINNING_INFLUENCES_PER_VERTEX; ++k){
+            rows = bones[v->boneIndices[k]].rows;
+            for(int r=0; r<4; ++r)
+                blended[r] = simdMulAdd(simdLoad(rows[r]), w[k], blended[r]);
+        }
+
+        __m128 pos = simdMulAdd(simdSplat(in0, 0), blended[0], blended[3]);
+        pos = simdMulAdd(simdSplat(in0, 1), blended[1], pos);
+        pos = simdMulAdd(simdSplat(in0, 2), blended[2], pos);
+
+        __m128 norm = _mm_mul_ps(simdSplat(in1, 1), blended[0]);
+        norm = simdMulAdd(simdSplat(in1, 2), blended[1], norm);
+        norm = simdMulAdd(simdSplat(in1, 3), blended[2], norm);
+
+        // Length squared in every lane (w is 0)
+        __m128 lengthSq = _mm_mul_ps(norm, norm);
+        lengthSq = _mm_add_ps(lengthSq, _mm_shuffle_ps(lengthSq, lengthSq, _MM_SHUFFLE(2, 3, 0, 1)));
+        lengthSq = _mm_add_ps(lengthSq, _mm_shuffle_ps(lengthSq, lengthSq, _MM_SHUFFLE(1, 0, 3, 2)));
+        norm = _mm_div_ps(norm, _mm_sqrt_ps(_mm_max_ps(lengthSq, minLengthSq)));
+        // {nx, ny, nz, 0} -> {0, nx, ny, nz}
+        norm = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(norm), 4));
+
+        float* out = &outVertices[i].pos[0];
+        _mm_storeu_ps(out, _mm_or_ps(_mm_andnot_ps(laneWMask, pos), _mm_and_ps(in0, laneWMask)));
+        _mm_storeu_ps(out + 4, _mm_or_ps(norm, _mm_and_ps(in1, laneXMask)));
+    }
+#else
+    for(uint32_t i=0; i<numVertices; ++i)
+    {
+        const SkinnedVertexData* v = vertices + i;
+        float blended[4][3] = {};
+        for(int k=0; k<SKINNING_INFLUENCES_PER_VERTEX; ++k){
+            const SkinningBone* bone = bones + v->boneIndices[k];
+            float w = v->boneWeights[k] * (1.f / 255.f);
+            for(int r=0; r<4; ++r){
+                blended[r][0] += w * bone->rows[r].x;
+                blended[r][1] += w * bone->rows[r].y;
+                blended[r][2] += w * bone->rows[r].z;
+            }
+        }
+
+        VertexData* out = outVertices + i;
+        float norm[3];
+        for(int c=0; c<3; ++c){
+            out->pos[c] = v->pos[0]*blended[0][c] + v->pos[1]*blended[1][c] + v->pos[2]*blended[2][c] + blended[3][c];
+            norm[c] = v->norm[0]*blended[0][c] + v->norm[1]*blended[1][c] + v->norm[2]*blended[2][c];
+        }
+        float lengthSq = norm[0]*norm[0] + norm[1]*norm[1] + norm[2]*norm[2];
+        float invLength = 1.f / sqrtf(lengthSq > 1e-30f ? lengthSq : 1e-30f);
+        for(int c=0; c<3; ++c)
+            out->norm[c] = norm[c] * invLength;
+        out->uv[0] = v->uv[0];
+        out->uv[1] = v->uv[1];
+    }
+#endif
+}
+
+struct SkinningContext
+{
+    const SkinnedVertexData* vertices;
+    const SkinningBone* bones;
+    VertexData* outVertices;
+};
+
+static void skinningJob(void* userData, uint32_t begin, uint32_t end)
+{
+    SkinningContext* ctx = (SkinningContext*)userData;
+    skinRange(ctx->vertices + begin, end - begin, ctx->bones, ctx->outVertices + begin);
+}
+
+void skinVertices(const SkinnedVertexData* vertices, uint32_t numVertices,
+                  const affine3x4* bones, uint32_t numBones,
+                  VertexData* outVertices, JobSystem* jobSystem)
+{
+    assert(numBones <= SKINNING_MAX_BONES);
+
+    // Shared by every job, 16KB at most
+    SkinningBone skinningBones[SKINNING_MAX_BONES];
+    makeSkinningBones(bones, numBones, skinningBones);
+
+    SkinningContext ctx;
+    ctx.vertices = vertices;
+    ctx.bones = skinningBones;
+    ctx.outVertices = outVertices;
+    if(jobSystem && numVertices > SKINNING_VERTICES_PER_JOB)
+        parallelFor(jobSystem, skinningJob, &ctx, numVertices, SKINNING_VERTICES_PER_JOB);
+    else
+        skinningJob(&ctx, 0, numVertices);
+}
+
+void skinVertexRange(const SkinnedVertexData* vertices, uint32_t numVertices,
+                     const affine3x4* bones, uint32_t numBones,
+                     VertexData* outVertices)
+{
+    assert(numBones <= SKINNING_MAX_BONES);
+    SkinningBone skinningBones[SKINNING_MAX_BONES];
+    makeSkinningBones(bones, numBones, skinningBones);
+    skinRange(vertices, numVertices, skinningBones, outVertices);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "3DMaths.h"
+#include "ObjLoading.h"
+
+struct JobSystem;
+
+// Bone indices and weights are packed the way the GPU would read them
+// (DXGI_FORMAT_R8G8B8A8_UINT and DXGI_FORMAT_R8G8B8A8_UNORM), so the same
+// buffer works for GPU skinning.
+#define SKINNING_MAX_BONES 256
+#define SKINNING_INFLUENCES_PER_VERTEX 4
+
+#pragma pack(push, 1)
+struct SkinnedVertexData
+{
+    float pos[3];
+    float uv[2];
+    float norm[3];
+    uint8_t boneIndices[SKINNING_INFLUENCES_PER_VERTEX];
+    // unorm8, should add up to 255. Unused influences have weight 0.
+    uint8_t boneWeights[SKINNING_INFLUENCES_PER_VERTEX];
+};
+#pragma pack(pop)
+
+// Skins 'numVertices' vertices with the matrix palette 'bones' (one
+// bindPose^-1 * boneTransform per bone) and writes them to 'outVertices'
+// as plain VertexData, ready to upload to the existing vertex buffer:
+//   pos  = sum of weight_i * transformPoint(pos, bones[index_i])
+//   norm = normalize(sum of weight_i * transformVector(norm, bones[index_i]))
+//   uv   = unchanged
+// Normals are transformed by the blended matrix itself, which is only
+// correct if the bones have uniform scale.
+// Every bone index must be < numBones (<= SKINNING_MAX_BONES).
+//
+// The vertices are skinned in ranges with parallelFor() on 'jobSystem',
+// or on the calling thread if it's NULL or the mesh is small.
+void skinVertices(const SkinnedVertexData* vertices, uint32_t numVertices,
+                  const affine3x4* bones, uint32_t numBones,
+                  VertexData* outVertices, JobSystem* jobSystem);
+
+// Single-threaded version of the above, e.g. to run inside a job
+// which has already been given a range of vertices
+void skinVertexRange(const SkinnedVertexData* vertices, uint32_t numVertices,
+                     const affine3x4* bones, uint32_t numBones,
+                     VertexData* outVertices);
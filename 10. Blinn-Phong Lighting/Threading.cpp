@@ -0,0 +1,201 @@
+#include "Threading.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+#endif
+
+struct ThreadStartInfo
+{
+    ThreadProc* proc;
+    void* userData;
+};
+
+#if defined(_WIN32)
+
+static DWORD WINAPI threadEntryPoint(LPVOID param)
+{
+    ThreadStartInfo startInfo = *(ThreadStartInfo*)param;
+    free(param);
+    startInfo.proc(startInfo.userData);
+    return 0;
+}
+
+Thread createThread(ThreadProc* proc, void* userData)
+{
+    ThreadStartInfo* startInfo = (ThreadStartInfo*)malloc(sizeof(ThreadStartInfo));
+    assert(startInfo);
+    startInfo->proc = proc;
+    startInfo->userData = userData;
+
+    Thread result;
+    result.handle = CreateThread(0, 0, threadEntryPoint, startInfo, 0, 0);
+    assert(result.handle);
+    return result;
+}
+
+void joinThread(Thread thread)
+{
+    WaitForSingleObject((HANDLE)thread.handle, INFINITE);
+    CloseHandle((HANDLE)thread.handle);
+}
+
+uint32_t getNumLogicalProcessors()
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwNumberOfProcessors;
+}
+
+void yieldThread()
+{
+    SwitchToThread();
+}
+
+Semaphore createSemaphore()
+{
+    Semaphore result;
+    result.handle = CreateSemaphoreW(0, 0, 0x7fffffff, 0);
+    assert(result.handle);
+    return result;
+}
+
+void destroySemaphore(Semaphore semaphore)
+{
+    CloseHandle((HANDLE)semaphore.handle);
+}
+
+void signalSemaphore(Semaphore semaphore, uint32_t count)
+{
+    if(count > 0)
+        ReleaseSemaphore((HANDLE)semaphore.handle, (LONG)count, 0);
+}
+
+void waitSemaphore(Semaphore semaphore)
+{
+    WaitForSingleObject((HANDLE)semaphore.handle, INFINITE);
+}
+
+#else
+
+static void* threadEntryPoint(void* param)
+{
+    ThreadStartInfo startInfo = *(ThreadStartInfo*)param;
+    free(param);
+    startInfo.proc(startInfo.userData);
+    return 0;
+}
+
+Thread createThread(ThreadProc* proc, void* userData)
+{
+    ThreadStartInfo* startInfo = (ThreadStartInfo*)malloc(sizeof(ThreadStartInfo));
+    assert(startInfo);
+    startInfo->proc = proc;
+    startInfo->userData = userData;
+
+    // pthread_t isn't guaranteed to fit in a pointer, so store it on the heap
+    pthread_t* pthread = (pthread_t*)malloc(sizeof(pthread_t));
+    assert(pthread);
+    int error = pthread_create(pthread, 0, threadEntryPoint, startInfo);
+    assert(error == 0);
+    (void)error;
+
+    Thread result;
+    result.handle = pthread;
+    return result;
+}
+
+void joinThread(Thread thread)
+{
+    pthread_t* pthread = (pthread_t*)thread.handle;
+    pthread_join(*pthread, 0);
+    free(pthread);
+}
+
+uint32_t getNumLogicalProcessors()
+{
+    long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+    return (numProcessors > 0) ? (uint32_t)numProcessors : 1;
+}
+
+void yieldThread()
+{
+    sched_yield();
+}
+
+Semaphore createSemaphore()
+{
+    sem_t* sem = (sem_t*)malloc(sizeof(sem_t));
+    assert(sem);
+    int error = sem_init(sem, 0, 0);
+    assert(error == 0);
+    (void)error;
+
+    Semaphore result;
+    result.handle = sem;
+    return result;
+}
+
+void destroySemaphore(Semaphore semaphore)
+{
+    sem_t* sem = (sem_t*)semaphore.handle;
+    sem_destroy(sem);
+    free(sem);
+}
+
+void signalSemaphore(Semaphore semaphore, uint32_t count)
+{
+    for(uint32_t i=0; i<count; ++i)
+        sem_post((sem_t*)semaphore.handle);
+}
+
+void waitSemaphore(Semaphore semaphore)
+{
+    // Retry if interrupted by a signal
+    while(sem_wait((sem_t*)semaphore.handle) != 0) {}
+}
+
+#endif
+
+struct ParallelTask
+{
+    ParallelTaskProc* proc;
+    void* userData;
+    uint32_t taskIndex;
+};
+
+static void parallelTaskEntryPoint(void* param)
+{
+    ParallelTask* task = (ParallelTask*)param;
+    task->proc(task->userData, task->taskIndex);
+}
+
+void runTasksInParallel(ParallelTaskProc* proc, void* userData, uint32_t numTasks)
+{
+    if(numTasks == 0)
+        return;
+
+    ParallelTask* tasks = (ParallelTask*)malloc(numTasks * sizeof(ParallelTask));
+    Thread* threads = (Thread*)malloc(numTasks * sizeof(Thread));
+    assert(tasks && threads);
+
+    for(uint32_t i=1; i<numTasks; ++i){
+        tasks[i] = {proc, userData, i};
+        threads[i] = createThread(parallelTaskEntryPoint, &tasks[i]);
+    }
+    proc(userData, 0);
+    for(uint32_t i=1; i<numTasks; ++i)
+        joinThread(threads[i]);
+
+    free(tasks);
+    free(threads);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+// Bare-bones cross-platform threading helpers.
+// Uses Win32 threads on Windows and pthreads everywhere else,
+// so code built on top of this (e.g. mesh processing) also
+// runs on Linux.
+
+typedef void ThreadProc(void* userData);
+
+struct Thread
+{
+    void* handle;
+};
+
+// Starts a new thread which runs proc(userData)
+Thread createThread(ThreadProc* proc, void* userData);
+// Blocks until 'thread' has finished and frees its resources
+void joinThread(Thread thread);
+
+uint32_t getNumLogicalProcessors();
+
+// Gives up the rest of the calling thread's time slice
+void yieldThread();
+
+// Counting semaphore, for putting idle threads to sleep
+struct Semaphore
+{
+    void* handle;
+};
+
+Semaphore createSemaphore();
+void destroySemaphore(Semaphore semaphore);
+// Adds 'count' to the semaphore, waking up to 'count' waiting threads
+void signalSemaphore(Semaphore semaphore, uint32_t count);
+// Blocks until the count is non-zero, then decrements it
+void waitSemaphore(Semaphore semaphore);
+
+// Runs proc(userData, taskIndex) for every taskIndex in [0, numTasks),
+// each on its own thread. Task 0 runs on the calling thread.
+// Returns once every task has finished, so it doubles as a barrier.
+typedef void ParallelTaskProc(void* userData, uint32_t taskIndex);
+void runTasksInParallel(ParallelTaskProc* proc, void* userData, uint32_t numTasks);
@@ -0,0 +1,219 @@
+#include "Timing.h"
+
+#pragma warning(disable:4996) // disable warning that fopen() is unsafe
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define TIMING_HAS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TIMING_HAS_TSC
+#endif
+
+static uint64_t readOSClockTicks()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)counter.QuadPart;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static uint64_t getOSClockFrequency()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)frequency.QuadPart;
+#else
+    return 1000000000ull;
+#endif
+}
+
+#if defined(TIMING_HAS_TSC)
+// CPUID.80000007H:EDX[8]
+static bool cpuHasInvariantTsc()
+{
+    unsigned int regs[4] = {};
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0x80000000);
+    if((unsigned int)info[0] < 0x80000007)
+        return false;
+    __cpuid(info, 0x80000007);
+    regs[3] = (unsigned int)info[3];
+#else
+    if(__get_cpuid_max(0x80000000, 0) < 0x80000007)
+        return false;
+    __get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+    return (regs[3] & (1 << 8)) != 0;
+}
+
+// Counts TSC ticks over ~20ms of the OS clock
+static uint64_t calibrateTscFrequency()
+{
+    uint64_t osFrequency = getOSClockFrequency();
+    uint64_t osStart = readOSClockTicks();
+    uint64_t tscStart = __rdtsc();
+    uint64_t osEnd;
+    do {
+        osEnd = readOSClockTicks();
+    } while(osEnd - osStart < osFrequency / 50);
+    uint64_t tscEnd = __rdtsc();
+    return (uint64_t)((double)(tscEnd - tscStart) * (double)osFrequency / (double)(osEnd - osStart));
+}
+#endif
+
+Clock createClock(ClockSource source)
+{
+    Clock result = {};
+    result.source = ClockSourceOS;
+    result.ticksPerSecond = getOSClockFrequency();
+#if defined(TIMING_HAS_TSC)
+    if(source == ClockSourceTSC && cpuHasInvariantTsc()){
+        result.source = ClockSourceTSC;
+        result.ticksPerSecond = calibrateTscFrequency();
+    }
+#else
+    (void)source;
+#endif
+    result.startTicks = readClockTicks(&result);
+    return result;
+}
+
+uint64_t readClockTicks(const Clock* clock)
+{
+#if defined(TIMING_HAS_TSC)
+    if(clock->source == ClockSourceTSC)
+        return __rdtsc();
+#else
+    (void)clock;
+#endif
+    return readOSClockTicks();
+}
+
+double clockTicksToSeconds(const Clock* clock, uint64_t ticks)
+{
+    return (double)ticks / (double)clock->ticksPerSecond;
+}
+
+double getClockSeconds(const Clock* clock)
+{
+    return clockTicksToSeconds(clock, readClockTicks(clock) - clock->startTicks);
+}
+
+static uint32_t frameHistogramBucket(float ms)
+{
+    if(!(ms > 0.f)) // Also catches NaN
+        return 0;
+    float bucket = ms / FRAME_HISTOGRAM_BUCKET_MS;
+    if(bucket >= (float)(FRAME_HISTOGRAM_BUCKETS - 1))
+        return FRAME_HISTOGRAM_BUCKETS - 1;
+    return (uint32_t)bucket;
+}
+
+void resetFrameStats(FrameStats* stats)
+{
+    memset(stats, 0, sizeof(FrameStats));
+}
+
+void recordFrameTime(FrameStats* stats, double frameSeconds)
+{
+    float ms = (float)(frameSeconds * 1000.0);
+    uint32_t slot = (uint32_t)(stats->numFramesRecorded & (FRAME_STATS_CAPACITY - 1));
+    if(stats->numFramesRecorded >= FRAME_STATS_CAPACITY){
+        uint32_t evictedBucket = frameHistogramBucket(stats->frameMs[slot]);
+        assert(stats->histogram[evictedBucket] > 0);
+        --stats->histogram[evictedBucket];
+    }
+    stats->frameMs[slot] = ms;
+    ++stats->histogram[frameHistogramBucket(ms)];
+    ++stats->numFramesRecorded;
+}
+
+static int compareFloats(const void* a, const void* b)
+{
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+// Nearest-rank percentile of 'sorted', 'p' in [0, 100]
+static float percentile(const float* sorted, uint32_t count, float p)
+{
+    uint32_t rank = (uint32_t)ceilf(p * 0.01f * (float)count);
+    if(rank < 1)
+        rank = 1;
+    if(rank > count)
+        rank = count;
+    return sorted[rank - 1];
+}
+
+FrameTimeSummary summariseFrameTimes(const FrameStats* stats)
+{
+    FrameTimeSummary result = {};
+    uint32_t count = stats->numFramesRecorded < FRAME_STATS_CAPACITY ? (uint32_t)stats->numFramesRecorded : FRAME_STATS_CAPACITY;
+    result.numFrames = count;
+    if(count == 0)
+        return result;
+
+    // Order in the ring buffer doesn't matter here, only which frames are in it
+    float sorted[FRAME_STATS_CAPACITY];
+    memcpy(sorted, stats->frameMs, count * sizeof(float));
+    qsort(sorted, count, sizeof(float), compareFloats);
+
+    double total = 0;
+    for(uint32_t i=0; i<count; ++i)
+        total += sorted[i];
+    result.avgMs = (float)(total / count);
+    result.minMs = sorted[0];
+    result.p50Ms = percentile(sorted, count, 50.f);
+    result.p95Ms = percentile(sorted, count, 95.f);
+    result.p99Ms = percentile(sorted, count, 99.f);
+    result.maxMs = sorted[count - 1];
+    return result;
+}
+
+bool writeFrameStatsCsv(const FrameStats* stats, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if(!file)
+        return false;
+
+    uint32_t count = stats->numFramesRecorded < FRAME_STATS_CAPACITY ? (uint32_t)stats->numFramesRecorded : FRAME_STATS_CAPACITY;
+    uint64_t firstFrame = stats->numFramesRecorded - count;
+    fprintf(file, "frame,ms\n");
+    for(uint64_t frame=firstFrame; frame<stats->numFramesRecorded; ++frame)
+        fprintf(file, "%llu,%.4f\n", (unsigned long long)frame, stats->frameMs[frame & (FRAME_STATS_CAPACITY - 1)]);
+
+    FrameTimeSummary summary = summariseFrameTimes(stats);
+    fprintf(file, "# frames=%u avg=%.4f min=%.4f p50=%.4f p95=%.4f p99=%.4f max=%.4f\n",
+            summary.numFrames, summary.avgMs, summary.minMs, summary.p50Ms, summary.p95Ms, summary.p99Ms, summary.maxMs);
+    fprintf(file, "# histogram (bucket_start_ms,count)\n");
+    for(uint32_t i=0; i<FRAME_HISTOGRAM_BUCKETS; ++i)
+        if(stats->histogram[i])
+            fprintf(file, "# %.1f,%u\n", i * FRAME_HISTOGRAM_BUCKET_MS, stats->histogram[i]);
+
+    fclose(file);
+    return true;
+}
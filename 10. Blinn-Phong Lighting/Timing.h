@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+// Portable high-resolution clock and frame-time statistics.
+// The clock uses QueryPerformanceCounter on Windows and
+// clock_gettime(CLOCK_MONOTONIC) elsewhere. Optionally it can read the
+// CPU's time-stamp counter directly, which is cheaper (no syscall/vDSO)
+// and is calibrated against the OS clock once at startup.
+
+enum ClockSource {
+    ClockSourceOS,
+    // Only used if the CPU reports an invariant TSC (constant rate
+    // across power states and cores), otherwise falls back to ClockSourceOS
+    ClockSourceTSC
+};
+
+struct Clock
+{
+    ClockSource source;
+    uint64_t ticksPerSecond;
+    uint64_t startTicks;
+};
+
+// Blocks for ~20ms when calibrating the TSC
+Clock createClock(ClockSource source);
+uint64_t readClockTicks(const Clock* clock);
+double clockTicksToSeconds(const Clock* clock, uint64_t ticks);
+// Seconds since createClock()
+double getClockSeconds(const Clock* clock);
+
+// Frame-time statistics over the last FRAME_STATS_CAPACITY frames.
+// Averages hide stutter: a steady 16.6ms and alternating 8ms/25ms have
+// the same mean, so we keep the individual times and look at the tail.
+const uint32_t FRAME_STATS_CAPACITY = 1024; // Must be a power of 2
+// Histogram buckets are FRAME_HISTOGRAM_BUCKET_MS wide; the last bucket
+// holds everything from (FRAME_HISTOGRAM_BUCKETS-1) * FRAME_HISTOGRAM_BUCKET_MS up
+const uint32_t FRAME_HISTOGRAM_BUCKETS = 64;
+const float FRAME_HISTOGRAM_BUCKET_MS = 1.f;
+
+struct FrameStats
+{
+    float frameMs[FRAME_STATS_CAPACITY]; // Ring buffer
+    uint64_t numFramesRecorded;          // Total, including overwritten ones
+    // Kept up to date as frames enter and leave the ring buffer
+    uint32_t histogram[FRAME_HISTOGRAM_BUCKETS];
+};
+
+struct FrameTimeSummary
+{
+    uint32_t numFrames; // Frames summarised, at most FRAME_STATS_CAPACITY
+    float avgMs;
+    float minMs;
+    float p50Ms;
+    float p95Ms;
+    float p99Ms;
+    float maxMs;
+};
+
+// FrameStats is ~4KB, so allocate it (or make it static) rather than
+// putting it on the stack
+void resetFrameStats(FrameStats* stats);
+void recordFrameTime(FrameStats* stats, double frameSeconds);
+// Sorts a copy of the ring buffer, O(n log n) in FRAME_STATS_CAPACITY
+FrameTimeSummary summariseFrameTimes(const FrameStats* stats);
+// Writes one "frame,ms" row per frame in the ring buffer, oldest first,
+// followed by the summary and histogram as comment lines.
+// Returns false if the file couldn't be opened.
+bool writeFrameStatsCsv(const FrameStats* stats, const char* path);
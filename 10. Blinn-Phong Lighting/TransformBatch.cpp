@@ -0,0 +1,160 @@
+#include "TransformBatch.h"
+#include "SimdMaths.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+TransformSoA allocTransformSoA(uint32_t count)
+{
+    // One allocation, split into the ten arrays
+    float* block = (float*)malloc(10 * (size_t)count * sizeof(float));
+    assert(block || count == 0);
+
+    TransformSoA result;
+    result.count  = count;
+    result.posX   = block;
+    result.posY   = block + 1*(size_t)count;
+    result.posZ   = block + 2*(size_t)count;
+    result.rotX   = block + 3*(size_t)count;
+    result.rotY   = block + 4*(size_t)count;
+    result.rotZ   = block + 5*(size_t)count;
+    result.rotW   = block + 6*(size_t)count;
+    result.scaleX = block + 7*(size_t)count;
+    result.scaleY = block + 8*(size_t)count;
+    result.scaleZ = block + 9*(size_t)count;
+    return result;
+}
+
+void freeTransformSoA(TransformSoA transforms)
+{
+    free(transforms.posX);
+}
+
+void* allocTransformBatchOutput(size_t bytes)
+{
+    // Over-allocate, and keep malloc()'s pointer just before the aligned one
+    uint8_t* block = (uint8_t*)malloc(bytes + TRANSFORM_BATCH_ALIGNMENT + sizeof(void*));
+    assert(block);
+    uintptr_t aligned = ((uintptr_t)(block + sizeof(void*)) + TRANSFORM_BATCH_ALIGNMENT - 1) & ~(uintptr_t)(TRANSFORM_BATCH_ALIGNMENT - 1);
+    ((void**)aligned)[-1] = block;
+    return (void*)aligned;
+}
+
+void freeTransformBatchOutput(void* output)
+{
+    if(output)
+        free(((void**)output)[-1]);
+}
+
+// NOTE on conventions: matrices are stored as m[column][row] and used with
+// row vectors (v * M), so element (row r, column c) is m[c][r] and the
+// translation lives in row 3. In the kernel below X[r][c] always means
+// (row r, column c) of matrix X, with one object per SIMD lane.
+
+void computeTransformsBatch(const TransformSoA* transforms, float4x4 viewMat, float4x4 projMat,
+                            float4x4* outModelViewMats, float4x4* outModelViewProjMats, float3x3* outNormalMats)
+{
+    // Broadcast the shared matrices once
+    wfloat view[4][4];
+    wfloat proj[4][4];
+    for(int r=0; r<4; ++r){
+        for(int c=0; c<4; ++c){
+            view[r][c] = wfloatSet1(viewMat.m[c][r]);
+            proj[r][c] = wfloatSet1(projMat.m[c][r]);
+        }
+    }
+    const wfloat zero = wfloatSet1(0.f);
+    const wfloat one = wfloatSet1(1.f);
+
+    const size_t float4x4Stride = sizeof(float4x4) / sizeof(float);
+    const size_t float3x3Stride = sizeof(float3x3) / sizeof(float);
+
+    // Outputs bigger than the cache would be evicted before they're read,
+    // so stream them out instead, which also saves reading every line in
+    // first. Only with cache line aligned outputs: each batch then ends on
+    // a line boundary, so no line is left half written between batches.
+    size_t outputBytes = (size_t)transforms->count * ((outModelViewMats ? sizeof(float4x4) : 0) +
+                                                      (outModelViewProjMats ? sizeof(float4x4) : 0) +
+                                                      (outNormalMats ? sizeof(float3x3) : 0));
+    bool aligned = ((uintptr_t)outModelViewMats % TRANSFORM_BATCH_ALIGNMENT) == 0 &&
+                   ((uintptr_t)outModelViewProjMats % TRANSFORM_BATCH_ALIGNMENT) == 0 &&
+                   ((uintptr_t)outNormalMats % TRANSFORM_BATCH_ALIGNMENT) == 0;
+    bool nonTemporal = aligned && outputBytes >= TRANSFORM_BATCH_STREAM_BYTES;
+
+    for(uint32_t base=0; base<transforms->count; base+=WFLOAT_WIDTH)
+    {
+        uint32_t remaining = transforms->count - base;
+        int n = (remaining < WFLOAT_WIDTH) ? (int)remaining : WFLOAT_WIDTH;
+
+        wfloat pos[3] = {
+            wfloatLoadPartial(transforms->posX + base, n, 0.f),
+            wfloatLoadPartial(transforms->posY + base, n, 0.f),
+            wfloatLoadPartial(transforms->posZ + base, n, 0.f)
+        };
+        wfloat qx = wfloatLoadPartial(transforms->rotX + base, n, 0.f);
+        wfloat qy = wfloatLoadPartial(transforms->rotY + base, n, 0.f);
+        wfloat qz = wfloatLoadPartial(transforms->rotZ + base, n, 0.f);
+        wfloat qw = wfloatLoadPartial(transforms->rotW + base, n, 1.f);
+        wfloat scale[3] = {
+            wfloatLoadPartial(transforms->scaleX + base, n, 1.f),
+            wfloatLoadPartial(transforms->scaleY + base, n, 1.f),
+            wfloatLoadPartial(transforms->scaleZ + base, n, 1.f)
+        };
+
+        wfloat rot[3][3];
+        wfloatQuatToRotation(qx, qy, qz, qw, rot);
+
+        // modelView = (scale * rotation * translation) * view
+        // Rows 0-2 only involve the scaled rotation, row 3 is translation
+        wfloat modelView[4][4];
+        for(int r=0; r<3; ++r){
+            wfloat linear0 = rot[r][0] * scale[r];
+            wfloat linear1 = rot[r][1] * scale[r];
+            wfloat linear2 = rot[r][2] * scale[r];
+            for(int c=0; c<4; ++c)
+                modelView[r][c] = wfloatMulAdd(linear2, view[2][c], wfloatMulAdd(linear1, view[1][c], linear0 * view[0][c]));
+        }
+        for(int c=0; c<4; ++c)
+            modelView[3][c] = wfloatMulAdd(pos[2], view[2][c], wfloatMulAdd(pos[1], view[1][c], wfloatMulAdd(pos[0], view[0][c], view[3][c])));
+
+        if(outModelViewMats){
+            wfloat cols[4][4];
+            for(int c=0; c<4; ++c)
+                for(int r=0; r<4; ++r)
+                    cols[c][r] = modelView[r][c];
+            wfloatStoreColumns(&outModelViewMats[base].m[0][0], float4x4Stride, cols, 4, n, nonTemporal);
+        }
+
+        if(outModelViewProjMats){
+            wfloat cols[4][4];
+            for(int c=0; c<4; ++c){
+                for(int r=0; r<4; ++r){
+                    cols[c][r] = modelView[r][0] * proj[0][c];
+                    cols[c][r] = wfloatMulAdd(modelView[r][1], proj[1][c], cols[c][r]);
+                    cols[c][r] = wfloatMulAdd(modelView[r][2], proj[2][c], cols[c][r]);
+                    cols[c][r] = wfloatMulAdd(modelView[r][3], proj[3][c], cols[c][r]);
+                }
+            }
+            wfloatStoreColumns(&outModelViewProjMats[base].m[0][0], float4x4Stride, cols, 4, n, nonTemporal);
+        }
+
+        if(outNormalMats){
+            // inverse-transpose of (scale * rotation * rigidView) is
+            // (scale^-1 * rotation * rigidView), i.e. row r of the
+            // modelView matrix divided by scale[r]^2
+            wfloat invScaleSq[3];
+            for(int r=0; r<3; ++r)
+                invScaleSq[r] = one / (scale[r] * scale[r]);
+            wfloat cols[3][4];
+            for(int c=0; c<3; ++c){
+                for(int r=0; r<3; ++r)
+                    cols[c][r] = modelView[r][c] * invScaleSq[r];
+                cols[c][3] = zero;
+            }
+            wfloatStoreColumns(&outNormalMats[base].m[0][0], float3x3Stride, cols, 3, n, nonTemporal);
+        }
+    }
+
+    if(nonTemporal)
+        wfloatStoreFence();
+}
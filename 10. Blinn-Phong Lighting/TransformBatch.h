@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include "3DMaths.h"
+
+// Object transforms in structure-of-arrays layout, so that batches of
+// objects can be processed a full SIMD register at a time.
+// Every array holds 'count' entries.
+struct TransformSoA
+{
+    uint32_t count;
+
+    float* posX;
+    float* posY;
+    float* posZ;
+
+    // Unit quaternions (x, y, z = axis * sin(angle/2), w = cos(angle/2))
+    float* rotX;
+    float* rotY;
+    float* rotZ;
+    float* rotW;
+
+    float* scaleX;
+    float* scaleY;
+    float* scaleZ;
+};
+
+// Allocates every array of a TransformSoA with room for 'count' objects
+// (uninitialised), using malloc()
+TransformSoA allocTransformSoA(uint32_t count);
+void freeTransformSoA(TransformSoA transforms);
+
+// Roughly an L2 cache: bigger outputs would be evicted before being read
+#define TRANSFORM_BATCH_STREAM_BYTES (1024 * 1024)
+#define TRANSFORM_BATCH_ALIGNMENT 64
+
+// Allocates an output array for computeTransformsBatch() aligned to
+// TRANSFORM_BATCH_ALIGNMENT (a cache line), using malloc()
+void* allocTransformBatchOutput(size_t bytes);
+void freeTransformBatchOutput(void* output);
+
+// Computes per-object matrices for every object in 'transforms'.
+// Each model matrix scales, then rotates, then translates (the same
+// order as the samples' scaleMat(s) * rotation * translationMat(pos)).
+//   outModelViewMats[i]     = modelMat * viewMat
+//   outModelViewProjMats[i] = modelMat * viewMat * projMat
+//   outNormalMats[i]        = float4x4ToFloat3x3(transpose(inverse(modelMat * viewMat)))
+// Any of the output arrays may be NULL to skip it.
+// Once the outputs add up to TRANSFORM_BATCH_STREAM_BYTES, and if every
+// array is aligned to TRANSFORM_BATCH_ALIGNMENT (see
+// allocTransformBatchOutput()), they're written with non-temporal stores,
+// which go around the cache. Unaligned outputs go through the cache, as
+// streaming lines that straddle two batches is slower than not streaming.
+// NOTE: The normal matrices are built directly from the scale factors
+// rather than a full inverse, so 'viewMat' must be rigid (rotation and
+// translation only), which any camera view matrix is.
+void computeTransformsBatch(const TransformSoA* transforms, float4x4 viewMat, float4x4 projMat,
+                            float4x4* outModelViewMats, float4x4* outModelViewProjMats, float3x3* outNormalMats);
@@ -0,0 +1,158 @@
+#include "TransformHierarchy.h"
+#include "SimdMaths.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h> // memcpy(), memset()
+
+// The dirty flags are scanned 8 bytes at a time, so they're padded
+// with clean flags to allow reading past the last node
+static const uint32_t DIRTY_FLAG_PADDING = 8;
+
+TransformHierarchy allocTransformHierarchy(uint32_t capacity)
+{
+    TransformHierarchy result;
+    result.count = 0;
+    result.capacity = capacity;
+    result.parents = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    result.numDescendants = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    result.dirty = (uint8_t*)calloc(capacity + DIRTY_FLAG_PADDING, 1);
+    result.local = allocTransformSoA(capacity);
+    result.worldMats = (affine3x4*)malloc(capacity * sizeof(affine3x4));
+    assert((result.parents && result.numDescendants && result.worldMats) || capacity == 0);
+    assert(result.dirty);
+    return result;
+}
+
+void freeTransformHierarchy(TransformHierarchy hierarchy)
+{
+    free(hierarchy.parents);
+    free(hierarchy.numDescendants);
+    free(hierarchy.dirty);
+    freeTransformSoA(hierarchy.local);
+    free(hierarchy.worldMats);
+}
+
+uint32_t addTransformNode(TransformHierarchy* hierarchy, uint32_t parent, float3 translation, quat rotation, float3 scale)
+{
+    assert(hierarchy->count < hierarchy->capacity);
+    uint32_t node = hierarchy->count++;
+
+    // Every ancestor's subtree must currently end just before 'node'
+    for(uint32_t ancestor = parent; ancestor != TRANSFORM_NO_PARENT; ancestor = hierarchy->parents[ancestor]){
+        assert(ancestor + hierarchy->numDescendants[ancestor] + 1 == node);
+        ++hierarchy->numDescendants[ancestor];
+    }
+
+    hierarchy->parents[node] = parent;
+    hierarchy->numDescendants[node] = 0;
+    setLocalTranslation(hierarchy, node, translation);
+    setLocalRotation(hierarchy, node, rotation);
+    setLocalScale(hierarchy, node, scale);
+    return node;
+}
+
+void setLocalTranslation(TransformHierarchy* hierarchy, uint32_t node, float3 translation)
+{
+    assert(node < hierarchy->count);
+    hierarchy->local.posX[node] = translation.x;
+    hierarchy->local.posY[node] = translation.y;
+    hierarchy->local.posZ[node] = translation.z;
+    hierarchy->dirty[node] = 1;
+}
+
+void setLocalRotation(TransformHierarchy* hierarchy, uint32_t node, quat rotation)
+{
+    assert(node < hierarchy->count);
+    hierarchy->local.rotX[node] = rotation.x;
+    hierarchy->local.rotY[node] = rotation.y;
+    hierarchy->local.rotZ[node] = rotation.z;
+    hierarchy->local.rotW[node] = rotation.w;
+    hierarchy->dirty[node] = 1;
+}
+
+void setLocalScale(TransformHierarchy* hierarchy, uint32_t node, float3 scale)
+{
+    assert(node < hierarchy->count);
+    hierarchy->local.scaleX[node] = scale.x;
+    hierarchy->local.scaleY[node] = scale.y;
+    hierarchy->local.scaleZ[node] = scale.z;
+    hierarchy->dirty[node] = 1;
+}
+
+// Recomputes world matrices for nodes [begin, end), which must be a
+// whole number of subtrees. First every local matrix in the range is
+// built WFLOAT_WIDTH nodes at a time (same maths as trsAffine3x4()),
+// then a sequential pass multiplies each one by its parent's world
+// matrix. Parents come first, so they're always up to date by then.
+static void updateWorldRange(TransformHierarchy* hierarchy, uint32_t begin, uint32_t end)
+{
+    const TransformSoA* local = &hierarchy->local;
+    const size_t affineStride = sizeof(affine3x4) / sizeof(float);
+
+    for(uint32_t base=begin; base<end; base+=WFLOAT_WIDTH)
+    {
+        uint32_t remaining = end - base;
+        int n = (remaining < WFLOAT_WIDTH) ? (int)remaining : WFLOAT_WIDTH;
+
+        wfloat pos[3] = {
+            wfloatLoadPartial(local->posX + base, n, 0.f),
+            wfloatLoadPartial(local->posY + base, n, 0.f),
+            wfloatLoadPartial(local->posZ + base, n, 0.f)
+        };
+        wfloat scale[3] = {
+            wfloatLoadPartial(local->scaleX + base, n, 1.f),
+            wfloatLoadPartial(local->scaleY + base, n, 1.f),
+            wfloatLoadPartial(local->scaleZ + base, n, 1.f)
+        };
+        wfloat rot[3][3];
+        wfloatQuatToRotation(wfloatLoadPartial(local->rotX + base, n, 0.f),
+                             wfloatLoadPartial(local->rotY + base, n, 0.f),
+                             wfloatLoadPartial(local->rotZ + base, n, 0.f),
+                             wfloatLoadPartial(local->rotW + base, n, 1.f), rot);
+
+        // Column c of the affine matrix is the scaled rotation's
+        // column c, then translation[c]
+        float* out = &hierarchy->worldMats[base].m[0][0];
+        for(int c=0; c<3; ++c)
+            wfloatStoreInterleaved4(out + 4*c, affineStride, rot[0][c] * scale[0], rot[1][c] * scale[1], rot[2][c] * scale[2], pos[c], n);
+    }
+
+    for(uint32_t i=begin; i<end; ++i){
+        uint32_t parent = hierarchy->parents[i];
+        if(parent != TRANSFORM_NO_PARENT)
+            hierarchy->worldMats[i] = hierarchy->worldMats[i] * hierarchy->worldMats[parent];
+    }
+}
+
+uint32_t updateWorldTransforms(TransformHierarchy* hierarchy)
+{
+    uint32_t numUpdated = 0;
+    uint32_t i = 0;
+    while(i < hierarchy->count)
+    {
+        uint64_t flags;
+        memcpy(&flags, hierarchy->dirty + i, sizeof(flags));
+        if(flags == 0){
+            i += sizeof(flags);
+            continue;
+        }
+        if(!hierarchy->dirty[i]){
+            ++i;
+            continue;
+        }
+
+        // The whole subtree needs updating, including any dirty
+        // descendants, so their flags are cleared here as well.
+        // Dirty subtrees which follow on directly are merged into the
+        // same range so that the SIMD pass works on full batches.
+        uint32_t end = i + 1 + hierarchy->numDescendants[i];
+        while(end < hierarchy->count && hierarchy->dirty[end])
+            end += 1 + hierarchy->numDescendants[end];
+        updateWorldRange(hierarchy, i, end);
+        memset(hierarchy->dirty + i, 0, end - i);
+        numUpdated += end - i;
+        i = end;
+    }
+    return numUpdated;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include "3DMaths.h"
+#include "TransformBatch.h"
+
+// Parent index of root nodes
+const uint32_t TRANSFORM_NO_PARENT = 0xffffffff;
+
+// Scene graph flattened into arrays. Nodes are stored in depth-first
+// order: each node comes after its parent, and its descendants are the
+// 'numDescendants[i]' nodes directly after it. That way world transforms
+// can be computed in one forward pass, and a changed node's whole
+// subtree is a contiguous range.
+//
+// Local transforms are kept as translation/rotation/scale in 'local'
+// (room for 'capacity' nodes) and world transforms are cached in
+// 'worldMats'. Changing a node's local transform only marks it dirty;
+// updateWorldTransforms() recomputes the dirty nodes and everything
+// below them.
+struct TransformHierarchy
+{
+    uint32_t count;
+    uint32_t capacity;
+
+    uint32_t* parents;
+    uint32_t* numDescendants;
+    uint8_t* dirty;
+
+    TransformSoA local;
+    affine3x4* worldMats; // localMat * parent's worldMat
+};
+
+// Allocates room for 'capacity' nodes using malloc()
+TransformHierarchy allocTransformHierarchy(uint32_t capacity);
+void freeTransformHierarchy(TransformHierarchy hierarchy);
+
+// Appends a node and returns its index. To keep the depth-first order
+// 'parent' must be TRANSFORM_NO_PARENT, the last node added or one of
+// that node's ancestors, i.e. each subtree is built before moving on
+// to the next one.
+uint32_t addTransformNode(TransformHierarchy* hierarchy, uint32_t parent, float3 translation, quat rotation, float3 scale);
+
+void setLocalTranslation(TransformHierarchy* hierarchy, uint32_t node, float3 translation);
+void setLocalRotation(TransformHierarchy* hierarchy, uint32_t node, quat rotation);
+void setLocalScale(TransformHierarchy* hierarchy, uint32_t node, float3 scale);
+
+// Recomputes the world matrices of every dirty node and their
+// descendants, and clears the dirty flags. For clean nodes only the
+// dirty flags are read, 8 at a time. Returns the number of nodes
+// recomputed.
+uint32_t updateWorldTransforms(TransformHierarchy* hierarchy);
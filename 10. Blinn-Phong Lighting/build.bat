@@ -15,7 +15,10 @@ set BUILD_DIR=".\build"
 if not exist %BUILD_DIR% mkdir %BUILD_DIR%
 pushd %BUILD_DIR%
 
-cl %COMPILER_FLAGS% ../main.cpp ../ObjLoading.cpp /link %LINKER_FLAGS% %SYSTEM_LIBS%
+cl %COMPILER_FLAGS% ../main.cpp ../ObjLoading.cpp ../Threading.cpp ../TransformBatch.cpp ../Culling.cpp ../FormatConversion.cpp ../Skinning.cpp ../TransformHierarchy.cpp ../JobSystem.cpp ../Scene.cpp ../Timing.cpp ../FramePacing.cpp ../InstancedDrawing.cpp ../CommandBuffer.cpp ../ConstantBufferRing.cpp ../RenderDeviceD3D11.cpp ../RenderDeviceRecording.cpp ../FrameRenderer.cpp ../RenderDeviceSoftware.cpp ../BlinnPhongShading.cpp ../LightClustering.cpp /link %LINKER_FLAGS% %SYSTEM_LIBS%
+
+REM Depth precision report for the projection modes in 3DMaths.h
+cl %COMPILER_FLAGS% ../tools/DepthPrecision.cpp /link %LINKER_FLAGS%
 
 popd
 echo Done
\ No newline at end of file
@@ -0,0 +1,204 @@
+// Checks and times BlinnPhongShading.h, the CPU version of ps_main in
+// BlinnPhong.hlsl.
+//
+// 1. Shades random eye-space points (half of them with normals near a
+//    light's halfway vector so the specular term isn't always 0) with
+//    shadeBlinnPhongBatch() and checks every result against the scalar
+//    powf() reference.
+// 2. Times both in pixels/s, with the sample's 2 point lights and with 32.
+//
+// The SIMD level is whatever 3DMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   c++ -O2 BlinnPhongBenchmark.cpp ../BlinnPhongShading.cpp ../Timing.cpp -o BlinnPhongBenchmark
+// Usage: BlinnPhongBenchmark [numPixels]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../BlinnPhongShading.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    return "avx+fma";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static float3 randomUnitVector()
+{
+    for(;;){
+        float3 v = {randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1)};
+        float lengthSq = dot(v, v);
+        if(lengthSq > 0.01f && lengthSq <= 1.f)
+            return v * (1.f / sqrtf(lengthSq));
+    }
+}
+
+struct Pixels
+{
+    size_t count;
+    float* posEye[3];
+    float* normalEye[3];
+    float* diffuseColor[3];
+    float* color[3];
+};
+
+// Returns the largest error relative to max(1, |reference|)
+static float maxError(const BlinnPhongLights* lights, const Pixels* pixels)
+{
+    float result = 0.f;
+    for(size_t i=0; i<pixels->count; ++i)
+    {
+        float3 reference = shadeBlinnPhongReference(lights,
+            {pixels->posEye[0][i], pixels->posEye[1][i], pixels->posEye[2][i]},
+            {pixels->normalEye[0][i], pixels->normalEye[1][i], pixels->normalEye[2][i]},
+            {pixels->diffuseColor[0][i], pixels->diffuseColor[1][i], pixels->diffuseColor[2][i]});
+        float expected[3] = { reference.x, reference.y, reference.z };
+        for(int c=0; c<3; ++c){
+            float error = fabsf(pixels->color[c][i] - expected[c]) / fmaxf(1.f, fabsf(expected[c]));
+            if(!(error <= result)) // Catches NaNs too
+                result = error;
+        }
+    }
+    return result;
+}
+
+// Best of a few runs, in pixels per second
+static double timeShading(const BlinnPhongLights* lights, const Pixels* pixels, bool reference, Clock* clock)
+{
+    BlinnPhongSurfaces surfaces = {
+        {pixels->posEye[0], pixels->posEye[1], pixels->posEye[2]},
+        {pixels->normalEye[0], pixels->normalEye[1], pixels->normalEye[2]},
+        {pixels->diffuseColor[0], pixels->diffuseColor[1], pixels->diffuseColor[2]}
+    };
+    double best = 1e30;
+    for(int run=0; run<5; ++run)
+    {
+        double start = getClockSeconds(clock);
+        if(reference){
+            for(size_t i=0; i<pixels->count; ++i){
+                float3 color = shadeBlinnPhongReference(lights,
+                    {pixels->posEye[0][i], pixels->posEye[1][i], pixels->posEye[2][i]},
+                    {pixels->normalEye[0][i], pixels->normalEye[1][i], pixels->normalEye[2][i]},
+                    {pixels->diffuseColor[0][i], pixels->diffuseColor[1][i], pixels->diffuseColor[2][i]});
+                pixels->color[0][i] = color.x;
+                pixels->color[1][i] = color.y;
+                pixels->color[2][i] = color.z;
+            }
+        }
+        else
+            shadeBlinnPhongBatch(lights, &surfaces, pixels->color, pixels->count);
+        double elapsed = getClockSeconds(clock) - start;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return (double)pixels->count / best;
+}
+
+int main(int argc, char** argv)
+{
+    size_t numPixels = 1 << 18;
+    if(argc > 1)
+        numPixels = (size_t)strtoul(argv[1], 0, 10);
+    if(numPixels == 0){
+        fprintf(stderr, "Usage: %s [numPixels >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    // The sample's directional light, then point lights in front of the
+    // camera. Their radius covers most of the points, the rest check
+    // lights fading out.
+    const uint32_t MAX_POINT_LIGHTS = 32;
+    BlinnPhongPointLight pointLights[MAX_POINT_LIGHTS];
+    srand(1);
+    for(uint32_t i=0; i<MAX_POINT_LIGHTS; ++i){
+        pointLights[i].posEye = {randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(-30, -1), 25.f};
+        pointLights[i].color = {randomFloat(0, 1), randomFloat(0, 1), randomFloat(0, 1), 1.f};
+    }
+    BlinnPhongLights lights = { normalise(float4{1.f, 1.f, 1.f, 0.f}), {0.7f, 0.8f, 0.2f, 1.f}, pointLights, 0, 2 };
+
+    Pixels pixels = {};
+    pixels.count = numPixels;
+    for(int c=0; c<3; ++c){
+        pixels.posEye[c] = (float*)malloc(numPixels * sizeof(float));
+        pixels.normalEye[c] = (float*)malloc(numPixels * sizeof(float));
+        pixels.diffuseColor[c] = (float*)malloc(numPixels * sizeof(float));
+        pixels.color[c] = (float*)malloc(numPixels * sizeof(float));
+    }
+    for(size_t i=0; i<numPixels; ++i)
+    {
+        float3 posEye = {randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(-30, -0.5f)};
+        float3 normalEye = randomUnitVector();
+        if(i & 1){
+            // Near the halfway vector of the directional or a point light
+            float3 toCamera = normalise(-posEye);
+            float3 toLight = lights.dirLightDirEye.xyz;
+            if(i & 2)
+                toLight = normalise(pointLights[(i >> 2) % 2].posEye.xyz + (-posEye));
+            normalEye = normalise(normalise(toCamera + toLight) + randomUnitVector() * randomFloat(0.f, 0.2f));
+        }
+        pixels.posEye[0][i] = posEye.x;
+        pixels.posEye[1][i] = posEye.y;
+        pixels.posEye[2][i] = posEye.z;
+        pixels.normalEye[0][i] = normalEye.x;
+        pixels.normalEye[1][i] = normalEye.y;
+        pixels.normalEye[2][i] = normalEye.z;
+        for(int c=0; c<3; ++c)
+            pixels.diffuseColor[c][i] = randomFloat(0, 1);
+    }
+
+    // Odd counts exercise the tail
+    BlinnPhongSurfaces surfaces = {
+        {pixels.posEye[0], pixels.posEye[1], pixels.posEye[2]},
+        {pixels.normalEye[0], pixels.normalEye[1], pixels.normalEye[2]},
+        {pixels.diffuseColor[0], pixels.diffuseColor[1], pixels.diffuseColor[2]}
+    };
+    const float MAX_ERROR = 1e-4f;
+    float errors[2];
+    for(int i=0; i<2; ++i){
+        lights.numPointLights = (i == 0) ? 2 : MAX_POINT_LIGHTS;
+        Pixels subset = pixels;
+        subset.count = numPixels - (numPixels > 1 ? 1 : 0);
+        shadeBlinnPhongBatch(&lights, &surfaces, pixels.color, subset.count);
+        errors[i] = maxError(&lights, &subset);
+        CHECK(errors[i] <= MAX_ERROR);
+    }
+
+    Clock clock = createClock(ClockSourceOS);
+    printf("{\n  \"simd\": \"%s\",\n  \"lanes\": %d,\n  \"pixels\": %zu,\n", simdLevelName(), WFLOAT_WIDTH, numPixels);
+    printf("  \"results\": [\n");
+    for(int i=0; i<2; ++i)
+    {
+        lights.numPointLights = (i == 0) ? 2 : MAX_POINT_LIGHTS;
+        double referenceRate = timeShading(&lights, &pixels, true, &clock);
+        double kernelRate = timeShading(&lights, &pixels, false, &clock);
+        printf("    {\"point_lights\": %u, \"max_relative_error\": %.3g, \"reference_mpixels_per_s\": %.2f, \"simd_mpixels_per_s\": %.2f, \"speedup\": %.2f}%s\n",
+               lights.numPointLights, (double)errors[i], 1e-6 * referenceRate, 1e-6 * kernelRate, kernelRate / referenceRate, i == 0 ? "," : "");
+    }
+    printf("  ],\n  \"failures\": %d\n}\n", numFailures);
+
+    for(int c=0; c<3; ++c){
+        free(pixels.posEye[c]);
+        free(pixels.normalEye[c]);
+        free(pixels.diffuseColor[c]);
+        free(pixels.color[c]);
+    }
+    return numFailures ? 1 : 0;
+}
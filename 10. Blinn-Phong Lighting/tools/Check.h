@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdio.h>
+
+// CHECK() for the tools: reports a failed condition with its file and
+// line on stderr and counts it in numFailures, which each tool turns into
+// a non-zero exit code. Each tool is a single translation unit, so the
+// counter can be a plain static.
+static int numFailures = 0;
+#define CHECK(condition) \
+    do { if(!(condition)){ fprintf(stderr, "%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #condition); ++numFailures; } } while(0)
@@ -0,0 +1,212 @@
+// Tests and benchmarks for CommandBuffer.h.
+// 1. Checks radixSortKeys() against qsort() (sorted and stable) for
+//    several key distributions.
+// 2. Records packets for a scene of many objects spread over several
+//    pipelines, materials and meshes, in random order, and compares
+//    draws and state binds for immediate submission (a draw per packet
+//    in recording order) with sorted + merged submission.
+// 3. Times radixSortKeys() against qsort() from 1K to 1M packets.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh):
+//   c++ -O2 CommandBufferBenchmark.cpp ../CommandBuffer.cpp ../InstancedDrawing.cpp ../Timing.cpp -o CommandBufferBenchmark
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../CommandBuffer.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static uint64_t randomState = 0x9e3779b97f4a7c15ull;
+static uint64_t randomU64()
+{
+    // xorshift64*
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return randomState * 0x2545f4914f6cdd1dull;
+}
+
+struct KeyValue
+{
+    uint64_t key;
+    uint32_t value;
+};
+
+// Orders by key, then by value (= original position) for stability
+static int compareKeyValues(const void* a, const void* b)
+{
+    const KeyValue* ka = (const KeyValue*)a;
+    const KeyValue* kb = (const KeyValue*)b;
+    if(ka->key != kb->key)
+        return ka->key < kb->key ? -1 : 1;
+    return (ka->value > kb->value) - (ka->value < kb->value);
+}
+
+enum KeyDistribution {
+    KeyDistributionRandom,       // All 64 bits random
+    KeyDistributionSortKeys,     // Few pipelines/materials/meshes, random depth
+    KeyDistributionFewDistinct,  // Lots of duplicates
+    KeyDistributionCount
+};
+static const char* KEY_DISTRIBUTION_NAMES[KeyDistributionCount] = {"random", "sort_keys", "few_distinct"};
+
+static uint64_t makeTestKey(KeyDistribution distribution)
+{
+    switch(distribution){
+        case KeyDistributionRandom: return randomU64();
+        case KeyDistributionSortKeys: {
+            float depth = (float)(randomU64() % 100000) * 0.01f;
+            return makeSortKey(RenderLayerOpaque, (DrawPipeline)(randomU64() % DrawPipelineCount),
+                               (uint32_t)(randomU64() % 32), (uint32_t)(randomU64() % 4), depth);
+        }
+        default: return randomU64() % 7;
+    }
+}
+
+static void fillKeys(KeyDistribution distribution, uint64_t* keys, uint32_t* values, KeyValue* reference, uint32_t count)
+{
+    for(uint32_t i=0; i<count; ++i){
+        keys[i] = makeTestKey(distribution);
+        values[i] = i;
+        reference[i].key = keys[i];
+        reference[i].value = i;
+    }
+}
+
+// Draws and binds when submitting every packet as its own draw, in
+// recording order, skipping binds that match the previous draw
+static void countImmediateSubmission(const CommandBuffer* commands, uint32_t* outDraws, uint32_t* outBinds)
+{
+    uint32_t binds = 0;
+    for(uint32_t i=0; i<commands->numPackets; ++i){
+        uint64_t key = commands->keys[i];
+        if(i == 0){
+            binds += 3;
+            continue;
+        }
+        uint64_t previous = commands->keys[i-1];
+        binds += sortKeyPipeline(key) != sortKeyPipeline(previous);
+        binds += sortKeyMaterial(key) != sortKeyMaterial(previous);
+        binds += sortKeyMesh(key) != sortKeyMesh(previous);
+    }
+    *outDraws = commands->numPackets;
+    *outBinds = binds;
+}
+
+static uint32_t countBinds(const InstancedDrawList* drawList)
+{
+    uint32_t binds = 0;
+    for(uint32_t i=0; i<drawList->numDraws; ++i){
+        uint32_t changes = drawList->draws[i].stateChanges;
+        binds += ((changes & DrawStateChangePipeline) != 0) + ((changes & DrawStateChangeMaterial) != 0) + ((changes & DrawStateChangeMesh) != 0);
+    }
+    return binds;
+}
+
+int main()
+{
+    const uint32_t MAX_COUNT = 1000000;
+    uint64_t* keys = (uint64_t*)malloc(MAX_COUNT * sizeof(uint64_t));
+    uint32_t* values = (uint32_t*)malloc(MAX_COUNT * sizeof(uint32_t));
+    uint64_t* scratchKeys = (uint64_t*)malloc(MAX_COUNT * sizeof(uint64_t));
+    uint32_t* scratchValues = (uint32_t*)malloc(MAX_COUNT * sizeof(uint32_t));
+    KeyValue* reference = (KeyValue*)malloc(MAX_COUNT * sizeof(KeyValue));
+    Clock clock = createClock(ClockSourceOS);
+
+    // Correctness
+    const uint32_t TEST_COUNTS[] = {0, 1, 2, 255, 256, 257, 10000};
+    for(int d=0; d<KeyDistributionCount; ++d){
+        for(uint32_t c=0; c<sizeof(TEST_COUNTS)/sizeof(TEST_COUNTS[0]); ++c){
+            uint32_t count = TEST_COUNTS[c];
+            fillKeys((KeyDistribution)d, keys, values, reference, count);
+            radixSortKeys(keys, values, scratchKeys, scratchValues, count);
+            qsort(reference, count, sizeof(KeyValue), compareKeyValues);
+            bool matches = true;
+            for(uint32_t i=0; i<count; ++i)
+                matches = matches && keys[i] == reference[i].key && values[i] == reference[i].value;
+            CHECK(matches);
+        }
+    }
+
+    printf("{\n");
+
+    // State changes for a scene recorded in random order
+    {
+        const uint32_t NUM_OBJECTS = 10000;
+        const uint32_t NUM_MATERIALS = 16;
+        const uint32_t NUM_MESHES = 4;
+        CommandBuffer commands = allocCommandBuffer(NUM_OBJECTS, NUM_OBJECTS * sizeof(BlinnPhongInstance));
+        InstancedDrawList drawList = allocInstancedDrawList(NUM_OBJECTS * sizeof(BlinnPhongInstance) + 16 * 1024, 1024);
+        for(uint32_t i=0; i<NUM_OBJECTS; ++i){
+            DrawPipeline pipeline = (DrawPipeline)(randomU64() % DrawPipelineCount);
+            uint32_t material = (uint32_t)(randomU64() % NUM_MATERIALS);
+            uint32_t mesh = (uint32_t)(randomU64() % NUM_MESHES);
+            float depth = (float)(randomU64() % 10000) * 0.01f;
+            uint32_t stride = pipeline == DrawPipelineLight ? sizeof(LightInstance) : sizeof(BlinnPhongInstance);
+            memset(pushDrawPacket(&commands, makeSortKey(RenderLayerOpaque, pipeline, material, mesh, depth), stride), 0, stride);
+        }
+        uint32_t immediateDraws, immediateBinds;
+        countImmediateSubmission(&commands, &immediateDraws, &immediateBinds);
+
+        double start = getClockSeconds(&clock);
+        sortCommandBuffer(&commands);
+        buildInstancedDraws(&commands, &drawList);
+        double elapsed = getClockSeconds(&clock) - start;
+
+        // Every pipeline/material/mesh combination becomes exactly one
+        // draw, and each draw's instances are front to back
+        uint32_t numCombinations = DrawPipelineCount * NUM_MATERIALS * NUM_MESHES;
+        CHECK(drawList.numDraws == numCombinations);
+        uint32_t totalInstances = 0;
+        for(uint32_t i=0; i<drawList.numDraws; ++i)
+            totalInstances += drawList.draws[i].numInstances;
+        CHECK(totalInstances == NUM_OBJECTS);
+        for(uint32_t i=1; i<commands.numPackets; ++i)
+            CHECK(commands.keys[i-1] <= commands.keys[i]);
+        uint32_t sortedBinds = countBinds(&drawList);
+
+        printf("  \"state_changes\": {\"objects\": %u, \"immediate_draws\": %u, \"immediate_binds\": %u, "
+               "\"sorted_draws\": %u, \"sorted_binds\": %u, \"sort_and_merge_us\": %.1f},\n",
+               NUM_OBJECTS, immediateDraws, immediateBinds, drawList.numDraws, sortedBinds, 1e6 * elapsed);
+        freeCommandBuffer(commands);
+        freeInstancedDrawList(drawList);
+    }
+
+    // Sort throughput
+    printf("  \"sort\": [\n");
+    const uint32_t BENCH_COUNTS[] = {1000, 10000, 100000, 1000000};
+    const int NUM_BENCH_COUNTS = sizeof(BENCH_COUNTS) / sizeof(BENCH_COUNTS[0]);
+    for(int c=0; c<NUM_BENCH_COUNTS; ++c){
+        for(int d=0; d<KeyDistributionCount; ++d){
+            uint32_t count = BENCH_COUNTS[c];
+            int numRepeats = count >= 100000 ? 3 : 20;
+            double radixSeconds = 0, qsortSeconds = 0;
+            for(int repeat=0; repeat<numRepeats; ++repeat){
+                fillKeys((KeyDistribution)d, keys, values, reference, count);
+                double start = getClockSeconds(&clock);
+                radixSortKeys(keys, values, scratchKeys, scratchValues, count);
+                radixSeconds += getClockSeconds(&clock) - start;
+                start = getClockSeconds(&clock);
+                qsort(reference, count, sizeof(KeyValue), compareKeyValues);
+                qsortSeconds += getClockSeconds(&clock) - start;
+            }
+            bool isLast = c == NUM_BENCH_COUNTS-1 && d == KeyDistributionCount-1;
+            printf("    {\"count\": %u, \"keys\": \"%s\", \"radix_ns_per_key\": %.2f, \"qsort_ns_per_key\": %.2f}%s\n",
+                   count, KEY_DISTRIBUTION_NAMES[d], 1e9 * radixSeconds / ((double)count * numRepeats),
+                   1e9 * qsortSeconds / ((double)count * numRepeats), isLast ? "" : ",");
+        }
+    }
+    printf("  ],\n");
+    printf("  \"failures\": %d\n}\n", numFailures);
+
+    free(keys);
+    free(values);
+    free(scratchKeys);
+    free(scratchValues);
+    free(reference);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+// Tests ConstantBufferRing.h against a mock device, without a GPU.
+// The mock keeps the "GPU" a configurable number of frames behind the
+// CPU. Every allocation is filled with a pattern and registered as a
+// pending GPU read; when the mock completes a frame's fence it checks
+// the patterns are still intact, i.e. the CPU never overwrote
+// constants the GPU hadn't finished with.
+// Scenarios: a roomy ring (no waits), tight rings (wrap and wait on
+// fences regularly), an allocation larger than the ring, and an
+// allocation timing.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh):
+//   c++ -O2 ConstantRingCheck.cpp ../ConstantBufferRing.cpp ../Threading.cpp ../Timing.cpp -pthread -o ConstantRingCheck
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../ConstantBufferRing.h"
+#include "../Timing.h"
+#include "Check.h"
+
+struct GpuRead
+{
+    uint32_t offset;
+    uint32_t size;
+    uint8_t pattern;
+};
+
+const uint32_t MAX_READS_PER_FRAME = 1024;
+const uint64_t MOCK_TICKS_PER_FRAME = 1000;
+
+struct MockDevice
+{
+    uint8_t* memory;
+    uint32_t sizeBytes;
+    bool isMapped;
+    uint32_t numMaps;
+    uint32_t numDiscards;
+
+    // The GPU finishes a fence 'latency' ticks after it's signalled.
+    // Time advances by MOCK_TICKS_PER_FRAME per frame and by one tick on
+    // every fence query, so spinning on a fence makes progress but
+    // polling doesn't noticeably speed up the GPU.
+    uint64_t time;
+    uint64_t latency;
+    bool fenceSignalled[CONSTANT_RING_MAX_FRAMES_IN_FLIGHT];
+    uint64_t fenceSignalTime[CONSTANT_RING_MAX_FRAMES_IN_FLIGHT];
+
+    // Reads the GPU will do for the frame being recorded and for each
+    // in-flight fence
+    GpuRead currentReads[MAX_READS_PER_FRAME];
+    uint32_t numCurrentReads;
+    GpuRead fenceReads[CONSTANT_RING_MAX_FRAMES_IN_FLIGHT][MAX_READS_PER_FRAME];
+    uint32_t numFenceReads[CONSTANT_RING_MAX_FRAMES_IN_FLIGHT];
+    uint64_t numReadsVerified;
+};
+
+static void* mockMap(void* userData, bool discard)
+{
+    MockDevice* device = (MockDevice*)userData;
+    CHECK(!device->isMapped);
+    CHECK(discard == (device->numMaps == 0)); // Only the first map needs to discard
+    device->isMapped = true;
+    ++device->numMaps;
+    if(discard)
+        ++device->numDiscards;
+    return device->memory;
+}
+
+static void mockUnmap(void* userData)
+{
+    MockDevice* device = (MockDevice*)userData;
+    CHECK(device->isMapped);
+    device->isMapped = false;
+}
+
+static void mockSignalFence(void* userData, uint32_t fenceSlot)
+{
+    MockDevice* device = (MockDevice*)userData;
+    CHECK(!device->fenceSignalled[fenceSlot]); // Slot must have been retired first
+    device->fenceSignalled[fenceSlot] = true;
+    device->fenceSignalTime[fenceSlot] = device->time;
+    memcpy(device->fenceReads[fenceSlot], device->currentReads, device->numCurrentReads * sizeof(GpuRead));
+    device->numFenceReads[fenceSlot] = device->numCurrentReads;
+    device->numCurrentReads = 0;
+}
+
+static bool mockIsFenceComplete(void* userData, uint32_t fenceSlot)
+{
+    MockDevice* device = (MockDevice*)userData;
+    ++device->time;
+    if(!device->fenceSignalled[fenceSlot])
+        return true;
+    if(device->time < device->fenceSignalTime[fenceSlot] + device->latency)
+        return false;
+
+    // The GPU reads this frame's constants now: they must be untouched
+    for(uint32_t i=0; i<device->numFenceReads[fenceSlot]; ++i){
+        const GpuRead* read = &device->fenceReads[fenceSlot][i];
+        bool intact = true;
+        for(uint32_t b=0; b<read->size; ++b)
+            intact = intact && device->memory[read->offset + b] == read->pattern;
+        CHECK(intact);
+        ++device->numReadsVerified;
+    }
+    device->fenceSignalled[fenceSlot] = false;
+    return true;
+}
+
+// 'latencyFrames' is how far the GPU runs behind the CPU
+static MockDevice* createMockDevice(uint32_t sizeBytes, uint32_t latencyFrames)
+{
+    MockDevice* device = (MockDevice*)calloc(1, sizeof(MockDevice));
+    device->memory = (uint8_t*)malloc(sizeBytes);
+    device->sizeBytes = sizeBytes;
+    device->latency = latencyFrames * MOCK_TICKS_PER_FRAME;
+    return device;
+}
+
+static void freeMockDevice(MockDevice* device)
+{
+    free(device->memory);
+    free(device);
+}
+
+static ConstantRingDevice makeRingDevice(MockDevice* device)
+{
+    ConstantRingDevice result;
+    result.userData = device;
+    result.map = mockMap;
+    result.unmap = mockUnmap;
+    result.signalFence = mockSignalFence;
+    result.isFenceComplete = mockIsFenceComplete;
+    return result;
+}
+
+static uint32_t randomState = 1;
+static uint32_t randomU32()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+// Runs 'numFrames' frames of random allocations (1 to 'maxAllocsPerFrame'
+// of 1 to 'maxAllocBytes' bytes each) and prints a JSON result line
+static void runScenario(const char* name, uint32_t ringBytes, uint32_t latencyFrames, uint32_t numFrames,
+                        uint32_t maxAllocsPerFrame, uint32_t maxAllocBytes, bool isLast)
+{
+    MockDevice* device = createMockDevice(ringBytes, latencyFrames);
+    ConstantBufferRing ring = createConstantBufferRing(makeRingDevice(device), ringBytes);
+    uint64_t numAllocs = 0, bytesRequested = 0;
+    uint8_t pattern = 1;
+    for(uint32_t frame=0; frame<numFrames; ++frame)
+    {
+        device->time += MOCK_TICKS_PER_FRAME;
+        beginConstantRingWrites(&ring);
+        uint32_t numAllocsThisFrame = 1 + randomU32() % maxAllocsPerFrame;
+        for(uint32_t i=0; i<numAllocsThisFrame; ++i)
+        {
+            uint32_t size = 1 + randomU32() % maxAllocBytes;
+            ConstantAllocation a = allocConstants(&ring, size);
+            CHECK(a.data != 0);
+            if(!a.data)
+                continue;
+            CHECK(a.offsetBytes % CONSTANT_RING_ALIGNMENT == 0);
+            CHECK(a.sizeBytes >= size && a.sizeBytes % CONSTANT_RING_ALIGNMENT == 0);
+            CHECK(a.offsetBytes + a.sizeBytes <= ringBytes);
+            CHECK(a.firstConstant * 16 == a.offsetBytes && a.numConstants * 16 == a.sizeBytes);
+            CHECK((uint8_t*)a.data == device->memory + a.offsetBytes);
+
+            memset(a.data, pattern, a.sizeBytes);
+            CHECK(device->numCurrentReads < MAX_READS_PER_FRAME);
+            GpuRead* read = &device->currentReads[device->numCurrentReads++];
+            read->offset = a.offsetBytes;
+            read->size = a.sizeBytes;
+            read->pattern = pattern;
+            pattern = pattern == 255 ? 1 : pattern + 1;
+            ++numAllocs;
+            bytesRequested += size;
+        }
+        endConstantRingWrites(&ring);
+        endConstantRingFrame(&ring);
+    }
+
+    // Drain the GPU so every read gets verified
+    while(ring.numFramesInFlight > 0){
+        beginConstantRingWrites(&ring);
+        endConstantRingWrites(&ring);
+        device->time += MOCK_TICKS_PER_FRAME;
+    }
+    CHECK(device->numReadsVerified == numAllocs);
+    CHECK(device->numDiscards == 1);
+
+    printf("    {\"scenario\": \"%s\", \"ring_bytes\": %u, \"gpu_latency_frames\": %u, \"frames\": %u, \"allocations\": %llu, "
+           "\"bytes_requested\": %llu, \"wraps\": %llu, \"fence_waits\": %llu, \"maps\": %u, \"reads_verified\": %llu}%s\n",
+           name, ringBytes, latencyFrames, numFrames, (unsigned long long)numAllocs,
+           (unsigned long long)bytesRequested, (unsigned long long)ring.numWraps, (unsigned long long)ring.numFenceWaits,
+           device->numMaps, (unsigned long long)device->numReadsVerified, isLast ? "" : ",");
+    freeMockDevice(device);
+}
+
+int main()
+{
+    printf("{\n  \"scenarios\": [\n");
+    // Plenty of room: should never wait
+    runScenario("roomy", 1024 * 1024, 2, 2000, 32, 1024, false);
+    // Around two frames' worth with the GPU two frames behind: wraps
+    // often and has to wait for the GPU regularly
+    runScenario("tight", 16 * 1024, 2, 2000, 16, 1024, false);
+    // Barely more than one frame: waits on nearly every frame
+    runScenario("one_frame", 8 * 1024, 3, 2000, 8, 512, true);
+    printf("  ],\n");
+
+    // An allocation that can't fit even with the GPU idle fails cleanly
+    {
+        MockDevice* device = createMockDevice(4096, 1);
+        ConstantBufferRing ring = createConstantBufferRing(makeRingDevice(device), 4096);
+        beginConstantRingWrites(&ring);
+        CHECK(allocConstants(&ring, 4097).data == 0);
+        CHECK(allocConstants(&ring, 0).data == 0);
+        CHECK(allocConstants(&ring, 4096).data != 0);
+        // The whole ring is now used by this frame, which isn't fenced yet
+        CHECK(allocConstants(&ring, 16).data == 0);
+        endConstantRingWrites(&ring);
+        endConstantRingFrame(&ring);
+        freeMockDevice(device);
+    }
+
+    // Allocation cost, no waits
+    {
+        const uint32_t RING_BYTES = 4 * 1024 * 1024;
+        MockDevice* device = createMockDevice(RING_BYTES, 1);
+        ConstantBufferRing ring = createConstantBufferRing(makeRingDevice(device), RING_BYTES);
+        Clock clock = createClock(ClockSourceOS);
+        const uint32_t NUM_FRAMES = 1000;
+        const uint32_t ALLOCS_PER_FRAME = 1000;
+        uint64_t checksum = 0;
+        double start = getClockSeconds(&clock);
+        for(uint32_t frame=0; frame<NUM_FRAMES; ++frame){
+            device->time += MOCK_TICKS_PER_FRAME;
+            beginConstantRingWrites(&ring);
+            for(uint32_t i=0; i<ALLOCS_PER_FRAME; ++i)
+                checksum += allocConstants(&ring, 192).offsetBytes;
+            endConstantRingWrites(&ring);
+            endConstantRingFrame(&ring);
+        }
+        double elapsed = getClockSeconds(&clock) - start;
+        printf("  \"ns_per_allocation\": %.2f,\n", 1e9 * elapsed / ((double)NUM_FRAMES * ALLOCS_PER_FRAME));
+        printf("  \"checksum\": %llu,\n", (unsigned long long)checksum);
+        freeMockDevice(device);
+    }
+
+    printf("  \"failures\": %d\n}\n", numFailures);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,345 @@
+// Checks and times cullSpheres() and cullAabbs() from Culling.h.
+//
+// 1. Random spheres and boxes around the camera (some reaching past the
+//    far plane, some behind the camera) with the standard, reverse-Z and
+//    infinite reverse-Z projections. Each object is classified with a
+//    plane test in doubles, one object at a time: spheres by centre
+//    distance + radius, boxes by their furthest corner. Objects clearly
+//    inside must be returned and objects clearly outside must not; ones
+//    within rounding of a plane may go either way.
+// 2. Zero-radius spheres are also checked against the clip-space test
+//    -w <= x <= w, -w <= y <= w, 0 <= z <= w, which doesn't use
+//    makeFrustum() at all. Objects far beyond zFar must only survive
+//    with the infinite far plane.
+// 3. Every count up to 3*WFLOAT_WIDTH+1, so every partial batch, must
+//    give the same indices as the full run and write nothing past them.
+// 4. Times both functions and a scalar float plane test that stops at the
+//    first plane an object is behind, in ns per object.
+//
+// The SIMD level is whatever SimdMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   c++ -O2 CullingCheck.cpp ../Culling.cpp ../Timing.cpp -o CullingCheck
+// Usage: CullingCheck [count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../Culling.h"
+#include "../SimdMaths.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    return "avx+fma";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+// Within this much (relative to the size of the values involved) of a
+// plane, float rounding can put an object on either side
+static const double BORDER_TOLERANCE = 1e-5;
+
+enum Classification
+{
+    ClassifiedOutside,
+    ClassifiedInside,
+    ClassifiedBorder
+};
+
+struct Objects
+{
+    uint32_t count;
+    float* centerX;
+    float* centerY;
+    float* centerZ;
+    float* radius;
+    float* extentX;
+    float* extentY;
+    float* extentZ;
+};
+
+static double planeDistance(float4 plane, double x, double y, double z)
+{
+    return (double)plane.x * x + (double)plane.y * y + (double)plane.z * z + (double)plane.w;
+}
+
+// Classifies an object from how far it reaches inside each plane
+// (negative when entirely behind it), relative to 'scale'
+static Classification classify(const double margins[6], double scale)
+{
+    bool border = false;
+    for(int p=0; p<6; ++p){
+        if(margins[p] < -BORDER_TOLERANCE * scale)
+            return ClassifiedOutside;
+        if(margins[p] <= BORDER_TOLERANCE * scale)
+            border = true;
+    }
+    return border ? ClassifiedBorder : ClassifiedInside;
+}
+
+static Classification classifySphere(const Frustum* frustum, const Objects* objects, uint32_t i)
+{
+    double x = objects->centerX[i], y = objects->centerY[i], z = objects->centerZ[i], r = objects->radius[i];
+    double margins[6];
+    for(int p=0; p<6; ++p)
+        margins[p] = planeDistance(frustum->planes[p], x, y, z) + r;
+    return classify(margins, 1.0 + fabs(x) + fabs(y) + fabs(z) + r + fabs((double)frustum->planes[4].w) + fabs((double)frustum->planes[5].w));
+}
+
+static Classification classifyAabb(const Frustum* frustum, const Objects* objects, uint32_t i)
+{
+    double x = objects->centerX[i], y = objects->centerY[i], z = objects->centerZ[i];
+    double ex = objects->extentX[i], ey = objects->extentY[i], ez = objects->extentZ[i];
+    double margins[6];
+    for(int p=0; p<6; ++p){
+        // Furthest corner into the frustum, found by trying all 8
+        margins[p] = -1e300;
+        for(int corner=0; corner<8; ++corner){
+            double cx = x + ((corner & 1) ? ex : -ex);
+            double cy = y + ((corner & 2) ? ey : -ey);
+            double cz = z + ((corner & 4) ? ez : -ez);
+            margins[p] = fmax(margins[p], planeDistance(frustum->planes[p], cx, cy, cz));
+        }
+    }
+    return classify(margins, 1.0 + fabs(x) + fabs(y) + fabs(z) + ex + ey + ez +
+                             fabs((double)frustum->planes[4].w) + fabs((double)frustum->planes[5].w));
+}
+
+// A point against the clip-space volume of 'viewProj' directly
+static Classification classifyPointClip(float4x4 viewProj, double x, double y, double z)
+{
+    double clip[4];
+    for(int c=0; c<4; ++c)
+        clip[c] = x * viewProj.m[c][0] + y * viewProj.m[c][1] + z * viewProj.m[c][2] + viewProj.m[c][3];
+    double margins[6] = {
+        clip[3] + clip[0], clip[3] - clip[0],
+        clip[3] + clip[1], clip[3] - clip[1],
+        clip[2], clip[3] - clip[2]
+    };
+    return classify(margins, 1.0 + fabs(clip[0]) + fabs(clip[1]) + fabs(clip[2]) + fabs(clip[3]));
+}
+
+// Counts objects returned although clearly outside, or missing although
+// clearly inside. 'visible' must be ascending with no repeats.
+static uint32_t countMisclassified(const Frustum* frustum, const Objects* objects, bool aabbs,
+                                   const uint32_t* visible, uint32_t numVisible)
+{
+    uint32_t numWrong = 0;
+    uint32_t v = 0;
+    for(uint32_t i=0; i<objects->count; ++i){
+        bool returned = v < numVisible && visible[v] == i;
+        if(returned)
+            ++v;
+        Classification expected = aabbs ? classifyAabb(frustum, objects, i) : classifySphere(frustum, objects, i);
+        if((expected == ClassifiedInside && !returned) || (expected == ClassifiedOutside && returned))
+            ++numWrong;
+    }
+    // Anything left over was out of order, repeated or out of range
+    return numWrong + (numVisible - v);
+}
+
+// The plane test one object at a time, for timing
+static uint32_t scalarCullSpheres(const Frustum* frustum, const Objects* objects, uint32_t* outVisibleIndices)
+{
+    uint32_t numVisible = 0;
+    for(uint32_t i=0; i<objects->count; ++i){
+        float3 center = {objects->centerX[i], objects->centerY[i], objects->centerZ[i]};
+        bool outside = false;
+        for(int p=0; p<6 && !outside; ++p)
+            outside = dot(frustum->planes[p].xyz, center) + frustum->planes[p].w < -objects->radius[i];
+        if(!outside)
+            outVisibleIndices[numVisible++] = i;
+    }
+    return numVisible;
+}
+
+static uint32_t scalarCullAabbs(const Frustum* frustum, const Objects* objects, uint32_t* outVisibleIndices)
+{
+    uint32_t numVisible = 0;
+    for(uint32_t i=0; i<objects->count; ++i){
+        float3 center = {objects->centerX[i], objects->centerY[i], objects->centerZ[i]};
+        bool outside = false;
+        for(int p=0; p<6 && !outside; ++p){
+            float4 plane = frustum->planes[p];
+            float reach = fabsf(plane.x) * objects->extentX[i] + fabsf(plane.y) * objects->extentY[i] + fabsf(plane.z) * objects->extentZ[i];
+            outside = dot(plane.xyz, center) + plane.w + reach < 0.f;
+        }
+        if(!outside)
+            outVisibleIndices[numVisible++] = i;
+    }
+    return numVisible;
+}
+
+static uint32_t cullObjects(const Frustum* frustum, const Objects* objects, bool aabbs, uint32_t count, uint32_t* outVisibleIndices)
+{
+    if(aabbs){
+        return cullAabbs(frustum, objects->centerX, objects->centerY, objects->centerZ,
+                         objects->extentX, objects->extentY, objects->extentZ, count, outVisibleIndices);
+    }
+    return cullSpheres(frustum, objects->centerX, objects->centerY, objects->centerZ, objects->radius, count, outVisibleIndices);
+}
+
+// Best of a few runs, in ns per object
+static double timeCull(const Frustum* frustum, const Objects* objects, bool aabbs, bool scalar, uint32_t* outVisibleIndices, Clock* clock)
+{
+    double best = 1e30;
+    for(int run=0; run<10; ++run){
+        double start = getClockSeconds(clock);
+        if(scalar)
+            aabbs ? scalarCullAabbs(frustum, objects, outVisibleIndices) : scalarCullSpheres(frustum, objects, outVisibleIndices);
+        else
+            cullObjects(frustum, objects, aabbs, objects->count, outVisibleIndices);
+        double elapsed = getClockSeconds(clock) - start;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return 1e9 * best / (double)objects->count;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t count = 100000;
+    if(argc > 1)
+        count = (uint32_t)strtoul(argv[1], 0, 10);
+    if(count < 3 * WFLOAT_WIDTH + 1){
+        fprintf(stderr, "Usage: %s [count >= %d]\n", argv[0], 3 * WFLOAT_WIDTH + 1);
+        return 1;
+    }
+
+    // Most objects within a few hundred units of the camera, the rest
+    // far beyond zFar. One sphere in 8 is a point, for the clip-space test.
+    Objects objects;
+    objects.count = count;
+    objects.centerX = (float*)malloc(count * sizeof(float));
+    objects.centerY = (float*)malloc(count * sizeof(float));
+    objects.centerZ = (float*)malloc(count * sizeof(float));
+    objects.radius = (float*)malloc(count * sizeof(float));
+    objects.extentX = (float*)malloc(count * sizeof(float));
+    objects.extentY = (float*)malloc(count * sizeof(float));
+    objects.extentZ = (float*)malloc(count * sizeof(float));
+    uint32_t* visible = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+    uint32_t* partialVisible = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+    srand(1);
+    for(uint32_t i=0; i<count; ++i){
+        float range = (i % 16 == 0) ? 100000.f : 400.f;
+        objects.centerX[i] = randomFloat(-range, range);
+        objects.centerY[i] = randomFloat(-range, range);
+        objects.centerZ[i] = randomFloat(-range, range);
+        objects.radius[i] = (i % 8 == 1) ? 0.f : randomFloat(0.f, 20.f);
+        objects.extentX[i] = randomFloat(0.f, 20.f);
+        objects.extentY[i] = randomFloat(0.f, 20.f);
+        objects.extentZ[i] = randomFloat(0.f, 20.f);
+    }
+
+    const float Z_NEAR = 0.1f;
+    const float Z_FAR = 1000.f;
+    quat cameraRotation = quatFromAxisAngle(normalise(float3{0.2f, 1, 0.1f}), 0.7f);
+    float4x4 cameraMat = trsMat({3, 5, 7}, cameraRotation, {1, 1, 1});
+    float4x4 viewMat = inverseTrsMat({3, 5, 7}, cameraRotation, {1, 1, 1});
+    float4 ahead = float4{0, 0, -1, 0} * cameraMat;
+    float4 cameraPos = float4{0, 0, 0, 1} * cameraMat;
+
+    const DepthMode MODES[] = {DepthModeStandard, DepthModeReverseZ, DepthModeInfiniteReverseZ};
+    const char* MODE_NAMES[] = {"standard", "reverse_z", "infinite_reverse_z"};
+    Clock clock = createClock(ClockSourceOS);
+    printf("{\n  \"simd\": \"%s\",\n  \"count\": %u,\n  \"results\": [\n", simdLevelName(), count);
+    for(int m=0; m<3; ++m)
+    {
+        float4x4 viewProj = viewMat * makePerspectiveMat(MODES[m], 16.f / 9.f, 1.f, Z_NEAR, Z_FAR);
+        Frustum frustum = makeFrustum(viewProj);
+
+        for(int aabbs=0; aabbs<2; ++aabbs){
+            uint32_t numVisible = cullObjects(&frustum, &objects, aabbs != 0, count, visible);
+            CHECK(countMisclassified(&frustum, &objects, aabbs != 0, visible, numVisible) == 0);
+
+            // Partial batches give the same answer and stop at 'count'
+            for(uint32_t n=0; n<=3 * WFLOAT_WIDTH + 1; ++n){
+                for(uint32_t i=0; i<=n; ++i)
+                    partialVisible[i] = 0xFFFFFFFF;
+                uint32_t numPartial = cullObjects(&frustum, &objects, aabbs != 0, n, partialVisible);
+                uint32_t numExpected = 0;
+                while(numExpected < numVisible && visible[numExpected] < n)
+                    ++numExpected;
+                CHECK(numPartial == numExpected);
+                CHECK(memcmp(partialVisible, visible, numExpected * sizeof(uint32_t)) == 0);
+                CHECK(partialVisible[numPartial] == 0xFFFFFFFF);
+            }
+        }
+
+        // Points against clip space
+        uint32_t numVisible = cullObjects(&frustum, &objects, false, count, visible);
+        uint32_t numPointsChecked = 0, numPointsWrong = 0;
+        for(uint32_t i=0, v=0; i<count; ++i){
+            bool returned = v < numVisible && visible[v] == i;
+            if(returned)
+                ++v;
+            if(objects.radius[i] != 0.f)
+                continue;
+            Classification expected = classifyPointClip(viewProj, objects.centerX[i], objects.centerY[i], objects.centerZ[i]);
+            numPointsChecked += expected != ClassifiedBorder;
+            numPointsWrong += (expected == ClassifiedInside && !returned) || (expected == ClassifiedOutside && returned);
+        }
+        CHECK(numPointsChecked > count / 16);
+        CHECK(numPointsWrong == 0);
+
+        // Far away straight ahead: only kept without a far plane. Behind
+        // the camera: never kept.
+        {
+            float x[3], y[3], z[3];
+            float radius[3] = {1.f, 1.f, 1.f};
+            const float DISTANCES[3] = {100.f, 100000.f, -10.f};
+            for(int i=0; i<3; ++i){
+                x[i] = cameraPos.x + DISTANCES[i] * ahead.x;
+                y[i] = cameraPos.y + DISTANCES[i] * ahead.y;
+                z[i] = cameraPos.z + DISTANCES[i] * ahead.z;
+            }
+            uint32_t indices[3];
+            uint32_t numFound = cullSpheres(&frustum, x, y, z, radius, 3, indices);
+            if(MODES[m] == DepthModeInfiniteReverseZ)
+                CHECK(numFound == 2 && indices[0] == 0 && indices[1] == 1);
+            else
+                CHECK(numFound == 1 && indices[0] == 0);
+        }
+
+        uint32_t numVisibleAabbs = cullObjects(&frustum, &objects, true, count, visible);
+        double spheresNs = timeCull(&frustum, &objects, false, false, visible, &clock);
+        double scalarSpheresNs = timeCull(&frustum, &objects, false, true, visible, &clock);
+        double aabbsNs = timeCull(&frustum, &objects, true, false, visible, &clock);
+        double scalarAabbsNs = timeCull(&frustum, &objects, true, true, visible, &clock);
+        printf("    {\"projection\": \"%s\", \"visible_spheres\": %u, \"visible_aabbs\": %u, \"points_checked_in_clip_space\": %u,\n"
+               "     \"spheres_ns_per_object\": %.3f, \"scalar_spheres_ns_per_object\": %.3f, \"spheres_speedup\": %.2f,\n"
+               "     \"aabbs_ns_per_object\": %.3f, \"scalar_aabbs_ns_per_object\": %.3f, \"aabbs_speedup\": %.2f}%s\n",
+               MODE_NAMES[m], numVisible, numVisibleAabbs, numPointsChecked,
+               spheresNs, scalarSpheresNs, scalarSpheresNs / spheresNs,
+               aabbsNs, scalarAabbsNs, scalarAabbsNs / aabbsNs, m < 2 ? "," : "");
+    }
+    printf("  ],\n  \"failures\": %d\n}\n", numFailures);
+
+    free(objects.centerX);
+    free(objects.centerY);
+    free(objects.centerZ);
+    free(objects.radius);
+    free(objects.extentX);
+    free(objects.extentY);
+    free(objects.extentZ);
+    free(visible);
+    free(partialVisible);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+// Depth precision report for the projection modes in 3DMaths.h.
+// For a range of view distances, prints the smallest increase in
+// distance that changes the value stored in the depth buffer, i.e. the
+// effective depth resolution, for each DepthMode with a 24-bit UNORM and
+// a 32-bit float depth buffer. The projection is evaluated in float like
+// the GPU does, so rounding in the matrix maths is included, not just
+// the storage format. Smaller is better; "clipped" means the distance is
+// beyond the far plane.
+//
+// Build: cl /nologo /O2 DepthPrecision.cpp   (or g++ -O2 DepthPrecision.cpp)
+// Usage: DepthPrecision [zNear zFar]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "../3DMaths.h"
+
+enum DepthFormat
+{
+    DepthFormatUnorm24,
+    DepthFormatFloat32,
+    DepthFormatCount
+};
+
+// Depth for a point at view-space distance 'dist' (z = -dist)
+static float projectDepth(float4x4 proj, float dist)
+{
+    float clipZ = -dist * proj.m[2][2] + proj.m[2][3];
+    float clipW = dist;
+    return clipZ / clipW;
+}
+
+// Value the depth buffer ends up holding, or -1 if 'depth' is clipped
+static double storeDepth(DepthFormat format, float depth)
+{
+    if(!(depth >= 0.f && depth <= 1.f))
+        return -1;
+    if(format == DepthFormatUnorm24)
+        return floor(depth * (double)((1 << 24) - 1) + 0.5);
+    // GPUs flush denormals to 0
+    return (depth < FLT_MIN) ? 0.0 : depth;
+}
+
+static float addUlps(float f, uint32_t ulps)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    bits += ulps;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Smallest step from 'dist' to a farther (float) distance which stores a
+// different depth value. Returns -1 if 'dist' is clipped, or infinity if
+// no farther distance is distinguishable.
+static double depthResolution(float4x4 proj, DepthFormat format, float dist)
+{
+    double stored = storeDepth(format, projectDepth(proj, dist));
+    if(stored < 0)
+        return -1;
+
+    // Stored depth is monotonic in distance: find the first float
+    // distance whose depth differs with an exponential then binary search
+    uint32_t lo = 0, hi = 1;
+    while(storeDepth(format, projectDepth(proj, addUlps(dist, hi))) == stored){
+        lo = hi;
+        hi *= 2;
+        if(hi >= (1u << 30))
+            return HUGE_VAL;
+    }
+    while(hi - lo > 1){
+        uint32_t mid = lo + (hi - lo) / 2;
+        if(storeDepth(format, projectDepth(proj, addUlps(dist, mid))) == stored)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (double)addUlps(dist, hi) - (double)dist;
+}
+
+int main(int argc, char** argv)
+{
+    // Defaults match the sample's camera
+    float zNear = 0.1f;
+    float zFar = 1000.f;
+    if(argc == 3){
+        zNear = (float)atof(argv[1]);
+        zFar = (float)atof(argv[2]);
+    }
+    if(!(zNear > 0.f && zFar > zNear)){
+        fprintf(stderr, "Usage: %s [zNear zFar], with 0 < zNear < zFar\n", argv[0]);
+        return 1;
+    }
+
+    const int NUM_MODES = 3;
+    const char* modeNames[NUM_MODES] = {"standard", "reverse-Z", "infinite reverse-Z"};
+    const char* formatNames[DepthFormatCount] = {"D24", "D32F"};
+    float4x4 projMats[NUM_MODES];
+    for(int mode=0; mode<NUM_MODES; ++mode)
+        projMats[mode] = makePerspectiveMat((DepthMode)mode, 1.f, degreesToRadians(84), zNear, zFar);
+
+    printf("Depth resolution (smallest distinguishable distance step), zNear = %g, zFar = %g\n\n", zNear, zFar);
+    printf("%12s", "distance");
+    for(int mode=0; mode<NUM_MODES; ++mode)
+        for(int format=0; format<DepthFormatCount; ++format){
+            char header[64];
+            snprintf(header, sizeof(header), "%s %s", modeNames[mode], formatNames[format]);
+            printf("  %23s", header);
+        }
+    printf("\n");
+
+    // Log-spaced distances from zNear to 10x zFar
+    for(double dist = zNear; dist <= 10.0 * zFar * 1.0001; dist *= sqrt(10.0))
+    {
+        printf("%12.4g", dist);
+        for(int mode=0; mode<NUM_MODES; ++mode)
+            for(int format=0; format<DepthFormatCount; ++format)
+            {
+                double resolution = depthResolution(projMats[mode], (DepthFormat)format, (float)dist);
+                if(resolution < 0)
+                    printf("  %23s", "clipped");
+                else
+                    printf("  %23.3e", resolution);
+            }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+// Checks and times the SIMD float4x4 operations in 3DMaths.h
+// (matrix * matrix, float4 * matrix, transpose and float4 normalise)
+// against the scalar code they replaced.
+//
+// 1. Random matrices and vectors through every operation, compared with
+//    the scalar formulas (scalarMul(), dot() per column etc.).
+//    Multiplies and transposes add in the same order as the scalar code,
+//    so they must match exactly unless FMA is in use (which rounds once
+//    per multiply-add, in either version, so they're only held to a
+//    tolerance then, relative to the size of the products being summed).
+//    normalise() sums its squares in a different order and divides, so it
+//    is held to a tolerance too.
+// 2. Times each operation and its scalar version in ns/op, over arrays
+//    (throughput) and, for the multiplies, as a chain where every result
+//    feeds the next (latency).
+//
+// The SIMD level is whatever 3DMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   c++ -O2 Float4x4Check.cpp ../Timing.cpp -o Float4x4Check
+// Usage: Float4x4Check [count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../3DMaths.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    return "avx+fma";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+// The scalar versions, as 3DMaths.h computes them with MATHS_NO_SIMD.
+// Matrix * matrix uses 3DMaths.h's own scalarMul().
+static float4 scalarVecMul(float4 v, float4x4 m)
+{
+    return { dot(v, m.cols[0]), dot(v, m.cols[1]), dot(v, m.cols[2]), dot(v, m.cols[3]) };
+}
+
+static float4x4 scalarTranspose(float4x4 m)
+{
+    float4x4 result;
+    for(int c=0; c<4; ++c)
+        for(int r=0; r<4; ++r)
+            result.m[c][r] = m.m[r][c];
+    return result;
+}
+
+static float4 scalarNormalise(float4 v)
+{
+    float invLength = 1.f / sqrtf(dot(v, v));
+    return { v.x*invLength, v.y*invLength, v.z*invLength, v.w*invLength };
+}
+
+// Largest error relative to max(1, |reference|) over 'count' floats
+static float maxError(const float* values, const float* reference, size_t count)
+{
+    float result = 0.f;
+    for(size_t i=0; i<count; ++i){
+        float error = fabsf(values[i] - reference[i]) / fmaxf(1.f, fabsf(reference[i]));
+        if(!(error <= result)) // Catches NaNs too
+            result = error;
+    }
+    return result;
+}
+
+// Largest error of a product relative to the sum of the magnitudes of
+// the terms added up for each element, as cancellation can leave the
+// result much smaller than the rounding in the terms
+static float matMulError(float4x4 a, float4x4 b, float4x4 result, float4x4 reference)
+{
+    float error = 0.f;
+    for(int c=0; c<4; ++c){
+        for(int r=0; r<4; ++r){
+            float scale = 0.f;
+            for(int k=0; k<4; ++k)
+                scale += fabsf(a.m[k][r] * b.m[c][k]);
+            error = fmaxf(error, fabsf(result.m[c][r] - reference.m[c][r]) / fmaxf(1.f, scale));
+        }
+    }
+    return error;
+}
+
+static float vecMulError(float4 v, float4x4 m, float4 result, float4 reference)
+{
+    const float* values = &result.x;
+    const float* references = &reference.x;
+    float error = 0.f;
+    for(int c=0; c<4; ++c){
+        float scale = fabsf(v.x * m.m[c][0]) + fabsf(v.y * m.m[c][1]) + fabsf(v.z * m.m[c][2]) + fabsf(v.w * m.m[c][3]);
+        error = fmaxf(error, fabsf(values[c] - references[c]) / fmaxf(1.f, scale));
+    }
+    return error;
+}
+
+struct Data
+{
+    size_t count;
+    float4x4* matsA;
+    float4x4* matsB;
+    float4x4* matsOut;
+    float4* vecs;
+    float4* vecsOut;
+    float checksum; // Results get folded in here so nothing is dead code
+};
+
+enum Op
+{
+    OpMatMul,
+    OpVecMul,
+    OpTranspose,
+    OpNormalise,
+    OpMatMulChain,
+    OpVecMulChain,
+    NUM_OPS
+};
+
+static const char* OP_NAMES[NUM_OPS] = {
+    "float4x4 * float4x4", "float4 * float4x4", "transpose", "normalise(float4)",
+    "float4x4 * float4x4 chain", "float4 * float4x4 chain"
+};
+
+static void runOp(Op op, bool scalar, Data* data)
+{
+    size_t n = data->count;
+    switch(op){
+        case OpMatMul:
+            for(size_t i=0; i<n; ++i)
+                data->matsOut[i] = scalar ? scalarMul(data->matsA[i], data->matsB[i]) : data->matsA[i] * data->matsB[i];
+            data->checksum += data->matsOut[n-1].m[0][0];
+            break;
+        case OpVecMul:
+            for(size_t i=0; i<n; ++i)
+                data->vecsOut[i] = scalar ? scalarVecMul(data->vecs[i], data->matsA[i]) : data->vecs[i] * data->matsA[i];
+            data->checksum += data->vecsOut[n-1].x;
+            break;
+        case OpTranspose:
+            for(size_t i=0; i<n; ++i)
+                data->matsOut[i] = scalar ? scalarTranspose(data->matsA[i]) : transpose(data->matsA[i]);
+            data->checksum += data->matsOut[n-1].m[0][1];
+            break;
+        case OpNormalise:
+            for(size_t i=0; i<n; ++i)
+                data->vecsOut[i] = scalar ? scalarNormalise(data->vecs[i]) : normalise(data->vecs[i]);
+            data->checksum += data->vecsOut[n-1].x;
+            break;
+        case OpMatMulChain: {
+            // Rotations, so the chain stays bounded
+            float4x4 m = data->matsB[0];
+            for(size_t i=0; i<n; ++i)
+                m = scalar ? scalarMul(m, data->matsB[i]) : m * data->matsB[i];
+            data->checksum += m.m[0][0];
+            break;
+        }
+        case OpVecMulChain: {
+            float4 v = data->vecs[0];
+            for(size_t i=0; i<n; ++i)
+                v = scalar ? scalarVecMul(v, data->matsB[i]) : v * data->matsB[i];
+            data->checksum += v.x;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Best of a few runs, in ns per operation
+static double timeOp(Op op, bool scalar, Data* data, Clock* clock)
+{
+    double best = 1e30;
+    for(int run=0; run<5; ++run){
+        double start = getClockSeconds(clock);
+        runOp(op, scalar, data);
+        double elapsed = getClockSeconds(clock) - start;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return 1e9 * best / (double)data->count;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 65536;
+    if(argc > 1)
+        count = (size_t)strtoul(argv[1], 0, 10);
+    if(count == 0){
+        fprintf(stderr, "Usage: %s [count >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    Data data = {};
+    data.count = count;
+    data.matsA = (float4x4*)malloc(count * sizeof(float4x4));
+    data.matsB = (float4x4*)malloc(count * sizeof(float4x4));
+    data.matsOut = (float4x4*)malloc(count * sizeof(float4x4));
+    data.vecs = (float4*)malloc(count * sizeof(float4));
+    data.vecsOut = (float4*)malloc(count * sizeof(float4));
+    srand(1);
+    for(size_t i=0; i<count; ++i){
+        for(int c=0; c<4; ++c)
+            for(int r=0; r<4; ++r)
+                data.matsA[i].m[c][r] = randomFloat(-10, 10);
+        data.matsB[i] = rotateXMat(randomFloat(-3, 3)) * rotateYMat(randomFloat(-3, 3));
+        data.vecs[i] = {randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(0.1f, 10)};
+    }
+
+#if defined(MATHS_SIMD_FMA)
+    const float MUL_MAX_ERROR = 1e-6f;
+#else
+    const float MUL_MAX_ERROR = 0.f;
+#endif
+    const float NORMALISE_MAX_ERROR = 1e-6f;
+    float errors[4] = {};
+    for(size_t i=0; i<count; ++i){
+        float4x4 matMul = data.matsA[i] * data.matsB[i];
+        float4x4 matMulRef = scalarMul(data.matsA[i], data.matsB[i]);
+        errors[OpMatMul] = fmaxf(errors[OpMatMul], matMulError(data.matsA[i], data.matsB[i], matMul, matMulRef));
+        // Unbounded inputs on both sides too
+        matMul = data.matsA[i] * data.matsA[count-1-i];
+        matMulRef = scalarMul(data.matsA[i], data.matsA[count-1-i]);
+        errors[OpMatMul] = fmaxf(errors[OpMatMul], matMulError(data.matsA[i], data.matsA[count-1-i], matMul, matMulRef));
+
+        float4 vecMul = data.vecs[i] * data.matsA[i];
+        float4 vecMulRef = scalarVecMul(data.vecs[i], data.matsA[i]);
+        errors[OpVecMul] = fmaxf(errors[OpVecMul], vecMulError(data.vecs[i], data.matsA[i], vecMul, vecMulRef));
+
+        float4x4 transposed = transpose(data.matsA[i]);
+        float4x4 transposedRef = scalarTranspose(data.matsA[i]);
+        errors[OpTranspose] = fmaxf(errors[OpTranspose], maxError(&transposed.m[0][0], &transposedRef.m[0][0], 16));
+
+        float4 normalised = normalise(data.vecs[i]);
+        float4 normalisedRef = scalarNormalise(data.vecs[i]);
+        errors[OpNormalise] = fmaxf(errors[OpNormalise], maxError(&normalised.x, &normalisedRef.x, 4));
+    }
+    CHECK(errors[OpMatMul] <= MUL_MAX_ERROR);
+    CHECK(errors[OpVecMul] <= MUL_MAX_ERROR);
+    CHECK(errors[OpTranspose] == 0.f);
+    CHECK(errors[OpNormalise] <= NORMALISE_MAX_ERROR);
+
+    Clock clock = createClock(ClockSourceOS);
+    printf("{\n  \"simd\": \"%s\",\n  \"count\": %zu,\n", simdLevelName(), count);
+    printf("  \"results\": [\n");
+    for(int op=0; op<NUM_OPS; ++op){
+        double scalarNs = timeOp((Op)op, true, &data, &clock);
+        double simdNs = timeOp((Op)op, false, &data, &clock);
+        printf("    {\"name\": \"%s\", ", OP_NAMES[op]);
+        if(op < 4)
+            printf("\"max_relative_error\": %.3g, ", (double)errors[op]);
+        printf("\"scalar_ns_per_op\": %.3f, \"simd_ns_per_op\": %.3f, \"speedup\": %.2f}%s\n",
+               scalarNs, simdNs, scalarNs / simdNs, op + 1 < NUM_OPS ? "," : "");
+    }
+    printf("  ],\n  \"checksum\": \"%g\",\n  \"failures\": %d\n}\n", (double)data.checksum, numFailures);
+
+    free(data.matsA);
+    free(data.matsB);
+    free(data.matsOut);
+    free(data.vecs);
+    free(data.vecsOut);
+    return numFailures ? 1 : 0;
+}
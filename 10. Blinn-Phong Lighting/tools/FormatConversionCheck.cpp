@@ -0,0 +1,436 @@
+// Checks FormatConversion.h.
+//
+// 1. Every one of the 65536 halfs through halfToFloat() and
+//    halfToFloatArray(), and every float bit pattern (2^32 of them, or
+//    every 'step'th) through floatToHalf() and floatToHalfArray(), against
+//    the hardware _cvtsh_ss()/_cvtss_sh() (round to nearest even). Results
+//    must match bit for bit, except that a NaN only has to stay a NaN of
+//    the same sign: F16C quiets NaNs and keeps their payload, the bit
+//    tricks don't. Needs a CPU with F16C; the array functions use it in
+//    the AVX2 build and SSE2 in the others.
+// 2. Every unorm8/16 and snorm8/16 value to float must give the correctly
+//    rounded v / (2^n-1) or v / (2^(n-1)-1) (-1 for the lowest snorm),
+//    and converting that back must give the same value (the lowest snorm
+//    comes back as -2^(n-1)+1, which is also -1). The bulk path must
+//    give the same floats as converting one value at a time.
+// 3. Floats to unorm/snorm on random and special values (NaN, infinities,
+//    out of range, exact halfway points): within rounding of the clamped
+//    and scaled value, and the bulk path must give the same results as
+//    converting one value at a time, which runs the scalar tail.
+// 4. Times the bulk functions in ns per value.
+//
+// The SIMD level is whatever 3DMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   c++ -O2 FormatConversionCheck.cpp ../FormatConversion.cpp ../Timing.cpp -o FormatConversionCheck
+// Usage: FormatConversionCheck [step]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <immintrin.h>
+
+#include "../3DMaths.h"
+#include "../FormatConversion.h"
+#include "../Timing.h"
+#include "Check.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define F16C_TARGET
+static bool cpuHasF16C() { int info[4]; __cpuid(info, 1); return (info[2] >> 29) & 1; }
+#else
+// The reference conversions are compiled for F16C in every build, and
+// only called after checking the CPU has it
+#define F16C_TARGET __attribute__((target("f16c")))
+static bool cpuHasF16C() { return __builtin_cpu_supports("f16c"); }
+#endif
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_F16C)
+    return "avx+f16c";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static float floatFromBits(uint32_t bits) { float f; memcpy(&f, &bits, sizeof(f)); return f; }
+static uint32_t floatToBits(float f) { uint32_t bits; memcpy(&bits, &f, sizeof(bits)); return bits; }
+
+F16C_TARGET static uint16_t referenceFloatToHalf(float f) { return (uint16_t)_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT); }
+F16C_TARGET static float referenceHalfToFloat(uint16_t h) { return _cvtsh_ss(h); }
+
+static bool isHalfNan(uint16_t h) { return (h & 0x7fff) > 0x7c00; }
+static bool isFloatNan(uint32_t bits) { return (bits & 0x7fffffff) > 0x7f800000; }
+
+// Bit-exact, or both NaN with the same sign
+static bool sameHalf(uint16_t a, uint16_t b)
+{
+    if(isHalfNan(a) || isHalfNan(b))
+        return isHalfNan(a) && isHalfNan(b) && (a & 0x8000) == (b & 0x8000);
+    return a == b;
+}
+
+static bool sameFloat(float a, float b)
+{
+    uint32_t aBits = floatToBits(a), bBits = floatToBits(b);
+    if(isFloatNan(aBits) || isFloatNan(bBits))
+        return isFloatNan(aBits) && isFloatNan(bBits) && (aBits & 0x80000000) == (bBits & 0x80000000);
+    return aBits == bBits;
+}
+
+struct HalfErrors
+{
+    uint64_t numChecked;
+    uint64_t scalarMismatches;
+    uint64_t arrayMismatches;
+    uint32_t firstMismatch; // Input bits, for the report when a check fails
+};
+
+static void noteMismatch(HalfErrors* errors, uint64_t* counter, uint32_t bits)
+{
+    if(errors->scalarMismatches + errors->arrayMismatches == 0)
+        errors->firstMismatch = bits;
+    ++*counter;
+}
+
+static HalfErrors checkHalfToFloat()
+{
+    HalfErrors errors = {};
+    static uint16_t halfs[65536];
+    static float floats[65536];
+    for(uint32_t i=0; i<65536; ++i)
+        halfs[i] = (uint16_t)i;
+    halfToFloatArray(halfs, floats, 65536);
+    for(uint32_t i=0; i<65536; ++i){
+        float expected = referenceHalfToFloat(halfs[i]);
+        if(!sameFloat(halfToFloat(halfs[i]), expected))
+            noteMismatch(&errors, &errors.scalarMismatches, i);
+        if(!sameFloat(floats[i], expected))
+            noteMismatch(&errors, &errors.arrayMismatches, i);
+    }
+    errors.numChecked = 65536;
+    return errors;
+}
+
+// Every 'step'th float bit pattern, in blocks that go through the bulk
+// function. A step of 1 covers all 2^32.
+static HalfErrors checkFloatToHalf(uint32_t step)
+{
+    HalfErrors errors = {};
+    const int BLOCK_SIZE = 4096;
+    float floats[BLOCK_SIZE];
+    uint16_t halfs[BLOCK_SIZE];
+    uint64_t bits = 0;
+    while(bits <= 0xffffffffu){
+        int n = 0;
+        for(; n < BLOCK_SIZE && bits <= 0xffffffffu; ++n, bits += step)
+            floats[n] = floatFromBits((uint32_t)bits);
+        floatToHalfArray(floats, halfs, (size_t)n);
+        for(int i=0; i<n; ++i){
+            uint16_t expected = referenceFloatToHalf(floats[i]);
+            if(!sameHalf(floatToHalf(floats[i]), expected))
+                noteMismatch(&errors, &errors.scalarMismatches, floatToBits(floats[i]));
+            if(!sameHalf(halfs[i], expected))
+                noteMismatch(&errors, &errors.arrayMismatches, floatToBits(floats[i]));
+        }
+        errors.numChecked += (uint64_t)n;
+    }
+    return errors;
+}
+
+// One normalised format, with its values widened to int so one routine
+// checks all four
+struct NormFormat
+{
+    const char* name;
+    int minValue;
+    int maxValue;  // Also the scale
+    void (*toFloat)(int minValue, int count, float* out);         // Converts minValue..minValue+count-1
+    void (*fromFloat)(const float* in, int* out, size_t count);
+};
+
+static void unorm8ToFloats(int minValue, int count, float* out)
+{
+    uint8_t* values = (uint8_t*)malloc((size_t)count);
+    for(int i=0; i<count; ++i)
+        values[i] = (uint8_t)(minValue + i);
+    unorm8ToFloatArray(values, out, (size_t)count);
+    free(values);
+}
+
+static void unorm16ToFloats(int minValue, int count, float* out)
+{
+    uint16_t* values = (uint16_t*)malloc((size_t)count * sizeof(uint16_t));
+    for(int i=0; i<count; ++i)
+        values[i] = (uint16_t)(minValue + i);
+    unorm16ToFloatArray(values, out, (size_t)count);
+    free(values);
+}
+
+static void snorm8ToFloats(int minValue, int count, float* out)
+{
+    int8_t* values = (int8_t*)malloc((size_t)count);
+    for(int i=0; i<count; ++i)
+        values[i] = (int8_t)(minValue + i);
+    snorm8ToFloatArray(values, out, (size_t)count);
+    free(values);
+}
+
+static void snorm16ToFloats(int minValue, int count, float* out)
+{
+    int16_t* values = (int16_t*)malloc((size_t)count * sizeof(int16_t));
+    for(int i=0; i<count; ++i)
+        values[i] = (int16_t)(minValue + i);
+    snorm16ToFloatArray(values, out, (size_t)count);
+    free(values);
+}
+
+static void floatsToUnorm8(const float* in, int* out, size_t count)
+{
+    uint8_t* values = (uint8_t*)malloc(count);
+    floatToUnorm8Array(in, values, count);
+    for(size_t i=0; i<count; ++i)
+        out[i] = values[i];
+    free(values);
+}
+
+static void floatsToUnorm16(const float* in, int* out, size_t count)
+{
+    uint16_t* values = (uint16_t*)malloc(count * sizeof(uint16_t));
+    floatToUnorm16Array(in, values, count);
+    for(size_t i=0; i<count; ++i)
+        out[i] = values[i];
+    free(values);
+}
+
+static void floatsToSnorm8(const float* in, int* out, size_t count)
+{
+    int8_t* values = (int8_t*)malloc(count);
+    floatToSnorm8Array(in, values, count);
+    for(size_t i=0; i<count; ++i)
+        out[i] = values[i];
+    free(values);
+}
+
+static void floatsToSnorm16(const float* in, int* out, size_t count)
+{
+    int16_t* values = (int16_t*)malloc(count * sizeof(int16_t));
+    floatToSnorm16Array(in, values, count);
+    for(size_t i=0; i<count; ++i)
+        out[i] = values[i];
+    free(values);
+}
+
+static const NormFormat NORM_FORMATS[] = {
+    {"unorm8",  0,      255,   unorm8ToFloats,  floatsToUnorm8},
+    {"unorm16", 0,      65535, unorm16ToFloats, floatsToUnorm16},
+    {"snorm8",  -128,   127,   snorm8ToFloats,  floatsToSnorm8},
+    {"snorm16", -32768, 32767, snorm16ToFloats, floatsToSnorm16},
+};
+static const int NUM_NORM_FORMATS = sizeof(NORM_FORMATS) / sizeof(NORM_FORMATS[0]);
+
+struct NormErrors
+{
+    int decodeMismatches;   // value -> float not correctly rounded
+    int roundTripMismatches;
+    int encodeErrors;       // float -> value not within rounding
+    int bulkMismatches;     // Bulk path differs from one value at a time
+};
+
+// Every value to float and back
+static void checkNormValues(const NormFormat* format, NormErrors* errors)
+{
+    int count = format->maxValue - format->minValue + 1;
+    float* floats = (float*)malloc((size_t)count * sizeof(float));
+    int* values = (int*)malloc((size_t)count * sizeof(int));
+    format->toFloat(format->minValue, count, floats);
+    format->fromFloat(floats, values, (size_t)count);
+    for(int i=0; i<count; ++i){
+        int value = format->minValue + i;
+        int expectedValue = (value < -format->maxValue) ? -format->maxValue : value;
+        float expected = (float)((double)expectedValue / (double)format->maxValue);
+        if(!sameFloat(floats[i], expected))
+            ++errors->decodeMismatches;
+        if(values[i] != expectedValue)
+            ++errors->roundTripMismatches;
+
+        float single;
+        format->toFloat(value, 1, &single);
+        if(!sameFloat(single, floats[i]))
+            ++errors->bulkMismatches;
+    }
+    free(floats);
+    free(values);
+}
+
+// Random and special floats to values, checked against the clamped and
+// scaled value in doubles. The scale is applied in float, so allow its
+// rounding on top of the half a step from rounding to an integer.
+static void checkNormEncode(const NormFormat* format, NormErrors* errors)
+{
+    const size_t count = 100000;
+    float* floats = (float*)malloc(count * sizeof(float));
+    int* values = (int*)malloc(count * sizeof(int));
+    float lo = (format->minValue < 0) ? -1.f : 0.f;
+    size_t n = 0;
+    float specials[] = {
+        NAN, -NAN, INFINITY, -INFINITY, 0.f, -0.f, 1.f, -1.f, 2.f, -2.f, 1e30f, -1e30f, 1e-30f, -1e-30f,
+        0.5f, -0.5f, 1.f - 1e-7f, -1.f + 1e-7f
+    };
+    for(float f : specials)
+        floats[n++] = f;
+    // Exact halfway points between values, which round to even
+    for(int v=format->minValue; v<format->maxValue && n < count/2; v += (format->maxValue > 255) ? 97 : 1)
+        floats[n++] = (float)(((double)v + 0.5) / (double)format->maxValue);
+    for(; n<count; ++n)
+        floats[n] = randomFloat(lo - 0.25f, 1.25f);
+
+    format->fromFloat(floats, values, count);
+    for(size_t i=0; i<count; ++i){
+        double f = floats[i];
+        if(isnan(f))
+            f = 0.0;
+        f = fmin(fmax(f, (double)lo), 1.0) * (double)format->maxValue;
+        double tolerance = 0.5 + fabs(f) * 2.0 * FLT_EPSILON;
+        if(!(fabs((double)values[i] - f) <= tolerance))
+            ++errors->encodeErrors;
+
+        int single;
+        format->fromFloat(&floats[i], &single, 1);
+        if(single != values[i])
+            ++errors->bulkMismatches;
+    }
+    free(floats);
+    free(values);
+}
+
+// Each converter over 'count' values, best of a few runs in ns per value
+struct ConvertTimes
+{
+    double floatToHalf, halfToFloat;
+    double floatToUnorm8, unorm8ToFloat, floatToUnorm16, unorm16ToFloat;
+    double floatToSnorm8, snorm8ToFloat, floatToSnorm16, snorm16ToFloat;
+};
+
+#define TIME_CONVERSION(result, call)                                      \
+    do{                                                                    \
+        double best = 1e30;                                                \
+        for(int run=0; run<5; ++run){                                      \
+            double start = getClockSeconds(&clock);                        \
+            call;                                                          \
+            double elapsed = getClockSeconds(&clock) - start;              \
+            if(elapsed < best)                                             \
+                best = elapsed;                                            \
+        }                                                                  \
+        result = 1e9 * best / (double)count;                               \
+    }while(0)
+
+static ConvertTimes timeConversions(size_t count)
+{
+    float* floats = (float*)malloc(count * sizeof(float));
+    float* floatsOut = (float*)malloc(count * sizeof(float));
+    uint16_t* shorts = (uint16_t*)malloc(count * sizeof(uint16_t));
+    uint8_t* bytes = (uint8_t*)malloc(count);
+    for(size_t i=0; i<count; ++i)
+        floats[i] = randomFloat(-1.f, 1.f);
+
+    Clock clock = createClock(ClockSourceOS);
+    ConvertTimes times = {};
+    TIME_CONVERSION(times.floatToHalf, floatToHalfArray(floats, shorts, count));
+    TIME_CONVERSION(times.halfToFloat, halfToFloatArray(shorts, floatsOut, count));
+    TIME_CONVERSION(times.floatToUnorm8, floatToUnorm8Array(floats, bytes, count));
+    TIME_CONVERSION(times.unorm8ToFloat, unorm8ToFloatArray(bytes, floatsOut, count));
+    TIME_CONVERSION(times.floatToUnorm16, floatToUnorm16Array(floats, shorts, count));
+    TIME_CONVERSION(times.unorm16ToFloat, unorm16ToFloatArray(shorts, floatsOut, count));
+    TIME_CONVERSION(times.floatToSnorm8, floatToSnorm8Array(floats, (int8_t*)bytes, count));
+    TIME_CONVERSION(times.snorm8ToFloat, snorm8ToFloatArray((const int8_t*)bytes, floatsOut, count));
+    TIME_CONVERSION(times.floatToSnorm16, floatToSnorm16Array(floats, (int16_t*)shorts, count));
+    TIME_CONVERSION(times.snorm16ToFloat, snorm16ToFloatArray((const int16_t*)shorts, floatsOut, count));
+
+    free(floats);
+    free(floatsOut);
+    free(shorts);
+    free(bytes);
+    return times;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t step = 1;
+    if(argc > 1)
+        step = (uint32_t)strtoul(argv[1], 0, 10);
+    if(step == 0){
+        fprintf(stderr, "Usage: %s [step >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    bool hasF16C = cpuHasF16C();
+    HalfErrors halfToFloatErrors = {};
+    HalfErrors floatToHalfErrors = {};
+    if(hasF16C){
+        halfToFloatErrors = checkHalfToFloat();
+        floatToHalfErrors = checkFloatToHalf(step);
+        CHECK(halfToFloatErrors.scalarMismatches == 0);
+        CHECK(halfToFloatErrors.arrayMismatches == 0);
+        CHECK(floatToHalfErrors.scalarMismatches == 0);
+        CHECK(floatToHalfErrors.arrayMismatches == 0);
+        if(halfToFloatErrors.scalarMismatches + halfToFloatErrors.arrayMismatches)
+            fprintf(stderr, "first half -> float mismatch: 0x%04x\n", halfToFloatErrors.firstMismatch);
+        if(floatToHalfErrors.scalarMismatches + floatToHalfErrors.arrayMismatches)
+            fprintf(stderr, "first float -> half mismatch: 0x%08x\n", floatToHalfErrors.firstMismatch);
+    }
+    else{
+        fprintf(stderr, "The CPU has no F16C, skipping the half checks\n");
+    }
+
+    srand(1);
+    NormErrors normErrors[NUM_NORM_FORMATS] = {};
+    for(int f=0; f<NUM_NORM_FORMATS; ++f){
+        checkNormValues(&NORM_FORMATS[f], &normErrors[f]);
+        checkNormEncode(&NORM_FORMATS[f], &normErrors[f]);
+        CHECK(normErrors[f].decodeMismatches == 0);
+        CHECK(normErrors[f].roundTripMismatches == 0);
+        CHECK(normErrors[f].encodeErrors == 0);
+        CHECK(normErrors[f].bulkMismatches == 0);
+    }
+
+    ConvertTimes times = timeConversions(1 << 16);
+
+    printf("{\n  \"simd\": \"%s\",\n  \"f16c\": %s,\n", simdLevelName(), hasF16C ? "true" : "false");
+    printf("  \"half_to_float\": {\"checked\": %llu, \"scalar_mismatches\": %llu, \"array_mismatches\": %llu},\n",
+           (unsigned long long)halfToFloatErrors.numChecked, (unsigned long long)halfToFloatErrors.scalarMismatches,
+           (unsigned long long)halfToFloatErrors.arrayMismatches);
+    printf("  \"float_to_half\": {\"checked\": %llu, \"scalar_mismatches\": %llu, \"array_mismatches\": %llu},\n",
+           (unsigned long long)floatToHalfErrors.numChecked, (unsigned long long)floatToHalfErrors.scalarMismatches,
+           (unsigned long long)floatToHalfErrors.arrayMismatches);
+    printf("  \"normalised\": [\n");
+    for(int f=0; f<NUM_NORM_FORMATS; ++f){
+        printf("    {\"format\": \"%s\", \"decode_mismatches\": %d, \"round_trip_mismatches\": %d, "
+               "\"encode_errors\": %d, \"bulk_mismatches\": %d}%s\n",
+               NORM_FORMATS[f].name, normErrors[f].decodeMismatches, normErrors[f].roundTripMismatches,
+               normErrors[f].encodeErrors, normErrors[f].bulkMismatches, f + 1 < NUM_NORM_FORMATS ? "," : "");
+    }
+    printf("  ],\n");
+    printf("  \"ns_per_value\": {\"floatToHalf\": %.3f, \"halfToFloat\": %.3f, "
+           "\"floatToUnorm8\": %.3f, \"unorm8ToFloat\": %.3f, \"floatToUnorm16\": %.3f, \"unorm16ToFloat\": %.3f, "
+           "\"floatToSnorm8\": %.3f, \"snorm8ToFloat\": %.3f, \"floatToSnorm16\": %.3f, \"snorm16ToFloat\": %.3f},\n",
+           times.floatToHalf, times.halfToFloat, times.floatToUnorm8, times.unorm8ToFloat, times.floatToUnorm16,
+           times.unorm16ToFloat, times.floatToSnorm8, times.snorm8ToFloat, times.floatToSnorm16, times.snorm16ToFloat);
+    printf("  \"failures\": %d\n}\n", numFailures);
+    return numFailures ? 1 : 0;
+}
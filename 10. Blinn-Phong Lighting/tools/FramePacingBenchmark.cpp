@@ -0,0 +1,128 @@
+// Measures FramePacer (FramePacing.h) accuracy and CPU cost.
+// For each target rate, runs frames with a variable amount of fake
+// work (10-60% of the frame budget) and compares three waiting
+// strategies:
+//   sleep:  OS sleep only (no spin tail)
+//   spin:   busy-wait only
+//   hybrid: sleep, then an adaptive spin tail (the default)
+// For each it reports the mean and p99 absolute error between target
+// and actual frame time, total drift from the ideal schedule, and
+// the CPU time used as a fraction of wall time.
+//
+// Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh):
+//   c++ -O2 FramePacingBenchmark.cpp ../FramePacing.cpp ../Timing.cpp -o FramePacingBenchmark
+// Usage: FramePacingBenchmark > results.json
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "../FramePacing.h"
+
+// CPU time used by this process, in seconds
+static double getProcessCpuSeconds()
+{
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (double)(k + u) * 1e-7;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#endif
+}
+
+enum PacingMode {
+    PacingModeSleep,
+    PacingModeSpin,
+    PacingModeHybrid,
+    PacingModeCount
+};
+static const char* PACING_MODE_NAMES[PacingModeCount] = {"sleep", "spin", "hybrid"};
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static uint32_t randomState = 12345;
+static float randomUnit()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return (float)(randomState >> 8) / 16777216.f;
+}
+
+static void runPacingTest(const Clock* clock, double targetHz, PacingMode mode, uint32_t numFrames, bool isLast)
+{
+    double targetSeconds = 1.0 / targetHz;
+    FramePacer pacer = createFramePacer(clock, targetSeconds);
+    if(mode == PacingModeSleep){
+        pacer.spinSeconds = 0;
+        pacer.adaptiveSpin = false;
+    }
+    else if(mode == PacingModeSpin){
+        pacer.spinSeconds = 1e9;
+        pacer.adaptiveSpin = false;
+    }
+
+    double* absErrors = (double*)malloc(numFrames * sizeof(double));
+    waitForNextFrame(&pacer); // Start the schedule at a frame boundary
+    resetFramePacerStats(&pacer);
+    double startSeconds = getClockSeconds(clock);
+    double startCpuSeconds = getProcessCpuSeconds();
+    for(uint32_t frame=0; frame<numFrames; ++frame)
+    {
+        double workSeconds = targetSeconds * (0.1 + 0.5 * randomUnit());
+        double workEnd = getClockSeconds(clock) + workSeconds;
+        while(getClockSeconds(clock) < workEnd) {}
+
+        double error = waitForNextFrame(&pacer);
+        absErrors[frame] = error < 0 ? -error : error;
+    }
+    double wallSeconds = getClockSeconds(clock) - startSeconds;
+    double cpuSeconds = getProcessCpuSeconds() - startCpuSeconds;
+    qsort(absErrors, numFrames, sizeof(double), compareDoubles);
+
+    printf("    {\"target_hz\": %.0f, \"mode\": \"%s\", \"frames\": %u, \"mean_abs_error_us\": %.1f, \"p99_abs_error_us\": %.1f, "
+           "\"max_error_us\": %.1f, \"late_frames\": %llu, \"drift_us\": %.1f, \"cpu_fraction\": %.3f, \"final_spin_us\": %.1f}%s\n",
+           targetHz, PACING_MODE_NAMES[mode], numFrames,
+           1e6 * pacer.sumAbsErrorSeconds / (double)pacer.numFrames,
+           1e6 * absErrors[(uint32_t)(0.99 * (numFrames - 1))],
+           1e6 * pacer.maxErrorSeconds, (unsigned long long)pacer.numLateFrames,
+           1e6 * (wallSeconds - numFrames * targetSeconds),
+           cpuSeconds / wallSeconds, mode == PacingModeSpin ? 0.0 : 1e6 * pacer.spinSeconds,
+           isLast ? "" : ",");
+    fflush(stdout);
+    free(absErrors);
+    destroyFramePacer(&pacer);
+}
+
+int main()
+{
+    Clock clock = createClock(ClockSourceTSC);
+    printf("{\n");
+    printf("  \"clock\": \"%s\",\n", clock.source == ClockSourceTSC ? "tsc" : "os");
+    printf("  \"results\": [\n");
+    const double RATES[] = {60, 144, 240};
+    const int NUM_RATES = sizeof(RATES) / sizeof(RATES[0]);
+    for(int i=0; i<NUM_RATES; ++i)
+        for(int mode=0; mode<PacingModeCount; ++mode)
+            runPacingTest(&clock, RATES[i], (PacingMode)mode, (uint32_t)(RATES[i] * 3), i == NUM_RATES-1 && mode == PacingModeCount-1);
+    printf("  ]\n");
+    printf("}\n");
+    return 0;
+}
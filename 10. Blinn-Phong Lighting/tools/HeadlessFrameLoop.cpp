@@ -0,0 +1,244 @@
+// Runs the sample's whole frame loop (fixed timestep simulation, culling,
+// draw packet recording/sorting, instance and constant uploads, draw
+// submission and Present) on the recording render device, without a
+// window or GPU.
+//
+// 1. Checks the recording backend catches misuse of RenderDevice.h.
+// 2. Runs a scripted camera (turning, so objects enter and leave the
+//    view) for a number of frames, checking every frame submits the
+//    expected commands with no errors and puts the point lights where
+//    the scene has them in eye space, and reports commands and bytes
+//    per frame plus the CPU cost of simulating and of rendering a frame.
+//    The median render cost must be within a budget of a few times what
+//    it normally is.
+//
+// Needs cube.obj and test.png from the sample directory; it looks in
+// the working directory and up to two directories above it.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh):
+//   c++ -O2 HeadlessFrameLoop.cpp ../FrameRenderer.cpp ../RenderDeviceRecording.cpp ../Scene.cpp ../TransformHierarchy.cpp
+//       ../TransformBatch.cpp ../Culling.cpp ../CommandBuffer.cpp ../InstancedDrawing.cpp ../ConstantBufferRing.cpp
+//       ../LightClustering.cpp ../JobSystem.cpp ../ObjLoading.cpp ../Threading.cpp ../Timing.cpp -pthread -o HeadlessFrameLoop
+// Usage: HeadlessFrameLoop [numFrames [commandLogFile]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../FrameRenderer.h"
+#include "../RenderDeviceRecording.h"
+#include "../FixedTimestep.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* findAssetDirectory()
+{
+    const char* CANDIDATES[] = { "", "../", "../../" };
+    char path[64];
+    for(int i=0; i<3; ++i){
+        snprintf(path, sizeof(path), "%scube.obj", CANDIDATES[i]);
+        FILE* file = fopen(path, "rb");
+        if(file){
+            fclose(file);
+            return CANDIDATES[i];
+        }
+    }
+    return 0;
+}
+
+// Misuse the device and check each mistake is counted
+static void checkRecordingBackend()
+{
+    RenderDevice* device = createRecordingRenderDevice(64, 64, 0);
+    uint16_t indices[3] = {0, 1, 2};
+    RenderBuffer indexBuffer = device->createBuffer(device, RenderBufferTypeIndex, RenderBufferUsageImmutable, sizeof(indices), indices);
+    RenderBuffer constantBuffer = device->createBuffer(device, RenderBufferTypeConstant, RenderBufferUsageDynamic, 1024, 0);
+    CHECK(indexBuffer != 0 && constantBuffer != 0);
+    CHECK(getRecordingStats(device).numErrors == 0);
+
+    uint64_t errors = 0;
+    CHECK(device->mapBuffer(device, indexBuffer, RenderMapWriteDiscard) == 0); // Immutable
+    CHECK(getRecordingStats(device).numErrors == ++errors);
+    device->setConstantBuffer(device, RenderShaderStageVertex, 0, constantBuffer, 8, 16); // Unaligned
+    CHECK(getRecordingStats(device).numErrors == ++errors);
+    device->setConstantBuffer(device, RenderShaderStageVertex, 0, constantBuffer, 48, 32); // Past the end
+    CHECK(getRecordingStats(device).numErrors == ++errors);
+    device->drawIndexedInstanced(device, 3, 1); // No pipeline
+    CHECK(getRecordingStats(device).numErrors == ++errors);
+    CHECK(device->mapBuffer(device, constantBuffer, RenderMapWriteDiscard) != 0);
+    device->present(device, 0); // Still mapped
+    CHECK(getRecordingStats(device).numErrors == ++errors);
+    device->unmapBuffer(device, constantBuffer);
+    device->unmapBuffer(device, constantBuffer); // Not mapped
+    CHECK(getRecordingStats(device).numErrors == ++errors);
+    device->setConstantBuffer(device, RenderShaderStagePixel, 0, constantBuffer, 16, 16);
+    CHECK(getRecordingStats(device).numErrors == errors);
+    CHECK(getRecordingStats(device).constantBytesBound == 256);
+    CHECK(device->createBuffer(device, RenderBufferTypeRaw, RenderBufferUsageDynamic, 6, 0) == 0); // Not whole uint32s
+    CHECK(getRecordingStats(device).numErrors == ++errors);
+    device->setRawBuffer(device, 1, constantBuffer); // Not a raw buffer
+    CHECK(getRecordingStats(device).numErrors == ++errors);
+    RenderBuffer rawBuffer = device->createBuffer(device, RenderBufferTypeRaw, RenderBufferUsageDynamic, 64, 0);
+    device->setRawBuffer(device, 1, rawBuffer);
+    CHECK(getRecordingStats(device).numErrors == errors);
+    CHECK(getRecordingStats(device).rawBytesBound == 64);
+    device->destroy(device);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t numFrames = 10000;
+    FILE* log = 0;
+    if(argc > 1)
+        numFrames = (uint32_t)strtoul(argv[1], 0, 10);
+    if(argc > 2)
+        log = fopen(argv[2], "w");
+    if(numFrames == 0 || (argc > 2 && !log)){
+        fprintf(stderr, "Usage: %s [numFrames >= 1 [commandLogFile]]\n", argv[0]);
+        return 1;
+    }
+    const char* assetDirectory = findAssetDirectory();
+    if(!assetDirectory){
+        fprintf(stderr, "Can't find cube.obj, run from the sample directory\n");
+        return 1;
+    }
+
+    checkRecordingBackend();
+
+    // Whole buffers mapped per frame: the 64KB instance buffer, a few KB
+    // of constant ring and the light buffers, all sized for the scene
+    const uint64_t MAPPED_BUDGET_BYTES = 72 * 1024;
+
+    const uint32_t WIDTH = 1024, HEIGHT = 768;
+    RenderDevice* device = createRecordingRenderDevice(WIDTH, HEIGHT, log);
+    FrameRenderer* frameRenderer = (FrameRenderer*)malloc(sizeof(FrameRenderer));
+    CHECK(createFrameRenderer(frameRenderer, device, assetDirectory, 0, FrameLightClusteringAuto));
+    RecordingStats creationStats = getRecordingStats(device);
+    CHECK(creationStats.numErrors == 0);
+    CHECK(creationStats.numCommands[RenderCommandCreatePipeline] == 2);
+    CHECK(creationStats.numCommands[RenderCommandCreateFence] == CONSTANT_RING_MAX_FRAMES_IN_FLIGHT);
+
+    Scene scene = createScene();
+    SceneState previousSceneState = makeInitialSceneState();
+    SceneState currentSceneState = previousSceneState;
+    FixedTimestep simulationTimestep = makeFixedTimestep(1.0 / 120.0, 30);
+    float4x4 perspectiveMat = makePerspectiveMat(DepthModeInfiniteReverseZ, (float)WIDTH / (float)HEIGHT, degreesToRadians(84), 0.1f, 1000.f);
+    device->resize(device, WIDTH, HEIGHT);
+
+    FrameStats* simulateStats = (FrameStats*)malloc(sizeof(FrameStats));
+    FrameStats* renderStats = (FrameStats*)malloc(sizeof(FrameStats));
+    resetFrameStats(simulateStats);
+    resetFrameStats(renderStats);
+    Clock clock = createClock(ClockSourceOS);
+
+    // Pretend to run at 60Hz, turning the camera for 2 seconds out of
+    // every 6 so the cubes go in and out of view
+    const double FRAME_SECONDS = 1.0 / 60.0;
+    bool keyIsDown[GameActionCount] = {};
+    resetRecordingStats(device);
+    uint32_t numFramesCulledSomething = 0;
+    double start = getClockSeconds(&clock);
+    for(uint32_t frame=0; frame<numFrames; ++frame)
+    {
+        keyIsDown[GameActionTurnCamLeft] = (frame % 360) < 120;
+        RecordingStats before = getRecordingStats(device);
+
+        double frameStart = getClockSeconds(&clock);
+        SceneState renderSceneState;
+        {
+            uint32_t numSteps = advanceFixedTimestep(&simulationTimestep, FRAME_SECONDS);
+            for(uint32_t i=0; i<numSteps; ++i){
+                previousSceneState = currentSceneState;
+                stepScene(&currentSceneState, keyIsDown, (float)simulationTimestep.stepSeconds);
+            }
+            renderSceneState = interpolateSceneStates(&previousSceneState, &currentSceneState, fixedTimestepAlpha(&simulationTimestep));
+            applySceneState(&scene, &renderSceneState);
+        }
+        double simulateEnd = getClockSeconds(&clock);
+        affine3x4 viewMat = sceneViewMatrix(&renderSceneState);
+        renderFrame(frameRenderer, &scene, viewMat, perspectiveMat);
+        device->present(device, 1);
+        double frameEnd = getClockSeconds(&clock);
+        recordFrameTime(simulateStats, simulateEnd - frameStart);
+        recordFrameTime(renderStats, frameEnd - simulateEnd);
+
+        // Every frame: instances, constants and the three light buffers
+        // uploaded once each, the vertex and pixel shaders' constants and
+        // the light buffers bound once, the lights always drawn and the
+        // cubes drawn if any are visible. Only the cubes have a texture.
+        RecordingStats after = getRecordingStats(device);
+        uint64_t draws = after.numCommands[RenderCommandDrawIndexedInstanced] - before.numCommands[RenderCommandDrawIndexedInstanced];
+        uint64_t instances = after.numInstancesDrawn - before.numInstancesDrawn;
+        CHECK(after.numErrors == 0);
+        CHECK(after.numCommands[RenderCommandMapBuffer] - before.numCommands[RenderCommandMapBuffer] == 5);
+        CHECK(after.numCommands[RenderCommandSetConstantBuffer] - before.numCommands[RenderCommandSetConstantBuffer] == 2);
+        CHECK(after.numCommands[RenderCommandSetRawBuffer] - before.numCommands[RenderCommandSetRawBuffer] == 3);
+        CHECK(after.bytesMapped - before.bytesMapped <= MAPPED_BUDGET_BYTES);
+        CHECK(after.numCommands[RenderCommandBeginFrame] - before.numCommands[RenderCommandBeginFrame] == 1);
+        CHECK(after.numCommands[RenderCommandPresent] - before.numCommands[RenderCommandPresent] == 1);
+        CHECK(draws == 1 || draws == 2);
+        CHECK(after.numCommands[RenderCommandSetTexture] - before.numCommands[RenderCommandSetTexture] == draws - 1);
+        CHECK(instances >= SCENE_NUM_LIGHTS && instances <= SCENE_NUM_LIGHTS + SCENE_NUM_CUBES);
+        CHECK((draws == 1) == (instances == SCENE_NUM_LIGHTS));
+        if(instances < SCENE_NUM_LIGHTS + SCENE_NUM_CUBES)
+            ++numFramesCulledSomething;
+
+        // The point lights orbit in front of the camera, so their eye
+        // positions are never the origin (where the camera is) and differ
+        float4 pointLightPosEye[SCENE_NUM_LIGHTS];
+        getPointLightPositionsEye(&scene, viewMat, pointLightPosEye);
+        for(int i=0; i<SCENE_NUM_LIGHTS; ++i){
+            CHECK(length(pointLightPosEye[i].xyz) > 0.1f);
+            CHECK(pointLightPosEye[i].w == 1.f);
+        }
+        CHECK(length(pointLightPosEye[0].xyz + -pointLightPosEye[1].xyz) > 0.01f);
+    }
+    double elapsed = getClockSeconds(&clock) - start;
+    // Over a full turn/pause cycle some frames should cull cubes and some not
+    if(numFrames >= 360)
+        CHECK(numFramesCulledSomething > 0 && numFramesCulledSomething < numFrames);
+
+    RecordingStats stats = getRecordingStats(device);
+    double perFrame = 1.0 / (double)numFrames;
+    printf("{\n  \"frames\": %u,\n  \"frames_with_culled_cubes\": %u,\n", numFrames, numFramesCulledSomething);
+    printf("  \"creation\": {\"commands\": %llu, \"bytes_uploaded\": %llu},\n",
+           (unsigned long long)(creationStats.numCommands[RenderCommandCreateBuffer] + creationStats.numCommands[RenderCommandCreatePipeline] +
+                                creationStats.numCommands[RenderCommandCreateTexture] + creationStats.numCommands[RenderCommandCreateFence]),
+           (unsigned long long)creationStats.bytesCreated);
+    printf("  \"commands_per_frame\": {");
+    bool first = true;
+    for(int i=0; i<RenderCommandCount; ++i){
+        if(stats.numCommands[i] == 0)
+            continue;
+        printf("%s\"%s\": %.2f", first ? "" : ", ", RENDER_COMMAND_NAMES[i], stats.numCommands[i] * perFrame);
+        first = false;
+    }
+    printf("},\n");
+    printf("  \"bytes_per_frame\": {\"mapped\": %.0f, \"constants_bound\": %.0f, \"raw_bound\": %.0f, \"instances_drawn\": %.1f, \"indices_drawn\": %.1f},\n",
+           stats.bytesMapped * perFrame, stats.constantBytesBound * perFrame, stats.rawBytesBound * perFrame,
+           stats.instanceBytesDrawn * perFrame, stats.indexBytesDrawn * perFrame);
+
+    FrameTimeSummary simulate = summariseFrameTimes(simulateStats);
+    FrameTimeSummary render = summariseFrameTimes(renderStats);
+    // Recording a frame takes a few microseconds. The median keeps the
+    // odd descheduled frame from failing this, while anything that adds
+    // real work per frame (e.g. building every light cluster for two
+    // lights, ~270us) still does.
+    const double RENDER_BUDGET_US = 20.0;
+    CHECK(1e3 * render.p50Ms < RENDER_BUDGET_US);
+    printf("  \"simulate_us\": {\"avg\": %.2f, \"p50\": %.2f, \"p99\": %.2f},\n", 1e3 * simulate.avgMs, 1e3 * simulate.p50Ms, 1e3 * simulate.p99Ms);
+    printf("  \"render_us\": {\"avg\": %.2f, \"p50\": %.2f, \"p99\": %.2f},\n", 1e3 * render.avgMs, 1e3 * render.p50Ms, 1e3 * render.p99Ms);
+    printf("  \"frames_per_second\": %.0f,\n", numFrames / elapsed);
+    printf("  \"failures\": %d\n}\n", numFailures);
+
+    freeScene(scene);
+    freeFrameRenderer(frameRenderer);
+    free(frameRenderer);
+    device->destroy(device);
+    free(simulateStats);
+    free(renderStats);
+    if(log)
+        fclose(log);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+// Runs the sample's scene simulation (Scene.h) without a window or GPU.
+//
+// 1. Fixed timestep at different refresh rates: feeds synthetic frame
+//    times (steady 30-1000 Hz, plus 60 Hz with periodic 200 ms hitches)
+//    through FixedTimestep for 10 simulated seconds and reports how many
+//    simulation steps were taken. The step count, and so the simulation
+//    cost per second, should be the same at every rate, and hitches
+//    shouldn't lose any time unless they exceed the catch-up cap.
+// 2. Raw speed: steps the simulation back to back with scripted input
+//    and reports how much faster than real time it runs, plus the cost
+//    of posing the transform hierarchy for a rendered frame.
+//
+// Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh):
+//   c++ -O2 HeadlessSimulation.cpp ../Scene.cpp ../TransformHierarchy.cpp ../TransformBatch.cpp ../Timing.cpp -o HeadlessSimulation
+// Usage: HeadlessSimulation > results.json
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../Scene.h"
+#include "../FixedTimestep.h"
+#include "../Timing.h"
+
+static const double STEP_SECONDS = 1.0 / 120.0;
+static const uint32_t MAX_STEPS_PER_FRAME = 30;
+
+// Scripted input: walk forward while turning, then strafe and look up
+static void getScriptedInput(uint64_t step, bool keyIsDown[GameActionCount])
+{
+    for(int i=0; i<GameActionCount; ++i)
+        keyIsDown[i] = false;
+    uint64_t phase = (step / 240) % 4;
+    keyIsDown[GameActionMoveCamFwd] = phase == 0 || phase == 1;
+    keyIsDown[GameActionTurnCamLeft] = phase == 1;
+    keyIsDown[GameActionMoveCamRight] = phase == 2;
+    keyIsDown[GameActionLookUp] = phase == 3;
+}
+
+struct RateResult
+{
+    uint64_t numFrames;
+    uint64_t numSteps;
+    double simulatedSeconds;
+    double droppedSeconds;
+};
+
+// Drives the fixed timestep with 'frameSeconds' per frame (every
+// 'hitchEvery'th frame takes 'hitchSeconds' instead, 0 for none) until
+// 'realSeconds' have passed
+static RateResult runAtFrameRate(double frameSeconds, uint32_t hitchEvery, double hitchSeconds, double realSeconds)
+{
+    SceneState previous = makeInitialSceneState();
+    SceneState current = previous;
+    Scene scene = createScene();
+    FixedTimestep timestep = makeFixedTimestep(STEP_SECONDS, MAX_STEPS_PER_FRAME);
+    bool keyIsDown[GameActionCount];
+
+    RateResult result = {};
+    double elapsed = 0;
+    while(elapsed < realSeconds)
+    {
+        double dt = (hitchEvery && result.numFrames % hitchEvery == hitchEvery - 1) ? hitchSeconds : frameSeconds;
+        elapsed += dt;
+        uint32_t numSteps = advanceFixedTimestep(&timestep, dt);
+        for(uint32_t i=0; i<numSteps; ++i){
+            getScriptedInput(timestep.numSteps - numSteps + i, keyIsDown);
+            previous = current;
+            stepScene(&current, keyIsDown, (float)timestep.stepSeconds);
+        }
+        SceneState render = interpolateSceneStates(&previous, &current, fixedTimestepAlpha(&timestep));
+        applySceneState(&scene, &render);
+        ++result.numFrames;
+    }
+    result.numSteps = timestep.numSteps;
+    result.simulatedSeconds = current.time;
+    result.droppedSeconds = timestep.droppedSeconds;
+    freeScene(scene);
+    return result;
+}
+
+int main()
+{
+    printf("{\n");
+    printf("  \"step_hz\": %.0f,\n", 1.0 / STEP_SECONDS);
+    printf("  \"frame_rates\": [\n");
+    const double REAL_SECONDS = 10.0;
+    const double RATES[] = {30, 60, 144, 240, 1000};
+    const int NUM_RATES = sizeof(RATES) / sizeof(RATES[0]);
+    for(int i=0; i<=NUM_RATES; ++i)
+    {
+        bool isHitchRun = (i == NUM_RATES);
+        double rate = isHitchRun ? 60 : RATES[i];
+        RateResult r = isHitchRun ? runAtFrameRate(1.0 / 60, 30, 0.2, REAL_SECONDS)
+                                  : runAtFrameRate(1.0 / rate, 0, 0, REAL_SECONDS);
+        printf("    {\"frame_hz\": %.0f, \"hitches\": %s, \"frames\": %llu, \"steps\": %llu, \"steps_per_frame\": %.3f, "
+               "\"simulated_seconds\": %.4f, \"dropped_seconds\": %.4f}%s\n",
+               rate, isHitchRun ? "true" : "false", (unsigned long long)r.numFrames, (unsigned long long)r.numSteps,
+               (double)r.numSteps / (double)r.numFrames, r.simulatedSeconds, r.droppedSeconds, isHitchRun ? "" : ",");
+    }
+    printf("  ],\n");
+
+    // Back-to-back simulation steps
+    {
+        SceneState state = makeInitialSceneState();
+        bool keyIsDown[GameActionCount];
+        const uint64_t NUM_STEPS = 2000000;
+        Clock clock = createClock(ClockSourceOS);
+        double start = getClockSeconds(&clock);
+        for(uint64_t step=0; step<NUM_STEPS; ++step){
+            getScriptedInput(step, keyIsDown);
+            stepScene(&state, keyIsDown, (float)STEP_SECONDS);
+        }
+        double elapsed = getClockSeconds(&clock) - start;
+        printf("  \"ns_per_step\": %.1f,\n", 1e9 * elapsed / (double)NUM_STEPS);
+        printf("  \"times_real_time\": %.0f,\n", state.time / elapsed);
+
+        // Posing the scene for a frame: interpolation + hierarchy update
+        Scene scene = createScene();
+        SceneState next = state;
+        stepScene(&next, keyIsDown, (float)STEP_SECONDS);
+        const uint32_t NUM_FRAMES = 200000;
+        start = getClockSeconds(&clock);
+        for(uint32_t frame=0; frame<NUM_FRAMES; ++frame){
+            SceneState render = interpolateSceneStates(&state, &next, (float)(frame % 100) * 0.01f);
+            applySceneState(&scene, &render);
+        }
+        elapsed = getClockSeconds(&clock) - start;
+        printf("  \"ns_per_frame_pose\": %.1f,\n", 1e9 * elapsed / (double)NUM_FRAMES);
+        // Printed so the work can't be optimised away
+        printf("  \"checksum\": \"%g\"\n", (double)(state.cameraPos.x + scene.transforms.worldMats[0].m[0][0]));
+        freeScene(scene);
+    }
+    printf("}\n");
+    return 0;
+}
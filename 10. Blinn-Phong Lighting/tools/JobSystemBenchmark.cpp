@@ -0,0 +1,425 @@
+// Tests and scaling benchmark for JobSystem.h.
+//
+// First runs a set of correctness checks (every task runs exactly once,
+// nested parallelFor, fork-join through JobCounters, bursts of tiny
+// jobs that make the workers sleep and wake, chains of runJobsAfter()
+// continuations) with one thread and with every thread, and exits with
+// status 1 if any fails.
+//
+// Then times each workload with 1, 2, 4, ... threads up to the number
+// of logical processors and prints JSON with the time and the speedup
+// over one thread. Thread counts past the number of logical processors
+// (if asked for) are marked "oversubscribed", and "scaling_measured" is
+// only true if more than one thread ran on its own processor:
+//   compute:    parallelFor over independent sinCos-heavy items
+//   skinning:   skinVertices() (a parallelFor) over 1M vertices,
+//               mostly limited by memory bandwidth
+//   fork_join:  recursive Fibonacci with runJob()/waitForCounter(),
+//               lots of small nested jobs and stealing
+//   empty_jobs: runJobs() with empty tasks, i.e. scheduling overhead
+//
+// Build (see build_benchmarks.sh):
+//   g++ -O2 -pthread JobSystemBenchmark.cpp ../JobSystem.cpp ../Threading.cpp ../Skinning.cpp ../Timing.cpp -o JobSystemBenchmark
+// Usage: JobSystemBenchmark [maxThreads] > results.json
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../3DMaths.h"
+#include "../JobSystem.h"
+#include "../Skinning.h"
+#include "../Timing.h"
+
+static int global_numFailures = 0;
+
+static void check(bool condition, const char* what, uint32_t numThreads)
+{
+    if(!condition){
+        fprintf(stderr, "FAILED: %s (%u threads)\n", what, numThreads);
+        ++global_numFailures;
+    }
+}
+
+//
+// Tests
+//
+
+static void incrementTask(void* userData, uint32_t taskIndex)
+{
+    uint32_t* counts = (uint32_t*)userData;
+    ++counts[taskIndex];
+}
+
+static void testRunJobs(JobSystem* jobSystem)
+{
+    const uint32_t NUM_TASKS = 100003;
+    const uint32_t NUM_SINGLE_JOBS = 1000;
+    uint32_t* counts = (uint32_t*)calloc(NUM_TASKS, sizeof(uint32_t));
+    uint32_t* singleCounts = (uint32_t*)calloc(NUM_SINGLE_JOBS, sizeof(uint32_t));
+    assert(counts && singleCounts);
+    JobCounter counter = {};
+    runJobs(jobSystem, incrementTask, counts, NUM_TASKS, &counter);
+    // Single jobs on the same counter as well
+    for(uint32_t i=0; i<NUM_SINGLE_JOBS; ++i)
+        runJob(jobSystem, incrementTask, singleCounts, i, &counter);
+    waitForCounter(jobSystem, &counter);
+
+    bool ok = counter.count == 0;
+    for(uint32_t i=0; i<NUM_TASKS; ++i)
+        ok = ok && counts[i] == 1;
+    for(uint32_t i=0; i<NUM_SINGLE_JOBS; ++i)
+        ok = ok && singleCounts[i] == 1;
+    check(ok, "every task runs exactly once", getNumJobThreads(jobSystem));
+    free(counts);
+    free(singleCounts);
+}
+
+struct NestedForData
+{
+    JobSystem* jobSystem;
+    uint32_t innerCount;
+    uint32_t* values;
+};
+
+struct NestedInnerData
+{
+    NestedForData* outer;
+    uint32_t outerIndex;
+};
+
+static void nestedInnerProc(void* userData, uint32_t begin, uint32_t end)
+{
+    NestedInnerData* inner = (NestedInnerData*)userData;
+    for(uint32_t i=begin; i<end; ++i)
+        inner->outer->values[inner->outerIndex * inner->outer->innerCount + i] += inner->outerIndex + i;
+}
+
+static void nestedOuterProc(void* userData, uint32_t begin, uint32_t end)
+{
+    NestedForData* data = (NestedForData*)userData;
+    for(uint32_t i=begin; i<end; ++i){
+        NestedInnerData inner = {data, i};
+        parallelFor(data->jobSystem, nestedInnerProc, &inner, data->innerCount, 37);
+    }
+}
+
+static void testNestedParallelFor(JobSystem* jobSystem)
+{
+    NestedForData data;
+    data.jobSystem = jobSystem;
+    data.innerCount = 1000;
+    const uint32_t OUTER_COUNT = 61;
+    data.values = (uint32_t*)calloc(OUTER_COUNT * data.innerCount, sizeof(uint32_t));
+    assert(data.values);
+    parallelFor(jobSystem, nestedOuterProc, &data, OUTER_COUNT, 1);
+
+    bool ok = true;
+    for(uint32_t o=0; o<OUTER_COUNT; ++o)
+        for(uint32_t i=0; i<data.innerCount; ++i)
+            ok = ok && data.values[o * data.innerCount + i] == o + i;
+    check(ok, "nested parallelFor", getNumJobThreads(jobSystem));
+    free(data.values);
+}
+
+struct FibData
+{
+    JobSystem* jobSystem;
+    uint32_t n;
+    uint32_t serialCutoff;
+    uint64_t result;
+};
+
+static uint64_t fibSerial(uint32_t n)
+{
+    return (n < 2) ? n : fibSerial(n - 1) + fibSerial(n - 2);
+}
+
+static void fibTask(void* userData, uint32_t /*taskIndex*/)
+{
+    FibData* data = (FibData*)userData;
+    if(data->n <= data->serialCutoff){
+        data->result = fibSerial(data->n);
+        return;
+    }
+    FibData a = {data->jobSystem, data->n - 1, data->serialCutoff, 0};
+    FibData b = {data->jobSystem, data->n - 2, data->serialCutoff, 0};
+    JobCounter counter = {};
+    runJob(data->jobSystem, fibTask, &a, 0, &counter);
+    runJob(data->jobSystem, fibTask, &b, 0, &counter);
+    waitForCounter(data->jobSystem, &counter);
+    data->result = a.result + b.result;
+}
+
+static uint64_t fibJobs(JobSystem* jobSystem, uint32_t n, uint32_t serialCutoff)
+{
+    FibData data = {jobSystem, n, serialCutoff, 0};
+    fibTask(&data, 0);
+    return data.result;
+}
+
+static void testForkJoin(JobSystem* jobSystem)
+{
+    check(fibJobs(jobSystem, 24, 2) == 46368, "fork-join with JobCounters", getNumJobThreads(jobSystem));
+}
+
+static void testBursts(JobSystem* jobSystem)
+{
+    // Few jobs at a time with gaps in between, so workers keep going to
+    // sleep and being woken up. A lost wake-up shows up as a hang.
+    const uint32_t NUM_ROUNDS = 20000;
+    const uint32_t TASKS_PER_ROUND = 4;
+    uint32_t counts[TASKS_PER_ROUND] = {};
+    for(uint32_t round=0; round<NUM_ROUNDS; ++round){
+        JobCounter counter = {};
+        runJobs(jobSystem, incrementTask, counts, TASKS_PER_ROUND, &counter);
+        waitForCounter(jobSystem, &counter);
+    }
+    bool ok = true;
+    for(uint32_t i=0; i<TASKS_PER_ROUND; ++i)
+        ok = ok && counts[i] == NUM_ROUNDS;
+    check(ok, "bursts of small jobs", getNumJobThreads(jobSystem));
+}
+
+struct ContinuationStage
+{
+    const JobCounter* previous; // Must have reached zero before any task of this stage runs
+    uint32_t* counts;
+};
+
+// Counts the task, or adds a large number if it started too early so the
+// final counts are off
+static void continuationStageTask(void* userData, uint32_t taskIndex)
+{
+    ContinuationStage* stage = (ContinuationStage*)userData;
+    bool startedEarly = stage->previous && stage->previous->count != 0;
+    stage->counts[taskIndex] += startedEarly ? 1000000 : 1;
+}
+
+static void testContinuations(JobSystem* jobSystem)
+{
+    // A chain of stages, each started by runJobsAfter() on the last
+    // one's counter, plus several continuations on the same counter and
+    // one on a counter which is already zero. Waiting on the last counter
+    // must wait for the whole chain. Repeated so the counters on the
+    // stack are reused while other threads may still be finishing.
+    const uint32_t NUM_STAGES = 4;
+    const uint32_t NUM_TASKS = 1001;
+    const uint32_t NUM_FAN_OUT = 8;
+    const uint32_t NUM_ROUNDS = 200;
+    uint32_t* counts = (uint32_t*)calloc((NUM_STAGES + NUM_FAN_OUT + 1) * NUM_TASKS, sizeof(uint32_t));
+    assert(counts);
+    for(uint32_t round=0; round<NUM_ROUNDS; ++round){
+        JobCounter counters[NUM_STAGES] = {};
+        ContinuationStage stages[NUM_STAGES];
+        for(uint32_t s=0; s<NUM_STAGES; ++s)
+            stages[s] = {s ? &counters[s-1] : 0, counts + s * NUM_TASKS};
+        runJobs(jobSystem, continuationStageTask, &stages[0], NUM_TASKS, &counters[0]);
+        for(uint32_t s=1; s<NUM_STAGES; ++s)
+            runJobsAfter(jobSystem, &counters[s-1], continuationStageTask, &stages[s], NUM_TASKS, &counters[s]);
+
+        JobCounter fanOutCounter = {};
+        ContinuationStage fanOut[NUM_FAN_OUT];
+        for(uint32_t f=0; f<NUM_FAN_OUT; ++f){
+            fanOut[f] = {&counters[0], counts + (NUM_STAGES + f) * NUM_TASKS};
+            runJobsAfter(jobSystem, &counters[0], continuationStageTask, &fanOut[f], NUM_TASKS, &fanOutCounter);
+        }
+
+        JobCounter zero = {};
+        JobCounter afterZeroCounter = {};
+        ContinuationStage afterZero = {&zero, counts + (NUM_STAGES + NUM_FAN_OUT) * NUM_TASKS};
+        runJobsAfter(jobSystem, &zero, continuationStageTask, &afterZero, NUM_TASKS, &afterZeroCounter);
+
+        waitForCounter(jobSystem, &counters[NUM_STAGES - 1]);
+        waitForCounter(jobSystem, &fanOutCounter);
+        waitForCounter(jobSystem, &afterZeroCounter);
+    }
+
+    bool ok = true;
+    for(uint32_t i=0; i<(NUM_STAGES + NUM_FAN_OUT + 1) * NUM_TASKS; ++i)
+        ok = ok && counts[i] == NUM_ROUNDS;
+    check(ok, "runJobsAfter() chains and fan-out", getNumJobThreads(jobSystem));
+    free(counts);
+}
+
+//
+// Benchmarks
+//
+
+struct ComputeData
+{
+    const float* inputs;
+    float* outputs;
+};
+
+static void computeProc(void* userData, uint32_t begin, uint32_t end)
+{
+    ComputeData* data = (ComputeData*)userData;
+    for(uint32_t i=begin; i<end; ++i){
+        float x = data->inputs[i];
+        float sum = 0;
+        for(int k=0; k<64; ++k){
+            float s = 0, c = 0;
+            sinCos(x, &s, &c);
+            sum += s * c;
+            x = x * 1.01f + 0.1f;
+        }
+        data->outputs[i] = sum;
+    }
+}
+
+struct SkinningData
+{
+    const SkinnedVertexData* vertices;
+    const affine3x4* bones;
+    uint32_t numBones;
+    VertexData* outVertices;
+};
+
+static void emptyTask(void*, uint32_t) {}
+
+enum Workload
+{
+    WorkloadCompute,
+    WorkloadSkinning,
+    WorkloadForkJoin,
+    WorkloadEmptyJobs,
+    NUM_WORKLOADS
+};
+static const char* WORKLOAD_NAMES[NUM_WORKLOADS] = {"compute", "skinning", "fork_join", "empty_jobs"};
+
+struct BenchInputs
+{
+    ComputeData compute;
+    uint32_t computeCount;
+    SkinningData skinning;
+    uint32_t numVertices;
+};
+
+static void runWorkload(JobSystem* jobSystem, Workload workload, BenchInputs* inputs)
+{
+    switch(workload){
+        case WorkloadCompute:
+            parallelFor(jobSystem, computeProc, &inputs->compute, inputs->computeCount, 256);
+            break;
+        case WorkloadSkinning:
+            skinVertices(inputs->skinning.vertices, inputs->numVertices, inputs->skinning.bones, inputs->skinning.numBones,
+                         inputs->skinning.outVertices, jobSystem);
+            break;
+        case WorkloadForkJoin:
+            if(fibJobs(jobSystem, 30, 12) != 832040)
+                ++global_numFailures;
+            break;
+        default: {
+            JobCounter counter = {};
+            runJobs(jobSystem, emptyTask, 0, 1000000, &counter);
+            waitForCounter(jobSystem, &counter);
+        }
+    }
+}
+
+// Best time of several runs, in seconds
+static double timeWorkload(JobSystem* jobSystem, Workload workload, BenchInputs* inputs, Clock* clock)
+{
+    runWorkload(jobSystem, workload, inputs); // Warm up
+    double best = 1e30;
+    for(int rep=0; rep<5; ++rep){
+        double start = getClockSeconds(clock);
+        runWorkload(jobSystem, workload, inputs);
+        double elapsed = getClockSeconds(clock) - start;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxThreads = getNumLogicalProcessors();
+    if(argc > 1)
+        maxThreads = (uint32_t)strtoul(argv[1], 0, 10);
+    if(maxThreads < 1){
+        fprintf(stderr, "Usage: %s [maxThreads >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    // Tests, single threaded and with every thread
+    uint32_t testThreadCounts[2] = {1, maxThreads};
+    for(int i=0; i<2; ++i){
+        JobSystem* jobSystem = createJobSystem(testThreadCounts[i] - 1);
+        testRunJobs(jobSystem);
+        testNestedParallelFor(jobSystem);
+        testForkJoin(jobSystem);
+        testBursts(jobSystem);
+        testContinuations(jobSystem);
+        destroyJobSystem(jobSystem);
+    }
+    if(global_numFailures > 0)
+        return 1;
+    fprintf(stderr, "All tests passed\n");
+
+    BenchInputs inputs;
+    inputs.computeCount = 1 << 16;
+    float* computeInputs = (float*)malloc(inputs.computeCount * sizeof(float));
+    float* computeOutputs = (float*)malloc(inputs.computeCount * sizeof(float));
+    assert(computeInputs && computeOutputs);
+    srand(1);
+    for(uint32_t i=0; i<inputs.computeCount; ++i)
+        computeInputs[i] = (float)rand() / (float)RAND_MAX;
+    inputs.compute = {computeInputs, computeOutputs};
+
+    const uint32_t NUM_BONES = 64;
+    affine3x4 bones[NUM_BONES];
+    for(uint32_t i=0; i<NUM_BONES; ++i)
+        bones[i] = trsAffine3x4({(float)i, 0, 0}, quatFromAxisAngle({0, 1, 0}, 0.1f * i), {1, 1, 1});
+    inputs.numVertices = 1 << 20;
+    SkinnedVertexData* vertices = (SkinnedVertexData*)malloc(inputs.numVertices * sizeof(SkinnedVertexData));
+    VertexData* skinnedVertices = (VertexData*)malloc(inputs.numVertices * sizeof(VertexData));
+    assert(vertices && skinnedVertices);
+    for(uint32_t i=0; i<inputs.numVertices; ++i){
+        SkinnedVertexData* v = &vertices[i];
+        for(int c=0; c<3; ++c){
+            v->pos[c] = (float)rand() / (float)RAND_MAX;
+            v->norm[c] = (c == 1) ? 1.f : 0.f;
+        }
+        v->uv[0] = v->uv[1] = 0;
+        for(int k=0; k<SKINNING_INFLUENCES_PER_VERTEX; ++k){
+            v->boneIndices[k] = (uint8_t)(rand() % NUM_BONES);
+            v->boneWeights[k] = (k == 0) ? 255 - 3*60 : 60;
+        }
+    }
+    inputs.skinning = {vertices, bones, NUM_BONES, skinnedVertices};
+
+    double singleThreadTimes[NUM_WORKLOADS] = {};
+    Clock clock = createClock(ClockSourceOS);
+    printf("{\n");
+    uint32_t numLogicalProcessors = getNumLogicalProcessors();
+    printf("  \"logical_processors\": %u,\n", numLogicalProcessors);
+    printf("  \"scaling_measured\": %s,\n", (numLogicalProcessors > 1 && maxThreads > 1) ? "true" : "false");
+    printf("  \"results\": [\n");
+    bool first = true;
+    for(uint32_t numThreads=1; ; numThreads*=2)
+    {
+        if(numThreads > maxThreads)
+            numThreads = maxThreads;
+        JobSystem* jobSystem = createJobSystem(numThreads - 1);
+        for(int w=0; w<NUM_WORKLOADS; ++w){
+            double seconds = timeWorkload(jobSystem, (Workload)w, &inputs, &clock);
+            if(numThreads == 1)
+                singleThreadTimes[w] = seconds;
+            printf("%s    {\"workload\": \"%s\", \"threads\": %u, \"ms\": %.3f, \"speedup\": %.2f, \"oversubscribed\": %s}",
+                   first ? "" : ",\n", WORKLOAD_NAMES[w], numThreads, seconds * 1e3, singleThreadTimes[w] / seconds,
+                   numThreads > numLogicalProcessors ? "true" : "false");
+            first = false;
+            fflush(stdout);
+        }
+        destroyJobSystem(jobSystem);
+        if(numThreads == maxThreads)
+            break;
+    }
+    printf("\n  ]\n}\n");
+    return (global_numFailures > 0) ? 1 : 0;
+}
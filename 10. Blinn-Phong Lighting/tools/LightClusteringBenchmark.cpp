@@ -0,0 +1,318 @@
+// Checks and times LightClustering.h, which assigns point lights to
+// froxels of the view frustum so BlinnPhong.hlsl only loops over the
+// lights reaching each pixel.
+//
+// 1. For random light spheres (some crossing the camera plane or
+//    entirely behind it) and random points in the frustum, for every
+//    DepthMode: every light whose sphere contains a point must be in the
+//    list of the cluster findCluster() gives for it, lists must be
+//    ascending and inside the index array, the job system must give the
+//    same lists as one thread, and shading a point with its cluster's
+//    lights must match shading it with every light. Also a few lights,
+//    which leave most clusters empty, coarser grids and no lights.
+// 2. Too small an index array drops light/cluster pairs and says so.
+// 3. Times assigning 256, 1024 and 2048 lights to the sample's 16x9x24
+//    grid on one thread and on the job system, and reports how many
+//    lights a point in the frustum is left with.
+//
+// The SIMD level is whatever 3DMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh):
+//   c++ -O2 -mavx2 -mfma LightClusteringBenchmark.cpp ../LightClustering.cpp ../BlinnPhongShading.cpp ../JobSystem.cpp
+//       ../Threading.cpp ../Timing.cpp -pthread -o LightClusteringBenchmark
+// Usage: LightClusteringBenchmark
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../LightClustering.h"
+#include "../BlinnPhongShading.h"
+#include "../JobSystem.h"
+#include "../Timing.h"
+#include "Check.h"
+
+// Same as FrameRenderer.cpp
+static const uint32_t TILES_X = 16;
+static const uint32_t TILES_Y = 9;
+static const uint32_t NUM_SLICES = 24;
+static const float CLUSTER_NEAR_Z = 0.5f;
+static const float CLUSTER_FAR_Z = 100.f;
+static const uint32_t MAX_LIGHT_INDICES = 4096 * 8;
+static const uint32_t MAX_LIGHTS = 2048;
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+// Eye-space point at 'depth' in front of the camera which projects to
+// ndc (x, y)
+static float3 pointAtNdc(const ClusterGrid* grid, float x, float y, float depth)
+{
+    // clip = projX.x * eyeX + projX.z * eyeZ + projX.w = ndc * w, and
+    // the same for y (see makeClusterGrid())
+    float4 pos = { 0.f, 0.f, -depth, 1.f };
+    float w = dot(pos, grid->projW);
+    return { (x * w - dot(pos, grid->projX)) / grid->projX.x, (y * w - dot(pos, grid->projY)) / grid->projY.y, -depth };
+}
+
+static float3 randomPointInFrustum(const ClusterGrid* grid, float minDepth, float maxDepth)
+{
+    // Uniform in log(depth), like the slices
+    float depth = minDepth * powf(maxDepth / minDepth, randomFloat(0.f, 1.f));
+    return pointAtNdc(grid, randomFloat(-0.999f, 0.999f), randomFloat(-0.999f, 0.999f), depth);
+}
+
+struct Lights
+{
+    uint32_t count;
+    float posX[MAX_LIGHTS], posY[MAX_LIGHTS], posZ[MAX_LIGHTS], radius[MAX_LIGHTS];
+    BlinnPhongPointLight shading[MAX_LIGHTS];
+};
+
+// 'count' lights in (and a little outside) the frustum up to 'maxDepth'.
+// With 'nearCamera', every 16th is around or behind the camera instead.
+static void makeRandomLights(Lights* lights, const ClusterGrid* grid, uint32_t count, float minRadius, float maxRadius, float maxDepth,
+                             bool nearCamera)
+{
+    lights->count = count;
+    for(uint32_t i=0; i<count; ++i)
+    {
+        float3 pos = pointAtNdc(grid, randomFloat(-1.2f, 1.2f), randomFloat(-1.2f, 1.2f), randomFloat(0.1f, maxDepth));
+        float radius = randomFloat(minRadius, maxRadius);
+        if(nearCamera && i % 16 == 0)
+            pos = { randomFloat(-3.f, 3.f), randomFloat(-3.f, 3.f), randomFloat(-2.f, 4.f) };
+        lights->posX[i] = pos.x;
+        lights->posY[i] = pos.y;
+        lights->posZ[i] = pos.z;
+        lights->radius[i] = radius;
+        lights->shading[i].posEye = { pos.x, pos.y, pos.z, radius };
+        lights->shading[i].color = { randomFloat(0.f, 1.f), randomFloat(0.f, 1.f), randomFloat(0.f, 1.f), 1.f };
+    }
+}
+
+static ClusterLightSpheres getSpheres(const Lights* lights)
+{
+    ClusterLightSpheres spheres = { lights->posX, lights->posY, lights->posZ, lights->radius, lights->count };
+    return spheres;
+}
+
+static bool clusterHasLight(const LightClusters* clusters, uint32_t cluster, uint32_t light)
+{
+    const uint16_t* indices = clusters->lightIndices + clusters->offsets[cluster];
+    for(uint32_t i=0; i<clusters->counts[cluster]; ++i)
+        if(indices[i] == light)
+            return true;
+    return false;
+}
+
+// Lists are ascending, in range and laid out one after another
+static bool listsAreValid(const LightClusters* clusters, uint32_t numClusters, uint32_t numLights)
+{
+    uint32_t offset = 0;
+    for(uint32_t c=0; c<numClusters; ++c)
+    {
+        if(clusters->offsets[c] != offset)
+            return false;
+        const uint16_t* indices = clusters->lightIndices + offset;
+        for(uint32_t i=0; i<clusters->counts[c]; ++i)
+            if(indices[i] >= numLights || (i > 0 && indices[i] <= indices[i - 1]))
+                return false;
+        offset += clusters->counts[c];
+    }
+    return offset == clusters->numLightIndices && offset <= clusters->maxLightIndices;
+}
+
+static bool sameLists(const LightClusters* a, const LightClusters* b, uint32_t numClusters)
+{
+    return a->numLightIndices == b->numLightIndices &&
+           memcmp(a->offsets, b->offsets, numClusters * sizeof(uint32_t)) == 0 &&
+           memcmp(a->counts, b->counts, numClusters * sizeof(uint32_t)) == 0 &&
+           memcmp(a->lightIndices, b->lightIndices, a->numLightIndices * sizeof(uint16_t)) == 0;
+}
+
+// Points in the frustum, beyond farZ too to cover the unbounded last
+// slice, inside a light which isn't in their cluster's list
+static uint32_t countMissedLights(const LightClusters* clusters, const ClusterGrid* grid, const Lights* lights, uint32_t numPoints)
+{
+    uint32_t numMissed = 0;
+    for(uint32_t p=0; p<numPoints; ++p)
+    {
+        float3 point = randomPointInFrustum(grid, 0.1f, 200.f);
+        uint32_t cluster = findCluster(grid, point);
+        for(uint32_t i=0; i<lights->count; ++i){
+            float3 toLight = { lights->posX[i] - point.x, lights->posY[i] - point.y, lights->posZ[i] - point.z };
+            // Slightly inside, lights just touching may go either way
+            if(length(toLight) < lights->radius[i] * 0.999f && !clusterHasLight(clusters, cluster, i))
+                ++numMissed;
+        }
+    }
+    return numMissed;
+}
+
+static void checkClustering(JobSystem* jobSystem, Lights* lights)
+{
+    const DepthMode DEPTH_MODES[] = { DepthModeStandard, DepthModeReverseZ, DepthModeInfiniteReverseZ };
+    LightClusters serial = allocLightClusters(TILES_X, TILES_Y, NUM_SLICES, MAX_LIGHTS, MAX_LIGHT_INDICES);
+    LightClusters parallel = allocLightClusters(TILES_X, TILES_Y, NUM_SLICES, MAX_LIGHTS, MAX_LIGHT_INDICES);
+    const uint32_t NUM_POINTS = 20000;
+    for(uint32_t m=0; m<sizeof(DEPTH_MODES) / sizeof(DEPTH_MODES[0]); ++m)
+    {
+        float4x4 projection = makePerspectiveMat(DEPTH_MODES[m], 16.f / 9.f, degreesToRadians(84), 0.1f, 1000.f);
+        ClusterGrid grid = makeClusterGrid(projection, CLUSTER_NEAR_Z, CLUSTER_FAR_Z, TILES_X, TILES_Y, NUM_SLICES);
+        uint32_t numClusters = clusterGridSize(&grid);
+        makeRandomLights(lights, &grid, 300, 0.2f, 6.f, 140.f, true);
+        ClusterLightSpheres spheres = getSpheres(lights);
+        assignLightsToClusters(&serial, &grid, &spheres, 0);
+        assignLightsToClusters(&parallel, &grid, &spheres, jobSystem);
+        CHECK(serial.numDroppedIndices == 0);
+        CHECK(listsAreValid(&serial, numClusters, lights->count));
+        CHECK(sameLists(&serial, &parallel, numClusters));
+
+        CHECK(countMissedLights(&serial, &grid, lights, NUM_POINTS) == 0);
+
+        BlinnPhongLights allLights = { normalise(float4{1.f, 1.f, 1.f, 0.f}), {0.7f, 0.8f, 0.2f, 1.f}, lights->shading, 0, lights->count };
+        BlinnPhongLights clusterLights = allLights;
+        uint32_t numShadingDifferences = 0;
+        for(uint32_t p=0; p<NUM_POINTS; ++p)
+        {
+            float3 point = randomPointInFrustum(&grid, 0.1f, 200.f);
+            uint32_t cluster = findCluster(&grid, point);
+
+            // Lights are left out only where they add exactly 0, and the
+            // lists keep the lights' order, so the sums are identical
+            clusterLights.pointLightIndices = serial.lightIndices + serial.offsets[cluster];
+            clusterLights.numPointLights = serial.counts[cluster];
+            float3 normal = normalise(float3{randomFloat(-1.f, 1.f), randomFloat(-1.f, 1.f), randomFloat(0.1f, 1.f)});
+            float3 diffuse = {1.f, 1.f, 1.f};
+            float3 expected = shadeBlinnPhongReference(&allLights, point, normal, diffuse);
+            float3 clustered = shadeBlinnPhongReference(&clusterLights, point, normal, diffuse);
+            if(clustered.x != expected.x || clustered.y != expected.y || clustered.z != expected.z)
+                ++numShadingDifferences;
+        }
+        CHECK(numShadingDifferences == 0);
+    }
+
+    // A few small lights leave most slices and tiles empty, which are
+    // skipped. The same LightClusters also takes a coarser grid, down to
+    // the single cluster FrameRenderer uses for a handful of lights, and
+    // no lights at all.
+    {
+        float4x4 projection = makePerspectiveMat(DepthModeInfiniteReverseZ, 16.f / 9.f, degreesToRadians(84), 0.1f, 1000.f);
+        const uint32_t GRIDS[3][3] = { {TILES_X, TILES_Y, NUM_SLICES}, {4, 3, 8}, {1, 1, 1} };
+        for(int g=0; g<3; ++g)
+        {
+            ClusterGrid grid = makeClusterGrid(projection, CLUSTER_NEAR_Z, CLUSTER_FAR_Z, GRIDS[g][0], GRIDS[g][1], GRIDS[g][2]);
+            uint32_t numClusters = clusterGridSize(&grid);
+            makeRandomLights(lights, &grid, 5, 0.2f, 1.f, 140.f, true);
+            ClusterLightSpheres spheres = getSpheres(lights);
+            assignLightsToClusters(&serial, &grid, &spheres, 0);
+            assignLightsToClusters(&parallel, &grid, &spheres, jobSystem);
+            CHECK(listsAreValid(&serial, numClusters, lights->count));
+            CHECK(sameLists(&serial, &parallel, numClusters));
+            CHECK(countMissedLights(&serial, &grid, lights, NUM_POINTS) == 0);
+            if(g == 0){
+                uint32_t numEmpty = 0;
+                for(uint32_t c=0; c<numClusters; ++c)
+                    numEmpty += (serial.counts[c] == 0);
+                CHECK(numEmpty > numClusters / 2);
+            }
+
+            spheres.count = 0;
+            assignLightsToClusters(&serial, &grid, &spheres, jobSystem);
+            CHECK(serial.numLightIndices == 0 && serial.numDroppedIndices == 0);
+            CHECK(listsAreValid(&serial, numClusters, 0));
+        }
+    }
+
+    // Too many indices: the later clusters' lists are cut short
+    {
+        float4x4 projection = makePerspectiveMat(DepthModeInfiniteReverseZ, 16.f / 9.f, degreesToRadians(84), 0.1f, 1000.f);
+        ClusterGrid grid = makeClusterGrid(projection, CLUSTER_NEAR_Z, CLUSTER_FAR_Z, TILES_X, TILES_Y, NUM_SLICES);
+        uint32_t numClusters = clusterGridSize(&grid);
+        LightClusters small = allocLightClusters(TILES_X, TILES_Y, NUM_SLICES, MAX_LIGHTS, 1000);
+        makeRandomLights(lights, &grid, 300, 0.2f, 6.f, 140.f, true);
+        ClusterLightSpheres spheres = getSpheres(lights);
+        assignLightsToClusters(&serial, &grid, &spheres, 0);
+        assignLightsToClusters(&small, &grid, &spheres, jobSystem);
+        CHECK(serial.numLightIndices > 1000);
+        CHECK(small.numLightIndices == 1000);
+        CHECK(small.numDroppedIndices == serial.numLightIndices - 1000);
+        CHECK(listsAreValid(&small, numClusters, lights->count));
+        freeLightClusters(small);
+    }
+    freeLightClusters(serial);
+    freeLightClusters(parallel);
+}
+
+struct Timings
+{
+    double serialMs, parallelMs;
+    uint32_t numLightIndices, numDroppedIndices;
+    double averageLightsPerPoint;
+};
+
+// Best of a few runs
+static Timings timeClustering(JobSystem* jobSystem, Lights* lights, uint32_t numLights, Clock* clock)
+{
+    float4x4 projection = makePerspectiveMat(DepthModeInfiniteReverseZ, 16.f / 9.f, degreesToRadians(84), 0.1f, 1000.f);
+    ClusterGrid grid = makeClusterGrid(projection, CLUSTER_NEAR_Z, CLUSTER_FAR_Z, TILES_X, TILES_Y, NUM_SLICES);
+    LightClusters clusters = allocLightClusters(TILES_X, TILES_Y, NUM_SLICES, MAX_LIGHTS, MAX_LIGHT_INDICES);
+    makeRandomLights(lights, &grid, numLights, 0.3f, 2.f, CLUSTER_FAR_Z, false);
+    ClusterLightSpheres spheres = getSpheres(lights);
+
+    Timings timings;
+    for(int parallel=0; parallel<2; ++parallel)
+    {
+        double best = 1e30;
+        for(int run=0; run<20; ++run){
+            double start = getClockSeconds(clock);
+            assignLightsToClusters(&clusters, &grid, &spheres, parallel ? jobSystem : 0);
+            double elapsed = getClockSeconds(clock) - start;
+            best = (elapsed < best) ? elapsed : best;
+        }
+        (parallel ? timings.parallelMs : timings.serialMs) = 1000.0 * best;
+    }
+    timings.numLightIndices = clusters.numLightIndices;
+    timings.numDroppedIndices = clusters.numDroppedIndices;
+
+    const uint32_t NUM_POINTS = 10000;
+    uint64_t totalLights = 0;
+    for(uint32_t p=0; p<NUM_POINTS; ++p)
+        totalLights += clusters.counts[findCluster(&grid, randomPointInFrustum(&grid, 1.f, CLUSTER_FAR_Z))];
+    timings.averageLightsPerPoint = (double)totalLights / NUM_POINTS;
+    freeLightClusters(clusters);
+    return timings;
+}
+
+int main()
+{
+    JobSystem* jobSystem = createJobSystem(0);
+    Lights* lights = (Lights*)malloc(sizeof(Lights));
+    srand(1);
+    checkClustering(jobSystem, lights);
+
+    Clock clock = createClock(ClockSourceOS);
+    const uint32_t LIGHT_COUNTS[] = { 256, 1024, 2048 };
+    const uint32_t NUM_COUNTS = sizeof(LIGHT_COUNTS) / sizeof(LIGHT_COUNTS[0]);
+    printf("{\n  \"grid\": [%u, %u, %u],\n  \"threads\": %u,\n", TILES_X, TILES_Y, NUM_SLICES, getNumJobThreads(jobSystem));
+    printf("  \"results\": [\n");
+    for(uint32_t i=0; i<NUM_COUNTS; ++i)
+    {
+        Timings timings = timeClustering(jobSystem, lights, LIGHT_COUNTS[i], &clock);
+        CHECK(timings.numDroppedIndices == 0);
+        printf("    {\"lights\": %u, \"serial_ms\": %.3f, \"job_system_ms\": %.3f, \"light_indices\": %u, \"dropped_indices\": %u, "
+               "\"average_lights_per_point\": %.1f}%s\n",
+               LIGHT_COUNTS[i], timings.serialMs, timings.parallelMs, timings.numLightIndices, timings.numDroppedIndices,
+               timings.averageLightsPerPoint, i + 1 < NUM_COUNTS ? "," : "");
+    }
+    printf("  ],\n  \"failures\": %d\n}\n", numFailures);
+
+    free(lights);
+    destroyJobSystem(jobSystem);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+// Microbenchmarks for 3DMaths.h and the batch kernels built on it.
+//
+// Every primitive is timed two ways:
+//   latency:    each call takes the previous call's result as input, so
+//               the time per op is the length of the dependency chain
+//   throughput: independent calls over large arrays, so the time per op
+//               is limited by execution ports and memory bandwidth
+// Results are printed as JSON (ns/op, plus GB/s for the bulk
+// converters) so runs from different compilers, CPUs and SIMD levels
+// can be compared. The SIMD level is whatever 3DMaths.h picks from the
+// compiler flags; define MATHS_NO_SIMD for the scalar baseline.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   g++ -O2 MathsBenchmark.cpp ../FormatConversion.cpp ../TransformBatch.cpp ../Timing.cpp -o MathsBenchmark
+// Usage: MathsBenchmark [arrayCount] > results.json
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../3DMaths.h"
+#include "../SimdMaths.h"
+#include "../FormatConversion.h"
+#include "../TransformBatch.h"
+#include "../Timing.h"
+
+// Forces 'p' to be written to memory and treated as modified, so the
+// compiler can't fold or drop the work that produced it
+#if defined(_MSC_VER)
+#include <intrin.h>
+static void clobber(void* p) { static void* volatile sink; sink = p; _ReadWriteBarrier(); }
+#else
+static void clobber(void* p) { asm volatile("" : : "g"(p) : "memory"); }
+#endif
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    return "avx+fma";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static const char* compilerName()
+{
+    static char name[128];
+#if defined(__clang__)
+    snprintf(name, sizeof(name), "clang %d.%d.%d", __clang_major__, __clang_minor__, __clang_patchlevel__);
+#elif defined(__GNUC__)
+    snprintf(name, sizeof(name), "gcc %d.%d.%d", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
+#elif defined(_MSC_VER)
+    snprintf(name, sizeof(name), "msvc %d", _MSC_FULL_VER);
+#else
+    snprintf(name, sizeof(name), "unknown");
+#endif
+    return name;
+}
+
+// Shared inputs and outputs. Arrays hold 'count' elements.
+struct BenchData
+{
+    size_t count;
+    float4x4* matsA;
+    float4x4* matsB;
+    float4x4* matsOut;
+    float4x4* matsOut2;
+    float3x3* mats3x3Out;
+    float4* vecs;
+    float4* vecsOut;
+    float3* vec3s;
+    float3* vec3sOut;
+    float* floats;       // 4 * count floats, in [-1, 1]
+    float* floatsOut;
+    float* floatsOut2;
+    uint16_t* halfs;     // 4 * count
+    uint8_t* bytes;      // 4 * count
+    TransformSoA transforms;
+    float checksum;      // Results get folded in here so nothing is dead code
+};
+
+// Runs the benchmark body 'iterations' times; returns nothing, results
+// go to 'data'
+typedef void BenchProc(BenchData* data, size_t iterations);
+
+struct Benchmark
+{
+    const char* name;
+    const char* pattern;  // "latency" or "throughput"
+    BenchProc* proc;
+    size_t opsPerIteration; // Ops per unit of 'iterations', 0 means data->count
+    size_t bytesPerOp;      // Memory traffic for GB/s, 0 to skip
+};
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static float4x4 randomRotationMat()
+{
+    float3 axis = normalise(float3{randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1) + 2.f});
+    return rotationMat(quatFromAxisAngle(axis, randomFloat(-3, 3)));
+}
+
+//
+// Latency benchmarks: one long dependency chain
+//
+
+static void benchMatMulLatency(BenchData* data, size_t iterations)
+{
+    float4x4 m = data->matsA[0];
+    float4x4 rotation = data->matsB[0];
+    for(size_t i=0; i<iterations; ++i)
+        m = m * rotation;
+    data->checksum += m.m[0][0];
+}
+
+static void benchTransposeLatency(BenchData* data, size_t iterations)
+{
+    float4x4 m = data->matsA[0];
+    for(size_t i=0; i<iterations; ++i){
+        m = transpose(m);
+        clobber(&m); // transpose(transpose(m)) would fold away otherwise
+    }
+    data->checksum += m.m[0][1];
+}
+
+static void benchNormaliseLatency(BenchData* data, size_t iterations)
+{
+    float4 v = data->vecs[0];
+    float4 offset = {1e-3f, 2e-3f, 3e-3f, 4e-3f};
+    for(size_t i=0; i<iterations; ++i){
+        v = normalise(v);
+        v = {v.x + offset.x, v.y + offset.y, v.z + offset.z, v.w + offset.w};
+    }
+    data->checksum += v.x;
+}
+
+static void benchCrossLatency(BenchData* data, size_t iterations)
+{
+    // v is perpendicular to the unit axis, so crossing keeps its length
+    float3 axis = normalise(data->vec3s[1]);
+    float3 v = cross(axis, data->vec3s[0]);
+    for(size_t i=0; i<iterations; ++i)
+        v = cross(v, axis);
+    data->checksum += v.x;
+}
+
+static void benchVecMatMulLatency(BenchData* data, size_t iterations)
+{
+    float4 v = data->vecs[0];
+    float4x4 rotation = data->matsB[0];
+    for(size_t i=0; i<iterations; ++i)
+        v = v * rotation;
+    data->checksum += v.x;
+}
+
+static void benchPerspectiveLatency(BenchData* data, size_t iterations)
+{
+    float aspectRatio = 1.5f;
+    for(size_t i=0; i<iterations; ++i){
+        float4x4 m = makePerspectiveMat(aspectRatio, 1.4f, 0.1f, 1000.f);
+        aspectRatio = 1.5f + m.m[0][0] * 1e-6f;
+    }
+    data->checksum += aspectRatio;
+}
+
+static void benchToFloat3x3Latency(BenchData* data, size_t iterations)
+{
+    float4x4 m = data->matsA[0];
+    for(size_t i=0; i<iterations; ++i){
+        float3x3 m3 = float4x4ToFloat3x3(m);
+        m.m[0][0] = m3.m[1][1] + 1e-6f;
+        clobber(&m);
+    }
+    data->checksum += m.m[0][0];
+}
+
+static void benchInverseLatency(BenchData* data, size_t iterations)
+{
+    float4x4 m = data->matsA[0];
+    for(size_t i=0; i<iterations; ++i)
+        m = inverse(m);
+    data->checksum += m.m[0][0];
+}
+
+static void benchSinCosLatency(BenchData* data, size_t iterations)
+{
+    float angle = 0.5f;
+    for(size_t i=0; i<iterations; ++i){
+        float s = 0, c = 0;
+        sinCos(angle, &s, &c);
+        angle = s + c;
+    }
+    data->checksum += angle;
+}
+
+static void benchLibmSinCosLatency(BenchData* data, size_t iterations)
+{
+    float angle = 0.5f;
+    for(size_t i=0; i<iterations; ++i)
+        angle = sinf(angle) + cosf(angle);
+    data->checksum += angle;
+}
+
+//
+// Throughput benchmarks: independent ops over arrays
+//
+
+static void benchMatMulThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=0; i<data->count; ++i)
+            data->matsOut[i] = data->matsA[i] * data->matsB[i];
+    data->checksum += data->matsOut[0].m[0][0];
+}
+
+static void benchTransposeThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=0; i<data->count; ++i)
+            data->matsOut[i] = transpose(data->matsA[i]);
+    data->checksum += data->matsOut[0].m[0][1];
+}
+
+static void benchNormaliseThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=0; i<data->count; ++i)
+            data->vecsOut[i] = normalise(data->vecs[i]);
+    data->checksum += data->vecsOut[0].x;
+}
+
+static void benchCrossThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=1; i<data->count; ++i)
+            data->vec3sOut[i] = cross(data->vec3s[i-1], data->vec3s[i]);
+    data->checksum += data->vec3sOut[1].x;
+}
+
+static void benchVecMatMulThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=0; i<data->count; ++i)
+            data->vecsOut[i] = data->vecs[i] * data->matsA[i];
+    data->checksum += data->vecsOut[0].x;
+}
+
+static void benchPerspectiveThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=0; i<data->count; ++i)
+            data->matsOut[i] = makePerspectiveMat(1.f + data->floats[i] * 0.5f, 1.4f, 0.1f, 1000.f);
+    data->checksum += data->matsOut[0].m[0][0];
+}
+
+static void benchToFloat3x3Throughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=0; i<data->count; ++i)
+            data->mats3x3Out[i] = float4x4ToFloat3x3(data->matsA[i]);
+    data->checksum += data->mats3x3Out[0].m[0][0];
+}
+
+static void benchInverseThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=0; i<data->count; ++i)
+            data->matsOut[i] = inverse(data->matsA[i]);
+    data->checksum += data->matsOut[0].m[0][0];
+}
+
+static void benchSinCosBatchThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        sinCosBatch(data->floats, data->floatsOut, data->floatsOut2, data->count);
+    data->checksum += data->floatsOut[0];
+}
+
+static void benchLibmSinCosThroughput(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        for(size_t i=0; i<data->count; ++i){
+            data->floatsOut[i] = sinf(data->floats[i]);
+            data->floatsOut2[i] = cosf(data->floats[i]);
+        }
+    data->checksum += data->floatsOut[0];
+}
+
+static void benchTransformBatchThroughput(BenchData* data, size_t iterations)
+{
+    float4x4 viewMat = data->matsB[0];
+    float4x4 projMat = makePerspectiveMat(1.5f, 1.4f, 0.1f, 1000.f);
+    for(size_t it=0; it<iterations; ++it)
+        computeTransformsBatch(&data->transforms, viewMat, projMat, data->matsOut, data->matsOut2, data->mats3x3Out);
+    data->checksum += data->matsOut[0].m[0][0];
+}
+
+// Bulk converters work on 4 * count values
+static void benchFloatToHalf(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        floatToHalfArray(data->floats, data->halfs, 4 * data->count);
+    data->checksum += data->halfs[0];
+}
+
+static void benchHalfToFloat(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        halfToFloatArray(data->halfs, data->floatsOut, 4 * data->count);
+    data->checksum += data->floatsOut[0];
+}
+
+static void benchFloatToUnorm8(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        floatToUnorm8Array(data->floats, data->bytes, 4 * data->count);
+    data->checksum += data->bytes[0];
+}
+
+static void benchUnorm8ToFloat(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        unorm8ToFloatArray(data->bytes, data->floatsOut, 4 * data->count);
+    data->checksum += data->floatsOut[0];
+}
+
+static void benchFloatToUnorm16(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        floatToUnorm16Array(data->floats, data->halfs, 4 * data->count);
+    data->checksum += data->halfs[0];
+}
+
+static void benchUnorm16ToFloat(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        unorm16ToFloatArray(data->halfs, data->floatsOut, 4 * data->count);
+    data->checksum += data->floatsOut[0];
+}
+
+static void benchFloatToSnorm8(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        floatToSnorm8Array(data->floats, (int8_t*)data->bytes, 4 * data->count);
+    data->checksum += data->bytes[0];
+}
+
+static void benchSnorm8ToFloat(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        snorm8ToFloatArray((const int8_t*)data->bytes, data->floatsOut, 4 * data->count);
+    data->checksum += data->floatsOut[0];
+}
+
+static void benchFloatToSnorm16(BenchData* data, size_t iterations)
+{
+    for(size_t it=0; it<iterations; ++it)
+        floatToSnorm16Array(data->floats, (int16_t*)data->halfs, 4 * data->count);
+    data->checksum += data->halfs[0];
+}
+
+// Times 'bench', picking an iteration count that runs for at least
+// 'minSeconds', and returns the best ns/op of several repeats
+static double runBenchmark(const Benchmark* bench, BenchData* data, double minSeconds, Clock* clock)
+{
+    size_t opsPerIteration = bench->opsPerIteration ? bench->opsPerIteration : data->count;
+
+    size_t iterations = 1;
+    for(;;){
+        double start = getClockSeconds(clock);
+        bench->proc(data, iterations);
+        double elapsed = getClockSeconds(clock) - start;
+        if(elapsed >= minSeconds)
+            break;
+        iterations *= (elapsed < minSeconds / 8) ? 8 : 2;
+    }
+
+    const int NUM_REPEATS = 5;
+    double bestNsPerOp = HUGE_VAL;
+    for(int r=0; r<NUM_REPEATS; ++r){
+        double start = getClockSeconds(clock);
+        bench->proc(data, iterations);
+        double elapsed = getClockSeconds(clock) - start;
+        double nsPerOp = 1e9 * elapsed / ((double)iterations * (double)opsPerIteration);
+        if(nsPerOp < bestNsPerOp)
+            bestNsPerOp = nsPerOp;
+    }
+    return bestNsPerOp;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 1 << 16;
+    if(argc > 1)
+        count = (size_t)strtoul(argv[1], 0, 10);
+    if(count < 2){
+        fprintf(stderr, "Usage: %s [arrayCount >= 2]\n", argv[0]);
+        return 1;
+    }
+
+    BenchData data = {};
+    data.count = count;
+    data.matsA = (float4x4*)malloc(count * sizeof(float4x4));
+    data.matsB = (float4x4*)malloc(count * sizeof(float4x4));
+    data.matsOut = (float4x4*)malloc(count * sizeof(float4x4));
+    data.matsOut2 = (float4x4*)malloc(count * sizeof(float4x4));
+    data.mats3x3Out = (float3x3*)malloc(count * sizeof(float3x3));
+    data.vecs = (float4*)malloc(count * sizeof(float4));
+    data.vecsOut = (float4*)malloc(count * sizeof(float4));
+    data.vec3s = (float3*)malloc(count * sizeof(float3));
+    data.vec3sOut = (float3*)malloc(count * sizeof(float3));
+    data.floats = (float*)malloc(4 * count * sizeof(float));
+    data.floatsOut = (float*)malloc(4 * count * sizeof(float));
+    data.floatsOut2 = (float*)malloc(4 * count * sizeof(float));
+    data.halfs = (uint16_t*)malloc(4 * count * sizeof(uint16_t));
+    data.bytes = (uint8_t*)malloc(4 * count * sizeof(uint8_t));
+    data.transforms = allocTransformSoA((uint32_t)count);
+    assert(data.matsA && data.matsB && data.matsOut && data.matsOut2 && data.mats3x3Out && data.vecs && data.vecsOut &&
+           data.vec3s && data.vec3sOut && data.floats && data.floatsOut && data.floatsOut2 && data.halfs && data.bytes);
+
+    srand(1);
+    for(size_t i=0; i<count; ++i){
+        // Rotation + translation, so chains of multiplies and inverses stay bounded
+        data.matsA[i] = randomRotationMat() * translationMat({randomFloat(-5, 5), randomFloat(-5, 5), randomFloat(-5, 5)});
+        data.matsB[i] = randomRotationMat();
+        data.vecs[i] = {randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1), 1};
+        data.vec3s[i] = {randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(1, 2)};
+
+        quat q = quatFromAxisAngle(normalise(data.vec3s[i]), randomFloat(-3, 3));
+        data.transforms.posX[i] = randomFloat(-50, 50);
+        data.transforms.posY[i] = randomFloat(-50, 50);
+        data.transforms.posZ[i] = randomFloat(-50, 50);
+        data.transforms.rotX[i] = q.x;
+        data.transforms.rotY[i] = q.y;
+        data.transforms.rotZ[i] = q.z;
+        data.transforms.rotW[i] = q.w;
+        data.transforms.scaleX[i] = randomFloat(0.5f, 2);
+        data.transforms.scaleY[i] = randomFloat(0.5f, 2);
+        data.transforms.scaleZ[i] = randomFloat(0.5f, 2);
+    }
+    for(size_t i=0; i<4*count; ++i)
+        data.floats[i] = randomFloat(-1, 1);
+    floatToHalfArray(data.floats, data.halfs, 4 * count);
+    floatToUnorm8Array(data.floats, data.bytes, 4 * count);
+
+    Benchmark benchmarks[] = {
+        {"float4x4 * float4x4",     "latency",    benchMatMulLatency,       1, 0},
+        {"transpose(float4x4)",     "latency",    benchTransposeLatency,    1, 0},
+        {"normalise(float4)",       "latency",    benchNormaliseLatency,    1, 0},
+        {"cross(float3)",           "latency",    benchCrossLatency,        1, 0},
+        {"float4 * float4x4",       "latency",    benchVecMatMulLatency,    1, 0},
+        {"makePerspectiveMat",      "latency",    benchPerspectiveLatency,  1, 0},
+        {"float4x4ToFloat3x3",      "latency",    benchToFloat3x3Latency,   1, 0},
+        {"inverse(float4x4)",       "latency",    benchInverseLatency,      1, 0},
+        {"sinCos",                  "latency",    benchSinCosLatency,       1, 0},
+        {"sinf + cosf",             "latency",    benchLibmSinCosLatency,   1, 0},
+
+        {"float4x4 * float4x4",     "throughput", benchMatMulThroughput,      0, 3 * sizeof(float4x4)},
+        {"transpose(float4x4)",     "throughput", benchTransposeThroughput,   0, 2 * sizeof(float4x4)},
+        {"normalise(float4)",       "throughput", benchNormaliseThroughput,   0, 2 * sizeof(float4)},
+        {"cross(float3)",           "throughput", benchCrossThroughput,       0, 2 * sizeof(float3)},
+        {"float4 * float4x4",       "throughput", benchVecMatMulThroughput,   0, 2 * sizeof(float4) + sizeof(float4x4)},
+        {"makePerspectiveMat",      "throughput", benchPerspectiveThroughput, 0, sizeof(float) + sizeof(float4x4)},
+        {"float4x4ToFloat3x3",      "throughput", benchToFloat3x3Throughput,  0, sizeof(float4x4) + sizeof(float3x3)},
+        {"inverse(float4x4)",       "throughput", benchInverseThroughput,     0, 2 * sizeof(float4x4)},
+        {"sinCosBatch",             "throughput", benchSinCosBatchThroughput, 0, 3 * sizeof(float)},
+        {"sinf + cosf",             "throughput", benchLibmSinCosThroughput,  0, 3 * sizeof(float)},
+        {"computeTransformsBatch",  "throughput", benchTransformBatchThroughput, 0, 10 * sizeof(float) + 2 * sizeof(float4x4) + sizeof(float3x3)},
+        {"floatToHalfArray",        "throughput", benchFloatToHalf,    4 * count, sizeof(float) + sizeof(uint16_t)},
+        {"halfToFloatArray",        "throughput", benchHalfToFloat,    4 * count, sizeof(float) + sizeof(uint16_t)},
+        {"floatToUnorm8Array",      "throughput", benchFloatToUnorm8,  4 * count, sizeof(float) + sizeof(uint8_t)},
+        {"unorm8ToFloatArray",      "throughput", benchUnorm8ToFloat,  4 * count, sizeof(float) + sizeof(uint8_t)},
+        {"floatToUnorm16Array",     "throughput", benchFloatToUnorm16, 4 * count, sizeof(float) + sizeof(uint16_t)},
+        {"unorm16ToFloatArray",     "throughput", benchUnorm16ToFloat, 4 * count, sizeof(float) + sizeof(uint16_t)},
+        {"floatToSnorm8Array",      "throughput", benchFloatToSnorm8,  4 * count, sizeof(float) + sizeof(int8_t)},
+        {"snorm8ToFloatArray",      "throughput", benchSnorm8ToFloat,  4 * count, sizeof(float) + sizeof(int8_t)},
+        {"floatToSnorm16Array",     "throughput", benchFloatToSnorm16, 4 * count, sizeof(float) + sizeof(int16_t)},
+    };
+    const int NUM_BENCHMARKS = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+    Clock clock = createClock(ClockSourceOS);
+    printf("{\n");
+    printf("  \"compiler\": \"%s\",\n", compilerName());
+    printf("  \"simd\": \"%s\",\n", simdLevelName());
+    printf("  \"array_count\": %zu,\n", count);
+    printf("  \"results\": [\n");
+    for(int i=0; i<NUM_BENCHMARKS; ++i)
+    {
+        const Benchmark* bench = &benchmarks[i];
+        double nsPerOp = runBenchmark(bench, &data, 0.05, &clock);
+        printf("    {\"name\": \"%s\", \"pattern\": \"%s\", \"ns_per_op\": %.4f, \"mops_per_s\": %.2f",
+               bench->name, bench->pattern, nsPerOp, 1e3 / nsPerOp);
+        if(bench->bytesPerOp)
+            printf(", \"gb_per_s\": %.3f", (double)bench->bytesPerOp / nsPerOp);
+        printf("}%s\n", (i + 1 < NUM_BENCHMARKS) ? "," : "");
+        fflush(stdout);
+    }
+    printf("  ],\n");
+    // Printed so the compiler has to compute every result
+    printf("  \"checksum\": \"%g\"\n", (double)data.checksum);
+    printf("}\n");
+    return 0;
+}
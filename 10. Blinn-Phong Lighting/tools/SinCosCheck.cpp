@@ -0,0 +1,277 @@
+// Checks and times sinCos() from 3DMaths.h and sinCosBatch() from
+// SimdMaths.h against sinf()/cosf().
+//
+// 1. Max absolute error of both against double precision sin()/cos():
+//    every float in [-4, 4] with a step of 2^-16 (that covers the first
+//    few quadrants finely), random angles up to |rad| = 8192 (the
+//    documented range) and a few exact values (0, multiples of pi/2).
+//    Both must stay within the documented 1e-7 plus the rounding of the
+//    result to float. The batch is run on every count up to
+//    3*WFLOAT_WIDTH+1 so the scalar tail is covered too, and must not
+//    write past 'count'.
+// 2. Times sinCos() against sinf() + cosf() in ns per angle, as a chain
+//    where every angle depends on the last result (latency) and over an
+//    array (throughput, where sinCosBatch() gets used).
+//
+// The SIMD level is whatever SimdMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   c++ -O2 SinCosCheck.cpp ../Timing.cpp -o SinCosCheck
+// Usage: SinCosCheck [count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../3DMaths.h"
+#include "../SimdMaths.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    return "avx+fma";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+// The documented error plus half an ulp of 1.0 for rounding the result
+static const double MAX_ERROR = 1e-7 + 6e-8;
+
+struct Errors
+{
+    double scalar;
+    double batch;
+    float worstAngle; // For the report when a check fails
+};
+
+// Largest error of sin and cos for one angle, NaN-safe
+static double angleError(float rad, float s, float c)
+{
+    double sinError = fabs((double)s - sin((double)rad));
+    double cosError = fabs((double)c - cos((double)rad));
+    if(!(sinError <= cosError))
+        return sinError;
+    return cosError;
+}
+
+static void accumulateErrors(const float* angles, size_t count, float* sins, float* coss, Errors* errors)
+{
+    sinCosBatch(angles, sins, coss, count);
+    for(size_t i=0; i<count; ++i){
+        float s, c;
+        sinCos(angles[i], &s, &c);
+        double error = angleError(angles[i], s, c);
+        if(!(error <= errors->scalar)){
+            errors->scalar = error;
+            errors->worstAngle = angles[i];
+        }
+        error = angleError(angles[i], sins[i], coss[i]);
+        if(!(error <= errors->batch)){
+            errors->batch = error;
+            errors->worstAngle = angles[i];
+        }
+    }
+}
+
+struct Data
+{
+    size_t count;
+    float* angles;
+    float* sins;
+    float* coss;
+    float checksum; // Results get folded in here so nothing is dead code
+};
+
+enum Op
+{
+    OpSinCosChain,
+    OpLibmChain,
+    OpSinCosArray,
+    OpSinCosBatch,
+    OpLibmArray,
+    NUM_OPS
+};
+
+static const char* OP_NAMES[NUM_OPS] = {
+    "sinCos chain", "sinf + cosf chain", "sinCos array", "sinCosBatch", "sinf + cosf array"
+};
+
+static void runOp(Op op, Data* data)
+{
+    size_t n = data->count;
+    switch(op){
+        case OpSinCosChain: {
+            float angle = 0.f;
+            for(size_t i=0; i<n; ++i){
+                float s, c;
+                sinCos(data->angles[i] + angle, &s, &c);
+                angle = s * c;
+            }
+            data->checksum += angle;
+            break;
+        }
+        case OpLibmChain: {
+            float angle = 0.f;
+            for(size_t i=0; i<n; ++i){
+                float x = data->angles[i] + angle;
+                angle = sinf(x) * cosf(x);
+            }
+            data->checksum += angle;
+            break;
+        }
+        case OpSinCosArray:
+            for(size_t i=0; i<n; ++i)
+                sinCos(data->angles[i], &data->sins[i], &data->coss[i]);
+            data->checksum += data->sins[n-1] + data->coss[0];
+            break;
+        case OpSinCosBatch:
+            sinCosBatch(data->angles, data->sins, data->coss, n);
+            data->checksum += data->sins[n-1] + data->coss[0];
+            break;
+        case OpLibmArray:
+            for(size_t i=0; i<n; ++i){
+                data->sins[i] = sinf(data->angles[i]);
+                data->coss[i] = cosf(data->angles[i]);
+            }
+            data->checksum += data->sins[n-1] + data->coss[0];
+            break;
+        default:
+            break;
+    }
+}
+
+// Best of a few runs, in ns per angle
+static double timeOp(Op op, Data* data, Clock* clock)
+{
+    double best = 1e30;
+    for(int run=0; run<5; ++run){
+        double start = getClockSeconds(clock);
+        runOp(op, data);
+        double elapsed = getClockSeconds(clock) - start;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return 1e9 * best / (double)data->count;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 65536;
+    if(argc > 1)
+        count = (size_t)strtoul(argv[1], 0, 10);
+    if(count == 0){
+        fprintf(stderr, "Usage: %s [count >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    // Every 2^-16 step in [-4, 4]
+    const size_t numSteps = 8 * 65536 + 1;
+    float* angles = (float*)malloc(numSteps * sizeof(float));
+    float* sins = (float*)malloc(numSteps * sizeof(float));
+    float* coss = (float*)malloc(numSteps * sizeof(float));
+    for(size_t i=0; i<numSteps; ++i)
+        angles[i] = -4.f + (float)i / 65536.f;
+    Errors smallErrors = {};
+    accumulateErrors(angles, numSteps, sins, coss, &smallErrors);
+
+    // Random angles over the whole documented range
+    srand(1);
+    for(size_t i=0; i<numSteps; ++i)
+        angles[i] = randomFloat(-8192.f, 8192.f);
+    Errors largeErrors = {};
+    accumulateErrors(angles, numSteps, sins, coss, &largeErrors);
+
+    CHECK(smallErrors.scalar <= MAX_ERROR);
+    CHECK(smallErrors.batch <= MAX_ERROR);
+    CHECK(largeErrors.scalar <= MAX_ERROR);
+    CHECK(largeErrors.batch <= MAX_ERROR);
+    if(numFailures){
+        fprintf(stderr, "worst angles: %.9g (|rad| <= 4), %.9g (|rad| <= 8192)\n",
+                (double)smallErrors.worstAngle, (double)largeErrors.worstAngle);
+    }
+
+    // Values that should come out exact
+    {
+        float s, c;
+        sinCos(0.f, &s, &c);
+        CHECK(s == 0.f && c == 1.f);
+        sinCos((float)M_PI / 2, &s, &c);
+        CHECK(s == 1.f && fabsf(c) <= MAX_ERROR);
+        sinCos((float)M_PI, &s, &c);
+        CHECK(fabsf(s) <= MAX_ERROR && c == -1.f);
+        sinCos(-(float)M_PI / 2, &s, &c);
+        CHECK(s == -1.f && fabsf(c) <= MAX_ERROR);
+    }
+
+    // Every partial count, with a guard entry after 'count' that must be
+    // left alone. The angles differ per lane so a lane mix-up shows.
+    {
+        const int maxCount = 3 * WFLOAT_WIDTH + 1;
+        float tailAngles[3 * WFLOAT_WIDTH + 1];
+        float tailSins[3 * WFLOAT_WIDTH + 2];
+        float tailCoss[3 * WFLOAT_WIDTH + 2];
+        for(int i=0; i<maxCount; ++i)
+            tailAngles[i] = -10.f + 2.3f * (float)i;
+        for(int n=1; n<=maxCount; ++n){
+            for(int i=0; i<=n; ++i){
+                tailSins[i] = 1234.f;
+                tailCoss[i] = 1234.f;
+            }
+            sinCosBatch(tailAngles, tailSins, tailCoss, (size_t)n);
+            double error = 0.0;
+            for(int i=0; i<n; ++i)
+                error = fmax(error, angleError(tailAngles[i], tailSins[i], tailCoss[i]));
+            CHECK(error <= MAX_ERROR);
+            CHECK(tailSins[n] == 1234.f && tailCoss[n] == 1234.f);
+        }
+        sinCosBatch(tailAngles, 0, 0, 0); // Nothing to do, touches nothing
+    }
+
+    free(angles);
+    free(sins);
+    free(coss);
+
+    Data data = {};
+    data.count = count;
+    data.angles = (float*)malloc(count * sizeof(float));
+    data.sins = (float*)malloc(count * sizeof(float));
+    data.coss = (float*)malloc(count * sizeof(float));
+    for(size_t i=0; i<count; ++i)
+        data.angles[i] = randomFloat(-(float)M_PI, (float)M_PI);
+
+    Clock clock = createClock(ClockSourceOS);
+    double ns[NUM_OPS];
+    for(int op=0; op<NUM_OPS; ++op)
+        ns[op] = timeOp((Op)op, &data, &clock);
+
+    printf("{\n  \"simd\": \"%s\",\n  \"count\": %zu,\n", simdLevelName(), count);
+    printf("  \"max_abs_error\": {\"sinCos\": %.3g, \"sinCosBatch\": %.3g, \"limit\": %.3g},\n",
+           fmax(smallErrors.scalar, largeErrors.scalar), fmax(smallErrors.batch, largeErrors.batch), MAX_ERROR);
+    printf("  \"results\": [\n");
+    for(int op=0; op<NUM_OPS; ++op)
+        printf("    {\"name\": \"%s\", \"ns_per_angle\": %.3f}%s\n", OP_NAMES[op], ns[op], op + 1 < NUM_OPS ? "," : "");
+    printf("  ],\n");
+    printf("  \"speedup\": {\"chain\": %.2f, \"array\": %.2f, \"batch\": %.2f},\n",
+           ns[OpLibmChain] / ns[OpSinCosChain], ns[OpLibmArray] / ns[OpSinCosArray], ns[OpLibmArray] / ns[OpSinCosBatch]);
+    printf("  \"checksum\": \"%g\",\n  \"failures\": %d\n}\n", (double)data.checksum, numFailures);
+
+    free(data.angles);
+    free(data.sins);
+    free(data.coss);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,252 @@
+// Checks and times skinVertices() and skinVertexRange() from Skinning.h.
+//
+// 1. Random bones (rotation, uniform scale, translation) and vertices
+//    with 1-4 influences are skinned with skinVertices() on the job
+//    system and on the calling thread, and with skinVertexRange(), and
+//    compared against skinning one vertex at a time with the formula
+//    from Skinning.h (transformPoint()/transformVector() per bone,
+//    weighted sum, normalised normal). Positions must be within 1e-5 of
+//    the size of the mesh, normals within 1e-5 and uvs exact.
+// 2. Vertex counts that don't fill the last job, and a mesh small enough
+//    to be skinned on the calling thread, must be skinned completely and
+//    must not write past the last vertex.
+// 3. Times the per-vertex reference and skinVertices() on one thread and
+//    on every job thread, in millions of vertices per second.
+//
+// The SIMD level is whatever 3DMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   c++ -O2 -pthread SkinningCheck.cpp ../Skinning.cpp ../JobSystem.cpp ../Threading.cpp ../Timing.cpp -o SkinningCheck
+// Usage: SkinningCheck [numVertices]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../3DMaths.h"
+#include "../Skinning.h"
+#include "../JobSystem.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    return "avx+fma";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static const float MESH_SIZE = 10.f;
+static const float POSITION_TOLERANCE = 1e-5f * 4.f * MESH_SIZE; // Bones move vertices up to ~4x the mesh size
+static const float NORMAL_TOLERANCE = 1e-5f;
+
+static void makeBones(affine3x4* bones, uint32_t numBones)
+{
+    for(uint32_t i=0; i<numBones; ++i){
+        float3 axis = normalise(float3{randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1) + 2.f});
+        float scale = randomFloat(0.5f, 2.f);
+        float3 translation = {randomFloat(-MESH_SIZE, MESH_SIZE), randomFloat(-MESH_SIZE, MESH_SIZE), randomFloat(-MESH_SIZE, MESH_SIZE)};
+        bones[i] = trsAffine3x4(translation, quatFromAxisAngle(axis, randomFloat(-3.f, 3.f)), {scale, scale, scale});
+    }
+}
+
+// 1-4 influences with unorm8 weights adding up to 255
+static void makeVertices(SkinnedVertexData* vertices, uint32_t numVertices, uint32_t numBones)
+{
+    for(uint32_t i=0; i<numVertices; ++i){
+        SkinnedVertexData* v = &vertices[i];
+        for(int c=0; c<3; ++c)
+            v->pos[c] = randomFloat(-MESH_SIZE, MESH_SIZE);
+        float3 norm = normalise(float3{randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1) + 2.f});
+        v->norm[0] = norm.x;
+        v->norm[1] = norm.y;
+        v->norm[2] = norm.z;
+        v->uv[0] = randomFloat(0, 1);
+        v->uv[1] = randomFloat(0, 1);
+
+        int numInfluences = 1 + rand() % SKINNING_INFLUENCES_PER_VERTEX;
+        int remaining = 255;
+        for(int k=0; k<SKINNING_INFLUENCES_PER_VERTEX; ++k){
+            v->boneIndices[k] = (uint8_t)(rand() % numBones);
+            int weight = 0;
+            if(k == numInfluences - 1)
+                weight = remaining;
+            else if(k < numInfluences)
+                weight = rand() % (remaining + 1);
+            v->boneWeights[k] = (uint8_t)weight;
+            remaining -= weight;
+        }
+    }
+}
+
+// One vertex at a time, straight from the formula in Skinning.h
+static void referenceSkin(const SkinnedVertexData* vertices, uint32_t numVertices,
+                          const affine3x4* bones, VertexData* outVertices)
+{
+    for(uint32_t i=0; i<numVertices; ++i){
+        const SkinnedVertexData* v = &vertices[i];
+        float3 pos = {v->pos[0], v->pos[1], v->pos[2]};
+        float3 norm = {v->norm[0], v->norm[1], v->norm[2]};
+        float3 skinnedPos = {};
+        float3 skinnedNorm = {};
+        for(int k=0; k<SKINNING_INFLUENCES_PER_VERTEX; ++k){
+            float w = v->boneWeights[k] / 255.f;
+            skinnedPos = skinnedPos + transformPoint(pos, bones[v->boneIndices[k]]) * w;
+            skinnedNorm = skinnedNorm + transformVector(norm, bones[v->boneIndices[k]]) * w;
+        }
+        skinnedNorm = normalise(skinnedNorm);
+        VertexData* out = &outVertices[i];
+        out->pos[0] = skinnedPos.x;
+        out->pos[1] = skinnedPos.y;
+        out->pos[2] = skinnedPos.z;
+        out->uv[0] = v->uv[0];
+        out->uv[1] = v->uv[1];
+        out->norm[0] = skinnedNorm.x;
+        out->norm[1] = skinnedNorm.y;
+        out->norm[2] = skinnedNorm.z;
+    }
+}
+
+struct Errors
+{
+    float pos;
+    float norm;
+    uint32_t numUvMismatches;
+};
+
+static void compareVertices(const VertexData* a, const VertexData* b, uint32_t numVertices, Errors* errors)
+{
+    for(uint32_t i=0; i<numVertices; ++i){
+        for(int c=0; c<3; ++c){
+            errors->pos = fmaxf(errors->pos, fabsf(a[i].pos[c] - b[i].pos[c]));
+            errors->norm = fmaxf(errors->norm, fabsf(a[i].norm[c] - b[i].norm[c]));
+            // NaN-safe: a NaN anywhere makes the error infinite
+            if(a[i].pos[c] != a[i].pos[c] || a[i].norm[c] != a[i].norm[c])
+                errors->pos = INFINITY;
+        }
+        if(a[i].uv[0] != b[i].uv[0] || a[i].uv[1] != b[i].uv[1])
+            ++errors->numUvMismatches;
+    }
+}
+
+static bool withinTolerance(const Errors* errors)
+{
+    return errors->pos <= POSITION_TOLERANCE && errors->norm <= NORMAL_TOLERANCE && errors->numUvMismatches == 0;
+}
+
+// Skins 'numVertices' with skinVertices() into a buffer with a guard
+// vertex after the end, compares against 'expected' and checks the guard
+static bool checkSkinVertices(const SkinnedVertexData* vertices, uint32_t numVertices, const affine3x4* bones,
+                              uint32_t numBones, const VertexData* expected, JobSystem* jobSystem, Errors* errors)
+{
+    VertexData* out = (VertexData*)malloc((numVertices + 1) * sizeof(VertexData));
+    memset(out, 0xcd, (numVertices + 1) * sizeof(VertexData));
+    VertexData guard = out[numVertices];
+    skinVertices(vertices, numVertices, bones, numBones, out, jobSystem);
+    compareVertices(out, expected, numVertices, errors);
+    bool guardIntact = memcmp(&out[numVertices], &guard, sizeof(guard)) == 0;
+    free(out);
+    return guardIntact;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t numVertices = 1 << 20;
+    if(argc > 1)
+        numVertices = (uint32_t)strtoul(argv[1], 0, 10);
+    if(numVertices == 0){
+        fprintf(stderr, "Usage: %s [numVertices >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    const uint32_t NUM_BONES = 200;
+    affine3x4 bones[NUM_BONES];
+    srand(1);
+    makeBones(bones, NUM_BONES);
+    SkinnedVertexData* vertices = (SkinnedVertexData*)malloc(numVertices * sizeof(SkinnedVertexData));
+    VertexData* expected = (VertexData*)malloc(numVertices * sizeof(VertexData));
+    VertexData* skinned = (VertexData*)malloc(numVertices * sizeof(VertexData));
+    makeVertices(vertices, numVertices, NUM_BONES);
+    referenceSkin(vertices, numVertices, bones, expected);
+
+    JobSystem* jobSystem = createJobSystem(0);
+
+    // Every path against the reference: the job system, the calling
+    // thread, skinVertexRange(), and counts that leave a partial last
+    // job (or fit in one job)
+    Errors jobErrors = {};
+    CHECK(checkSkinVertices(vertices, numVertices, bones, NUM_BONES, expected, jobSystem, &jobErrors));
+    CHECK(withinTolerance(&jobErrors));
+
+    Errors singleThreadErrors = {};
+    CHECK(checkSkinVertices(vertices, numVertices, bones, NUM_BONES, expected, 0, &singleThreadErrors));
+    CHECK(withinTolerance(&singleThreadErrors));
+
+    Errors rangeErrors = {};
+    skinVertexRange(vertices, numVertices, bones, NUM_BONES, skinned);
+    compareVertices(skinned, expected, numVertices, &rangeErrors);
+    CHECK(withinTolerance(&rangeErrors));
+
+    Errors partialErrors = {};
+    const uint32_t partialCounts[] = {1, 3, 4095, 4097, 3 * 4096 + 17};
+    for(uint32_t count : partialCounts){
+        if(count > numVertices)
+            continue;
+        CHECK(checkSkinVertices(vertices, count, bones, NUM_BONES, expected, jobSystem, &partialErrors));
+    }
+    CHECK(withinTolerance(&partialErrors));
+
+    if(numFailures){
+        fprintf(stderr, "max errors (pos, norm): job system %g %g, one thread %g %g, range %g %g, partial %g %g\n",
+                (double)jobErrors.pos, (double)jobErrors.norm, (double)singleThreadErrors.pos, (double)singleThreadErrors.norm,
+                (double)rangeErrors.pos, (double)rangeErrors.norm, (double)partialErrors.pos, (double)partialErrors.norm);
+    }
+
+    // Best of a few runs of each
+    Clock clock = createClock(ClockSourceOS);
+    double referenceTime = 1e30, singleThreadTime = 1e30, jobTime = 1e30;
+    for(int run=0; run<5; ++run){
+        double start = getClockSeconds(&clock);
+        referenceSkin(vertices, numVertices, bones, skinned);
+        double t1 = getClockSeconds(&clock);
+        skinVertices(vertices, numVertices, bones, NUM_BONES, skinned, 0);
+        double t2 = getClockSeconds(&clock);
+        skinVertices(vertices, numVertices, bones, NUM_BONES, skinned, jobSystem);
+        double t3 = getClockSeconds(&clock);
+        referenceTime = fmin(referenceTime, t1 - start);
+        singleThreadTime = fmin(singleThreadTime, t2 - t1);
+        jobTime = fmin(jobTime, t3 - t2);
+    }
+
+    printf("{\n  \"simd\": \"%s\",\n  \"vertices\": %u,\n  \"bones\": %u,\n  \"job_threads\": %u,\n",
+           simdLevelName(), numVertices, NUM_BONES, getNumJobThreads(jobSystem));
+    printf("  \"max_error\": {\"pos\": %.3g, \"norm\": %.3g, \"pos_limit\": %.3g, \"norm_limit\": %.3g},\n",
+           (double)fmaxf(fmaxf(jobErrors.pos, singleThreadErrors.pos), fmaxf(rangeErrors.pos, partialErrors.pos)),
+           (double)fmaxf(fmaxf(jobErrors.norm, singleThreadErrors.norm), fmaxf(rangeErrors.norm, partialErrors.norm)),
+           (double)POSITION_TOLERANCE, (double)NORMAL_TOLERANCE);
+    printf("  \"mverts_per_s\": {\"reference\": %.1f, \"one_thread\": %.1f, \"job_system\": %.1f},\n",
+           1e-6 * numVertices / referenceTime, 1e-6 * numVertices / singleThreadTime, 1e-6 * numVertices / jobTime);
+    printf("  \"speedup\": {\"one_thread\": %.2f, \"job_system\": %.2f},\n",
+           referenceTime / singleThreadTime, referenceTime / jobTime);
+    printf("  \"checksum\": \"%g\",\n  \"failures\": %d\n}\n", (double)skinned[numVertices - 1].pos[0], numFailures);
+
+    destroyJobSystem(jobSystem);
+    free(vertices);
+    free(expected);
+    free(skinned);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,542 @@
+// Renders the sample with the software render device (no GPU, no window).
+//
+// 1. Rasterization rules: a triangle fan and a grid of triangles whose
+//    diagonals run through pixel centres, each covering the whole
+//    viewport, must cover every pixel exactly once (top-left fill rule,
+//    no cracks); clockwise triangles must be culled; the depth test and
+//    clear value must follow the depth mode.
+//    Jittered meshes of triangles sharing edges, with random 1/256 pixel
+//    vertices (some right on pixel centres) and long edges reaching far
+//    outside the viewport, must have no holes or overdraw.
+// 2. Renders the same frame on one thread and on the job system and
+//    checks the images are identical. Renders it again with the scene's
+//    lights on the full cluster grid, which BlinnPhong.hlsl otherwise
+//    only uses with 16 or more lights: lights fade to nothing before
+//    the edge of the clusters they're in, so that must be identical too.
+// 3. Runs the scripted camera of HeadlessFrameLoop for a number of frames
+//    and reports the time per frame, triangles, tile bins and pixels.
+//    The last frame can be written out as a binary PPM image.
+//
+// Needs cube.obj and test.png from the sample directory; it looks in
+// the working directory and up to two directories above it.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh):
+//   c++ -O2 -mavx2 -mfma SoftwareRender.cpp ../RenderDeviceSoftware.cpp ../BlinnPhongShading.cpp ../LightClustering.cpp ../FrameRenderer.cpp
+//       ../JobSystem.cpp ../Scene.cpp ../TransformHierarchy.cpp ../TransformBatch.cpp ../Culling.cpp ../CommandBuffer.cpp ../InstancedDrawing.cpp
+//       ../ConstantBufferRing.cpp ../ObjLoading.cpp ../Threading.cpp ../Timing.cpp -pthread -o SoftwareRender
+// Usage: SoftwareRender [width height [numFrames [image.ppm]]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../RenderDeviceSoftware.h"
+#include "../FrameRenderer.h"
+#include "../FixedTimestep.h"
+#include "../JobSystem.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* findAssetDirectory()
+{
+    const char* CANDIDATES[] = { "", "../", "../../" };
+    char path[64];
+    for(int i=0; i<3; ++i){
+        snprintf(path, sizeof(path), "%scube.obj", CANDIDATES[i]);
+        FILE* file = fopen(path, "rb");
+        if(file){
+            fclose(file);
+            return CANDIDATES[i];
+        }
+    }
+    return 0;
+}
+
+// Draws flat coloured triangles given in clip space, through the light
+// pipeline with an identity model-view and projection
+struct RasterTest
+{
+    RenderDevice* device;
+    RenderPipeline pipeline;
+    RenderBuffer constantBuffer;
+    RenderBuffer instanceBuffer;
+};
+
+static RasterTest createRasterTest(uint32_t width, uint32_t height, DepthMode depthMode)
+{
+    RasterTest test;
+    test.device = createSoftwareRenderDevice(width, height, depthMode, 0);
+    RenderDevice* device = test.device;
+    RenderVertexElement elements[] =
+    {
+        { "POS", 0, RenderVertexFormatFloat3, 0, 0, false },
+        { "MODELVIEW", 0, RenderVertexFormatFloat4, 1, offsetof(LightInstance, modelView.cols[0]), true },
+        { "MODELVIEW", 1, RenderVertexFormatFloat4, 1, offsetof(LightInstance, modelView.cols[1]), true },
+        { "MODELVIEW", 2, RenderVertexFormatFloat4, 1, offsetof(LightInstance, modelView.cols[2]), true },
+        { "COLOR", 0, RenderVertexFormatFloat4, 1, offsetof(LightInstance, color), true }
+    };
+    RenderPipelineDesc desc = { "Lights.hlsl", "vs_main", "ps_main", elements, 5 };
+    test.pipeline = device->createPipeline(device, &desc);
+    test.constantBuffer = device->createBuffer(device, RenderBufferTypeConstant, RenderBufferUsageDynamic, 256, 0);
+    test.instanceBuffer = device->createBuffer(device, RenderBufferTypeVertex, RenderBufferUsageDynamic, 16 * sizeof(LightInstance), 0);
+    CHECK(test.pipeline && test.constantBuffer && test.instanceBuffer);
+
+    float4x4* projection = (float4x4*)device->mapBuffer(device, test.constantBuffer, RenderMapWriteDiscard);
+    *projection = {};
+    for(int i=0; i<4; ++i)
+        projection->m[i][i] = 1.f;
+    device->unmapBuffer(device, test.constantBuffer);
+    device->setPipeline(device, test.pipeline);
+    device->setConstantBuffer(device, RenderShaderStageVertex, 0, test.constantBuffer, 0, 16);
+    device->setConstantBuffer(device, RenderShaderStagePixel, 0, test.constantBuffer, 0, 16);
+    return test;
+}
+
+// 'positions' are clip space xyz (w = 1), one draw per colour
+static void drawTriangles(RasterTest* test, const float* positions, uint32_t numVertices, const uint16_t* indices, uint32_t numIndices,
+                          const float4* colors, uint32_t numDraws)
+{
+    RenderDevice* device = test->device;
+    LightInstance* instances = (LightInstance*)device->mapBuffer(device, test->instanceBuffer, RenderMapWriteDiscard);
+    for(uint32_t i=0; i<numDraws; ++i){
+        instances[i] = {};
+        instances[i].modelView.m[0][0] = instances[i].modelView.m[1][1] = instances[i].modelView.m[2][2] = 1.f;
+        instances[i].color = colors[i];
+    }
+    device->unmapBuffer(device, test->instanceBuffer);
+
+    RenderBuffer vertexBuffer = device->createBuffer(device, RenderBufferTypeVertex, RenderBufferUsageImmutable, numVertices * 12, positions);
+    RenderBuffer indexBuffer = device->createBuffer(device, RenderBufferTypeIndex, RenderBufferUsageImmutable, numIndices * 2, indices);
+    device->setVertexBuffer(device, 0, vertexBuffer, 12, 0);
+    device->setIndexBuffer(device, indexBuffer);
+    for(uint32_t i=0; i<numDraws; ++i){
+        device->setVertexBuffer(device, 1, test->instanceBuffer, sizeof(LightInstance), i * sizeof(LightInstance));
+        device->drawIndexedInstanced(device, numIndices, 1);
+    }
+}
+
+static uint32_t readPixel(const RenderDevice* device, uint32_t x, uint32_t y)
+{
+    uint32_t width, height, rowPitch;
+    const uint32_t* pixels = getSoftwareFrame(device, &width, &height, &rowPitch);
+    return pixels[y * rowPitch + x];
+}
+
+static void checkRasterRules()
+{
+    const uint32_t WIDTH = 97, HEIGHT = 61; // Not whole tiles or SIMD blocks
+    const float BLACK[4] = { 0.f, 0.f, 0.f, 1.f };
+    const float4 RED = { 1.f, 0.f, 0.f, 1.f };
+    const float4 GREEN = { 0.f, 1.f, 0.f, 1.f };
+    const uint32_t PACKED_RED = 0xff0000ff, PACKED_GREEN = 0xff00ff00;
+
+    // Fan around an off-centre point out to points along the viewport's
+    // border, counter-clockwise
+    float fan[3 * 13];
+    uint16_t fanIndices[3 * 12], clockwiseIndices[3 * 12];
+    {
+        const float RIM[12][2] = {
+            {-1.f, -1.f}, {-0.3f, -1.f}, {0.45f, -1.f}, {1.f, -1.f}, {1.f, -0.1f}, {1.f, 1.f},
+            {0.2f, 1.f}, {-0.61f, 1.f}, {-1.f, 1.f}, {-1.f, 0.37f}, {-1.f, -0.2f}, {-1.f, -0.93f}
+        };
+        fan[0] = 0.123f; fan[1] = -0.217f; fan[2] = 0.5f;
+        for(int i=0; i<12; ++i){
+            fan[3 + 3*i + 0] = RIM[i][0];
+            fan[3 + 3*i + 1] = RIM[i][1];
+            fan[3 + 3*i + 2] = 0.5f;
+            fanIndices[3*i + 0] = 0;
+            fanIndices[3*i + 1] = (uint16_t)(1 + i);
+            fanIndices[3*i + 2] = (uint16_t)(1 + (i + 1) % 12);
+            clockwiseIndices[3*i + 0] = 0;
+            clockwiseIndices[3*i + 1] = fanIndices[3*i + 2];
+            clockwiseIndices[3*i + 2] = fanIndices[3*i + 1];
+        }
+    }
+
+    // Fan: every pixel covered once. Drawn again at the same depth it
+    // covers them all again and fails the LESS test everywhere.
+    {
+        RasterTest test = createRasterTest(WIDTH, HEIGHT, DepthModeStandard);
+        RenderDevice* device = test.device;
+        device->beginFrame(device, BLACK);
+        float4 colors[2] = { RED, GREEN };
+        drawTriangles(&test, fan, 13, fanIndices, 36, colors, 1);
+        device->present(device, 0);
+        SoftwareRenderStats stats = getSoftwareRenderStats(device);
+        CHECK(stats.numTriangles == 12 && stats.numTrianglesCulled == 0);
+        CHECK(stats.numPixelsCovered == WIDTH * HEIGHT);
+        CHECK(stats.numPixelsShaded == WIDTH * HEIGHT);
+        CHECK(readPixel(device, 0, 0) == PACKED_RED && readPixel(device, WIDTH - 1, HEIGHT - 1) == PACKED_RED);
+
+        resetSoftwareRenderStats(device);
+        device->beginFrame(device, BLACK);
+        drawTriangles(&test, fan, 13, fanIndices, 36, colors, 2);
+        device->present(device, 0);
+        stats = getSoftwareRenderStats(device);
+        CHECK(stats.numPixelsCovered == 2 * WIDTH * HEIGHT);
+        CHECK(stats.numPixelsShaded == WIDTH * HEIGHT);
+        CHECK(readPixel(device, WIDTH / 2, HEIGHT / 2) == PACKED_RED);
+
+        // Clockwise is a back face
+        resetSoftwareRenderStats(device);
+        device->beginFrame(device, BLACK);
+        drawTriangles(&test, fan, 13, clockwiseIndices, 36, colors, 1);
+        device->present(device, 0);
+        stats = getSoftwareRenderStats(device);
+        CHECK(stats.numTrianglesCulled == 12 && stats.numPixelsCovered == 0);
+        CHECK(readPixel(device, WIDTH / 2, HEIGHT / 2) == 0xff000000);
+        device->destroy(device);
+    }
+
+    // Grid of squares split along alternating diagonals, reaching past
+    // the viewport, with corners on pixel centres so every edge passes
+    // through pixel centres
+    {
+        const uint32_t SIZE = 64, CELL = 8, N = SIZE / CELL + 1;
+        float grid[3 * (N + 1) * (N + 1)];
+        uint16_t gridIndices[6 * N * N];
+        for(uint32_t y=0; y<=N; ++y){
+            for(uint32_t x=0; x<=N; ++x){
+                float* v = &grid[3 * (y * (N + 1) + x)];
+                v[0] = 2.f * ((float)(x * CELL) - 3.5f) / SIZE - 1.f;
+                v[1] = 1.f - 2.f * ((float)(y * CELL) - 3.5f) / SIZE;
+                v[2] = 0.25f;
+            }
+        }
+        uint32_t numGridIndices = 0;
+        for(uint32_t y=0; y<N; ++y){
+            for(uint32_t x=0; x<N; ++x){
+                uint16_t topLeft = (uint16_t)(y * (N + 1) + x), topRight = (uint16_t)(topLeft + 1);
+                uint16_t bottomLeft = (uint16_t)(topLeft + N + 1), bottomRight = (uint16_t)(bottomLeft + 1);
+                // Counter-clockwise on screen
+                uint16_t quad[6] = { topLeft, bottomLeft, bottomRight, topLeft, bottomRight, topRight };
+                if((x + y) & 1){
+                    uint16_t other[6] = { topLeft, bottomLeft, topRight, topRight, bottomLeft, bottomRight };
+                    memcpy(quad, other, sizeof(quad));
+                }
+                memcpy(&gridIndices[numGridIndices], quad, sizeof(quad));
+                numGridIndices += 6;
+            }
+        }
+        RasterTest test = createRasterTest(SIZE, SIZE, DepthModeStandard);
+        RenderDevice* device = test.device;
+        device->beginFrame(device, BLACK);
+        drawTriangles(&test, grid, (N + 1) * (N + 1), gridIndices, numGridIndices, &GREEN, 1);
+        device->present(device, 0);
+        SoftwareRenderStats stats = getSoftwareRenderStats(device);
+        CHECK(stats.numTrianglesCulled == 0);
+        CHECK(stats.numPixelsCovered == SIZE * SIZE);
+        device->destroy(device);
+    }
+
+    // Depth modes: a quad at z = 0.2 over a full screen fan at z = 0.5.
+    // LESS keeps the quad, reverse-Z's GREATER keeps the fan.
+    {
+        float quad[12] = { -0.5f, -0.5f, 0.2f,  0.5f, -0.5f, 0.2f,  0.5f, 0.5f, 0.2f,  -0.5f, 0.5f, 0.2f };
+        uint16_t quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+        DepthMode modes[2] = { DepthModeStandard, DepthModeInfiniteReverseZ };
+        uint32_t expected[2] = { PACKED_RED, PACKED_GREEN };
+        for(int i=0; i<2; ++i){
+            RasterTest test = createRasterTest(WIDTH, HEIGHT, modes[i]);
+            RenderDevice* device = test.device;
+            device->beginFrame(device, BLACK);
+            drawTriangles(&test, quad, 4, quadIndices, 6, &RED, 1);
+            drawTriangles(&test, fan, 13, fanIndices, 36, &GREEN, 1);
+            device->present(device, 0);
+            CHECK(readPixel(device, WIDTH / 2, HEIGHT / 2) == expected[i]);
+            CHECK(readPixel(device, 2, 2) == PACKED_GREEN);
+            device->destroy(device);
+        }
+    }
+}
+
+struct CoverageCounts
+{
+    uint64_t numTriangles;
+    uint64_t numHoles;    // Pixels no triangle covered
+    uint64_t numOverdraw; // Pixels covered more than once, counted each extra time
+};
+
+// Random position within 'jitter' pixels of (x, y), snapped to 1/256 and
+// every few vertices onto a pixel centre, as clip space xyz
+static void jitteredVertex(float x, float y, float jitter, uint32_t width, uint32_t height, float* outPosition)
+{
+    x += jitter * (2.f * (float)rand() / (float)RAND_MAX - 1.f);
+    y += jitter * (2.f * (float)rand() / (float)RAND_MAX - 1.f);
+    if(rand() % 3 == 0){
+        x = floorf(x) + 0.5f;
+        y = floorf(y) + 0.5f;
+    }else{
+        x = floorf(x * 256.f) / 256.f;
+        y = floorf(y * 256.f) / 256.f;
+    }
+    outPosition[0] = 2.f * x / (float)width - 1.f;
+    outPosition[1] = 1.f - 2.f * y / (float)height;
+    outPosition[2] = 0.5f;
+}
+
+// Draws a mesh covering the viewport at one depth, so with the LESS test
+// every pixel covered passes once: holes are the pixels never shaded and
+// overdraw the covered pixels which failed
+static void countCoverage(uint32_t width, uint32_t height, const float* positions, uint32_t numVertices,
+                          const uint16_t* indices, uint32_t numIndices, CoverageCounts* counts)
+{
+    const float BLACK[4] = { 0.f, 0.f, 0.f, 1.f };
+    const float4 GREEN = { 0.f, 1.f, 0.f, 1.f };
+    RasterTest test = createRasterTest(width, height, DepthModeStandard);
+    RenderDevice* device = test.device;
+    device->beginFrame(device, BLACK);
+    drawTriangles(&test, positions, numVertices, indices, numIndices, &GREEN, 1);
+    device->present(device, 0);
+    SoftwareRenderStats stats = getSoftwareRenderStats(device);
+    counts->numTriangles += stats.numTriangles;
+    counts->numHoles += (uint64_t)width * height - stats.numPixelsShaded;
+    counts->numOverdraw += stats.numPixelsCovered - stats.numPixelsShaded;
+    device->destroy(device);
+}
+
+static CoverageCounts checkSharedEdges()
+{
+    const uint32_t WIDTH = 509, HEIGHT = 317; // Not whole tiles or SIMD blocks
+    const int NUM_MESHES = 8;
+    CoverageCounts counts = {};
+    srand(1);
+
+    // Grid of cells 24 pixels across, reaching past the viewport, with
+    // the corners moved up to 6 pixels and split along random diagonals
+    {
+        const float CELL = 24.f;
+        const uint32_t NX = (uint32_t)((WIDTH + 2 * CELL) / CELL) + 1, NY = (uint32_t)((HEIGHT + 2 * CELL) / CELL) + 1;
+        float* grid = (float*)malloc(3 * (NX + 1) * (NY + 1) * sizeof(float));
+        uint16_t* gridIndices = (uint16_t*)malloc(6 * NX * NY * sizeof(uint16_t));
+        for(int mesh=0; mesh<NUM_MESHES; ++mesh){
+            for(uint32_t y=0; y<=NY; ++y){
+                for(uint32_t x=0; x<=NX; ++x)
+                    jitteredVertex((float)x * CELL - CELL, (float)y * CELL - CELL, 6.f, WIDTH, HEIGHT, &grid[3 * (y * (NX + 1) + x)]);
+            }
+            uint32_t numGridIndices = 0;
+            for(uint32_t y=0; y<NY; ++y){
+                for(uint32_t x=0; x<NX; ++x){
+                    uint16_t topLeft = (uint16_t)(y * (NX + 1) + x), topRight = (uint16_t)(topLeft + 1);
+                    uint16_t bottomLeft = (uint16_t)(topLeft + NX + 1), bottomRight = (uint16_t)(bottomLeft + 1);
+                    // Counter-clockwise on screen
+                    uint16_t quad[6] = { topLeft, bottomLeft, bottomRight, topLeft, bottomRight, topRight };
+                    if(rand() & 1){
+                        uint16_t other[6] = { topLeft, bottomLeft, topRight, topRight, bottomLeft, bottomRight };
+                        memcpy(quad, other, sizeof(quad));
+                    }
+                    memcpy(&gridIndices[numGridIndices], quad, sizeof(quad));
+                    numGridIndices += 6;
+                }
+            }
+            countCoverage(WIDTH, HEIGHT, grid, (NX + 1) * (NY + 1), gridIndices, numGridIndices, &counts);
+        }
+        free(grid);
+        free(gridIndices);
+    }
+
+    // Fan of long thin triangles from a point inside the viewport out to
+    // a rim 2000 pixels outside it, where the edge functions get large
+    {
+        const uint32_t NUM_RIM = 4 * 64;
+        const float RIM = 2000.f;
+        float fan[3 * (1 + NUM_RIM)];
+        uint16_t fanIndices[3 * NUM_RIM];
+        for(int mesh=0; mesh<NUM_MESHES; ++mesh){
+            jitteredVertex(0.5f * WIDTH, 0.5f * HEIGHT, 100.f, WIDTH, HEIGHT, fan);
+            // Counter-clockwise on screen: along the top right to left,
+            // down the left, along the bottom and up the right
+            for(uint32_t i=0; i<NUM_RIM; ++i){
+                float t = (float)(i % 64) / 64.f;
+                float x0 = -RIM, x1 = WIDTH + RIM, y0 = -RIM, y1 = HEIGHT + RIM;
+                float x, y;
+                switch(i / 64){
+                    case 0: x = x1 + (x0 - x1) * t; y = y0; break;
+                    case 1: x = x0; y = y0 + (y1 - y0) * t; break;
+                    case 2: x = x0 + (x1 - x0) * t; y = y1; break;
+                    default: x = x1; y = y1 + (y0 - y1) * t; break;
+                }
+                jitteredVertex(x, y, 10.f, WIDTH, HEIGHT, &fan[3 * (1 + i)]);
+                fanIndices[3*i + 0] = 0;
+                fanIndices[3*i + 1] = (uint16_t)(1 + i);
+                fanIndices[3*i + 2] = (uint16_t)(1 + (i + 1) % NUM_RIM);
+            }
+            countCoverage(WIDTH, HEIGHT, fan, 1 + NUM_RIM, fanIndices, 3 * NUM_RIM, &counts);
+        }
+    }
+
+    CHECK(counts.numHoles == 0);
+    CHECK(counts.numOverdraw == 0);
+    return counts;
+}
+
+struct SampleRenderer
+{
+    RenderDevice* device;
+    FrameRenderer* frameRenderer;
+};
+
+static SampleRenderer createSampleRenderer(uint32_t width, uint32_t height, JobSystem* jobSystem, const char* assetDirectory,
+                                           FrameLightClustering lightClustering)
+{
+    SampleRenderer sample;
+    sample.device = createSoftwareRenderDevice(width, height, DepthModeInfiniteReverseZ, jobSystem);
+    sample.frameRenderer = (FrameRenderer*)malloc(sizeof(FrameRenderer));
+    CHECK(createFrameRenderer(sample.frameRenderer, sample.device, assetDirectory, jobSystem, lightClustering));
+    return sample;
+}
+
+static void freeSampleRenderer(SampleRenderer* sample)
+{
+    freeFrameRenderer(sample->frameRenderer);
+    free(sample->frameRenderer);
+    sample->device->destroy(sample->device);
+}
+
+static bool writePpm(const char* path, const RenderDevice* device)
+{
+    FILE* file = fopen(path, "wb");
+    if(!file)
+        return false;
+    uint32_t width, height, rowPitch;
+    const uint32_t* pixels = getSoftwareFrame(device, &width, &height, &rowPitch);
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    for(uint32_t y=0; y<height; ++y){
+        for(uint32_t x=0; x<width; ++x){
+            uint32_t pixel = pixels[y * rowPitch + x];
+            uint8_t rgb[3] = { (uint8_t)pixel, (uint8_t)(pixel >> 8), (uint8_t)(pixel >> 16) };
+            fwrite(rgb, 1, 3, file);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = 1920, height = 1080, numFrames = 120;
+    const char* imagePath = 0;
+    if(argc > 2){
+        width = (uint32_t)strtoul(argv[1], 0, 10);
+        height = (uint32_t)strtoul(argv[2], 0, 10);
+    }
+    if(argc > 3)
+        numFrames = (uint32_t)strtoul(argv[3], 0, 10);
+    if(argc > 4)
+        imagePath = argv[4];
+    if(width == 0 || height == 0 || numFrames == 0 || argc == 2){
+        fprintf(stderr, "Usage: %s [width height [numFrames >= 1 [image.ppm]]]\n", argv[0]);
+        return 1;
+    }
+    const char* assetDirectory = findAssetDirectory();
+    if(!assetDirectory){
+        fprintf(stderr, "Can't find cube.obj, run from the sample directory\n");
+        return 1;
+    }
+
+    checkRasterRules();
+    CoverageCounts coverage = checkSharedEdges();
+
+    JobSystem* jobSystem = createJobSystem(0);
+    float4x4 perspectiveMat = makePerspectiveMat(DepthModeInfiniteReverseZ, (float)width / (float)height, degreesToRadians(84), 0.1f, 1000.f);
+    Scene scene = createScene();
+    SceneState sceneState = makeInitialSceneState();
+    applySceneState(&scene, &sceneState);
+
+    // One thread, the job system and the cluster grid must give the same image
+    uint32_t numGridClusters, numGridLightIndices;
+    {
+        SampleRenderer serial = createSampleRenderer(width, height, 0, assetDirectory, FrameLightClusteringAuto);
+        SampleRenderer parallel = createSampleRenderer(width, height, jobSystem, assetDirectory, FrameLightClusteringAuto);
+        SampleRenderer grid = createSampleRenderer(width, height, jobSystem, assetDirectory, FrameLightClusteringGrid);
+        SampleRenderer* samples[3] = { &serial, &parallel, &grid };
+        for(int i=0; i<3; ++i){
+            renderFrame(samples[i]->frameRenderer, &scene, sceneViewMatrix(&sceneState), perspectiveMat);
+            samples[i]->device->present(samples[i]->device, 1);
+        }
+        uint32_t rowPitch;
+        const uint32_t* serialPixels = getSoftwareFrame(serial.device, &width, &height, &rowPitch);
+        for(int i=1; i<3; ++i){
+            const uint32_t* pixels = getSoftwareFrame(samples[i]->device, &width, &height, &rowPitch);
+            bool identical = true;
+            for(uint32_t y=0; y<height; ++y)
+                identical = identical && memcmp(serialPixels + y * rowPitch, pixels + y * rowPitch, width * sizeof(uint32_t)) == 0;
+            CHECK(identical);
+        }
+        SoftwareRenderStats stats = getSoftwareRenderStats(parallel.device);
+        CHECK(stats.numPixelsShaded > 0 && stats.numPixelsShaded <= stats.numPixelsCovered);
+
+        // The grid really is in use, with the lights in some clusters only
+        const LightClusters* gridClusters = &grid.frameRenderer->lightClusters;
+        numGridClusters = gridClusters->tilesX * gridClusters->tilesY * gridClusters->numSlices;
+        numGridLightIndices = gridClusters->numLightIndices;
+        CHECK(serial.frameRenderer->lightClusters.numLightIndices <= SCENE_NUM_LIGHTS);
+        CHECK(numGridClusters > 1 && numGridLightIndices > 0 && numGridLightIndices < SCENE_NUM_LIGHTS * numGridClusters);
+        CHECK(gridClusters->numDroppedIndices == 0);
+        freeSampleRenderer(&serial);
+        freeSampleRenderer(&parallel);
+        freeSampleRenderer(&grid);
+    }
+
+    // The scripted camera from HeadlessFrameLoop
+    SampleRenderer sample = createSampleRenderer(width, height, jobSystem, assetDirectory, FrameLightClusteringAuto);
+    RenderDevice* device = sample.device;
+    SceneState previousSceneState = sceneState;
+    SceneState currentSceneState = sceneState;
+    FixedTimestep simulationTimestep = makeFixedTimestep(1.0 / 120.0, 30);
+    FrameStats* submitStats = (FrameStats*)malloc(sizeof(FrameStats));
+    FrameStats* rasterizeStats = (FrameStats*)malloc(sizeof(FrameStats));
+    resetFrameStats(submitStats);
+    resetFrameStats(rasterizeStats);
+    Clock clock = createClock(ClockSourceOS);
+    const double FRAME_SECONDS = 1.0 / 60.0;
+    bool keyIsDown[GameActionCount] = {};
+    resetSoftwareRenderStats(device);
+    for(uint32_t frame=0; frame<numFrames; ++frame)
+    {
+        keyIsDown[GameActionTurnCamLeft] = (frame % 360) < 120;
+        uint32_t numSteps = advanceFixedTimestep(&simulationTimestep, FRAME_SECONDS);
+        for(uint32_t i=0; i<numSteps; ++i){
+            previousSceneState = currentSceneState;
+            stepScene(&currentSceneState, keyIsDown, (float)simulationTimestep.stepSeconds);
+        }
+        SceneState renderSceneState = interpolateSceneStates(&previousSceneState, &currentSceneState, fixedTimestepAlpha(&simulationTimestep));
+        applySceneState(&scene, &renderSceneState);
+
+        double frameStart = getClockSeconds(&clock);
+        renderFrame(sample.frameRenderer, &scene, sceneViewMatrix(&renderSceneState), perspectiveMat);
+        double submitEnd = getClockSeconds(&clock);
+        device->present(device, 1);
+        recordFrameTime(submitStats, submitEnd - frameStart);
+        recordFrameTime(rasterizeStats, getClockSeconds(&clock) - submitEnd);
+    }
+    SoftwareRenderStats stats = getSoftwareRenderStats(device);
+    if(imagePath)
+        CHECK(writePpm(imagePath, device));
+
+    double perFrame = 1.0 / (double)numFrames;
+    FrameTimeSummary submit = summariseFrameTimes(submitStats);
+    FrameTimeSummary rasterize = summariseFrameTimes(rasterizeStats);
+    printf("{\n  \"width\": %u,\n  \"height\": %u,\n  \"frames\": %u,\n  \"threads\": %u,\n", width, height, numFrames, getNumJobThreads(jobSystem));
+    printf("  \"shared_edges\": {\"triangles\": %llu, \"holes\": %llu, \"overdraw\": %llu},\n",
+           (unsigned long long)coverage.numTriangles, (unsigned long long)coverage.numHoles, (unsigned long long)coverage.numOverdraw);
+    printf("  \"cluster_grid\": {\"clusters\": %u, \"light_indices\": %u},\n", numGridClusters, numGridLightIndices);
+    printf("  \"per_frame\": {\"triangles\": %.1f, \"triangles_culled\": %.1f, \"tile_bins\": %.1f, \"pixels_covered\": %.0f, \"pixels_shaded\": %.0f},\n",
+           stats.numTriangles * perFrame, stats.numTrianglesCulled * perFrame, stats.numTileBins * perFrame,
+           stats.numPixelsCovered * perFrame, stats.numPixelsShaded * perFrame);
+    // Submitting covers culling, vertex processing and binning; present() rasterizes
+    printf("  \"submit_ms\": {\"avg\": %.3f, \"p50\": %.3f, \"p99\": %.3f},\n", submit.avgMs, submit.p50Ms, submit.p99Ms);
+    printf("  \"rasterize_ms\": {\"avg\": %.2f, \"p50\": %.2f, \"p99\": %.2f},\n", rasterize.avgMs, rasterize.p50Ms, rasterize.p99Ms);
+    printf("  \"frames_per_second\": %.1f,\n", 1000.0 / (submit.avgMs + rasterize.avgMs));
+    printf("  \"failures\": %d\n}\n", numFailures);
+
+    freeSampleRenderer(&sample);
+    freeScene(scene);
+    destroyJobSystem(jobSystem);
+    free(submitStats);
+    free(rasterizeStats);
+    return numFailures ? 1 : 0;
+}
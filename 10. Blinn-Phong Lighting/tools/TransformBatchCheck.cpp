@@ -0,0 +1,278 @@
+// Checks and times computeTransformsBatch() from TransformBatch.h.
+//
+// 1. Random positions, rotations and scales, with a rigid camera view
+//    matrix. Every model-view, model-view-proj and normal matrix is checked
+//    against the scalar maths (trsMat(), operator*, normalMatrix()), for
+//    every count up to a few SIMD widths (so every partial batch) and the
+//    full count. The full count is checked with cache line aligned outputs
+//    (streamed out) and with outputs 16 bytes off (written through the
+//    cache). The entry after the last object must be left untouched.
+// 2. Times the kernel both ways and the scalar loop for the full count
+//    (100K objects by default, the sample's target) against a 2 ms budget,
+//    next to a memset() of the same output as a floor. The budget is only
+//    met with AVX2 + FMA (about 1.5 ms against 2.5 ms for SSE2), so
+//    missing it fails those builds and is only reported for the others.
+//
+// The SIMD level is whatever 3DMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   c++ -O2 TransformBatchCheck.cpp ../TransformBatch.cpp ../Timing.cpp -o TransformBatchCheck
+// Usage: TransformBatchCheck [numObjects]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../TransformBatch.h"
+#include "../SimdMaths.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    return "avx+fma";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static quat randomRotation()
+{
+    for(;;){
+        quat q = {randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1)};
+        float lengthSq = dot(q, q);
+        if(lengthSq > 0.01f && lengthSq <= 1.f)
+            return normalise(q);
+    }
+}
+
+struct Outputs
+{
+    float4x4* modelViewMats;
+    float4x4* modelViewProjMats;
+    float3x3* normalMats;
+    void* blocks[3];
+};
+
+// 'offset' bytes past allocTransformBatchOutput()'s alignment
+static Outputs allocOutputs(uint32_t count, size_t offset)
+{
+    Outputs result;
+    result.blocks[0] = allocTransformBatchOutput(count * sizeof(float4x4) + offset);
+    result.blocks[1] = allocTransformBatchOutput(count * sizeof(float4x4) + offset);
+    result.blocks[2] = allocTransformBatchOutput(count * sizeof(float3x3) + offset);
+    result.modelViewMats = (float4x4*)((uint8_t*)result.blocks[0] + offset);
+    result.modelViewProjMats = (float4x4*)((uint8_t*)result.blocks[1] + offset);
+    result.normalMats = (float3x3*)((uint8_t*)result.blocks[2] + offset);
+    return result;
+}
+
+static void freeOutputs(Outputs outputs)
+{
+    for(int i=0; i<3; ++i)
+        freeTransformBatchOutput(outputs.blocks[i]);
+}
+
+static void referenceTransforms(const TransformSoA* transforms, uint32_t i, float4x4 viewMat, float4x4 projMat,
+                                float4x4* outModelView, float4x4* outModelViewProj, float3x3* outNormal)
+{
+    float3 pos = {transforms->posX[i], transforms->posY[i], transforms->posZ[i]};
+    quat rot = {transforms->rotX[i], transforms->rotY[i], transforms->rotZ[i], transforms->rotW[i]};
+    float3 scale = {transforms->scaleX[i], transforms->scaleY[i], transforms->scaleZ[i]};
+    *outModelView = trsMat(pos, rot, scale) * viewMat;
+    *outModelViewProj = *outModelView * projMat;
+    *outNormal = normalMatrix(*outModelView);
+}
+
+// Largest error relative to max(1, |reference|) over 'count' floats
+static float maxError(const float* values, const float* reference, size_t count)
+{
+    float result = 0.f;
+    for(size_t i=0; i<count; ++i){
+        float error = fabsf(values[i] - reference[i]) / fmaxf(1.f, fabsf(reference[i]));
+        if(!(error <= result)) // Catches NaNs too
+            result = error;
+    }
+    return result;
+}
+
+// Runs the kernel on the first 'count' objects and returns the largest
+// error against the scalar maths
+static float checkCount(const TransformSoA* transforms, uint32_t count, float4x4 viewMat, float4x4 projMat, Outputs outputs)
+{
+    // Marks the entry after the last object, which must not be written
+    const unsigned char GUARD = 0xcd;
+    memset(&outputs.modelViewMats[count], GUARD, sizeof(float4x4));
+    memset(&outputs.modelViewProjMats[count], GUARD, sizeof(float4x4));
+    memset(&outputs.normalMats[count], GUARD, sizeof(float3x3));
+
+    TransformSoA subset = *transforms;
+    subset.count = count;
+    computeTransformsBatch(&subset, viewMat, projMat, outputs.modelViewMats, outputs.modelViewProjMats, outputs.normalMats);
+
+    float result = 0.f;
+    for(uint32_t i=0; i<count; ++i){
+        float4x4 modelView, modelViewProj;
+        float3x3 normal;
+        referenceTransforms(transforms, i, viewMat, projMat, &modelView, &modelViewProj, &normal);
+        result = fmaxf(result, maxError(&outputs.modelViewMats[i].m[0][0], &modelView.m[0][0], 16));
+        result = fmaxf(result, maxError(&outputs.modelViewProjMats[i].m[0][0], &modelViewProj.m[0][0], 16));
+        // The fourth float of each float3x3 row is padding
+        for(int r=0; r<3; ++r)
+            result = fmaxf(result, maxError(outputs.normalMats[i].m[r], normal.m[r], 3));
+    }
+
+    const unsigned char* guards[3] = {
+        (const unsigned char*)&outputs.modelViewMats[count],
+        (const unsigned char*)&outputs.modelViewProjMats[count],
+        (const unsigned char*)&outputs.normalMats[count]
+    };
+    size_t guardSizes[3] = { sizeof(float4x4), sizeof(float4x4), sizeof(float3x3) };
+    for(int g=0; g<3; ++g){
+        bool untouched = true;
+        for(size_t b=0; b<guardSizes[g]; ++b)
+            untouched = untouched && guards[g][b] == GUARD;
+        CHECK(untouched);
+    }
+    return result;
+}
+
+// Best of a few runs, in seconds
+static double timeTransforms(const TransformSoA* transforms, float4x4 viewMat, float4x4 projMat, Outputs outputs, bool reference, Clock* clock)
+{
+    double best = 1e30;
+    for(int run=0; run<(reference ? 3 : 50); ++run)
+    {
+        double start = getClockSeconds(clock);
+        if(reference){
+            for(uint32_t i=0; i<transforms->count; ++i)
+                referenceTransforms(transforms, i, viewMat, projMat, &outputs.modelViewMats[i], &outputs.modelViewProjMats[i], &outputs.normalMats[i]);
+        }
+        else
+            computeTransformsBatch(transforms, viewMat, projMat, outputs.modelViewMats, outputs.modelViewProjMats, outputs.normalMats);
+        double elapsed = getClockSeconds(clock) - start;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t numObjects = 100000;
+    if(argc > 1)
+        numObjects = (uint32_t)strtoul(argv[1], 0, 10);
+    if(numObjects == 0){
+        fprintf(stderr, "Usage: %s [numObjects >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    TransformSoA transforms = allocTransformSoA(numObjects);
+    for(uint32_t i=0; i<numObjects; ++i){
+        quat rot = randomRotation();
+        transforms.posX[i] = randomFloat(-100, 100);
+        transforms.posY[i] = randomFloat(-100, 100);
+        transforms.posZ[i] = randomFloat(-100, 100);
+        transforms.rotX[i] = rot.x;
+        transforms.rotY[i] = rot.y;
+        transforms.rotZ[i] = rot.z;
+        transforms.rotW[i] = rot.w;
+        transforms.scaleX[i] = randomFloat(0.5f, 2.f);
+        transforms.scaleY[i] = randomFloat(0.5f, 2.f);
+        transforms.scaleZ[i] = randomFloat(0.5f, 2.f);
+    }
+
+    // A rigid view matrix (the kernel's normal matrices rely on it)
+    float4x4 viewMat = inverseTrsMat({3.f, 4.f, 20.f}, randomRotation(), {1.f, 1.f, 1.f});
+    float4x4 projMat = makePerspectiveMat(16.f / 9.f, 1.2f, 0.1f, 1000.f);
+
+    // One spare entry for the guard
+    Outputs outputs = allocOutputs(numObjects + 1, 0);
+    Outputs unalignedOutputs = allocOutputs(numObjects + 1, 16);
+
+    const float MAX_ERROR = 1e-4f;
+    float worstError = 0.f;
+    uint32_t maxPartialCount = 3 * WFLOAT_WIDTH + 1;
+    for(uint32_t count=1; count<=maxPartialCount && count<=numObjects; ++count)
+        worstError = fmaxf(worstError, checkCount(&transforms, count, viewMat, projMat, outputs));
+    worstError = fmaxf(worstError, checkCount(&transforms, numObjects, viewMat, projMat, outputs));
+    worstError = fmaxf(worstError, checkCount(&transforms, numObjects, viewMat, projMat, unalignedOutputs));
+    CHECK(worstError <= MAX_ERROR);
+
+    // Both ways of writing the results must match exactly
+    CHECK(memcmp(outputs.modelViewMats, unalignedOutputs.modelViewMats, numObjects * sizeof(float4x4)) == 0);
+    CHECK(memcmp(outputs.modelViewProjMats, unalignedOutputs.modelViewProjMats, numObjects * sizeof(float4x4)) == 0);
+    CHECK(memcmp(outputs.normalMats, unalignedOutputs.normalMats, numObjects * sizeof(float3x3)) == 0);
+
+    // NULL outputs are skipped, the others must come out the same
+    {
+        Outputs single = allocOutputs(numObjects, 0);
+        computeTransformsBatch(&transforms, viewMat, projMat, 0, single.modelViewProjMats, 0);
+        CHECK(memcmp(single.modelViewProjMats, outputs.modelViewProjMats, numObjects * sizeof(float4x4)) == 0);
+        computeTransformsBatch(&transforms, viewMat, projMat, 0, 0, single.normalMats);
+        CHECK(memcmp(single.normalMats, outputs.normalMats, numObjects * sizeof(float3x3)) == 0);
+        freeOutputs(single);
+    }
+
+    const double BUDGET_MS = 2.0;
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    const bool BUDGET_EXPECTED = true;
+#else
+    const bool BUDGET_EXPECTED = false;
+#endif
+    Clock clock = createClock(ClockSourceOS);
+    double referenceSeconds = timeTransforms(&transforms, viewMat, projMat, outputs, true, &clock);
+    double kernelSeconds = timeTransforms(&transforms, viewMat, projMat, outputs, false, &clock);
+    // Another process can slow down every run of a round, so give builds
+    // expected to make the budget a few more rounds before failing them
+    for(int round=0; BUDGET_EXPECTED && round<10 && 1e3 * kernelSeconds > BUDGET_MS; ++round)
+        kernelSeconds = fmin(kernelSeconds, timeTransforms(&transforms, viewMat, projMat, outputs, false, &clock));
+    double unalignedSeconds = timeTransforms(&transforms, viewMat, projMat, unalignedOutputs, false, &clock);
+    double memsetSeconds = 1e30;
+    for(int run=0; run<20; ++run){
+        double start = getClockSeconds(&clock);
+        memset(outputs.modelViewMats, run, numObjects * sizeof(float4x4));
+        memset(outputs.modelViewProjMats, run, numObjects * sizeof(float4x4));
+        memset(outputs.normalMats, run, numObjects * sizeof(float3x3));
+        double elapsed = getClockSeconds(&clock) - start;
+        if(elapsed < memsetSeconds)
+            memsetSeconds = elapsed;
+    }
+    bool withinBudget = 1e3 * kernelSeconds <= BUDGET_MS;
+    CHECK(withinBudget || !BUDGET_EXPECTED);
+    double outputMB = numObjects * (2.0 * sizeof(float4x4) + sizeof(float3x3)) / (1024.0 * 1024.0);
+
+    printf("{\n  \"simd\": \"%s\",\n  \"lanes\": %d,\n  \"objects\": %u,\n", simdLevelName(), WFLOAT_WIDTH, numObjects);
+    printf("  \"max_relative_error\": %.3g,\n", (double)worstError);
+    printf("  \"output_mb\": %.2f,\n", outputMB);
+    printf("  \"reference_ms\": %.3f,\n", 1e3 * referenceSeconds);
+    printf("  \"batch_ms\": %.3f,\n", 1e3 * kernelSeconds);
+    printf("  \"batch_unaligned_ms\": %.3f,\n", 1e3 * unalignedSeconds);
+    printf("  \"memset_ms\": %.3f,\n", 1e3 * memsetSeconds);
+    printf("  \"batch_ns_per_object\": %.2f,\n", 1e9 * kernelSeconds / numObjects);
+    printf("  \"batch_output_gb_per_s\": %.2f,\n", outputMB / 1024.0 / kernelSeconds);
+    printf("  \"speedup\": %.2f,\n", referenceSeconds / kernelSeconds);
+    printf("  \"budget_ms\": %.1f,\n", BUDGET_MS);
+    printf("  \"budget_expected\": %s,\n", BUDGET_EXPECTED ? "true" : "false");
+    printf("  \"within_budget\": %s,\n", withinBudget ? "true" : "false");
+    printf("  \"failures\": %d\n}\n", numFailures);
+
+    freeOutputs(outputs);
+    freeOutputs(unalignedOutputs);
+    freeTransformSoA(transforms);
+    return numFailures ? 1 : 0;
+}
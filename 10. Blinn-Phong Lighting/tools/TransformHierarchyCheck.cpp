@@ -0,0 +1,277 @@
+// Checks and times updateWorldTransforms() from TransformHierarchy.h.
+//
+// 1. Builds a random forest of 'count' nodes (up to 16 levels deep) and
+//    checks every world matrix against a recursive reference which walks
+//    each tree from its root, building local matrices with
+//    trsAffine3x4() and multiplying them with scalarMul(). Matrices must
+//    agree within 1e-5 of their largest element.
+// 2. Rounds of random edits (translation, rotation or scale of 1 to 1000
+//    random nodes, some of them inside already dirty subtrees) followed
+//    by an update: every world matrix must match the reference again,
+//    the returned count must be the number of nodes in the union of the
+//    edited subtrees, and every dirty flag must be cleared.
+// 3. Times the update with nothing dirty, with 100 random nodes dirty
+//    and with every node dirty, in ms.
+//
+// The SIMD level is whatever SimdMaths.h picks from the compiler flags.
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh for the scalar/SSE2/AVX2 variants):
+//   c++ -O2 TransformHierarchyCheck.cpp ../TransformHierarchy.cpp ../TransformBatch.cpp ../Timing.cpp -o TransformHierarchyCheck
+// Usage: TransformHierarchyCheck [count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../3DMaths.h"
+#include "../SimdMaths.h"
+#include "../TransformHierarchy.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* simdLevelName()
+{
+#if defined(MATHS_SIMD_AVX) && defined(MATHS_SIMD_FMA)
+    return "avx+fma";
+#elif defined(MATHS_SIMD_AVX)
+    return "avx";
+#elif defined(MATHS_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static const int MAX_DEPTH = 16;
+static const float MAX_RELATIVE_ERROR = 1e-5f;
+
+static float3 randomTranslation()
+{
+    return {randomFloat(-5, 5), randomFloat(-5, 5), randomFloat(-5, 5)};
+}
+
+static quat randomRotation()
+{
+    float3 axis = normalise(float3{randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1) + 2.f});
+    return quatFromAxisAngle(axis, randomFloat(-3.f, 3.f));
+}
+
+// Close to 1 so that 16 levels neither blow up nor vanish
+static float3 randomScale()
+{
+    return {randomFloat(0.8f, 1.25f), randomFloat(0.8f, 1.25f), randomFloat(0.8f, 1.25f)};
+}
+
+// Each node's parent is picked among the last node and its ancestors,
+// as addTransformNode() requires. About 1 in 100 nodes starts a new tree.
+static void buildRandomForest(TransformHierarchy* hierarchy, uint32_t count)
+{
+    uint32_t path[MAX_DEPTH]; // The last node added and its ancestors, root first
+    int pathLength = 0;
+    for(uint32_t i=0; i<count; ++i){
+        int depth = (pathLength == 0 || rand() % 100 == 0) ? 0 : 1 + rand() % pathLength;
+        if(depth >= MAX_DEPTH)
+            depth = MAX_DEPTH - 1;
+        uint32_t parent = (depth == 0) ? TRANSFORM_NO_PARENT : path[depth - 1];
+        path[depth] = addTransformNode(hierarchy, parent, randomTranslation(), randomRotation(), randomScale());
+        pathLength = depth + 1;
+    }
+}
+
+static affine3x4 localMat(const TransformHierarchy* hierarchy, uint32_t node)
+{
+    const TransformSoA* local = &hierarchy->local;
+    return trsAffine3x4({local->posX[node], local->posY[node], local->posZ[node]},
+                        {local->rotX[node], local->rotY[node], local->rotZ[node], local->rotW[node]},
+                        {local->scaleX[node], local->scaleY[node], local->scaleZ[node]});
+}
+
+// World matrix of 'node' from its parent's, then each child subtree in
+// turn. Children are found by skipping over the previous child's
+// descendants.
+static void referenceSubtree(const TransformHierarchy* hierarchy, uint32_t node, const affine3x4* parentWorld, affine3x4* outWorld)
+{
+    outWorld[node] = parentWorld ? scalarMul(localMat(hierarchy, node), *parentWorld) : localMat(hierarchy, node);
+    uint32_t end = node + 1 + hierarchy->numDescendants[node];
+    for(uint32_t child = node + 1; child < end; child += 1 + hierarchy->numDescendants[child])
+        referenceSubtree(hierarchy, child, &outWorld[node], outWorld);
+}
+
+static void referenceWorldTransforms(const TransformHierarchy* hierarchy, affine3x4* outWorld)
+{
+    for(uint32_t root = 0; root < hierarchy->count; root += 1 + hierarchy->numDescendants[root])
+        referenceSubtree(hierarchy, root, 0, outWorld);
+}
+
+// Largest difference of any element relative to the largest element of
+// the reference matrix (at least 1), NaN-safe
+static float maxRelativeError(const affine3x4* worldMats, const affine3x4* expected, uint32_t count)
+{
+    float maxError = 0.f;
+    for(uint32_t i=0; i<count; ++i){
+        float largest = 1.f;
+        for(int r=0; r<3; ++r)
+            for(int c=0; c<4; ++c)
+                largest = fmaxf(largest, fabsf(expected[i].m[r][c]));
+        for(int r=0; r<3; ++r){
+            for(int c=0; c<4; ++c){
+                float error = fabsf(worldMats[i].m[r][c] - expected[i].m[r][c]) / largest;
+                if(!(error <= maxError))
+                    maxError = error;
+            }
+        }
+    }
+    return maxError;
+}
+
+// Edits 'numEdits' random nodes and returns how many nodes their
+// subtrees cover together, i.e. what the next update has to recompute
+static uint32_t editRandomNodes(TransformHierarchy* hierarchy, uint32_t numEdits, uint8_t* covered)
+{
+    memset(covered, 0, hierarchy->count);
+    for(uint32_t e=0; e<numEdits; ++e){
+        uint32_t node = (uint32_t)(((uint64_t)rand() * RAND_MAX + rand()) % hierarchy->count);
+        switch(rand() % 3){
+            case 0:  setLocalTranslation(hierarchy, node, randomTranslation()); break;
+            case 1:  setLocalRotation(hierarchy, node, randomRotation()); break;
+            default: setLocalScale(hierarchy, node, randomScale()); break;
+        }
+        memset(covered + node, 1, 1 + hierarchy->numDescendants[node]);
+    }
+    uint32_t numCovered = 0;
+    for(uint32_t i=0; i<hierarchy->count; ++i)
+        numCovered += covered[i];
+    return numCovered;
+}
+
+static bool allClean(const TransformHierarchy* hierarchy)
+{
+    for(uint32_t i=0; i<hierarchy->count; ++i)
+        if(hierarchy->dirty[i])
+            return false;
+    return true;
+}
+
+// Marks 'numNodes' nodes dirty without changing them, so every timed
+// update has the same work to do
+static void touchNodes(TransformHierarchy* hierarchy, const uint32_t* nodes, uint32_t numNodes)
+{
+    for(uint32_t i=0; i<numNodes; ++i){
+        uint32_t node = nodes[i];
+        setLocalScale(hierarchy, node, {hierarchy->local.scaleX[node], hierarchy->local.scaleY[node], hierarchy->local.scaleZ[node]});
+    }
+}
+
+// Best of a few runs of touching 'nodes' and updating, in ms
+static double timeUpdate(TransformHierarchy* hierarchy, const uint32_t* nodes, uint32_t numNodes, Clock* clock, uint32_t* outNumUpdated)
+{
+    double best = 1e30;
+    for(int run=0; run<10; ++run){
+        touchNodes(hierarchy, nodes, numNodes);
+        double start = getClockSeconds(clock);
+        *outNumUpdated = updateWorldTransforms(hierarchy);
+        double elapsed = getClockSeconds(clock) - start;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return 1e3 * best;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t count = 100000;
+    if(argc > 1)
+        count = (uint32_t)strtoul(argv[1], 0, 10);
+    if(count == 0){
+        fprintf(stderr, "Usage: %s [count >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    TransformHierarchy hierarchy = allocTransformHierarchy(count);
+    buildRandomForest(&hierarchy, count);
+    affine3x4* expected = (affine3x4*)malloc(count * sizeof(affine3x4));
+    uint8_t* covered = (uint8_t*)malloc(count);
+
+    uint32_t numRoots = 0, maxDescendants = 0, maxDepth = 0;
+    for(uint32_t i=0; i<count; ++i){
+        numRoots += (hierarchy.parents[i] == TRANSFORM_NO_PARENT);
+        if(hierarchy.numDescendants[i] > maxDescendants)
+            maxDescendants = hierarchy.numDescendants[i];
+        uint32_t depth = 0;
+        for(uint32_t ancestor = hierarchy.parents[i]; ancestor != TRANSFORM_NO_PARENT; ancestor = hierarchy.parents[ancestor])
+            ++depth;
+        if(depth > maxDepth)
+            maxDepth = depth;
+    }
+
+    // Everything is dirty after building
+    CHECK(updateWorldTransforms(&hierarchy) == count);
+    CHECK(allClean(&hierarchy));
+    referenceWorldTransforms(&hierarchy, expected);
+    float maxError = maxRelativeError(hierarchy.worldMats, expected, count);
+
+    // Random edits, from none to many
+    const uint32_t EDIT_COUNTS[] = {0, 1, 2, 10, 100, 1000};
+    int numCountMismatches = 0;
+    for(int round=0; round<24; ++round){
+        uint32_t numEdits = EDIT_COUNTS[round % (sizeof(EDIT_COUNTS) / sizeof(EDIT_COUNTS[0]))];
+        uint32_t expectedUpdated = editRandomNodes(&hierarchy, numEdits, covered);
+        uint32_t numUpdated = updateWorldTransforms(&hierarchy);
+        if(numUpdated != expectedUpdated){
+            fprintf(stderr, "round %d: %u edits updated %u nodes, expected %u\n", round, numEdits, numUpdated, expectedUpdated);
+            ++numCountMismatches;
+        }
+        CHECK(allClean(&hierarchy));
+        referenceWorldTransforms(&hierarchy, expected);
+        maxError = fmaxf(maxError, maxRelativeError(hierarchy.worldMats, expected, count));
+    }
+    CHECK(numCountMismatches == 0);
+    CHECK(maxError <= MAX_RELATIVE_ERROR);
+
+    // Timings: nothing dirty, 100 random nodes, every root (so every node)
+    const uint32_t NUM_DIRTY = 100;
+    uint32_t* dirtyNodes = (uint32_t*)malloc((count > NUM_DIRTY ? count : NUM_DIRTY) * sizeof(uint32_t));
+    uint32_t numDirty = 0;
+    for(; numDirty < NUM_DIRTY && numDirty < count; ++numDirty)
+        dirtyNodes[numDirty] = (uint32_t)(((uint64_t)rand() * RAND_MAX + rand()) % count);
+    uint32_t* roots = (uint32_t*)malloc(numRoots * sizeof(uint32_t));
+    for(uint32_t root=0, n=0; root < count; root += 1 + hierarchy.numDescendants[root])
+        roots[n++] = root;
+
+    Clock clock = createClock(ClockSourceOS);
+    uint32_t cleanUpdated, dirtyUpdated, fullUpdated;
+    double cleanMs = timeUpdate(&hierarchy, 0, 0, &clock, &cleanUpdated);
+    double dirtyMs = timeUpdate(&hierarchy, dirtyNodes, numDirty, &clock, &dirtyUpdated);
+    double fullMs = timeUpdate(&hierarchy, roots, numRoots, &clock, &fullUpdated);
+    CHECK(cleanUpdated == 0);
+    CHECK(fullUpdated == count);
+
+    // Every node is recomputed per update above, in the same order, so
+    // the result must still match
+    referenceWorldTransforms(&hierarchy, expected);
+    maxError = fmaxf(maxError, maxRelativeError(hierarchy.worldMats, expected, count));
+    CHECK(maxError <= MAX_RELATIVE_ERROR);
+
+    printf("{\n  \"simd\": \"%s\",\n  \"nodes\": %u,\n  \"roots\": %u,\n  \"largest_subtree\": %u,\n  \"max_depth\": %u,\n",
+           simdLevelName(), count, numRoots, maxDescendants + 1, maxDepth + 1);
+    printf("  \"max_relative_error\": {\"value\": %.3g, \"limit\": %.3g},\n", (double)maxError, (double)MAX_RELATIVE_ERROR);
+    printf("  \"update_ms\": {\"clean\": %.4f, \"dirty_100\": %.4f, \"full\": %.4f},\n", cleanMs, dirtyMs, fullMs);
+    printf("  \"nodes_updated\": {\"clean\": %u, \"dirty_100\": %u, \"full\": %u},\n", cleanUpdated, dirtyUpdated, fullUpdated);
+    printf("  \"failures\": %d\n}\n", numFailures);
+
+    free(dirtyNodes);
+    free(roots);
+    free(covered);
+    free(expected);
+    freeTransformHierarchy(hierarchy);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+// Checks the .obj loader's two weld modes and weldVertices() (ObjLoading.h).
+//
+// 1. Writes a heightfield .obj twice over, once in a smoothing group
+//    with a normal per face and once unsmoothed with a normal per
+//    vertex, plus a degenerate triangle, then loads it with
+//    ObjWeldModeEpsilon and ObjWeldModeQuantized. Both must give the
+//    same triangles with the same corner attributes; the quantized weld
+//    must find exactly one vertex per grid point and drop the degenerate
+//    triangle. A mesh with more than OBJ_MAX_VERTICES vertices must fail
+//    to load instead of wrapping its 16-bit indices.
+// 2. Welds a 401x401 grid (160801 vertices, 960000 corners) whose
+//    corners are nudged by less than the position and UV tolerances, on
+//    one thread and on a job system with 4 threads. Both must give one
+//    vertex per grid point and byte-identical buffers. Nudging the UVs
+//    by more than the UV tolerance (but not the positions) must split
+//    exactly the vertices whose corners got different UVs.
+// Reports the time each load and weld takes.
+//
+// Exits with a non-zero code if any check fails. Results are printed as JSON.
+//
+// Build (see build_benchmarks.sh):
+//   c++ -O2 -pthread WeldCheck.cpp ../ObjLoading.cpp ../JobSystem.cpp ../Threading.cpp ../Timing.cpp -o WeldCheck
+// Usage: WeldCheck (writes and deletes WeldCheck.obj in the working directory)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "../ObjLoading.h"
+#include "../JobSystem.h"
+#include "../Timing.h"
+#include "Check.h"
+
+static const char* OBJ_PATH = "WeldCheck.obj";
+
+static float heightAt(float x, float y)
+{
+    return 0.2f * sinf(1.3f * x) * cosf(0.7f * y);
+}
+
+static void normalAt(float x, float y, float n[3])
+{
+    float dx = 0.2f * 1.3f * cosf(1.3f * x) * cosf(0.7f * y);
+    float dy = -0.2f * 0.7f * sinf(1.3f * x) * sinf(0.7f * y);
+    float invLength = 1.f / sqrtf(dx*dx + dy*dy + 1.f);
+    n[0] = -dx * invLength;
+    n[1] = -dy * invLength;
+    n[2] = invLength;
+}
+
+// Two g x g quad grids of (g+1)^2 positions each: the first smoothed with
+// a normal per quad, the second 100 units along x, unsmoothed with a
+// normal per grid point and followed by one degenerate triangle
+static bool writeGridObj(const char* path, uint32_t g)
+{
+    FILE* file = fopen(path, "w");
+    if(!file)
+        return false;
+    uint32_t n = g + 1;
+    for(uint32_t grid=0; grid<2; ++grid)
+        for(uint32_t j=0; j<n; ++j)
+            for(uint32_t i=0; i<n; ++i){
+                float x = 0.1f * (float)i, y = 0.1f * (float)j;
+                fprintf(file, "v %.6f %.6f %.6f\n", x + 100.f * (float)grid, y, heightAt(x, y));
+            }
+    for(uint32_t j=0; j<n; ++j)
+        for(uint32_t i=0; i<n; ++i)
+            fprintf(file, "vt %.6f %.6f\n", (float)i / (float)g, (float)j / (float)g);
+    // Per quad of the first grid, then per point of the second
+    for(uint32_t j=0; j<g; ++j)
+        for(uint32_t i=0; i<g; ++i){
+            float normal[3];
+            normalAt(0.1f * ((float)i + 0.5f), 0.1f * ((float)j + 0.5f), normal);
+            fprintf(file, "vn %.6f %.6f %.6f\n", normal[0], normal[1], normal[2]);
+        }
+    for(uint32_t j=0; j<n; ++j)
+        for(uint32_t i=0; i<n; ++i){
+            float normal[3];
+            normalAt(0.1f * (float)i, 0.1f * (float)j, normal);
+            fprintf(file, "vn %.6f %.6f %.6f\n", normal[0], normal[1], normal[2]);
+        }
+    // .obj indices start at 1
+    for(uint32_t grid=0; grid<2; ++grid)
+    {
+        fprintf(file, grid == 0 ? "s 1\n" : "s off\n");
+        for(uint32_t j=0; j<g; ++j)
+            for(uint32_t i=0; i<g; ++i){
+                uint32_t t[4] = { j*n + i + 1, j*n + i + 2, (j+1)*n + i + 2, (j+1)*n + i + 1 };
+                uint32_t v[4], vn[4];
+                for(int k=0; k<4; ++k){
+                    v[k] = t[k] + grid * n * n;
+                    vn[k] = (grid == 0) ? j*g + i + 1 : g*g + t[k];
+                }
+                fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", v[0], t[0], vn[0], v[1], t[1], vn[1], v[2], t[2], vn[2]);
+                fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", v[0], t[0], vn[0], v[2], t[2], vn[2], v[3], t[3], vn[3]);
+            }
+    }
+    uint32_t first = n * n + 1;
+    fprintf(file, "f %u/1/%u %u/1/%u %u/2/%u\n", first, g*g + 1, first, g*g + 1, first + 1, g*g + 2);
+    fclose(file);
+    return true;
+}
+
+static bool nearlyEqual(const float* a, const float* b, int count, float tolerance)
+{
+    for(int i=0; i<count; ++i)
+        if(fabsf(a[i] - b[i]) > tolerance)
+            return false;
+    return true;
+}
+
+static bool cornersMatch(const VertexData* a, const VertexData* b)
+{
+    return nearlyEqual(a->pos, b->pos, 3, 1e-5f) && nearlyEqual(a->uv, b->uv, 2, 1e-5f) && nearlyEqual(a->norm, b->norm, 3, 1e-4f);
+}
+
+struct LoadResults
+{
+    double epsilonMs, quantizedMs;
+    uint32_t epsilonVertices, quantizedVertices;
+};
+
+static LoadResults checkLoadObj(JobSystem* jobSystem, const Clock* clock)
+{
+    LoadResults results = {};
+    const uint32_t G = 60;
+    const uint32_t N = G + 1;
+    CHECK(writeGridObj(OBJ_PATH, G));
+
+    double start = getClockSeconds(clock);
+    LoadedObj epsilon = loadObj(OBJ_PATH, ObjWeldModeEpsilon);
+    double mid = getClockSeconds(clock);
+    LoadedObj quantized = loadObj(OBJ_PATH, ObjWeldModeQuantized, jobSystem);
+    double end = getClockSeconds(clock);
+    results.epsilonMs = 1e3 * (mid - start);
+    results.quantizedMs = 1e3 * (end - mid);
+    results.epsilonVertices = epsilon.numVertices;
+    results.quantizedVertices = quantized.numVertices;
+
+    // One vertex per grid point. The epsilon weld compares unsmoothed
+    // normals against the running sum of those merged so far, so it can
+    // keep duplicates of a point, but never fewer vertices.
+    const uint32_t NUM_TRIANGLES = 2 * 2 * G * G;
+    CHECK(quantized.numVertices == 2 * N * N);
+    CHECK(quantized.numIndices == 3 * NUM_TRIANGLES);
+    CHECK(epsilon.numVertices >= quantized.numVertices);
+    CHECK(epsilon.numIndices == 3 * (NUM_TRIANGLES + 1));
+
+    // Same triangles in the same order once the degenerate one is skipped
+    uint32_t numCompared = 0;
+    bool allMatch = true;
+    for(uint32_t e=0, q=0; e + 3 <= epsilon.numIndices && q + 3 <= quantized.numIndices; e += 3)
+    {
+        const uint16_t* et = epsilon.indexBuffer + e;
+        if(et[0] == et[1] || et[1] == et[2] || et[2] == et[0])
+            continue;
+        const uint16_t* qt = quantized.indexBuffer + q;
+        for(int k=0; k<3; ++k)
+            allMatch &= cornersMatch(&epsilon.vertexBuffer[et[k]], &quantized.vertexBuffer[qt[k]]);
+        q += 3;
+        ++numCompared;
+    }
+    CHECK(allMatch);
+    CHECK(numCompared == NUM_TRIANGLES);
+    freeLoadedObj(epsilon);
+    freeLoadedObj(quantized);
+
+    // 2 * 191^2 = 72962 vertices don't fit in 16-bit indices
+    CHECK(writeGridObj(OBJ_PATH, 190));
+    LoadedObj tooBig = loadObj(OBJ_PATH, ObjWeldModeQuantized, jobSystem);
+    CHECK(tooBig.numVertices == 0 && tooBig.numIndices == 0 && !tooBig.vertexBuffer && !tooBig.indexBuffer);
+    freeLoadedObj(tooBig);
+
+    remove(OBJ_PATH);
+    return results;
+}
+
+// Corners of a g x g quad grid, two triangles per quad. Each corner's x,
+// y and UV are nudged by a different multiple of 'positionNudge' and
+// 'uvNudge' depending on its index mod 3; z and normals are exact.
+static VertexData* makeGridCorners(uint32_t g, float positionNudge, float uvNudge, uint32_t* numCorners)
+{
+    *numCorners = 6 * g * g;
+    VertexData* corners = (VertexData*)malloc(*numCorners * sizeof(VertexData));
+    uint32_t c = 0;
+    for(uint32_t j=0; j<g; ++j)
+        for(uint32_t i=0; i<g; ++i)
+        {
+            const uint32_t QUAD_CORNERS[6][2] = { {0,0}, {1,0}, {1,1}, {0,0}, {1,1}, {0,1} };
+            for(int k=0; k<6; ++k, ++c)
+            {
+                uint32_t pi = i + QUAD_CORNERS[k][0], pj = j + QUAD_CORNERS[k][1];
+                float x = 0.01f * (float)pi, y = 0.01f * (float)pj;
+                float nudge = (float)(c % 3);
+                VertexData* v = &corners[c];
+                v->pos[0] = x + nudge * positionNudge;
+                v->pos[1] = y - nudge * positionNudge;
+                v->pos[2] = heightAt(x, y);
+                v->uv[0] = (float)pi / (float)g + nudge * uvNudge;
+                v->uv[1] = (float)pj / (float)g;
+                normalAt(x, y, v->norm);
+            }
+        }
+    return corners;
+}
+
+static bool meshesIdentical(const WeldedMesh* a, const WeldedMesh* b)
+{
+    return a->numVertices == b->numVertices && a->numIndices == b->numIndices &&
+           memcmp(a->vertexBuffer, b->vertexBuffer, a->numVertices * sizeof(VertexData)) == 0 &&
+           memcmp(a->indexBuffer, b->indexBuffer, a->numIndices * sizeof(uint32_t)) == 0;
+}
+
+struct WeldResults
+{
+    uint32_t numCorners, numVertices;
+    double oneThreadMs, jobSystemMs;
+};
+
+static WeldResults checkWeldVertices(JobSystem* jobSystem, const Clock* clock)
+{
+    const uint32_t G = 400;
+    const uint32_t N = G + 1;
+    // Corners of a point are up to 2e-6 apart in position (tolerance 1e-5)
+    // and 2e-4 apart in u (tolerance 5e-4)
+    const WeldTolerances TOLERANCES = { 1e-5f, 5e-4f, 1e-3f };
+    WeldResults results = {};
+    VertexData* corners = makeGridCorners(G, 1e-6f, 1e-4f, &results.numCorners);
+
+    double start = getClockSeconds(clock);
+    WeldedMesh oneThread = weldVertices(corners, 0, results.numCorners, TOLERANCES, 0);
+    double mid = getClockSeconds(clock);
+    WeldedMesh jobs = weldVertices(corners, 0, results.numCorners, TOLERANCES, jobSystem);
+    double end = getClockSeconds(clock);
+    results.oneThreadMs = 1e3 * (mid - start);
+    results.jobSystemMs = 1e3 * (end - mid);
+    results.numVertices = oneThread.numVertices;
+
+    CHECK(oneThread.numVertices == N * N);
+    CHECK(oneThread.numIndices == results.numCorners);
+    CHECK(meshesIdentical(&oneThread, &jobs));
+    // Every corner uses the vertex of its own grid point
+    bool allMatch = true;
+    for(uint32_t c=0; c<oneThread.numIndices && allMatch; ++c){
+        const VertexData* v = &oneThread.vertexBuffer[oneThread.indexBuffer[c]];
+        allMatch &= nearlyEqual(v->pos, corners[c].pos, 2, 1e-5f) && nearlyEqual(v->uv, corners[c].uv, 2, 5e-4f);
+    }
+    CHECK(allMatch);
+    freeWeldedMesh(oneThread);
+    freeWeldedMesh(jobs);
+
+    // With a UV tolerance below the UV nudge, each grid point splits into
+    // one vertex per distinct nudge among its corners. Positions, with
+    // the same tolerance as before, still don't split anything.
+    const WeldTolerances TIGHT_UV = { 1e-5f, 1e-5f, 1e-3f };
+    uint8_t* nudgesUsed = (uint8_t*)calloc(N * N, 1);
+    for(uint32_t c=0; c<results.numCorners; ++c){
+        uint32_t pi = (uint32_t)lroundf(corners[c].pos[0] / 0.01f);
+        uint32_t pj = (uint32_t)lroundf(corners[c].pos[1] / 0.01f);
+        nudgesUsed[pj * N + pi] |= 1 << (c % 3);
+    }
+    uint32_t expectedVertices = 0;
+    for(uint32_t p=0; p<N * N; ++p)
+        expectedVertices += (nudgesUsed[p] & 1) + (nudgesUsed[p] >> 1 & 1) + (nudgesUsed[p] >> 2 & 1);
+    free(nudgesUsed);
+    WeldedMesh tightOneThread = weldVertices(corners, 0, results.numCorners, TIGHT_UV, 0);
+    WeldedMesh tightJobs = weldVertices(corners, 0, results.numCorners, TIGHT_UV, jobSystem);
+    CHECK(tightOneThread.numVertices == expectedVertices);
+    CHECK(meshesIdentical(&tightOneThread, &tightJobs));
+    freeWeldedMesh(tightOneThread);
+    freeWeldedMesh(tightJobs);
+
+    free(corners);
+    return results;
+}
+
+int main()
+{
+    // A fixed thread count, so the weld is split the same way on any machine
+    const uint32_t NUM_JOB_THREADS = 4;
+    JobSystem* jobSystem = createJobSystem(NUM_JOB_THREADS - 1);
+    Clock clock = createClock(ClockSourceOS);
+
+    LoadResults load = checkLoadObj(jobSystem, &clock);
+    WeldResults weld = checkWeldVertices(jobSystem, &clock);
+
+    printf("{\n  \"logical_processors\": %u,\n  \"job_threads\": %u,\n", getNumLogicalProcessors(), getNumJobThreads(jobSystem));
+    printf("  \"load_obj\": {\"epsilon_ms\": %.2f, \"quantized_ms\": %.2f, \"epsilon_vertices\": %u, \"quantized_vertices\": %u},\n",
+           load.epsilonMs, load.quantizedMs, load.epsilonVertices, load.quantizedVertices);
+    printf("  \"weld_vertices\": {\"corners\": %u, \"vertices\": %u, \"one_thread_ms\": %.2f, \"job_system_ms\": %.2f},\n",
+           weld.numCorners, weld.numVertices, weld.oneThreadMs, weld.jobSystemMs);
+    printf("  \"failures\": %d\n}\n", numFailures);
+
+    destroyJobSystem(jobSystem);
+    return numFailures ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+#!/bin/sh
+# Builds tools/MathsBenchmark.cpp for Linux/macOS at each SIMD level:
+#   MathsBenchmark_scalar  (MATHS_NO_SIMD)
+#   MathsBenchmark_sse2    (x86-64 baseline)
+#   MathsBenchmark_avx2    (AVX2 + FMA + F16C)
+# Run each with e.g. ./build/MathsBenchmark_avx2 > avx2.json
+# Also builds JobSystemBenchmark (tests + thread scaling of JobSystem.h)
+# HeadlessSimulation (Scene.h on a fixed timestep, no window) and
+# FramePacingBenchmark (frame limiter accuracy and CPU cost) and
+# InstancingCheck (draw count and instance data of InstancedDrawing.h) and
+# CommandBufferBenchmark (sort-key radix sort and state-change merging) and
+# ConstantRingCheck (ConstantBufferRing.h against a mock device) and
+# HeadlessFrameLoop (the whole frame loop on the recording render device) and
+# SoftwareRender (rasterization checks and 1080p frame times of the software
+# render device, built for AVX2). Run those two from the sample directory so
+# they find cube.obj and test.png.
+# BlinnPhongBenchmark_{scalar,sse2,avx2} check BlinnPhongShading.h
+# against its scalar reference and time it in pixels/s at each SIMD level.
+# TransformBatchCheck_{scalar,sse2,avx2} check TransformBatch.h the
+# same way and time 100K objects against the 2 ms budget.
+# Float4x4Check_{scalar,sse2,avx2} check the SIMD float4x4 operations
+# in 3DMaths.h against their scalar code and time both.
+# SinCosCheck_{scalar,sse2,avx2} check the error of sinCos() and
+# sinCosBatch() against double precision and time them against sinf/cosf.
+# CullingCheck_{scalar,sse2,avx2} check cullSpheres() and cullAabbs()
+# against a scalar plane test for each projection and time both.
+# FormatConversionCheck_{scalar,sse2,avx2} check every half and
+# every float bit pattern against the F16C instructions, round-trip every
+# unorm8/16 and snorm8/16 value and time the bulk converters (about 40 s
+# each; pass a step, e.g. 257, to check every 257th float instead).
+# SkinningCheck_{scalar,sse2,avx2} check skinVertices() on the job
+# system against skinning one vertex at a time and time both in verts/s.
+# TransformHierarchyCheck_{scalar,sse2,avx2} check
+# updateWorldTransforms() against a recursive reference after random edits
+# and time clean, 100-dirty and full updates of 100K nodes.
+# LightClusteringBenchmark checks LightClustering.h never misses a light
+# and times assigning hundreds to thousands of lights, serially and on the
+# job system (AVX2).
+# WeldCheck compares the .obj loader's epsilon and quantized welds and
+# weldVertices() on one thread and on the job system (run from anywhere,
+# it writes and deletes WeldCheck.obj in the working directory).
+# CXX selects the compiler (default c++).
+
+CXX=${CXX:-c++}
+FLAGS="-O2 -std=c++14 -Wall -Wno-unknown-pragmas"
+SOURCES="MathsBenchmark.cpp ../FormatConversion.cpp ../TransformBatch.cpp ../Timing.cpp"
+
+cd "$(dirname "$0")" || exit 1
+mkdir -p build
+
+$CXX $FLAGS -DMATHS_NO_SIMD $SOURCES -o build/MathsBenchmark_scalar || exit 1
+$CXX $FLAGS $SOURCES -o build/MathsBenchmark_sse2 || exit 1
+$CXX $FLAGS -mavx2 -mfma -mf16c $SOURCES -o build/MathsBenchmark_avx2 || exit 1
+$CXX $FLAGS -pthread JobSystemBenchmark.cpp ../JobSystem.cpp ../Threading.cpp ../Skinning.cpp ../Timing.cpp -o build/JobSystemBenchmark || exit 1
+$CXX $FLAGS HeadlessSimulation.cpp ../Scene.cpp ../TransformHierarchy.cpp ../TransformBatch.cpp ../Timing.cpp -o build/HeadlessSimulation || exit 1
+$CXX $FLAGS FramePacingBenchmark.cpp ../FramePacing.cpp ../Timing.cpp -o build/FramePacingBenchmark || exit 1
+$CXX $FLAGS InstancingCheck.cpp ../InstancedDrawing.cpp ../CommandBuffer.cpp ../Timing.cpp -o build/InstancingCheck || exit 1
+$CXX $FLAGS CommandBufferBenchmark.cpp ../CommandBuffer.cpp ../InstancedDrawing.cpp ../Timing.cpp -o build/CommandBufferBenchmark || exit 1
+$CXX $FLAGS -pthread ConstantRingCheck.cpp ../ConstantBufferRing.cpp ../Threading.cpp ../Timing.cpp -o build/ConstantRingCheck || exit 1
+$CXX $FLAGS -pthread HeadlessFrameLoop.cpp ../FrameRenderer.cpp ../RenderDeviceRecording.cpp ../Scene.cpp ../TransformHierarchy.cpp \
+    ../TransformBatch.cpp ../Culling.cpp ../CommandBuffer.cpp ../InstancedDrawing.cpp ../ConstantBufferRing.cpp \
+    ../LightClustering.cpp ../JobSystem.cpp ../ObjLoading.cpp ../Threading.cpp ../Timing.cpp -o build/HeadlessFrameLoop || exit 1
+$CXX $FLAGS -mavx2 -mfma -pthread SoftwareRender.cpp ../RenderDeviceSoftware.cpp ../BlinnPhongShading.cpp ../LightClustering.cpp ../FrameRenderer.cpp \
+    ../JobSystem.cpp ../Scene.cpp ../TransformHierarchy.cpp ../TransformBatch.cpp ../Culling.cpp ../CommandBuffer.cpp ../InstancedDrawing.cpp \
+    ../ConstantBufferRing.cpp ../ObjLoading.cpp ../Threading.cpp ../Timing.cpp -o build/SoftwareRender || exit 1
+$CXX $FLAGS -mavx2 -mfma -pthread LightClusteringBenchmark.cpp ../LightClustering.cpp ../BlinnPhongShading.cpp ../JobSystem.cpp \
+    ../Threading.cpp ../Timing.cpp -o build/LightClusteringBenchmark || exit 1
+$CXX $FLAGS -pthread WeldCheck.cpp ../ObjLoading.cpp ../JobSystem.cpp ../Threading.cpp ../Timing.cpp -o build/WeldCheck || exit 1
+for LEVEL in "scalar -DMATHS_NO_SIMD" "sse2" "avx2 -mavx2 -mfma -mf16c"; do
+    set -- $LEVEL
+    NAME=$1; shift
+    $CXX $FLAGS "$@" BlinnPhongBenchmark.cpp ../BlinnPhongShading.cpp ../Timing.cpp -o build/BlinnPhongBenchmark_$NAME || exit 1
+    $CXX $FLAGS "$@" TransformBatchCheck.cpp ../TransformBatch.cpp ../Timing.cpp -o build/TransformBatchCheck_$NAME || exit 1
+    $CXX $FLAGS "$@" Float4x4Check.cpp ../Timing.cpp -o build/Float4x4Check_$NAME || exit 1
+    $CXX $FLAGS "$@" SinCosCheck.cpp ../Timing.cpp -o build/SinCosCheck_$NAME || exit 1
+    $CXX $FLAGS "$@" CullingCheck.cpp ../Culling.cpp ../Timing.cpp -o build/CullingCheck_$NAME || exit 1
+    $CXX $FLAGS "$@" FormatConversionCheck.cpp ../FormatConversion.cpp ../Timing.cpp -o build/FormatConversionCheck_$NAME || exit 1
+    $CXX $FLAGS "$@" -pthread SkinningCheck.cpp ../Skinning.cpp ../JobSystem.cpp ../Threading.cpp ../Timing.cpp -o build/SkinningCheck_$NAME || exit 1
+    $CXX $FLAGS "$@" TransformHierarchyCheck.cpp ../TransformHierarchy.cpp ../TransformBatch.cpp ../Timing.cpp -o build/TransformHierarchyCheck_$NAME || exit 1
+done
+echo Done